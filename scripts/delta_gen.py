@@ -0,0 +1,278 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Generate and apply patches for the delta FOTA download.
+
+create: builds the patch that turns the image running on the device into a
+        new one, and checks it by applying it again.
+apply:  rebuilds the new image from the running one and a patch, the same
+        way CONFIG_FOTA_DL_DELTA does on the device.
+
+The patch format is described in src/fota_dl/delta.h. Matches between the
+images are found bsdiff style: a match may contain differing bytes, so code
+that only moved keeps matching although the addresses in it changed. The
+differences are coded as zero runs and literals, which is what keeps the
+patch small without a decompressor on the device.
+"""
+
+import argparse
+import collections
+import struct
+import sys
+import zlib
+from pathlib import Path
+
+MAGIC = b"IPD1"
+HEADER = struct.Struct("<4sIII")
+
+# Length of the hashed prefix a match is looked up with.
+SEED_LEN = 8
+# Matches shorter than this are sent as extra bytes.
+MATCH_MIN = 16
+# A match ends when fewer than half of the last WINDOW bytes are equal.
+WINDOW = 16
+# Zero runs shorter than this stay inside a literal, a piece costs two
+# varints.
+ZERO_RUN_MIN = 3
+CANDIDATES_MAX = 8
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7f
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return value << 1 if value >= 0 else ((-value - 1) << 1) | 1
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def index_source(source):
+    index = {}
+    for pos in range(len(source) - SEED_LEN + 1):
+        seeds = index.setdefault(source[pos:pos + SEED_LEN], [])
+        if len(seeds) < CANDIDATES_MAX:
+            seeds.append(pos)
+    return index
+
+
+def extend(source, target, s, t):
+    """Length of the approximate match at s in source and t in target."""
+    length = 0
+    best = 0
+    recent = collections.deque(maxlen=WINDOW)
+    equal = 0
+    while s + length < len(source) and t + length < len(target):
+        same = source[s + length] == target[t + length]
+        if len(recent) == WINDOW:
+            equal -= recent[0]
+        recent.append(same)
+        equal += same
+        length += 1
+        if same:
+            best = length
+        if len(recent) == WINDOW and equal * 2 < WINDOW:
+            break
+    # Trailing differences are cheaper as extra bytes.
+    return best
+
+
+def find_matches(source, target):
+    index = index_source(source)
+    matches = []
+    t = 0
+    predicted = None
+    while t < len(target) - SEED_LEN:
+        candidates = list(index.get(target[t:t + SEED_LEN], ()))
+        # Code following a match usually continues at the same distance.
+        if predicted is not None and predicted < len(source):
+            candidates.append(predicted)
+        best_len, best_s = 0, None
+        for s in candidates:
+            length = extend(source, target, s, t)
+            if length > best_len:
+                best_len, best_s = length, s
+        if best_len >= MATCH_MIN:
+            matches.append((best_s, t, best_len))
+            t += best_len
+            predicted = best_s + best_len
+        else:
+            t += 1
+            predicted = predicted + 1 if predicted is not None else None
+    return matches
+
+
+def encode_diff(diff):
+    out = bytearray()
+    pos = 0
+    while pos < len(diff):
+        zeros = pos
+        while zeros < len(diff) and diff[zeros] == 0:
+            zeros += 1
+        # The literal ends where a zero run worth its own piece starts.
+        lit = zeros
+        while lit < len(diff):
+            run = lit
+            while run < len(diff) and diff[run] == 0:
+                run += 1
+            if run == lit:
+                lit += 1
+            elif run - lit >= ZERO_RUN_MIN or run == len(diff):
+                break
+            else:
+                lit = run
+        out += varint(zeros - pos) + varint(lit - zeros) + diff[zeros:lit]
+        pos = lit
+    return bytes(out)
+
+
+def create(source, target):
+    matches = find_matches(source, target)
+    body = bytearray()
+    src_pos = 0
+    t = 0
+
+    # Target bytes ahead of the first match are extra bytes of an empty
+    # diff.
+    if not matches or matches[0][1] > 0:
+        end = matches[0][1] if matches else len(target)
+        seek = matches[0][0] if matches else 0
+        body += varint(0) + varint(end) + varint(zigzag(seek))
+        body += target[:end]
+        src_pos, t = seek, end
+
+    for i, (s, mt, length) in enumerate(matches):
+        assert s == src_pos and mt == t
+        diff = bytes((target[mt + k] - source[s + k]) & 0xff
+                     for k in range(length))
+        extra_end = matches[i + 1][1] if i + 1 < len(matches) \
+            else len(target)
+        next_s = matches[i + 1][0] if i + 1 < len(matches) else s + length
+        seek = next_s - (s + length)
+        body += varint(length) + varint(extra_end - (mt + length))
+        body += varint(zigzag(seek))
+        body += encode_diff(diff)
+        body += target[mt + length:extra_end]
+        src_pos, t = next_s, extra_end
+
+    header = HEADER.pack(MAGIC, len(source), len(target),
+                         zlib.crc32(source) & 0xffffffff)
+    return header + bytes(body), matches
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def varint(self):
+        value, shift = 0, 0
+        while True:
+            byte = self.take(1)[0]
+            value |= (byte & 0x7f) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def take(self, length):
+        if self.pos + length > len(self.data):
+            raise ValueError("patch truncated")
+        out = self.data[self.pos:self.pos + length]
+        self.pos += length
+        return out
+
+
+def apply(source, patch):
+    magic, source_size, target_size, crc = HEADER.unpack_from(patch)
+    if magic != MAGIC:
+        raise ValueError("not a patch")
+    if source_size > len(source) or \
+            zlib.crc32(source[:source_size]) & 0xffffffff != crc:
+        raise ValueError("patch does not apply to this image")
+
+    source = source[:source_size]
+    reader = Reader(patch)
+    reader.pos = HEADER.size
+    target = bytearray()
+    src_pos = 0
+    while len(target) < target_size:
+        diff_len = reader.varint()
+        extra_len = reader.varint()
+        seek = unzigzag(reader.varint())
+        while diff_len:
+            zeros = reader.varint()
+            if src_pos + zeros > source_size:
+                raise ValueError("source overrun")
+            target += source[src_pos:src_pos + zeros]
+            src_pos += zeros
+            lit = reader.varint()
+            for byte in reader.take(lit):
+                target.append((source[src_pos] + byte) & 0xff)
+                src_pos += 1
+            diff_len -= zeros + lit
+            if diff_len < 0:
+                raise ValueError("diff overrun")
+        target += reader.take(extra_len)
+        src_pos += seek
+        if not 0 <= src_pos <= source_size:
+            raise ValueError("seek out of range")
+    if len(target) != target_size or reader.pos != len(patch):
+        raise ValueError("patch length mismatch")
+    return bytes(target)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command")
+    sub.required = True
+
+    p = sub.add_parser("create", help="create a patch")
+    p.add_argument("source", help="image running on the device")
+    p.add_argument("target", help="new image")
+    p.add_argument("patch", help="patch file to write")
+
+    p = sub.add_parser("apply", help="apply a patch")
+    p.add_argument("source", help="image running on the device")
+    p.add_argument("patch", help="patch file")
+    p.add_argument("target", help="image file to write")
+
+    args = parser.parse_args()
+
+    if args.command == "create":
+        source = Path(args.source).read_bytes()
+        target = Path(args.target).read_bytes()
+        patch, matches = create(source, target)
+        if apply(source, patch) != target:
+            sys.exit("error: patch verification failed")
+        Path(args.patch).write_bytes(patch)
+        matched = sum(m[2] for m in matches)
+        print("{} bytes, {:.1f}% of the {} byte image, {} matches "
+              "covering {:.1f}%".format(
+                  len(patch), 100 * len(patch) / len(target), len(target),
+                  len(matches), 100 * matched / max(len(target), 1)))
+    else:
+        source = Path(args.source).read_bytes()
+        patch = Path(args.patch).read_bytes()
+        try:
+            target = apply(source, patch)
+        except (ValueError, struct.error) as e:
+            sys.exit("error: {}".format(e))
+        Path(args.target).write_bytes(target)
+        print("{} bytes written".format(len(target)))
+
+
+if __name__ == "__main__":
+    main()
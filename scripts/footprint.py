@@ -0,0 +1,397 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Report ROM and RAM footprint per module and per symbol.
+
+report:  reads the linker map of every build found under the given
+         directories, typically the twister output of the test_footprint_*
+         variants in sample.yaml, writes footprint.json next to each map
+         and checks the totals and modules against the budgets in
+         scripts/footprint_budgets.json. Exits with status 1 if a budget
+         is exceeded or a build has none. --update writes the measured
+         sizes as new budgets. The build
+         runs the check itself with CONFIG_FOOTPRINT_CHECK, which the
+         variants enable.
+compare: prints what changes between two builds, per module and for the
+         symbols that changed most, for example what DTLS costs.
+
+The application is built with function and data sections, so each input
+section in the map is one symbol. Modules are the directories under src/
+for application code and the libraries for everything else. Initialized
+data counts towards both ROM and RAM.
+
+No budgets are checked in yet, so the variants fail the check until they
+are recorded from the variants built with the release toolchain and the
+file is committed:
+  $ZEPHYR_BASE/scripts/sanitycheck -T . -t footprint -b
+  footprint.py report sanity-out --update
+
+Examples, with twister run as scripts/sanitycheck in this Zephyr version:
+  footprint.py report sanity-out --modules
+  footprint.py compare sanity-out/nrf9160_pca10090ns/*/test_footprint_coap \\
+      sanity-out/nrf9160_pca10090ns/*/test_footprint_coap_dtls
+"""
+
+import argparse
+import collections
+import json
+import math
+import os
+import re
+import sys
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(SCRIPT_DIR, "..", "src")
+BUDGETS = os.path.join(SCRIPT_DIR, "footprint_budgets.json")
+REPORT = "footprint.json"
+
+MEMORY = re.compile(r"^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+OUTPUT_SECTION = re.compile(
+    r"^(\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)"
+    r"(?:\s+load address 0x([0-9a-fA-F]+))?\s*$")
+INPUT_SECTION = re.compile(
+    r"^ (\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+ARCHIVE_MEMBER = re.compile(r"^(.*)\((.*)\)$")
+SECTION_PREFIX = re.compile(
+    r"^\.(?:text|rodata|data|bss|noinit|ramfunc)\.(?:unlikely\.)?")
+
+
+def source_modules():
+    """Maps source file names to the module directory they are in."""
+    modules = {"main.c": "main"}
+    for entry in os.listdir(SRC_DIR):
+        path = os.path.join(SRC_DIR, entry)
+        if os.path.isdir(path):
+            for name in os.listdir(path):
+                modules[name] = entry
+    return modules
+
+
+def object_module(obj, modules):
+    match = ARCHIVE_MEMBER.match(obj)
+    archive, member = match.groups() if match else (None, obj)
+    member = os.path.basename(member)
+    source = re.sub(r"\.(obj|o)$", "", member)
+
+    if archive is None:
+        return "zephyr" if "zephyr" in obj else "other"
+    archive = os.path.basename(archive)
+    if archive == "libapp.a":
+        return modules.get(source, "app")
+    if archive.startswith("libc") or archive.startswith("libgcc") or \
+            archive.startswith("libm"):
+        return "toolchain"
+    name = re.sub(r"^lib|\.a$", "", archive)
+    return name.replace("__", "/").lstrip("./")
+
+
+class Region:
+    def __init__(self, name, origin, length):
+        self.name = name
+        self.origin = origin
+        self.end = origin + length
+        self.kind = "rom" if "FLASH" in name.upper() else \
+            "ram" if "RAM" in name.upper() else None
+
+    def __contains__(self, addr):
+        return self.origin <= addr < self.end
+
+
+def parse_map(path, modules):
+    regions = []
+    symbols = collections.OrderedDict()
+    section = None
+    output = None
+    pending = None
+
+    with open(path) as f:
+        lines = f.read().splitlines()
+
+    i = 0
+    while i < len(lines) and not lines[i].startswith("Memory Configuration"):
+        i += 1
+    while i < len(lines) and \
+            not lines[i].startswith("Linker script and memory map"):
+        match = MEMORY.match(lines[i])
+        if match and match.group(1) != "*default*":
+            regions.append(Region(match.group(1), int(match.group(2), 16),
+                                  int(match.group(3), 16)))
+        i += 1
+
+    def kind(addr):
+        for region in regions:
+            if addr in region:
+                return region.kind
+        return None
+
+    for line in lines[i:]:
+        if not line.strip():
+            continue
+
+        # Output sections start in the first column, long names are
+        # followed by their address on the next line.
+        if not line[0].isspace():
+            match = OUTPUT_SECTION.match(line)
+            if match is None:
+                section = line.split()[0] if len(line.split()) == 1 \
+                    else None
+                output = None
+                continue
+            section = match.group(1) or section
+            vma = int(match.group(2), 16)
+            lma = int(match.group(4), 16) if match.group(4) else vma
+            output = None if section == "/DISCARD/" else \
+                (kind(vma), kind(lma))
+            continue
+        if section is not None and output is None:
+            match = OUTPUT_SECTION.match(line)
+            if match and line.startswith("  "):
+                vma = int(match.group(2), 16)
+                lma = int(match.group(4), 16) if match.group(4) else vma
+                output = None if section == "/DISCARD/" else \
+                    (kind(vma), kind(lma))
+                continue
+
+        if output is None:
+            continue
+
+        match = INPUT_SECTION.match(line)
+        if match is None:
+            # Long input section names are followed by their address on
+            # the next line.
+            stripped = line.strip()
+            pending = stripped if line.startswith(" .") and \
+                len(stripped.split()) == 1 else None
+            continue
+
+        name = match.group(1) or pending
+        pending = None
+        size = int(match.group(3), 16)
+        obj = match.group(4).strip()
+        if name is None or name == "*fill*" or size == 0 or \
+                obj.startswith("0x"):
+            continue
+
+        vma_kind, lma_kind = output
+        rom = size if "rom" in (vma_kind, lma_kind) else 0
+        ram = size if vma_kind == "ram" else 0
+        if not rom and not ram:
+            continue
+
+        module = object_module(obj, modules)
+        symbol = SECTION_PREFIX.sub("", name)
+        if symbol == name:
+            symbol = "{}:{}".format(
+                os.path.basename(ARCHIVE_MEMBER.sub(r"\2", obj)), name)
+
+        entry = symbols.setdefault((module, symbol), [0, 0])
+        entry[0] += rom
+        entry[1] += ram
+
+    return symbols
+
+
+def build_report(build_dir, modules):
+    map_path = os.path.join(build_dir, "zephyr", "zephyr.map")
+    symbols = parse_map(map_path, modules)
+
+    board = None
+    config = os.path.join(build_dir, "zephyr", ".config")
+    if os.path.exists(config):
+        with open(config) as f:
+            match = re.search(r'^CONFIG_BOARD="(.*)"$', f.read(), re.M)
+            board = match.group(1) if match else None
+
+    module_sizes = collections.defaultdict(lambda: {"rom": 0, "ram": 0})
+    for (module, _), (rom, ram) in symbols.items():
+        module_sizes[module]["rom"] += rom
+        module_sizes[module]["ram"] += ram
+
+    return {
+        "variant": os.path.basename(os.path.normpath(build_dir)),
+        "board": board,
+        "rom": sum(s[0] for s in symbols.values()),
+        "ram": sum(s[1] for s in symbols.values()),
+        "modules": dict(sorted(module_sizes.items())),
+        "symbols": [{"module": m, "name": n, "rom": rom, "ram": ram}
+                    for (m, n), (rom, ram) in
+                    sorted(symbols.items(),
+                           key=lambda s: -(s[1][0] + s[1][1]))],
+    }
+
+
+def find_builds(paths):
+    builds = []
+    for path in paths:
+        for root, dirs, files in os.walk(path):
+            if os.path.basename(root) == "zephyr" and "zephyr.map" in files:
+                builds.append(os.path.dirname(root))
+                dirs[:] = []
+    return sorted(builds)
+
+
+def load_report(path):
+    if os.path.isdir(path):
+        path = os.path.join(path, REPORT)
+    with open(path) as f:
+        return json.load(f)
+
+
+def budget_check(report, budget):
+    """Returns a list of (what, size, budget) that are over budget."""
+    over = []
+    for kind in ("rom", "ram"):
+        if kind in budget and report[kind] > budget[kind]:
+            over.append(("total " + kind, report[kind], budget[kind]))
+    for module, limits in budget.get("modules", {}).items():
+        sizes = report["modules"].get(module, {"rom": 0, "ram": 0})
+        for kind in ("rom", "ram"):
+            if kind in limits and sizes[kind] > limits[kind]:
+                over.append(("{} {}".format(module, kind), sizes[kind],
+                             limits[kind]))
+    return over
+
+
+def budget_from(report, headroom, app_modules):
+    def ceil(size):
+        return int(math.ceil(size * (1 + headroom / 100) / 256) * 256)
+
+    return {
+        "rom": ceil(report["rom"]),
+        "ram": ceil(report["ram"]),
+        "modules": {m: {"rom": ceil(s["rom"]), "ram": ceil(s["ram"])}
+                    for m, s in report["modules"].items()
+                    if m in app_modules},
+    }
+
+
+def report_cmd(args):
+    modules = source_modules()
+    app_modules = set(modules.values())
+    with open(args.budgets) as f:
+        budgets = json.load(f)
+
+    builds = find_builds(args.paths)
+    if not builds:
+        sys.exit("error: no zephyr/zephyr.map found under {}".format(
+            ", ".join(args.paths)))
+
+    failed = False
+    reports = []
+    print("{:<34} {:>9} {:>9}  {}".format("Variant", "ROM", "RAM",
+                                          "Budget"))
+    for build in builds:
+        report = build_report(build, modules)
+        reports.append(report)
+        with open(os.path.join(build, REPORT), "w") as f:
+            json.dump(report, f, indent=1)
+
+        budget = budgets["variants"].get(report["variant"])
+
+        if budgets.get("board") not in (None, report["board"]):
+            status = "not budgeted on {}".format(report["board"])
+        elif args.update:
+            budgets["variants"][report["variant"]] = budget_from(
+                report, args.headroom, app_modules)
+            status = "updated"
+        elif budget is None:
+            status = "NO BUDGET: record one with --update"
+            failed = True
+        else:
+            over = budget_check(report, budget)
+            status = "ok" if not over else "EXCEEDED: " + ", ".join(
+                "{} {} > {}".format(*o) for o in over)
+            failed |= bool(over)
+
+        print("{:<34} {:>9} {:>9}  {}".format(
+            report["variant"], report["rom"], report["ram"], status))
+
+        if args.modules:
+            for module, sizes in sorted(report["modules"].items(),
+                                        key=lambda m: -m[1]["rom"]):
+                print("  {:<32} {:>9} {:>9}".format(module, sizes["rom"],
+                                                    sizes["ram"]))
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(reports, f, indent=1)
+
+    if args.update:
+        with open(args.budgets, "w") as f:
+            json.dump(budgets, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("Budgets written to {}".format(args.budgets))
+
+    sys.exit(1 if failed else 0)
+
+
+def compare_cmd(args):
+    base = load_report(args.base)
+    new = load_report(args.new)
+
+    print("{} -> {}".format(base["variant"], new["variant"]))
+    print("{:<34} {:>9} {:>9}".format("", "ROM", "RAM"))
+    print("{:<34} {:>+9} {:>+9}".format("Total", new["rom"] - base["rom"],
+                                        new["ram"] - base["ram"]))
+
+    zero = {"rom": 0, "ram": 0}
+    for module in sorted(set(base["modules"]) | set(new["modules"])):
+        a = base["modules"].get(module, zero)
+        b = new["modules"].get(module, zero)
+        if a != b:
+            print("  {:<32} {:>+9} {:>+9}".format(
+                module, b["rom"] - a["rom"], b["ram"] - a["ram"]))
+
+    def by_symbol(report):
+        return {(s["module"], s["name"]): s for s in report["symbols"]}
+
+    a, b = by_symbol(base), by_symbol(new)
+    deltas = []
+    for key in set(a) | set(b):
+        sa, sb = a.get(key, zero), b.get(key, zero)
+        delta = (sb["rom"] - sa["rom"], sb["ram"] - sa["ram"])
+        if delta != (0, 0):
+            deltas.append((key, delta))
+    deltas.sort(key=lambda d: -(abs(d[1][0]) + abs(d[1][1])))
+
+    if deltas:
+        print("\nLargest symbol changes:")
+    for (module, name), (rom, ram) in deltas[:args.top]:
+        print("  {:<48} {:>+9} {:>+9}".format(
+            "{}: {}".format(module, name)[:48], rom, ram))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command")
+    sub.required = True
+
+    p = sub.add_parser("report", help="report builds and check budgets")
+    p.add_argument("paths", nargs="+",
+                   help="build directories or directories containing them")
+    p.add_argument("--budgets", default=BUDGETS)
+    p.add_argument("--output", help="write all reports to this JSON file")
+    p.add_argument("--modules", action="store_true",
+                   help="print the size of every module")
+    p.add_argument("--update", action="store_true",
+                   help="write the measured sizes as budgets")
+    p.add_argument("--headroom", type=float, default=5,
+                   help="percent added to measured sizes with --update")
+    p.set_defaults(func=report_cmd)
+
+    p = sub.add_parser("compare", help="compare two builds")
+    p.add_argument("base", help="build directory or footprint.json")
+    p.add_argument("new", help="build directory or footprint.json")
+    p.add_argument("--top", type=int, default=20,
+                   help="number of symbols listed")
+    p.set_defaults(func=compare_cmd)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
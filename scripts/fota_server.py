@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Serve a firmware image to the FOTA download of either backend.
+
+coap: serves the image on the CONFIG_COAP_BACKEND_FOTA_RESOURCE resource
+      with Block2 transfers. The block size requested by the device is
+      used, or a smaller one given with --max-szx.
+mqtt: answers chunk requests on <client ID>/fota/req with chunks on
+      <client ID>/fota/chunk, in the format described for
+      CONFIG_MQTT_BACKEND_FOTA.
+
+The download is started on the device by sending it the downlink command
+{"cmd":"fota","val":<image ID>}. --drop fails a share of the requests to
+exercise the retries and the resumption after an interrupted download.
+
+Requires aiocoap for coap (pip3 install aiocoap) and paho-mqtt for mqtt
+(pip3 install paho-mqtt).
+"""
+
+import argparse
+import asyncio
+import json
+import random
+import struct
+from pathlib import Path
+
+MCUBOOT_IMAGE_MAGIC = 0x96f3b83d
+DELTA_MAGIC = b"IPD1"
+
+
+class Image:
+    def __init__(self, args):
+        self.data = Path(args.image).read_bytes()
+        self.image_id = args.image_id
+        self.drop = args.drop
+        self.served = 0
+        self.requests = 0
+
+        magic, = struct.unpack_from("<I", self.data)
+        if magic != MCUBOOT_IMAGE_MAGIC and \
+                not self.data.startswith(DELTA_MAGIC):
+            print("warning: {} is neither a signed MCUboot image nor a "
+                  "patch, the device will reject it".format(args.image))
+
+    def dropped(self):
+        self.requests += 1
+        return random.random() < self.drop
+
+    def log(self, offset, length):
+        self.served += length
+        print("{:>8}/{} bytes at {:>8}, {} bytes served in {} requests"
+              .format(offset + length, len(self.data), offset,
+                      self.served, self.requests))
+
+
+def serve_coap(args, image):
+    import aiocoap
+    import aiocoap.resource as resource
+    from aiocoap.optiontypes import BlockOption
+
+    class Firmware(resource.Resource):
+        def needs_blockwise_assembly(self, request):
+            # Blocks are cut here, so that the device's block size and
+            # the Size2 option are honoured exactly.
+            return False
+
+        async def render_get(self, request):
+            query = dict(q.split("=", 1) for q in request.opt.uri_query
+                         if "=" in q)
+            if query.get("id") != str(image.image_id):
+                return aiocoap.Message(code=aiocoap.NOT_FOUND)
+
+            if image.dropped():
+                # The device ignores error responses and retries after
+                # its block timeout, as for a lost response.
+                return aiocoap.Message(code=aiocoap.SERVICE_UNAVAILABLE)
+
+            num, szx = 0, args.max_szx
+            if request.opt.block2 is not None:
+                num = request.opt.block2.block_number
+                szx = min(request.opt.block2.size_exponent, args.max_szx)
+                # A smaller block size renumbers the blocks.
+                num = (num << request.opt.block2.size_exponent) >> szx
+
+            size = 16 << szx
+            offset = num * size
+            chunk = image.data[offset:offset + size]
+            more = offset + size < len(image.data)
+
+            response = aiocoap.Message(code=aiocoap.CONTENT, payload=chunk)
+            response.opt.block2 = BlockOption.BlockwiseTuple(num, more, szx)
+            response.opt.size2 = len(image.data)
+
+            image.log(offset, len(chunk))
+            return response
+
+    async def run():
+        site = resource.Site()
+        site.add_resource([args.resource], Firmware())
+        await aiocoap.Context.create_server_context(
+            site, bind=("::", args.port))
+        print("Serving {} bytes as image {} on coap://[::]:{}/{}".format(
+            len(image.data), image.image_id, args.port, args.resource))
+        await asyncio.get_event_loop().create_future()
+
+    asyncio.get_event_loop().run_until_complete(run())
+
+
+def serve_mqtt(args, image):
+    import paho.mqtt.client as mqtt
+
+    def on_connect(client, userdata, flags, rc):
+        client.subscribe("+/fota/req")
+        print("Serving {} bytes as image {} on {}:{}".format(
+            len(image.data), image.image_id, args.broker, args.port))
+
+    def on_message(client, userdata, msg):
+        try:
+            req = json.loads(msg.payload)
+            image_id, offset, length = req["id"], req["off"], req["len"]
+        except (ValueError, KeyError):
+            print("Malformed request on {}".format(msg.topic))
+            return
+
+        if image_id != image.image_id or image.dropped():
+            return
+
+        client_id = msg.topic.split("/")[0]
+        chunk = image.data[offset:offset + length]
+        header = struct.pack(">III", image_id, offset, len(image.data))
+        client.publish("{}/fota/chunk".format(client_id), header + chunk)
+
+        image.log(offset, len(chunk))
+
+    client = mqtt.Client()
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.loop_forever()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--image", required=True,
+                        help="signed image, for example app_update.bin, "
+                        "or a patch made with delta_gen.py")
+    parser.add_argument("--image-id", type=int, required=True,
+                        help="ID sent to the device in the fota command")
+    parser.add_argument("--drop", type=float, default=0.0,
+                        help="share of requests failed, 0 to 1")
+    sub = parser.add_subparsers(dest="transport")
+    sub.required = True
+
+    coap = sub.add_parser("coap", help="serve over CoAP Block2")
+    coap.add_argument("--port", type=int, default=5683)
+    coap.add_argument("--resource", default="fw")
+    coap.add_argument("--max-szx", type=int, default=6, choices=range(7),
+                      help="largest block size exponent served")
+
+    mqtt = sub.add_parser("mqtt", help="serve MQTT chunk requests")
+    mqtt.add_argument("--broker", default="localhost")
+    mqtt.add_argument("--port", type=int, default=1883)
+
+    args = parser.parse_args()
+    image = Image(args)
+
+    if args.transport == "coap":
+        serve_coap(args, image)
+    else:
+        serve_mqtt(args, image)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Measure TLS and DTLS handshake cost between the device and a local server.
+
+Runs as a relay in front of a local broker or CoAP server. The device is
+configured to connect to the relay, which forwards traffic unmodified while
+parsing the (D)TLS record layer. For every connection it reports the
+handshake bytes in each direction, the number of flights and round trips,
+and the time from ClientHello until the first application data record.
+
+Examples:
+  # MQTT over TLS, mosquitto listening on 8884
+  handshake_bench.py --mode tls --listen 8883 --upstream 127.0.0.1:8884 \\
+      --label psk-ccm8 --csv results.csv
+  # CoAP over DTLS
+  handshake_bench.py --mode dtls --listen 5684 --upstream 127.0.0.1:5784
+"""
+
+import argparse
+import csv
+import os
+import selectors
+import socket
+import time
+
+CONTENT_CHANGE_CIPHER_SPEC = 20
+CONTENT_ALERT = 21
+CONTENT_HANDSHAKE = 22
+CONTENT_APPLICATION_DATA = 23
+
+TLS_RECORD_HEADER_LEN = 5
+DTLS_RECORD_HEADER_LEN = 13
+
+UPLINK = "client"
+DOWNLINK = "server"
+
+
+class Handshake:
+    """Tracks a single handshake from the first record to application data."""
+
+    def __init__(self, label):
+        self.label = label
+        self.start = None
+        self.end = None
+        self.bytes = {UPLINK: 0, DOWNLINK: 0}
+        self.records = 0
+        self.flights = []
+
+    @property
+    def done(self):
+        return self.end is not None
+
+    def record(self, direction, content_type, length):
+        if self.done:
+            return
+        if content_type == CONTENT_APPLICATION_DATA:
+            self.end = time.monotonic()
+            return
+        if content_type not in (CONTENT_HANDSHAKE, CONTENT_CHANGE_CIPHER_SPEC,
+                                CONTENT_ALERT):
+            return
+        if self.start is None:
+            self.start = time.monotonic()
+        self.bytes[direction] += length
+        self.records += 1
+        if not self.flights or self.flights[-1] != direction:
+            self.flights.append(direction)
+
+    def result(self):
+        elapsed = (self.end or time.monotonic()) - (self.start or 0)
+        return {
+            "label": self.label,
+            "client_bytes": self.bytes[UPLINK],
+            "server_bytes": self.bytes[DOWNLINK],
+            "total_bytes": self.bytes[UPLINK] + self.bytes[DOWNLINK],
+            "records": self.records,
+            "flights": len(self.flights),
+            # Every server flight answers a client flight.
+            "round_trips": self.flights.count(DOWNLINK),
+            "time_ms": round(elapsed * 1000) if self.start else 0,
+            "complete": self.done,
+        }
+
+
+class TlsStream:
+    """Reassembles TLS records from one direction of a TCP stream."""
+
+    def __init__(self, handshake, direction):
+        self.handshake = handshake
+        self.direction = direction
+        self.buf = b""
+
+    def feed(self, data):
+        self.buf += data
+        while len(self.buf) >= TLS_RECORD_HEADER_LEN:
+            length = int.from_bytes(self.buf[3:5], "big")
+            total = TLS_RECORD_HEADER_LEN + length
+            if len(self.buf) < total:
+                break
+            self.handshake.record(self.direction, self.buf[0], total)
+            self.buf = self.buf[total:]
+
+
+def dtls_records(handshake, direction, datagram):
+    offset = 0
+    while offset + DTLS_RECORD_HEADER_LEN <= len(datagram):
+        length = int.from_bytes(datagram[offset + 11:offset + 13], "big")
+        total = DTLS_RECORD_HEADER_LEN + length
+        handshake.record(direction, datagram[offset], total)
+        offset += total
+
+
+def report(result, csv_path):
+    print("{label}: {total_bytes} handshake bytes ({client_bytes} up, "
+          "{server_bytes} down), {records} records, {flights} flights, "
+          "{round_trips} round trips, {time_ms} ms{suffix}".format(
+              suffix="" if result["complete"] else " (incomplete)", **result))
+    if csv_path:
+        new = not os.path.exists(csv_path)
+        with open(csv_path, "a", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=list(result))
+            if new:
+                writer.writeheader()
+            writer.writerow(result)
+
+
+def relay_tls(args, upstream):
+    listener = socket.create_server(("0.0.0.0", args.listen))
+    while True:
+        device, addr = listener.accept()
+        server = socket.create_connection(upstream)
+        print("Connection from {}:{}".format(*addr))
+        handshake = Handshake(args.label)
+        streams = {device: (server, TlsStream(handshake, UPLINK)),
+                   server: (device, TlsStream(handshake, DOWNLINK))}
+        sel = selectors.DefaultSelector()
+        sel.register(device, selectors.EVENT_READ)
+        sel.register(server, selectors.EVENT_READ)
+        open_conn = True
+        while open_conn:
+            for key, _ in sel.select():
+                data = key.fileobj.recv(4096)
+                peer, stream = streams[key.fileobj]
+                if not data:
+                    open_conn = False
+                    break
+                stream.feed(data)
+                peer.sendall(data)
+                if handshake.done and args.once:
+                    open_conn = False
+        report(handshake.result(), args.csv)
+        device.close()
+        server.close()
+        if args.once:
+            return
+
+
+def relay_dtls(args, upstream):
+    listener = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    listener.bind(("0.0.0.0", args.listen))
+    server = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    server.connect(upstream)
+    sel = selectors.DefaultSelector()
+    sel.register(listener, selectors.EVENT_READ)
+    sel.register(server, selectors.EVENT_READ)
+    device_addr = None
+    handshake = None
+    while True:
+        for key, _ in sel.select(timeout=args.idle):
+            if key.fileobj is listener:
+                data, addr = listener.recvfrom(4096)
+                if handshake is None or addr != device_addr:
+                    if handshake is not None:
+                        report(handshake.result(), args.csv)
+                    print("Session from {}:{}".format(*addr))
+                    handshake = Handshake(args.label)
+                    device_addr = addr
+                dtls_records(handshake, UPLINK, data)
+                server.send(data)
+            else:
+                data = server.recv(4096)
+                if device_addr is None:
+                    continue
+                dtls_records(handshake, DOWNLINK, data)
+                listener.sendto(data, device_addr)
+            if handshake is not None and handshake.done and args.once:
+                report(handshake.result(), args.csv)
+                return
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__.splitlines()[0],
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="\n".join(__doc__.splitlines()[1:]))
+    parser.add_argument("--mode", choices=["tls", "dtls"], required=True)
+    parser.add_argument("--listen", type=int, required=True,
+                        help="Port the device connects to")
+    parser.add_argument("--upstream", required=True,
+                        help="host:port of the local server")
+    parser.add_argument("--label", default="default",
+                        help="Configuration name used in the report")
+    parser.add_argument("--csv", help="Append results to this CSV file")
+    parser.add_argument("--once", action="store_true",
+                        help="Exit after the first completed handshake")
+    parser.add_argument("--idle", type=float, default=None,
+                        help="DTLS select timeout in seconds")
+    args = parser.parse_args()
+
+    host, port = args.upstream.rsplit(":", 1)
+    upstream = (host, int(port))
+
+    if args.mode == "tls":
+        relay_tls(args, upstream)
+    else:
+        relay_dtls(args, upstream)
+
+
+if __name__ == "__main__":
+    main()
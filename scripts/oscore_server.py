@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Local OSCORE server for interoperability and overhead measurements.
+
+Serves the CoAP backend resource behind an OSCORE security context that
+mirrors the device's CONFIG_COAP_BACKEND_OSCORE_* options (sender and
+recipient IDs swapped). Every accepted request is verified by aiocoap, and
+the datagram size on the wire is compared with the size the same request
+would have had without OSCORE.
+
+Requires aiocoap with OSCORE support: pip3 install "aiocoap[oscore]"
+"""
+
+import argparse
+import asyncio
+import json
+import socket
+import statistics
+import tempfile
+import time
+from pathlib import Path
+
+import aiocoap
+import aiocoap.resource as resource
+from aiocoap import oscore
+from aiocoap.credentials import CredentialsMap
+from aiocoap.oscore_sitewrapper import OscoreSiteWrapper
+
+# Version/type/TKL, code and message ID.
+COAP_HEADER_LEN = 4
+
+
+def option_len(value_len, delta):
+    """Encoded size of a single CoAP option."""
+    size = 1 + value_len
+    for field in (delta, value_len):
+        if field >= 269:
+            size += 2
+        elif field >= 13:
+            size += 1
+    return size
+
+
+class Stats:
+    def __init__(self):
+        self.wire = []
+        self.plain = []
+        self.arrival = []
+
+    def add(self, wire_len, plain_len):
+        self.wire.append(wire_len)
+        self.plain.append(plain_len)
+        self.arrival.append(time.monotonic())
+
+    def report(self):
+        if not self.wire:
+            return "no requests"
+        overhead = [w - p for w, p in zip(self.wire, self.plain)]
+        return ("requests: {}, wire bytes avg {:.1f}, unprotected avg {:.1f}, "
+                "OSCORE overhead avg {:.1f} (min {}, max {})".format(
+                    len(self.wire), statistics.mean(self.wire),
+                    statistics.mean(self.plain), statistics.mean(overhead),
+                    min(overhead), max(overhead)))
+
+
+def request_token(data):
+    """Token of a CoAP request datagram, None for other datagrams.
+
+    Empty messages such as pings and responses carry no request code.
+    """
+    if len(data) < COAP_HEADER_LEN:
+        return None
+    token_len = data[0] & 0x0F
+    code = data[1]
+    if code == 0 or code >> 5 != 0 or token_len > 8:
+        return None
+    return bytes(data[COAP_HEADER_LEN:COAP_HEADER_LEN + token_len])
+
+
+class Publish(resource.Resource):
+    def __init__(self, stats, datagrams):
+        super().__init__()
+        self.stats = stats
+        self.datagrams = datagrams
+
+    async def render_put(self, request):
+        token_len = len(request.token)
+        path = request.opt.uri_path[0] if request.opt.uri_path else ""
+        plain_len = (COAP_HEADER_LEN + token_len +
+                     option_len(len(path.encode()), 11) +
+                     (1 + len(request.payload) if request.payload else 0))
+        wire_len = self.datagrams.pop(request.token, 0)
+        self.stats.add(wire_len, plain_len)
+        print("{} byte payload from {}: {}".format(
+            len(request.payload), request.remote.hostinfo, self.stats.report()))
+        return aiocoap.Message(code=aiocoap.CHANGED)
+
+
+def write_context(directory, args):
+    """Server side context, sender and recipient swapped versus the device."""
+    settings = {
+        "algorithm": "AES-CCM-16-64-128",
+        "kdf-hashfun": "sha256",
+        "secret_hex": args.master_secret,
+        "salt_hex": args.master_salt,
+        "sender-id_hex": args.recipient_id,
+        "recipient-id_hex": args.sender_id,
+    }
+    (Path(directory) / "settings.json").write_text(json.dumps(settings))
+
+
+class WireCounter(asyncio.DatagramProtocol):
+    """Relays datagrams to the aiocoap server while recording the size of
+    requests by token. The outer token is not protected by OSCORE, so the
+    inner request carries the same one.
+    """
+
+    def __init__(self, upstream, datagrams):
+        self.upstream = upstream
+        self.datagrams = datagrams
+        self.peers = {}
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        token = request_token(data)
+        if token is not None:
+            # A retransmission replaces the size of the original.
+            self.datagrams[token] = len(data)
+        relay = self.peers.get(addr)
+        if relay is None:
+            relay = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            relay.setblocking(False)
+            relay.connect(self.upstream)
+            self.peers[addr] = relay
+            asyncio.get_event_loop().add_reader(
+                relay, self.relay_back, relay, addr)
+        relay.send(data)
+
+    def relay_back(self, relay, addr):
+        self.transport.sendto(relay.recv(2048), addr)
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=5683,
+                        help="Port the device sends to")
+    parser.add_argument("--resource", default="iot_publisher")
+    parser.add_argument("--master-secret", required=True)
+    parser.add_argument("--master-salt", default="")
+    parser.add_argument("--sender-id", default="01",
+                        help="Device sender ID, as configured on the device")
+    parser.add_argument("--recipient-id", default="",
+                        help="Device recipient ID, as configured on the device")
+    args = parser.parse_args()
+
+    stats = Stats()
+    datagrams = {}
+
+    with tempfile.TemporaryDirectory() as context_dir:
+        write_context(context_dir, args)
+
+        site = resource.Site()
+        site.add_resource([args.resource], Publish(stats, datagrams))
+
+        credentials = CredentialsMap()
+        credentials[":device"] = oscore.FilesystemSecurityContext(context_dir)
+        site = OscoreSiteWrapper(site, credentials)
+
+        internal_port = args.port + 1000
+        await aiocoap.Context.create_server_context(
+            site, bind=("127.0.0.1", internal_port))
+        await asyncio.get_event_loop().create_datagram_endpoint(
+            lambda: WireCounter(("127.0.0.1", internal_port), datagrams),
+            local_addr=("0.0.0.0", args.port))
+
+        print("OSCORE server listening on port {}".format(args.port))
+        try:
+            await asyncio.get_event_loop().create_future()
+        finally:
+            print(stats.report())
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
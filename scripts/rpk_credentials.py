@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Generate and provision raw public key style credentials.
+
+The backends' *_TLS_CREDENTIALS_RAW_PUBLIC_KEY mode authenticates each end
+by its P-256 public key. Since the modem only accepts X.509 credentials,
+every key is wrapped in the smallest self-signed certificate OpenSSL can
+produce: a one letter subject and no extensions. The server certificate is
+pinned as the only CA of the sec tag, so no chain is ever transmitted.
+
+Subcommands:
+  generate  create device and server keys and certificates, and print the
+            AT%CMNG commands that provision them to a sec tag
+  compare   print the credential bytes sent in a handshake for an existing
+            certificate chain versus the raw public key mode
+
+Requires the openssl command line tool.
+"""
+
+import argparse
+import base64
+import subprocess
+import tempfile
+from pathlib import Path
+
+# Extensions that OpenSSL 3 adds to self-signed certificates by default.
+MINIMAL_CONFIG = """
+[req]
+distinguished_name = dn
+x509_extensions = none_ext
+prompt = no
+[dn]
+CN = {cn}
+[none_ext]
+subjectKeyIdentifier = none
+authorityKeyIdentifier = none
+"""
+
+MINIMAL_CONFIG_LEGACY = """
+[req]
+distinguished_name = dn
+prompt = no
+[dn]
+CN = {cn}
+"""
+
+# Type values of AT%CMNG.
+CMNG_CA_CERT = 0
+CMNG_CLIENT_CERT = 1
+CMNG_CLIENT_KEY = 2
+
+
+def openssl(*args, stdin=None):
+    return subprocess.run(["openssl"] + list(args), input=stdin,
+                          stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                          check=True).stdout
+
+
+def generate_key(path):
+    openssl("genpkey", "-algorithm", "EC",
+            "-pkeyopt", "ec_paramgen_curve:P-256", "-out", str(path))
+
+
+def self_signed(key, cn, days, out):
+    with tempfile.TemporaryDirectory() as tmp:
+        for template in (MINIMAL_CONFIG, MINIMAL_CONFIG_LEGACY):
+            config = Path(tmp) / "req.cnf"
+            config.write_text(template.format(cn=cn))
+            try:
+                openssl("req", "-new", "-x509", "-sha256", "-key", str(key),
+                        "-days", str(days), "-config", str(config),
+                        "-out", str(out))
+                return
+            except subprocess.CalledProcessError:
+                continue
+    raise RuntimeError("openssl could not create a certificate")
+
+
+def der_len(pem_path, kind="x509"):
+    if kind == "x509":
+        return len(openssl("x509", "-in", str(pem_path), "-outform", "DER"))
+    return len(openssl("pkey", "-in", str(pem_path), "-pubout",
+                       "-outform", "DER"))
+
+
+def chain_der_len(pem_path):
+    total = 0
+    blocks = Path(pem_path).read_text().split("-----END CERTIFICATE-----")
+    for block in blocks:
+        if "-----BEGIN CERTIFICATE-----" not in block:
+            continue
+        body = block.split("-----BEGIN CERTIFICATE-----")[1]
+        total += len(base64.b64decode("".join(body.split())))
+    return total
+
+
+def cmng(sec_tag, kind, pem_path):
+    pem = Path(pem_path).read_text().strip()
+    return 'AT%CMNG=0,{},{},"{}"'.format(sec_tag, kind, pem)
+
+
+def generate(args):
+    out = Path(args.out)
+    out.mkdir(parents=True, exist_ok=True)
+
+    device_key = out / "device_key.pem"
+    device_cert = out / "device_cert.pem"
+    server_key = Path(args.server_key) if args.server_key else out / "server_key.pem"
+    server_cert = out / "server_cert.pem"
+
+    generate_key(device_key)
+    if not args.server_key:
+        generate_key(server_key)
+
+    self_signed(device_key, "d", args.days, device_cert)
+    self_signed(server_key, "s", args.days, server_cert)
+
+    print("Public key (SubjectPublicKeyInfo): {} bytes".format(
+        der_len(device_key, "pkey")))
+    print("Minimal device certificate:        {} bytes".format(
+        der_len(device_cert)))
+    print("Minimal server certificate:        {} bytes".format(
+        der_len(server_cert)))
+    print()
+    print("Configure the server with {} and {}, and trust {}.".format(
+        server_key, server_cert, device_cert))
+    print("Provision the device with, modem offline (AT+CFUN=4):")
+    print()
+    print(cmng(args.sec_tag, CMNG_CA_CERT, server_cert))
+    print(cmng(args.sec_tag, CMNG_CLIENT_CERT, device_cert))
+    print(cmng(args.sec_tag, CMNG_CLIENT_KEY, device_key))
+
+
+def compare(args):
+    chain = chain_der_len(args.chain)
+    with tempfile.TemporaryDirectory() as tmp:
+        key = Path(tmp) / "key.pem"
+        cert = Path(tmp) / "cert.pem"
+        generate_key(key)
+        self_signed(key, "s", 1, cert)
+        minimal = der_len(cert)
+
+    # Client and server each send their credentials once per handshake.
+    print("Certificate chain: {} bytes per side".format(chain))
+    print("Raw public key:    {} bytes per side".format(minimal))
+    print("Saved per full mutual handshake: {} bytes".format(
+        2 * (chain - minimal)))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__.splitlines()[0],
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="\n".join(__doc__.splitlines()[1:]))
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    gen = sub.add_parser("generate")
+    gen.add_argument("--sec-tag", type=int, default=201)
+    gen.add_argument("--out", default="rpk_credentials")
+    gen.add_argument("--server-key",
+                     help="Existing server P-256 key, generated if omitted")
+    gen.add_argument("--days", type=int, default=36500)
+    gen.set_defaults(func=generate)
+
+    cmp_parser = sub.add_parser("compare")
+    cmp_parser.add_argument("--chain", required=True,
+                            help="PEM file with the certificate chain in use")
+    cmp_parser.set_defaults(func=compare)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
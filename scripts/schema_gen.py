@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Generate the firmware schema table from the schema registry.
+
+Checks src/serializer/schema.json and writes the header with the field
+tables that src/serializer/schema.c builds the registry from. Run by the
+build when CONFIG_SERIALIZER_POSITIONAL is set.
+
+The CRC of a schema covers its ID, name, version and field list. The
+firmware announces it at connect, so the server can tell whether it
+decodes with the same registry. telemetry_decode.py computes it with
+schema_crc() as well.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+import zlib
+
+SERIALIZER_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              "..", "src", "serializer")
+REGISTRY = os.path.join(SERIALIZER_DIR, "schema.json")
+QUANT_SPEC = os.path.join(SERIALIZER_DIR, "quant.json")
+
+TYPES = ("uint", "str", "quant")
+ID_ANNOUNCE = 0
+FIELD_NAME = re.compile(r"^\w+(\[\d+\])?(\.\w+(\[\d+\])?)*$")
+
+
+def schema_crc(schema):
+    fields = ";".join("{}:{}{}".format(
+        f["name"], f["type"], ":" + f["unit"] if "unit" in f else "")
+        for f in schema["fields"])
+    text = "{}|{}|{}|{}".format(schema["id"], schema["name"],
+                                schema["version"], fields)
+    return zlib.crc32(text.encode()) & 0xffffffff
+
+
+def registry_load(path=REGISTRY):
+    """Returns the schemas of the registry, raises ValueError if it is not
+    valid."""
+    with open(QUANT_SPEC) as f:
+        units = json.load(f)["units"]
+    with open(path) as f:
+        schemas = json.load(f)["schemas"]
+
+    ids = set()
+    names = set()
+    for schema in schemas:
+        where = "schema {}".format(schema.get("name"))
+        if not 0 < schema["id"] <= 0xff:
+            raise ValueError("{}: ID {} out of range".format(
+                where, schema["id"]))
+        if schema["id"] in ids:
+            raise ValueError("{}: ID {} used twice".format(
+                where, schema["id"]))
+        if (schema["name"], schema["version"]) in names:
+            raise ValueError("{}: version {} used twice".format(
+                where, schema["version"]))
+        ids.add(schema["id"])
+        names.add((schema["name"], schema["version"]))
+
+        for field in schema["fields"]:
+            if not FIELD_NAME.match(field["name"]):
+                raise ValueError("{}: bad field name {}".format(
+                    where, field["name"]))
+            if field["type"] not in TYPES:
+                raise ValueError("{}: {} has unknown type {}".format(
+                    where, field["name"], field["type"]))
+            if (field["type"] == "quant") != ("unit" in field):
+                raise ValueError("{}: {} needs a unit only if quantized"
+                                 .format(where, field["name"]))
+            if field.get("unit", "deg") not in units:
+                raise ValueError("{}: {} has unknown unit {}".format(
+                    where, field["name"], field["unit"]))
+    return schemas
+
+
+def header(schemas):
+    out = ["/* Generated from src/serializer/schema.json by "
+           "scripts/schema_gen.py,",
+           " * do not edit.",
+           " */",
+           "",
+           "#ifndef SCHEMA_TABLE_H__",
+           "#define SCHEMA_TABLE_H__",
+           ""]
+
+    for schema in schemas:
+        out.append("#define SCHEMA_FIELDS_{} \\".format(schema["name"]))
+        for i, field in enumerate(schema["fields"]):
+            unit = "QUANT_" + field["unit"].upper() if "unit" in field \
+                else "0"
+            out.append("\tSCHEMA_FIELD({}, {}, SCHEMA_{}, {}){}".format(
+                schema["record"], field["name"], field["type"].upper(),
+                unit, ", \\" if i + 1 < len(schema["fields"]) else ""))
+        out.append("")
+
+    out.append("#define SCHEMA_REGISTRY(S) \\")
+    for i, schema in enumerate(schemas):
+        out.append("\tS({}, {}, {}, 0x{:08x}){}".format(
+            schema["name"], schema["id"], schema["version"],
+            schema_crc(schema), " \\" if i + 1 < len(schemas) else ""))
+
+    out += ["", "#endif /* SCHEMA_TABLE_H__ */", ""]
+    return "\n".join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", help="header file to write")
+    parser.add_argument("--registry", default=REGISTRY,
+                        help="schema registry, default %(default)s")
+    args = parser.parse_args()
+
+    try:
+        schemas = registry_load(args.registry)
+    except (ValueError, KeyError) as e:
+        sys.exit("error: {}: {}".format(args.registry, e))
+
+    text = header(schemas)
+    # The header is only rewritten when it changed, so that the sources
+    # including it are not rebuilt for nothing.
+    if os.path.exists(args.output):
+        with open(args.output) as f:
+            if f.read() == text:
+                return
+    with open(args.output, "w") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
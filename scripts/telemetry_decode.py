@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Decode telemetry records published by the serializer.
+
+Decodes a Protocol Buffers Telemetry message, see
+src/serializer/telemetry.proto, or a positional record of a schema of
+src/serializer/schema.json, and prints it as JSON. Quantized values are
+scaled back to the units of the telemetry record with the decode spec in
+src/serializer/quant.json. Builds that changed the resolutions are decoded
+with the values from their .config, given with --config.
+
+Positional records are told from Protocol Buffers by their first byte, a
+schema ID, unless --format is given. The announcement a device sends at
+connect is printed with the schemas it lists checked against the
+registry.
+
+The payload is read from a file, or as hex from the command line with
+--hex. The schema is read from telemetry.proto, no protobuf package is
+needed.
+
+Examples:
+  telemetry_decode.py payload.bin
+  telemetry_decode.py --hex 0a4a0803120a4e422d496f5420475053...
+  telemetry_decode.py payload.bin --config build/zephyr/.config
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+from schema_gen import ID_ANNOUNCE, registry_load, schema_crc
+
+SERIALIZER_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              "..", "src", "serializer")
+PROTO = os.path.join(SERIALIZER_DIR, "telemetry.proto")
+QUANT_SPEC = os.path.join(SERIALIZER_DIR, "quant.json")
+
+FIELD = re.compile(r"^\s*(repeated\s+)?(\w+)\s+(\w+)\s*=\s*(\d+)\s*;")
+
+
+def proto_parse(path):
+    """Returns {message: {number: (name, type, repeated)}}."""
+    messages = {}
+    current = None
+    with open(path) as f:
+        for line in f:
+            line = line.split("//")[0]
+            match = re.match(r"^\s*message\s+(\w+)", line)
+            if match:
+                current = messages.setdefault(match.group(1), {})
+                continue
+            match = FIELD.match(line)
+            if match and current is not None:
+                repeated, ftype, name, number = match.groups()
+                current[int(number)] = (name, ftype, bool(repeated))
+            if line.strip() == "}":
+                current = None
+    return messages
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def done(self):
+        return self.pos >= len(self.data)
+
+    def varint(self):
+        value, shift = 0, 0
+        while True:
+            byte = self.take(1)[0]
+            value |= (byte & 0x7f) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def take(self, length):
+        if self.pos + length > len(self.data):
+            raise ValueError("truncated at offset {}".format(self.pos))
+        out = self.data[self.pos:self.pos + length]
+        self.pos += length
+        return out
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def scalar(ftype, reader, wire_type):
+    if ftype == "double":
+        return struct.unpack("<d", reader.take(8))[0]
+    if ftype == "string":
+        return reader.take(reader.varint()).decode()
+    value = reader.varint()
+    return unzigzag(value) if ftype.startswith("sint") else value
+
+
+def decode(messages, name, data):
+    fields = messages[name]
+    out = {}
+    reader = Reader(data)
+    while not reader.done():
+        key = reader.varint()
+        number, wire_type = key >> 3, key & 7
+        if number not in fields:
+            # Unknown fields are skipped, as protobuf does.
+            if wire_type == 0:
+                reader.varint()
+            elif wire_type == 1:
+                reader.take(8)
+            elif wire_type == 2:
+                reader.take(reader.varint())
+            elif wire_type == 5:
+                reader.take(4)
+            else:
+                raise ValueError("wire type {}".format(wire_type))
+            continue
+
+        fname, ftype, repeated = fields[number]
+        if ftype in messages:
+            out[fname] = decode(messages, ftype, reader.take(
+                reader.varint()))
+        elif repeated and wire_type == 2 and ftype != "string":
+            packed = Reader(reader.take(reader.varint()))
+            values = out.setdefault(fname, [])
+            while not packed.done():
+                values.append(scalar(ftype, packed, None))
+        elif repeated:
+            out.setdefault(fname, []).append(
+                scalar(ftype, reader, wire_type))
+        else:
+            out[fname] = scalar(ftype, reader, wire_type)
+    return out
+
+
+def quant_load(config):
+    with open(QUANT_SPEC) as f:
+        spec = json.load(f)
+    if config:
+        with open(config) as f:
+            values = dict(re.findall(r"^(CONFIG_\w+)=(\d+)$", f.read(),
+                                     re.M))
+        for unit in spec["units"].values():
+            if unit["kconfig"] in values:
+                unit["steps_per_unit"] = int(values[unit["kconfig"]])
+    return spec
+
+
+def scale(spec, unit):
+    unit = spec["units"][unit]
+    return unit["unit_size"] / unit["steps_per_unit"]
+
+
+def dequantize(record, spec):
+    """Scales quantized records back and stores them under the name of the
+    record they replace."""
+    for key in [k for k in record if k.endswith("_q")]:
+        values = dict(record.pop(key))
+        for fname in values:
+            unit = spec["fields"].get("{}.{}".format(key, fname))
+            if unit is None:
+                continue
+            factor = scale(spec, unit)
+            if isinstance(values[fname], list):
+                values[fname] = [v * factor for v in values[fname]]
+            else:
+                values[fname] = values[fname] * factor
+        record[key[:-2]] = values
+    return record
+
+
+def path_set(record, name, value):
+    """Stores value under a C member name such as acc.v[0]."""
+    parts = re.findall(r"(\w+)(?:\[(\d+)\])?", name)
+    node = record
+    for i, (member, index) in enumerate(parts):
+        last = i + 1 == len(parts)
+        if index:
+            items = node.setdefault(member, [])
+            index = int(index)
+            items.extend([None] * (index + 1 - len(items)))
+            if last:
+                items[index] = value
+            else:
+                if items[index] is None:
+                    items[index] = {}
+                node = items[index]
+        elif last:
+            node[member] = value
+        else:
+            node = node.setdefault(member, {})
+
+
+def positional_decode(schemas, data, spec):
+    """Decodes a positional record, quantized values are left as steps
+    without a spec."""
+    reader = Reader(data)
+    schema_id = reader.take(1)[0]
+    schema = next((s for s in schemas if s["id"] == schema_id), None)
+    if schema is None:
+        raise ValueError("schema {} not in the registry".format(schema_id))
+
+    record = {}
+    for field in schema["fields"]:
+        if field["type"] == "str":
+            value = reader.take(reader.varint()).decode()
+        elif field["type"] == "quant":
+            value = unzigzag(reader.varint())
+            if spec is not None:
+                value *= scale(spec, field["unit"])
+        else:
+            value = reader.varint()
+        path_set(record, field["name"], value)
+
+    if not reader.done():
+        raise ValueError("{} bytes after the record".format(
+            len(data) - reader.pos))
+    return record
+
+
+def announce_decode(schemas, data, spec):
+    reader = Reader(data)
+    reader.take(1)
+    announced = []
+    for _ in range(reader.varint()):
+        schema_id = reader.take(1)[0]
+        version = reader.varint()
+        crc = struct.unpack("<I", reader.take(4))[0]
+        schema = next((s for s in schemas if s["id"] == schema_id), None)
+        if schema is None:
+            status = "unknown"
+        elif schema["version"] != version or schema_crc(schema) != crc:
+            status = "differs from the registry"
+        else:
+            status = "ok"
+        announced.append({
+            "id": schema_id,
+            "name": schema["name"] if schema else None,
+            "version": version,
+            "crc": "0x{:08x}".format(crc),
+            "status": status,
+        })
+
+    # Resolutions are listed in the order of quant.json, which is the
+    # order of enum quant_unit.
+    units = list(spec["units"])
+    resolutions = {}
+    for i in range(reader.varint()):
+        steps = reader.varint()
+        resolutions[units[i] if i < len(units) else str(i)] = steps
+
+    return {"schemas": announced, "steps_per_unit": resolutions}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("payload", nargs="?", help="payload file")
+    parser.add_argument("--hex", help="payload as hex")
+    parser.add_argument("--config", help=".config of the build, for "
+                        "resolutions changed from the defaults")
+    parser.add_argument("--raw", action="store_true",
+                        help="print quantized records as steps")
+    parser.add_argument("--format", default="auto",
+                        choices=("auto", "protobuf", "positional"),
+                        help="payload format, default %(default)s")
+    args = parser.parse_args()
+
+    if args.hex:
+        data = bytes.fromhex(args.hex)
+    elif args.payload:
+        with open(args.payload, "rb") as f:
+            data = f.read()
+    else:
+        parser.error("give a payload file or --hex")
+
+    if not data:
+        sys.exit("error: empty payload")
+
+    schemas = registry_load()
+    spec = quant_load(args.config)
+    fmt = args.format
+    if fmt == "auto":
+        ids = [s["id"] for s in schemas] + [ID_ANNOUNCE]
+        fmt = "positional" if data[0] in ids else "protobuf"
+
+    try:
+        if fmt == "protobuf":
+            record = decode(proto_parse(PROTO), "Telemetry", data)
+            if not args.raw:
+                record = dequantize(record, spec)
+        elif data[0] == ID_ANNOUNCE:
+            record = announce_decode(schemas, data, spec)
+        else:
+            record = positional_decode(schemas, data,
+                                       None if args.raw else spec)
+    except (ValueError, struct.error, UnicodeDecodeError) as e:
+        sys.exit("error: {}".format(e))
+
+    print(json.dumps(record, indent=2))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,467 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Decode a Zephyr CTF trace and report application latencies.
+
+Reads a CTF stream captured with CONFIG_TRACING_CTF and CONFIG_APP_TRACE,
+either the channel file written on native_posix or the raw bytes captured
+from the tracing UART on target. The Zephyr CTF metadata and the
+application metadata in src/app_trace/metadata are combined to decode it.
+
+Reports:
+  - publication latencies: enqueue to encode, encode to socket write,
+    socket write to acknowledgment and enqueue to acknowledgment
+  - connection phase latencies: start to resolved, resolved to transport
+    connected, transport to ready, and start to ready
+  - keepalive ping count and interval
+  - poll wake-up causes
+and, with --timeline, every application event on a common time axis.
+
+Examples:
+  trace_analyze.py build/channel0_0 \\
+      --zephyr-metadata $ZEPHYR_BASE/subsys/debug/tracing/ctf/tsdl/metadata
+  trace_analyze.py uart_capture.bin --zephyr-metadata metadata \\
+      --clock-hz 32768 --timeline
+"""
+
+import argparse
+import collections
+import csv
+import os
+import re
+import sys
+
+APP_METADATA = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                            "..", "src", "app_trace", "metadata")
+
+BACKENDS = {0: "mqtt", 1: "coap"}
+POLL_CAUSES = {0: "timeout", 1: "input", 2: "socket error", 3: "poll error"}
+CONNECT_PHASES = {0: "start", 1: "resolved", 2: "transport", 3: "ready",
+                  4: "failed"}
+
+
+class TsdlError(Exception):
+    pass
+
+
+class Tsdl:
+    """Minimal TSDL parser covering the constructs of the Zephyr metadata:
+    integer, enum, struct, string and fixed length array types, type
+    aliases, and the trace, clock, stream and event blocks."""
+
+    TOKEN = re.compile(r'"(?:[^"\\]|\\.)*"|:=|[A-Za-z_][\w.]*|0[xX][0-9a-fA-F]+'
+                       r'|-?\d+|[{}\[\];:=,<>]')
+
+    def __init__(self, text):
+        text = re.sub(r"/\*.*?\*/", " ", text, flags=re.S)
+        text = re.sub(r"//[^\n]*", " ", text)
+        self.tokens = self.TOKEN.findall(text)
+        self.pos = 0
+        self.types = {}
+        self.byte_order = "<"
+        self.clock_freq = None
+        self.packet_header = None
+        self.event_header = None
+        self.events = {}
+        self.parse()
+
+    def peek(self):
+        return self.tokens[self.pos] if self.pos < len(self.tokens) else None
+
+    def next(self):
+        tok = self.peek()
+        if tok is None:
+            raise TsdlError("unexpected end of metadata")
+        self.pos += 1
+        return tok
+
+    def expect(self, tok):
+        got = self.next()
+        if got != tok:
+            raise TsdlError("expected {} got {}".format(tok, got))
+
+    def skip_block(self):
+        depth = 0
+        while True:
+            tok = self.next()
+            if tok == "{":
+                depth += 1
+            elif tok == "}":
+                depth -= 1
+                if depth == 0:
+                    return
+
+    def attributes(self):
+        """Parse { key = value; key := type; ... } into a dict."""
+        attrs = {}
+        self.expect("{")
+        while self.peek() != "}":
+            key = self.next()
+            op = self.next()
+            if op == ":=":
+                attrs[key] = self.type_spec()
+            elif op == "=":
+                value = []
+                while self.peek() != ";":
+                    value.append(self.next())
+                attrs[key] = " ".join(value).strip('"')
+            else:
+                raise TsdlError("unexpected {} after {}".format(op, key))
+            self.expect(";")
+        self.expect("}")
+        return attrs
+
+    @staticmethod
+    def number(value):
+        return int(value, 0)
+
+    def type_spec(self):
+        tok = self.next()
+        if tok == "integer":
+            attrs = self.attributes()
+            return ("int", self.number(attrs["size"]),
+                    attrs.get("signed", "false") in ("true", "1"),
+                    self.number(attrs.get("align", "8")))
+        if tok == "string":
+            if self.peek() == "{":
+                self.attributes()
+            return ("string",)
+        if tok == "enum":
+            name = None
+            if self.peek() not in (":", "{"):
+                name = self.next()
+            if self.peek() == ":":
+                self.next()
+                base = self.type_spec()
+            else:
+                base = ("int", 32, True, 8)
+            if self.peek() == "{":
+                self.skip_block()
+            if name:
+                self.types["enum " + name] = base
+            return base
+        if tok == "struct":
+            name = None
+            if self.peek() != "{":
+                name = self.next()
+                if self.peek() != "{":
+                    return self.types["struct " + name]
+            fields = self.struct_body()
+            result = ("struct", fields)
+            if name:
+                self.types["struct " + name] = result
+            return result
+        if tok in self.types:
+            return self.types[tok]
+        raise TsdlError("unknown type {}".format(tok))
+
+    def struct_body(self):
+        fields = []
+        self.expect("{")
+        while self.peek() != "}":
+            ftype = self.type_spec()
+            name = self.next()
+            while self.peek() == "[":
+                self.next()
+                length = self.number(self.next())
+                self.expect("]")
+                ftype = ("array", ftype, length)
+            self.expect(";")
+            fields.append((name, ftype))
+        self.expect("}")
+        return fields
+
+    def parse(self):
+        while self.peek() is not None:
+            tok = self.next()
+            if tok == "typealias":
+                ftype = self.type_spec()
+                self.expect(":=")
+                name = []
+                while self.peek() != ";":
+                    name.append(self.next())
+                self.types[" ".join(name)] = ftype
+            elif tok in ("struct", "enum"):
+                self.pos -= 1
+                self.type_spec()
+            elif tok == "trace":
+                attrs = self.attributes()
+                if attrs.get("byte_order") == "be":
+                    self.byte_order = ">"
+                self.packet_header = attrs.get("packet.header")
+            elif tok == "clock":
+                attrs = self.attributes()
+                if "freq" in attrs:
+                    self.clock_freq = self.number(attrs["freq"])
+            elif tok == "stream":
+                attrs = self.attributes()
+                self.event_header = attrs.get("event.header")
+            elif tok == "event":
+                attrs = self.attributes()
+                self.events[self.number(attrs["id"])] = (
+                    attrs["name"], attrs.get("fields", ("struct", [])))
+            elif tok == "env":
+                self.skip_block()
+            else:
+                raise TsdlError("unexpected {}".format(tok))
+            self.expect(";")
+        if self.event_header is None:
+            raise TsdlError("no stream event.header in metadata")
+
+
+class Decoder:
+    def __init__(self, tsdl, data):
+        self.tsdl = tsdl
+        self.data = data
+        self.pos = 0
+
+    def read(self, ftype):
+        kind = ftype[0]
+        if kind == "int":
+            size, signed, align = ftype[1], ftype[2], ftype[3]
+            self.pos += (-self.pos) % max(align // 8, 1)
+            nbytes = size // 8
+            raw = self.data[self.pos:self.pos + nbytes]
+            if len(raw) < nbytes:
+                raise EOFError
+            self.pos += nbytes
+            order = "little" if self.tsdl.byte_order == "<" else "big"
+            return int.from_bytes(raw, order, signed=signed)
+        if kind == "string":
+            end = self.data.index(b"\0", self.pos)
+            value = self.data[self.pos:end].decode(errors="replace")
+            self.pos = end + 1
+            return value
+        if kind == "array":
+            items = [self.read(ftype[1]) for _ in range(ftype[2])]
+            if ftype[1][0] == "int" and ftype[1][1] == 8:
+                return bytes(items).split(b"\0")[0].decode(errors="replace")
+            return items
+        if kind == "struct":
+            return {name: self.read(sub) for name, sub in ftype[1]}
+        raise TsdlError("cannot decode {}".format(kind))
+
+    def events(self):
+        if self.tsdl.packet_header is not None:
+            self.read(self.tsdl.packet_header)
+        while self.pos < len(self.data):
+            try:
+                header = self.read(self.tsdl.event_header)
+                event_id = header["id"]
+                if event_id not in self.tsdl.events:
+                    raise TsdlError("unknown event id 0x{:x} at offset {}"
+                                    .format(event_id, self.pos))
+                name, ftype = self.tsdl.events[event_id]
+                fields = self.read(ftype)
+            except (EOFError, ValueError):
+                # Capture ended in the middle of an event.
+                return
+            yield header["timestamp"], name, fields
+
+
+def unwrap(events, bits=32):
+    """Turn wrapping cycle counters into monotonic ones."""
+    offset = 0
+    last = None
+    for ts, name, fields in events:
+        if last is not None and ts < last:
+            offset += 1 << bits
+        last = ts
+        yield ts + offset, name, fields
+
+
+class Stats:
+    def __init__(self):
+        self.samples = collections.defaultdict(list)
+
+    def add(self, key, value):
+        self.samples[key].append(value)
+
+    def rows(self):
+        for key, values in self.samples.items():
+            values = sorted(values)
+            n = len(values)
+            yield (key, n, values[0], sum(values) / n, values[n // 2],
+                   values[min(n - 1, (n * 95) // 100)], values[-1])
+
+
+def analyze(events, clock_hz, timeline=None):
+    stats = Stats()
+    counts = collections.Counter()
+    enqueued = collections.deque()
+    encoded = {}
+    written = {}
+    connect = {}
+    pings = []
+    start = None
+
+    def ms(cycles):
+        return cycles * 1000.0 / clock_hz
+
+    for ts, name, f in events:
+        if not name.startswith("app_"):
+            continue
+        if start is None:
+            start = ts
+        if timeline is not None:
+            timeline.append((ms(ts - start), name, f))
+
+        if name == "app_publish_enqueue":
+            enqueued.append(ts)
+        elif name == "app_publish_encode":
+            key = (f["backend"], f["msg_id"])
+            # Publications are encoded in the order they were requested.
+            queued = enqueued.popleft() if enqueued else None
+            encoded[key] = (queued, ts)
+            if queued is not None:
+                stats.add("publish: enqueue -> encode", ms(ts - queued))
+        elif name == "app_publish_write":
+            key = (f["backend"], f["msg_id"])
+            if key in encoded:
+                stats.add("publish: encode -> write",
+                          ms(ts - encoded[key][1]))
+            if f["result"] < 0:
+                counts["write errors"] += 1
+                encoded.pop(key, None)
+            else:
+                written[key] = ts
+        elif name == "app_publish_ack":
+            key = (f["backend"], f["msg_id"])
+            if key in written:
+                stats.add("publish: write -> ack", ms(ts - written.pop(key)))
+            queued = encoded.pop(key, (None, None))[0]
+            if queued is not None:
+                stats.add("publish: enqueue -> ack", ms(ts - queued))
+        elif name == "app_poll_wake":
+            counts["poll wake: " + POLL_CAUSES.get(f["cause"],
+                                                    str(f["cause"]))] += 1
+        elif name == "app_ping":
+            if pings:
+                stats.add("ping interval", ms(ts - pings[-1]))
+            pings.append(ts)
+        elif name == "app_connect_phase":
+            backend = f["backend"]
+            phase = CONNECT_PHASES.get(f["phase"], str(f["phase"]))
+            if phase == "start":
+                connect[backend] = {"start": ts}
+                continue
+            phases = connect.get(backend)
+            if phases is None:
+                continue
+            if phase == "failed":
+                counts["connect failures"] += 1
+                connect.pop(backend)
+                continue
+            previous = {"resolved": "start", "transport": "resolved",
+                        "ready": "transport"}[phase]
+            if previous in phases:
+                stats.add("connect: {} -> {}".format(previous, phase),
+                          ms(ts - phases[previous]))
+            phases[phase] = ts
+            if phase == "ready":
+                stats.add("connect: start -> ready",
+                          ms(ts - phases["start"]))
+                connect.pop(backend)
+
+    counts["pings"] = len(pings)
+    counts["publications without ack"] = len(written)
+    return stats, counts
+
+
+def format_fields(fields):
+    parts = []
+    for key, value in fields.items():
+        if key == "backend":
+            value = BACKENDS.get(value, value)
+        elif key == "cause":
+            value = POLL_CAUSES.get(value, value)
+        elif key == "phase":
+            value = CONNECT_PHASES.get(value, value)
+        parts.append("{}={}".format(key, value))
+    return " ".join(parts)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__.splitlines()[0],
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="\n".join(__doc__.splitlines()[1:]))
+    parser.add_argument("stream",
+                        help="CTF stream file, or a CTF directory holding "
+                             "the stream and its metadata")
+    parser.add_argument("--zephyr-metadata",
+                        help="Zephyr CTF metadata, taken from the CTF "
+                             "directory if omitted")
+    parser.add_argument("--app-metadata", default=APP_METADATA)
+    parser.add_argument("--clock-hz", type=int,
+                        help="Timestamp frequency, overrides the metadata "
+                             "clock")
+    parser.add_argument("--timeline", action="store_true",
+                        help="Print every application event")
+    parser.add_argument("--csv", help="Write latency statistics to a file")
+    args = parser.parse_args()
+
+    stream = args.stream
+    zephyr_metadata = args.zephyr_metadata
+    if os.path.isdir(stream):
+        if zephyr_metadata is None:
+            zephyr_metadata = os.path.join(stream, "metadata")
+        names = sorted(n for n in os.listdir(stream) if n != "metadata")
+        if not names:
+            sys.exit("No stream file in {}".format(stream))
+        stream = os.path.join(stream, names[0])
+    if zephyr_metadata is None:
+        sys.exit("--zephyr-metadata is required for a stream file")
+
+    with open(zephyr_metadata) as f:
+        text = f.read()
+    with open(args.app_metadata) as f:
+        text += "\n" + f.read()
+    try:
+        tsdl = Tsdl(text)
+    except (TsdlError, KeyError) as e:
+        sys.exit("Metadata: {}".format(e))
+
+    clock_hz = args.clock_hz or tsdl.clock_freq
+    if not clock_hz:
+        sys.exit("No clock frequency in the metadata, pass --clock-hz")
+
+    with open(stream, "rb") as f:
+        data = f.read()
+
+    timeline = [] if args.timeline else None
+    try:
+        stats, counts = analyze(unwrap(Decoder(tsdl, data).events()),
+                                clock_hz, timeline)
+    except TsdlError as e:
+        sys.exit("Stream: {}".format(e))
+
+    if timeline is not None:
+        for t, name, fields in timeline:
+            print("{:12.3f} ms  {:<20} {}".format(
+                t, name[len("app_"):], format_fields(fields)))
+        print()
+
+    rows = list(stats.rows())
+    print("{:<30} {:>6} {:>9} {:>9} {:>9} {:>9} {:>9}".format(
+        "Latency (ms)", "count", "min", "avg", "p50", "p95", "max"))
+    for key, n, lo, avg, p50, p95, hi in rows:
+        print("{:<30} {:>6} {:>9.1f} {:>9.1f} {:>9.1f} {:>9.1f} {:>9.1f}"
+              .format(key, n, lo, avg, p50, p95, hi))
+    print()
+    for key, value in sorted(counts.items()):
+        print("{:<30} {:>6}".format(key, value))
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            writer = csv.writer(f)
+            writer.writerow(["phase", "count", "min_ms", "avg_ms", "p50_ms",
+                             "p95_ms", "max_ms"])
+            writer.writerows(rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Application trace points.
+ */
+
+#ifndef APP_TRACE_H__
+#define APP_TRACE_H__
+
+#include <zephyr.h>
+
+#if defined(CONFIG_APP_TRACE)
+#include <ctf_middle.h>
+#endif
+
+/**
+ * @defgroup app_trace Application trace points
+ * @{
+ * @brief CTF events emitted into the Zephyr trace stream.
+ *
+ *        The events share the stream, the event header and the clock of
+ *        the kernel events. Their IDs start above the ones used by Zephyr
+ *        and must match the declarations in the metadata file next to
+ *        this header. All trace points compile to nothing when
+ *        CONFIG_APP_TRACE is disabled.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Application event IDs. */
+enum app_trace_event_id {
+	APP_TRACE_EVT_PUBLISH_ENQUEUE = 0xA0,
+	APP_TRACE_EVT_PUBLISH_ENCODE = 0xA1,
+	APP_TRACE_EVT_PUBLISH_WRITE = 0xA2,
+	APP_TRACE_EVT_PUBLISH_ACK = 0xA3,
+	APP_TRACE_EVT_POLL_WAKE = 0xA4,
+	APP_TRACE_EVT_PING = 0xA5,
+	APP_TRACE_EVT_CONNECT_PHASE = 0xA6
+};
+
+/** @brief Backend that emitted an event. */
+enum app_trace_backend {
+	APP_TRACE_BACKEND_MQTT,
+	APP_TRACE_BACKEND_COAP
+};
+
+/** @brief Causes of a poll wake-up in the main loop. */
+enum app_trace_poll_cause {
+	/** Keepalive or linger timeout. */
+	APP_TRACE_POLL_TIMEOUT,
+	/** Data received. */
+	APP_TRACE_POLL_INPUT,
+	/** Socket closed or failed. */
+	APP_TRACE_POLL_SOCKET_ERROR,
+	/** poll() itself failed. */
+	APP_TRACE_POLL_ERROR
+};
+
+/** @brief Connection phases. */
+enum app_trace_connect_phase {
+	/** Connection attempt started. */
+	APP_TRACE_CONNECT_START,
+	/** Server address resolved. */
+	APP_TRACE_CONNECT_RESOLVED,
+	/** Transport connected, including the (D)TLS handshake. */
+	APP_TRACE_CONNECT_TRANSPORT,
+	/** Ready for data, after CONNACK for MQTT. */
+	APP_TRACE_CONNECT_READY,
+	/** Connection attempt failed. */
+	APP_TRACE_CONNECT_FAILED
+};
+
+#if defined(CONFIG_APP_TRACE)
+
+/** @brief A publication was requested.
+ *
+ *  @param[in] seq Publication number.
+ */
+static inline void app_trace_publish_enqueue(u32_t seq)
+{
+	CTF_EVENT(CTF_LITERAL(u8_t, APP_TRACE_EVT_PUBLISH_ENQUEUE), seq);
+}
+
+/** @brief A backend started encoding a message.
+ *
+ *  @param[in] backend Backend, see @ref app_trace_backend.
+ *  @param[in] msg_id Message ID or token of the message.
+ *  @param[in] len Payload length, 0 if the payload is written in place
+ *                 after the header.
+ */
+static inline void app_trace_publish_encode(u8_t backend, u16_t msg_id,
+					    u32_t len)
+{
+	CTF_EVENT(CTF_LITERAL(u8_t, APP_TRACE_EVT_PUBLISH_ENCODE), backend,
+		  msg_id, len);
+}
+
+/** @brief A backend handed a message to the socket.
+ *
+ *  @param[in] backend Backend, see @ref app_trace_backend.
+ *  @param[in] msg_id Message ID or token of the message.
+ *  @param[in] result 0 or a negative error code.
+ */
+static inline void app_trace_publish_write(u8_t backend, u16_t msg_id,
+					   s32_t result)
+{
+	CTF_EVENT(CTF_LITERAL(u8_t, APP_TRACE_EVT_PUBLISH_WRITE), backend,
+		  msg_id, result);
+}
+
+/** @brief The server acknowledged a message.
+ *
+ *  @param[in] backend Backend, see @ref app_trace_backend.
+ *  @param[in] msg_id Message ID or token of the message.
+ */
+static inline void app_trace_publish_ack(u8_t backend, u16_t msg_id)
+{
+	CTF_EVENT(CTF_LITERAL(u8_t, APP_TRACE_EVT_PUBLISH_ACK), backend,
+		  msg_id);
+}
+
+/** @brief The main loop woke up from poll().
+ *
+ *  @param[in] cause Cause, see @ref app_trace_poll_cause.
+ */
+static inline void app_trace_poll_wake(u8_t cause)
+{
+	CTF_EVENT(CTF_LITERAL(u8_t, APP_TRACE_EVT_POLL_WAKE), cause);
+}
+
+/** @brief A keepalive ping was sent.
+ *
+ *  @param[in] backend Backend, see @ref app_trace_backend.
+ */
+static inline void app_trace_ping(u8_t backend)
+{
+	CTF_EVENT(CTF_LITERAL(u8_t, APP_TRACE_EVT_PING), backend);
+}
+
+/** @brief A connection phase was completed.
+ *
+ *  @param[in] backend Backend, see @ref app_trace_backend.
+ *  @param[in] phase Phase, see @ref app_trace_connect_phase.
+ *  @param[in] result 0 or a negative error code.
+ */
+static inline void app_trace_connect_phase(u8_t backend, u8_t phase,
+					   s32_t result)
+{
+	CTF_EVENT(CTF_LITERAL(u8_t, APP_TRACE_EVT_CONNECT_PHASE), backend,
+		  phase, result);
+}
+
+#else
+
+static inline void app_trace_publish_enqueue(u32_t seq) {}
+static inline void app_trace_publish_encode(u8_t backend, u16_t msg_id,
+					    u32_t len) {}
+static inline void app_trace_publish_write(u8_t backend, u16_t msg_id,
+					   s32_t result) {}
+static inline void app_trace_publish_ack(u8_t backend, u16_t msg_id) {}
+static inline void app_trace_poll_wake(u8_t cause) {}
+static inline void app_trace_ping(u8_t backend) {}
+static inline void app_trace_connect_phase(u8_t backend, u8_t phase,
+					   s32_t result) {}
+
+#endif /* CONFIG_APP_TRACE */
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* APP_TRACE_H__ */
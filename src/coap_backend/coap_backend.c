@@ -4,6 +4,23 @@
 #include <net/coap.h>
 #include <stdio.h>
 #include <net/tls_credentials.h>
+#include <tls_ciphersuites.h>
+#include <app_trace.h>
+#include <perf_budget.h>
+#include <resolver.h>
+#include <endpoint.h>
+
+#if defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
+#include <coap_tcp.h>
+#endif
+
+#if defined(CONFIG_COAP_BACKEND_OSCORE)
+#include <oscore.h>
+#endif
+
+#if defined(CONFIG_COAP_BACKEND_FOTA)
+#include <fota_dl.h>
+#endif
 
 #include <logging/log.h>
 
@@ -13,13 +30,87 @@ BUILD_ASSERT_MSG(sizeof(CONFIG_COAP_BACKEND_SERVER_HOST_NAME) > 1,
 		 "CoAP server hostname not set");
 
 static struct sockaddr_storage host_addr;
+static struct endpoint_list endpoints;
+/* Host name of the selected server. */
+static const char *server_host;
+
+#if defined(CONFIG_COAP_BACKEND_TLS_CIPHERSUITES_PSK_AES128_CCM8)
+static const int cipher_list[] = { TLS_PSK_WITH_AES_128_CCM_8 };
+#elif defined(CONFIG_COAP_BACKEND_TLS_CIPHERSUITES_PSK_AES128_CBC_SHA256)
+static const int cipher_list[] = { TLS_PSK_WITH_AES_128_CBC_SHA256 };
+#elif defined(CONFIG_COAP_BACKEND_TLS_CIPHERSUITES_ECDHE_ECDSA_AES128_CBC_SHA256)
+static const int cipher_list[] = { TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256 };
+#elif defined(CONFIG_COAP_BACKEND_TLS_CIPHERSUITES_ECDHE_RSA_AES128_CBC_SHA256)
+static const int cipher_list[] = { TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256 };
+#endif
 
 static int client_fd;
 static u16_t next_token;
+/* Uptime of the last message sent, the keepalive is counted from it. */
+static s64_t last_tx;
 
 #define APP_COAP_VERSION 1
 
-static u8_t coap_buf[CONFIG_COAP_BACKEND_RX_TX_BUFFER_LEN];
+#if defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
+#define COAP_BACKEND_SOCKTYPE SOCK_STREAM
+#define COAP_BUF_HEADROOM COAP_TCP_HEADROOM
+#else
+#define COAP_BACKEND_SOCKTYPE SOCK_DGRAM
+#define COAP_BUF_HEADROOM 0
+#endif
+
+/* Messages are encoded at COAP_BUF_HEADROOM so that they can be reframed in
+ * place when a stream transport is used.
+ */
+static u8_t coap_buf[COAP_BUF_HEADROOM + CONFIG_COAP_BACKEND_RX_TX_BUFFER_LEN];
+#define COAP_MSG_BUF (coap_buf + COAP_BUF_HEADROOM)
+#define COAP_MSG_BUF_LEN CONFIG_COAP_BACKEND_RX_TX_BUFFER_LEN
+
+/* Held while coap_buf is in use, from coap_backend_write_begin() until the
+ * request is sent while a payload is written in place. It also guards the
+ * OSCORE context, which requests and responses share. It is not held while
+ * received data is dispatched, the handlers may send. Decrypted payloads are
+ * moved into the receive buffer first.
+ */
+K_MUTEX_DEFINE(coap_buf_lock);
+
+/* Request a payload is written into, in coap_buf. */
+static struct coap_packet tx_request;
+/* Start of its encoding, also guarded by coap_buf_lock. */
+static u32_t tx_encode_start;
+
+#if defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
+/* Received stream data is reassembled separately so that a partially
+ * received frame survives messages being sent in between.
+ */
+static u8_t stream_buf[COAP_TCP_HEADROOM + CONFIG_COAP_BACKEND_RX_TX_BUFFER_LEN];
+static size_t stream_len;
+
+/* Largest message the server accepts, updated from its CSM. */
+static u32_t peer_max_msg_size = COAP_TCP_DEFAULT_MAX_MSG_SIZE;
+#else
+/* Received datagrams are kept apart from coap_buf, so that messages sent
+ * while one is handled do not overwrite it. Only the thread polling the
+ * backend uses it.
+ */
+static u8_t rx_buf[CONFIG_COAP_BACKEND_RX_TX_BUFFER_LEN];
+#endif
+
+#if defined(CONFIG_COAP_BACKEND_FOTA)
+#define FOTA_BLOCK_SIZE(szx) (16U << (szx))
+
+BUILD_ASSERT_MSG(FOTA_BLOCK_SIZE(CONFIG_COAP_BACKEND_FOTA_BLOCK_SZX) <=
+		 CONFIG_COAP_BACKEND_RX_TX_BUFFER_LEN / 2,
+		 "FOTA block does not fit in the CoAP receive buffer");
+
+/* Block2 requests carry their own token so that responses are told apart
+ * from those to publications.
+ */
+static u16_t fota_token;
+static u32_t fota_image_id;
+/* Block size exponent, lowered if the server answers with smaller blocks. */
+static u8_t fota_szx = CONFIG_COAP_BACKEND_FOTA_BLOCK_SZX;
+#endif
 
 #if !defined(CONFIG_CLOUD_API)
 static coap_backend_evt_handler_t module_evt_handler;
@@ -30,7 +121,7 @@ static struct cloud_backend *coap_backend;
 #endif
 
 #if !defined(CONFIG_CLOUD_API)
-static void coap_backend_notify_event(const struct coap_backend_evt *evt)
+static void coap_backend_notify_event(const struct coap_backend_event *evt)
 {
 	if ((module_evt_handler != NULL) && (evt != NULL)) {
 		module_evt_handler(evt);
@@ -41,51 +132,130 @@ static void coap_backend_notify_event(const struct coap_backend_evt *evt)
 static int server_resolve(void)
 {
 	int err;
-	struct addrinfo *result;
-	struct addrinfo hints = {
-		.ai_family = AF_INET,
-		.ai_socktype = SOCK_DGRAM
-	};
-	char ipv4_addr[NET_IPV4_ADDR_LEN];
 
-	err = getaddrinfo(CONFIG_COAP_BACKEND_SERVER_HOST_NAME, NULL, &hints,
-			  &result);
-	if (err != 0) {
-		LOG_ERR("ERROR: getaddrinfo failed %d", err);
-		return -EIO;
+	if (endpoint_list_get("COAP_BACKEND") == NULL) {
+		err = endpoint_list_init(
+			&endpoints, "COAP_BACKEND",
+			CONFIG_COAP_BACKEND_SERVER_HOST_NAME,
+			CONFIG_COAP_BACKEND_SERVER_PORT,
+			CONFIG_COAP_BACKEND_SERVER_FALLBACK_HOSTS, AF_INET,
+			COAP_BACKEND_SOCKTYPE);
+		if (err) {
+			return err;
+		}
 	}
 
-	if (result == NULL) {
-		LOG_ERR("ERROR: Address not found");
-		return -ENOENT;
+	return endpoint_select(&endpoints, &host_addr, &server_host);
+}
+
+static int coap_packet_send(const struct coap_packet *packet)
+{
+	int err;
+	u8_t *data = packet->data;
+	size_t len = packet->offset;
+
+#if defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
+	size_t frame_offset;
+
+	err = coap_tcp_frame(coap_buf, packet->offset, &frame_offset);
+	if (err) {
+		LOG_ERR("Failed to frame CoAP message, %d", err);
+		return err;
 	}
 
-	/* IPv4 Address. */
-	struct sockaddr_in *server4 = ((struct sockaddr_in *)&host_addr);
+	data = coap_buf + frame_offset;
+	len = COAP_BUF_HEADROOM + packet->offset - frame_offset;
 
-	server4->sin_addr.s_addr =
-		((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
-	server4->sin_family = AF_INET;
-	server4->sin_port = htons(CONFIG_COAP_BACKEND_SERVER_PORT);
+	if (len > peer_max_msg_size) {
+		LOG_ERR("Message exceeds server max message size %d",
+			peer_max_msg_size);
+		return -EMSGSIZE;
+	}
+#endif
 
-	inet_ntop(AF_INET, &server4->sin_addr.s_addr, ipv4_addr,
-		  sizeof(ipv4_addr));
-	LOG_DBG("IPv4 Address found %s", log_strdup(ipv4_addr));
+	err = send(client_fd, data, len, 0);
+	if (err < 0) {
+		return -errno;
+	}
 
-	/* Free the address. */
-	freeaddrinfo(result);
+	last_tx = k_uptime_get();
 
 	return 0;
 }
 
-int coap_backend_ping(void)
+#if defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
+static int coap_signal_send(u8_t code, const u8_t *token, u8_t token_len)
 {
 	int err;
-	struct coap_packet ping;
+	struct coap_packet signal;
+
+	err = coap_packet_init(&signal, COAP_MSG_BUF, COAP_MSG_BUF_LEN,
+			       APP_COAP_VERSION, COAP_TYPE_NON_CON,
+			       token_len, (u8_t *)token, code, 0);
+	if (err < 0) {
+		LOG_ERR("Failed to create CoAP signal, %d", err);
+		return err;
+	}
+
+	if (code == COAP_TCP_SIGNAL_CSM) {
+		err = coap_append_option_int(&signal,
+					     COAP_TCP_OPTION_MAX_MESSAGE_SIZE,
+					     CONFIG_COAP_BACKEND_RX_TX_BUFFER_LEN);
+		if (err < 0) {
+			LOG_ERR("Failed to encode CSM option, %d", err);
+			return err;
+		}
+	}
+
+	return coap_packet_send(&signal);
+}
+
+static void coap_signal_handle(const struct coap_packet *signal)
+{
+	u8_t token[8];
+	u16_t token_len;
+	struct coap_option option;
+
+	switch (coap_header_get_code(signal)) {
+	case COAP_TCP_SIGNAL_CSM:
+		if (coap_find_options(signal, COAP_TCP_OPTION_MAX_MESSAGE_SIZE,
+				      &option, 1) == 1) {
+			peer_max_msg_size = coap_option_value_to_int(&option);
+		}
+
+		LOG_DBG("CSM received, max message size %d",
+			peer_max_msg_size);
+		break;
+	case COAP_TCP_SIGNAL_PING:
+		token_len = coap_header_get_token(signal, token);
+
+		k_mutex_lock(&coap_buf_lock, K_FOREVER);
+		(void)coap_signal_send(COAP_TCP_SIGNAL_PONG, token, token_len);
+		k_mutex_unlock(&coap_buf_lock);
+		break;
+	case COAP_TCP_SIGNAL_PONG:
+		LOG_DBG("CoAP PONG received");
+		break;
+	default:
+		LOG_DBG("CoAP signal 7.%02d received",
+			coap_header_get_code(signal) & 0x1F);
+		break;
+	}
+}
+#endif
+
+static int ping_send(void)
+{
+	int err;
+
+	app_trace_ping(APP_TRACE_BACKEND_COAP);
 
-	next_token = 0;
+#if defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
+	err = coap_signal_send(COAP_TCP_SIGNAL_PING, NULL, 0);
+#else
+	struct coap_packet ping;
 
-	err = coap_packet_init(&ping, coap_buf, sizeof(coap_buf),
+	err = coap_packet_init(&ping, COAP_MSG_BUF, COAP_MSG_BUF_LEN,
 			       APP_COAP_VERSION, COAP_TYPE_CON,
 			       0, NULL, 0, coap_next_id());
 	if (err < 0) {
@@ -93,155 +263,629 @@ int coap_backend_ping(void)
 		return err;
 	}
 
-	err = send(client_fd, ping.data, ping.offset, 0);
+	err = coap_packet_send(&ping);
+#endif
 	if (err < 0) {
-		LOG_ERR("Failed to send CoAP PING, %d", errno);
-		return -errno;
+		LOG_ERR("Failed to send CoAP PING, %d", err);
+		return err;
 	}
 
-	LOG_DBG("CoAP PING sent: token 0x%04x", next_token);
+	LOG_DBG("CoAP PING sent");
 
 	return 0;
 }
 
-int coap_backend_input(void)
+int coap_backend_ping(void)
 {
-	int err, received;
-	struct coap_packet reply;
-	const u8_t *payload;
-	u16_t payload_len;
-	u8_t token[8];
-	u16_t token_len;
-	u8_t temp_buf[16];
+	int err;
 
-	received = recv(client_fd, coap_buf, sizeof(coap_buf), MSG_DONTWAIT);
-	if (received == EAGAIN || received == EWOULDBLOCK) {
-		LOG_DBG("socket EAGAIN");
-		goto exit;
-	} else if (received < 0) {
-		LOG_DBG("Socket error, exit...");
+	k_mutex_lock(&coap_buf_lock, K_FOREVER);
+	err = ping_send();
+	k_mutex_unlock(&coap_buf_lock);
+
+	return err;
+}
+
+int coap_backend_keepalive_time_left(void)
+{
+	/* Counted from the last message sent rather than from the call, so
+	 * that input on another backend polled alongside does not put the
+	 * ping off indefinitely.
+	 */
+	s64_t left = last_tx + K_SECONDS(CONFIG_COAP_BACKEND_KEEPALIVE) -
+		     k_uptime_get();
+
+	return MAX(left, 0);
+}
+
+static void coap_backend_error_notify(void)
+{
 #if defined(CONFIG_CLOUD_API)
-		struct cloud_event error_event = {
-			.type = CLOUD_EVT_ERROR,
-		};
-		cloud_notify_event(coap_backend, &error_event, NULL);
+	struct cloud_event error_event = {
+		.type = CLOUD_EVT_ERROR,
+	};
+	cloud_notify_event(coap_backend, &error_event, NULL);
 #else
-		struct coap_backend_event error_evt = {
-			.type = COAP_BACKEND_EVT_ERROR,
-		};
-		coap_backend_notify_event(&error_evt);
-		return -ESOCKTNOSUPPORT;
+	struct coap_backend_event error_evt = {
+		.type = COAP_BACKEND_EVT_ERROR,
+	};
+	coap_backend_notify_event(&error_evt);
 #endif
+}
+
+static void coap_backend_data_notify(const u8_t *payload, u16_t len)
+{
+#if defined(CONFIG_CLOUD_API)
+	struct cloud_event data_event = {
+		.type = CLOUD_EVT_DATA_RECEIVED,
+		.data.msg.buf = (char *)payload,
+		.data.msg.len = len,
+	};
+	cloud_notify_event(coap_backend, &data_event, NULL);
+#else
+	struct coap_backend_event data_evt = {
+		.type = COAP_BACKEND_EVT_DATA_RECEIVED,
+		.ptr = (char *)payload,
+		.len = len,
+	};
+	coap_backend_notify_event(&data_evt);
+#endif
+}
+
+#if defined(CONFIG_COAP_BACKEND_FOTA)
+static int fota_block_request(u32_t image_id, size_t offset)
+{
+	int err;
+	struct coap_packet request;
+	char query[sizeof("id=4294967295")];
+	u32_t num = offset / FOTA_BLOCK_SIZE(fota_szx);
+
+	fota_token = sys_rand32_get();
+	fota_image_id = image_id;
+
+	err = coap_packet_init(&request, COAP_MSG_BUF, COAP_MSG_BUF_LEN,
+			       APP_COAP_VERSION, COAP_TYPE_NON_CON,
+			       sizeof(fota_token), (u8_t *)&fota_token,
+			       COAP_METHOD_GET, coap_next_id());
+	if (err < 0) {
+		LOG_ERR("Failed to create CoAP request, %d", err);
+		return err;
 	}
 
-	if (received == 0) {
-		LOG_ERR("Empty datagram");
-		goto exit;
+	err = coap_packet_append_option(&request, COAP_OPTION_URI_PATH,
+				(u8_t *)CONFIG_COAP_BACKEND_FOTA_RESOURCE,
+				strlen(CONFIG_COAP_BACKEND_FOTA_RESOURCE));
+	if (err < 0) {
+		LOG_ERR("Failed to encode CoAP option, %d", err);
+		return err;
 	}
 
-	err = coap_packet_parse(&reply, coap_buf, received, NULL, 0);
+	snprintf(query, sizeof(query), "id=%u", image_id);
+
+	err = coap_packet_append_option(&request, COAP_OPTION_URI_QUERY,
+					(u8_t *)query, strlen(query));
 	if (err < 0) {
-		LOG_ERR("Malformed response received: %d", err);
+		LOG_ERR("Failed to encode CoAP option, %d", err);
+		return err;
+	}
+
+	/* Block2 value: NUM, M = 0 in requests, SZX. */
+	err = coap_append_option_int(&request, COAP_OPTION_BLOCK2,
+				     (num << 4) | fota_szx);
+	if (err < 0) {
+		LOG_ERR("Failed to encode CoAP option, %d", err);
+		return err;
+	}
+
+	/* An empty Size2 in the first request asks for the image size. */
+	if (num == 0) {
+		err = coap_append_option_int(&request, COAP_OPTION_SIZE2, 0);
+		if (err < 0) {
+			LOG_ERR("Failed to encode CoAP option, %d", err);
+			return err;
+		}
+	}
+
+	err = coap_packet_send(&request);
+	if (err < 0) {
+		LOG_ERR("Failed to send FOTA block request, %d", err);
+		return err;
+	}
+
+	LOG_DBG("FOTA block %d requested: token 0x%04x", num, fota_token);
+
+	return 0;
+}
+
+static int fota_request(u32_t image_id, size_t offset)
+{
+	int err;
+
+	k_mutex_lock(&coap_buf_lock, K_FOREVER);
+	err = fota_block_request(image_id, offset);
+	k_mutex_unlock(&coap_buf_lock);
+
+	return err;
+}
+
+static void fota_response_handle(const struct coap_packet *reply,
+				 const u8_t *payload, u16_t payload_len)
+{
+	int block2, size2;
+	u8_t szx;
+
+	if (coap_header_get_code(reply) != COAP_RESPONSE_CODE_CONTENT) {
+		LOG_ERR("FOTA block request failed, code: 0x%x",
+			coap_header_get_code(reply));
+		return;
+	}
+
+	/* A response without Block2 carries the complete image. */
+	block2 = coap_get_option_int(reply, COAP_OPTION_BLOCK2);
+	size2 = coap_get_option_int(reply, COAP_OPTION_SIZE2);
+
+	if (block2 < 0) {
+		(void)fota_dl_block_received(fota_image_id, 0, payload,
+					     payload_len, MAX(size2, 0), true);
+		return;
+	}
+
+	szx = block2 & 0x07;
+	fota_szx = MIN(szx, fota_szx);
+
+	(void)fota_dl_block_received(fota_image_id,
+				     (block2 >> 4) * FOTA_BLOCK_SIZE(szx),
+				     payload, payload_len, MAX(size2, 0),
+				     !(block2 & 0x08));
+}
+
+static void fota_done(int result)
+{
+	if (result) {
+		return;
+	}
+
 #if defined(CONFIG_CLOUD_API)
-		struct cloud_event error_event = {
-			.type = CLOUD_EVT_ERROR,
-		};
-		cloud_notify_event(coap_backend, &error_event, NULL);
+	struct cloud_event fota_event = {
+		.type = CLOUD_EVT_FOTA_DONE,
+	};
+	cloud_notify_event(coap_backend, &fota_event, NULL);
 #else
-		struct coap_backend_event error_evt = {
-			.type = COAP_BACKEND_EVT_ERROR,
-		};
-		coap_backend_notify_event(&error_evt);
-		return -ESOCKTNOSUPPORT;
+	struct coap_backend_event fota_evt = {
+		.type = COAP_BACKEND_EVT_FOTA_DONE,
+	};
+	coap_backend_notify_event(&fota_evt);
+#endif
+}
+
+static const struct fota_dl_transport fota_transport = {
+	.request = fota_request,
+	.done = fota_done,
+};
 #endif
+
+static int coap_message_handle(u8_t *data, size_t len)
+{
+	int err;
+	struct coap_packet reply;
+	const u8_t *payload;
+	u16_t payload_len;
+	u8_t token[8] = { 0 };
+	u16_t token_len;
+	u8_t temp_buf[16];
+
+	err = coap_packet_parse(&reply, data, len, NULL, 0);
+	if (err < 0) {
+		LOG_ERR("Malformed response received: %d", err);
+		coap_backend_error_notify();
+		return -ESOCKTNOSUPPORT;
 	}
 
+#if defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
+	if ((coap_header_get_code(&reply) >> 5) == 7) {
+		coap_signal_handle(&reply);
+		return 0;
+	}
+#endif
+
+#if defined(CONFIG_COAP_BACKEND_OSCORE)
+	if (coap_header_get_code(&reply) != COAP_CODE_EMPTY) {
+		u8_t inner_code;
+
+		k_mutex_lock(&coap_buf_lock, K_FOREVER);
+		err = oscore_unprotect(&reply, &inner_code, &payload,
+				       &payload_len);
+		if ((err == 0) && (payload_len > 0)) {
+			u8_t *plaintext;
+			u16_t ciphertext_len;
+
+			/* The plaintext is in the OSCORE scratch buffer, which
+			 * the next request overwrites. It is moved over the
+			 * longer ciphertext, in the receive buffer.
+			 */
+			plaintext = (u8_t *)coap_packet_get_payload(&reply,
+							&ciphertext_len);
+			memcpy(plaintext, payload, payload_len);
+			payload = plaintext;
+		}
+		k_mutex_unlock(&coap_buf_lock);
+		if (err) {
+			LOG_WRN("Unverified response dropped, %d", err);
+			return 0;
+		}
+
+		LOG_DBG("OSCORE inner response code: 0x%x", inner_code);
+	} else {
+		payload = NULL;
+		payload_len = 0;
+	}
+#else
 	payload = coap_packet_get_payload(&reply, &payload_len);
+#endif
 	token_len = coap_header_get_token(&reply, token);
 
-	if ((token_len != sizeof(next_token)) &&
+#if defined(CONFIG_COAP_BACKEND_FOTA)
+	if ((token_len == sizeof(fota_token)) &&
+	    (memcmp(&fota_token, token, sizeof(fota_token)) == 0)) {
+		fota_response_handle(&reply, payload, payload_len);
+		return 0;
+	}
+#endif
+
+	if ((token_len != sizeof(next_token)) ||
 	    (memcmp(&next_token, token, sizeof(next_token)) != 0)) {
 		LOG_DBG("Invalid token received: 0x%02x%02x",
 		       token[1], token[0]);
-		goto exit;
+		return 0;
 	}
 
+	app_trace_publish_ack(APP_TRACE_BACKEND_COAP, next_token);
+
 	// snprintf(temp_buf, MAX(payload_len, sizeof(temp_buf)), "%s", payload);
 
 	LOG_DBG("CoAP response: code: 0x%x, token 0x%02x%02x, payload: %s\n",
 	       coap_header_get_code(&reply), token[1], token[0], temp_buf);
 
-exit:
+	if ((payload != NULL) && (payload_len > 0)) {
+		coap_backend_data_notify(payload, payload_len);
+	}
+
 	return 0;
 }
 
-int coap_backend_send(const struct coap_backend_tx_data *const tx_data)
+#if defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
+static int input(void)
+{
+	int err, received;
+	size_t frame_len, msg_offset, msg_len;
+
+	received = recv(client_fd, stream_buf + COAP_TCP_HEADROOM + stream_len,
+			sizeof(stream_buf) - COAP_TCP_HEADROOM - stream_len,
+			MSG_DONTWAIT);
+	if ((received < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		LOG_DBG("socket EAGAIN");
+		return 0;
+	} else if (received <= 0) {
+		LOG_DBG("Socket error, exit...");
+		coap_backend_error_notify();
+		return -ESOCKTNOSUPPORT;
+	}
+
+	stream_len += received;
+
+	while (true) {
+		frame_len = coap_tcp_frame_len(stream_buf + COAP_TCP_HEADROOM,
+					       stream_len);
+		if (frame_len == 0) {
+			break;
+		}
+
+		if (frame_len > sizeof(stream_buf) - COAP_TCP_HEADROOM) {
+			LOG_ERR("Frame of %d bytes exceeds receive buffer",
+				frame_len);
+			stream_len = 0;
+			coap_backend_error_notify();
+			return -EMSGSIZE;
+		}
+
+		if (frame_len > stream_len) {
+			break;
+		}
+
+		err = coap_tcp_unframe(stream_buf, frame_len, &msg_offset,
+				       &msg_len);
+		if (err == 0) {
+			(void)coap_message_handle(stream_buf + msg_offset,
+						  msg_len);
+		} else {
+			LOG_ERR("Malformed frame received: %d", err);
+		}
+
+		stream_len -= frame_len;
+		memmove(stream_buf + COAP_TCP_HEADROOM,
+			stream_buf + COAP_TCP_HEADROOM + frame_len,
+			stream_len);
+	}
+
+	return 0;
+}
+#else
+static int input(void)
+{
+	int received;
+
+	received = recv(client_fd, rx_buf, sizeof(rx_buf), MSG_DONTWAIT);
+	if ((received < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		LOG_DBG("socket EAGAIN");
+		return 0;
+	} else if (received < 0) {
+		LOG_DBG("Socket error, exit...");
+		coap_backend_error_notify();
+		return -ESOCKTNOSUPPORT;
+	}
+
+	if (received == 0) {
+		LOG_ERR("Empty datagram");
+		return 0;
+	}
+
+	return coap_message_handle(rx_buf, received);
+}
+#endif
+
+int coap_backend_input(void)
+{
+	/* Received data is not in coap_buf, the lock is only taken for what
+	 * is shared with the senders so that the handlers can send.
+	 */
+	return input();
+}
+
+#if !defined(CONFIG_COAP_BACKEND_OSCORE)
+static int write_begin(struct coap_backend_writer *writer,
+		       const char *resource, size_t len)
 {
 	int err;
-	struct coap_packet request;
 
-	struct coap_backend_tx_data tx_data_send = {
-		.str = tx_data->str,
-		.len = tx_data->len
-	};
+	k_mutex_lock(&coap_buf_lock, K_FOREVER);
 
 	next_token++;
 
-	err = coap_packet_init(&request, coap_buf, sizeof(coap_buf),
+	app_trace_publish_encode(APP_TRACE_BACKEND_COAP, next_token, len);
+	tx_encode_start = perf_budget_encode_start();
+
+	/* The token binds the response, a downlink command, to the request. */
+	err = coap_packet_init(&tx_request, COAP_MSG_BUF, COAP_MSG_BUF_LEN,
 			       APP_COAP_VERSION, COAP_TYPE_NON_CON,
-			       0, NULL, COAP_METHOD_PUT, coap_next_id());
+			       sizeof(next_token), (u8_t *)&next_token,
+			       COAP_METHOD_PUT, coap_next_id());
 	if (err < 0) {
 		LOG_ERR("Failed to create CoAP request, %d", err);
-		return err;
+		goto error;
 	}
 
-	err = coap_packet_append_option(&request, COAP_OPTION_URI_PATH,
-					(u8_t *)CONFIG_COAP_BACKEND_RESOURCE,
-					strlen(CONFIG_COAP_BACKEND_RESOURCE));
+	err = coap_packet_append_option(&tx_request, COAP_OPTION_URI_PATH,
+					(u8_t *)resource, strlen(resource));
 	if (err < 0) {
 		LOG_ERR("Failed to encode CoAP option, %d", err);
-		return err;
+		goto error;
 	}
 
-	err = coap_packet_append_payload_marker(&request);
+	err = coap_packet_append_payload_marker(&tx_request);
 	if (err < 0) {
 		LOG_ERR("Failed to encode CoAP payload marker, %d", err);
-		return err;
+		goto error;
+	}
+
+	writer->buf = tx_request.data + tx_request.offset;
+	writer->size = tx_request.max_len - tx_request.offset;
+
+	return 0;
+
+error:
+	k_mutex_unlock(&coap_buf_lock);
+
+	return err;
+}
+#endif
+
+int coap_backend_write_begin(struct coap_backend_writer *writer,
+			     const char *resource)
+{
+#if defined(CONFIG_COAP_BACKEND_OSCORE)
+	/* The payload is encrypted into the message by coap_backend_send(). */
+	return -ENOTSUP;
+#else
+	return write_begin(writer, resource ? resource :
+			   CONFIG_COAP_BACKEND_RESOURCE, 0);
+#endif
+}
+
+int coap_backend_write_end(size_t len)
+{
+	int err;
+
+	if (len > tx_request.max_len - tx_request.offset) {
+		err = -EMSGSIZE;
+		goto exit;
 	}
 
-	err = coap_packet_append_payload(&request, tx_data_send.str,
-					 tx_data_send.len);
+	/* The payload marker is not sent without a payload. */
+	if (len == 0) {
+		tx_request.offset--;
+	} else {
+		tx_request.offset += len;
+	}
+
+	perf_budget_encode_end(tx_encode_start, tx_request.offset);
+
+	err = coap_packet_send(&tx_request);
+
+	app_trace_publish_write(APP_TRACE_BACKEND_COAP, next_token,
+				MIN(err, 0));
+
 	if (err < 0) {
-		LOG_ERR("Failed to encode CoAP payload, %d", err);
-		return err;
+		LOG_ERR("Failed to send CoAP request, %d", err);
+		goto exit;
 	}
 
-	err = send(client_fd, request.data, request.offset, 0);
+	LOG_DBG("CoAP request sent: token 0x%04x", next_token);
+
+exit:
+	k_mutex_unlock(&coap_buf_lock);
+
+	return err;
+}
+
+void coap_backend_write_abort(void)
+{
+	k_mutex_unlock(&coap_buf_lock);
+}
+
+int coap_backend_send(const struct coap_backend_tx_data *const tx_data)
+{
+	int err;
+	const char *resource = tx_data->resource ? tx_data->resource :
+			       CONFIG_COAP_BACKEND_RESOURCE;
+#if defined(CONFIG_COAP_BACKEND_OSCORE)
+	struct coap_packet request;
+	u32_t encode_start;
+
+	k_mutex_lock(&coap_buf_lock, K_FOREVER);
+
+	next_token++;
+
+	app_trace_publish_encode(APP_TRACE_BACKEND_COAP, next_token,
+				 tx_data->len);
+	encode_start = perf_budget_encode_start();
+
+	/* The token binds the protected response to this request. */
+	err = oscore_protect(&request, COAP_MSG_BUF, COAP_MSG_BUF_LEN,
+			     (u8_t *)&next_token, sizeof(next_token),
+			     COAP_METHOD_PUT, resource,
+			     tx_data->str, tx_data->len);
 	if (err < 0) {
-		LOG_ERR("Failed to send CoAP request, %d", errno);
-		return -errno;
+		LOG_ERR("Failed to protect CoAP request, %d", err);
+		goto exit;
+	}
+
+	perf_budget_encode_end(encode_start, request.offset);
+
+	err = coap_packet_send(&request);
+
+	app_trace_publish_write(APP_TRACE_BACKEND_COAP, next_token,
+				MIN(err, 0));
+
+	if (err < 0) {
+		LOG_ERR("Failed to send CoAP request, %d", err);
+		goto exit;
 	}
 
 	LOG_DBG("CoAP request sent: token 0x%04x", next_token);
 
-	return 0;
+exit:
+	k_mutex_unlock(&coap_buf_lock);
+
+	return err;
+#else
+	struct coap_backend_writer writer;
+
+	err = write_begin(&writer, resource, tx_data->len);
+	if (err) {
+		return err;
+	}
+
+	if (tx_data->len > writer.size) {
+		LOG_ERR("Payload of %d bytes does not fit", tx_data->len);
+		coap_backend_write_abort();
+		return -EMSGSIZE;
+	}
+
+	memcpy(writer.buf, tx_data->str, tx_data->len);
+
+	return coap_backend_write_end(tx_data->len);
+#endif
 }
 
 int coap_backend_disconnect(void)
 {
+	endpoint_disconnected(&endpoints);
+
 	return close(client_fd);
 }
 
 
+#if defined(CONFIG_COAP_BACKEND_DTLS_ENABLE) || \
+	defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
+static int socket_security_configure(int fd)
+{
+	int ret;
+	sec_tag_t tls_tag_list[] = {
+		CONFIG_COAP_BACKEND_SEC_TAG,
+	};
+#if defined(CONFIG_COAP_BACKEND_TLS_CREDENTIALS_PSK)
+	/* Both ends are authenticated by the pre-shared key. */
+	int peer_verify = TLS_PEER_VERIFY_NONE;
+#else
+	int peer_verify = TLS_PEER_VERIFY_REQUIRED;
+#endif
+
+	ret = setsockopt(fd, SOL_TLS, TLS_SEC_TAG_LIST,
+			 tls_tag_list, sizeof(tls_tag_list));
+	if (ret < 0) {
+		LOG_ERR("Failed to set TLS_SEC_TAG_LIST option: %d", errno);
+		return ret;
+	}
+
+	ret = setsockopt(fd, SOL_TLS, TLS_PEER_VERIFY,
+			 &peer_verify, sizeof(peer_verify));
+	if (ret < 0) {
+		LOG_ERR("Failed to set TLS_PEER_VERIFY option: %d", errno);
+		return ret;
+	}
+
+#if !defined(CONFIG_COAP_BACKEND_TLS_CIPHERSUITES_DEFAULT)
+	ret = setsockopt(fd, SOL_TLS, TLS_CIPHERSUITE_LIST,
+			 cipher_list, sizeof(cipher_list));
+	if (ret < 0) {
+		LOG_ERR("Failed to set TLS_CIPHERSUITE_LIST option: %d", errno);
+		return ret;
+	}
+#endif
+
+	return 0;
+}
+#endif
+
 int coap_backend_connect(struct coap_backend_config *const config)
 {
 	int ret = 0;
+	s64_t connect_start;
 
-#if defined(CONFIG_COAP_BACKEND_DTLS_ENABLE)
+#if defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
 
-	sec_tag_t tls_tag_list[] = {
-		CONFIG_COAP_BACKEND_SEC_TAG,
-	};
+	client_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TLS_1_2);
+	if (client_fd < 0) {
+		LOG_ERR("Failed to create CoAP socket: %d.", errno);
+		return -errno;
+	}
+
+	ret = socket_security_configure(client_fd);
+	if (ret < 0) {
+		goto error;
+	}
+
+#if !defined(CONFIG_COAP_BACKEND_TLS_CREDENTIALS_RAW_PUBLIC_KEY)
+	/* With raw public keys the server is identified by its pinned key. */
+	ret = setsockopt(client_fd, SOL_TLS, TLS_HOSTNAME, server_host,
+			 strlen(server_host));
+	if (ret < 0) {
+		LOG_ERR("Failed to set TLS_HOSTNAME option: %d", errno);
+		goto error;
+	}
+#endif
+
+#elif defined(CONFIG_COAP_BACKEND_DTLS_ENABLE)
 
 	client_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_DTLS_1_2);
 	if (client_fd < 0) {
@@ -249,10 +893,8 @@ int coap_backend_connect(struct coap_backend_config *const config)
 		return -errno;
 	}
 
-	ret = setsockopt(client_fd, SOL_TLS, TLS_SEC_TAG_LIST,
-			 tls_tag_list, sizeof(tls_tag_list));
+	ret = socket_security_configure(client_fd);
 	if (ret < 0) {
-		LOG_ERR("Failed to set TLS_SEC_TAG_LIST option: %d", errno);
 		goto error;
 	}
 
@@ -264,6 +906,8 @@ int coap_backend_connect(struct coap_backend_config *const config)
 	}
 #endif
 
+	connect_start = k_uptime_get();
+
 	ret = connect(client_fd, (struct sockaddr *)&host_addr,
 		      sizeof(struct sockaddr_in));
 	if (ret < 0) {
@@ -271,15 +915,48 @@ int coap_backend_connect(struct coap_backend_config *const config)
 		goto error;
 	}
 
+	/* For secure transports this covers the complete handshake. */
+	LOG_DBG("Connected to server in %d ms",
+		(int)(k_uptime_get() - connect_start));
+
+	last_tx = k_uptime_get();
+
+	app_trace_connect_phase(APP_TRACE_BACKEND_COAP,
+				APP_TRACE_CONNECT_TRANSPORT, 0);
+
+#if defined(CONFIG_COAP_BACKEND_TRANSPORT_TLS)
+	stream_len = 0;
+	peer_max_msg_size = COAP_TCP_DEFAULT_MAX_MSG_SIZE;
+
+	/* Both ends must send a CSM as their first message. */
+	ret = coap_signal_send(COAP_TCP_SIGNAL_CSM, NULL, 0);
+	if (ret < 0) {
+		LOG_ERR("Failed to send CSM: %d", ret);
+		errno = -ret;
+		goto error;
+	}
+#endif
+
 #if !defined(CONFIG_CLOUD_API)
 	config->socket = client_fd;
 #endif
 
 	next_token = sys_rand32_get();
 
+	/* Plain UDP has no handshake to time. */
+	endpoint_connected(&endpoints,
+			   IS_ENABLED(CONFIG_COAP_BACKEND_DTLS_ENABLE) ||
+			   IS_ENABLED(CONFIG_COAP_BACKEND_TRANSPORT_TLS));
+
+	app_trace_connect_phase(APP_TRACE_BACKEND_COAP,
+				APP_TRACE_CONNECT_READY, 0);
+
 	return 0;
 
 error:
+	app_trace_connect_phase(APP_TRACE_BACKEND_COAP,
+				APP_TRACE_CONNECT_FAILED, -errno);
+	endpoint_failed(&endpoints);
 	(void)close(client_fd);
 	return -errno;
 }
@@ -287,7 +964,34 @@ error:
 int coap_backend_init(const struct coap_backend_config *const config,
 		      coap_backend_evt_handler_t event_handler)
 {
-	return server_resolve();
+	int err;
+
+	app_trace_connect_phase(APP_TRACE_BACKEND_COAP,
+				APP_TRACE_CONNECT_START, 0);
+
+#if !defined(CONFIG_CLOUD_API)
+	module_evt_handler = event_handler;
+#endif
+
+#if defined(CONFIG_COAP_BACKEND_OSCORE)
+	err = oscore_init();
+	if (err) {
+		LOG_ERR("oscore_init, error: %d", err);
+		return err;
+	}
+#endif
+
+#if defined(CONFIG_COAP_BACKEND_FOTA)
+	fota_dl_transport_set(&fota_transport);
+#endif
+
+	err = server_resolve();
+
+	app_trace_connect_phase(APP_TRACE_BACKEND_COAP,
+				err ? APP_TRACE_CONNECT_FAILED :
+				      APP_TRACE_CONNECT_RESOLVED, err);
+
+	return err;
 }
 
 #if defined(CONFIG_CLOUD_API)
@@ -343,6 +1047,10 @@ static int c_send(const struct cloud_backend *const backend,
 		.len = msg->len,
 	};
 
+	if (msg->endpoint.type == CLOUD_EP_TOPIC_STATE) {
+		tx_data.resource = CONFIG_COAP_BACKEND_STATE_RESOURCE;
+	}
+
 	return coap_backend_send(&tx_data);
 }
 
@@ -358,7 +1066,7 @@ static int c_ping(const struct cloud_backend *const backend)
 
 static int c_keepalive_time_left(const struct cloud_backend *const backend)
 {
-	return K_SECONDS(CONFIG_COAP_BACKEND_KEEPALIVE);
+	return coap_backend_keepalive_time_left();
 }
 
 static const struct cloud_api coap_backend_api = {
@@ -11,6 +11,7 @@
 #ifndef COAP_BACKEND_H__
 #define COAP_BACKEND_H__
 
+#include <zephyr/types.h>
 #include <stdio.h>
 
 /**
@@ -55,6 +56,18 @@ struct coap_backend_tx_data {
 	char *str;
 	/** Length of message. */
 	size_t len;
+	/** Resource the message is sent to, CONFIG_COAP_BACKEND_RESOURCE
+	 *  if NULL.
+	 */
+	const char *resource;
+};
+
+/** @brief Payload writer, see coap_backend_write_begin(). */
+struct coap_backend_writer {
+	/** Where the payload is written, in the message buffer. */
+	u8_t *buf;
+	/** Room for the payload. */
+	size_t size;
 };
 
 /** @brief CoAP library asynchronous event handler.
@@ -115,6 +128,41 @@ int coap_backend_disconnect(void);
  */
 int coap_backend_send(const struct coap_backend_tx_data *const tx_data);
 
+/** @brief Start a request whose payload is written in place.
+ *
+ *  The header and options of the request are encoded into the message
+ *  buffer of the backend, the payload is then written by the caller
+ *  directly after them. This saves copying it as coap_backend_send() does.
+ *  Other requests wait until coap_backend_write_end() or
+ *  coap_backend_write_abort() is called from the same thread.
+ *
+ *  @param[out] writer Where and how much payload can be written.
+ *  @param[in] resource Resource the request is sent to,
+ *                      CONFIG_COAP_BACKEND_RESOURCE if NULL.
+ *
+ *  @return 0 If successful.
+ *            -ENOTSUP with CONFIG_COAP_BACKEND_OSCORE, the payload is
+ *            encrypted into the message.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int coap_backend_write_begin(struct coap_backend_writer *writer,
+			     const char *resource);
+
+/** @brief Send the request started by coap_backend_write_begin().
+ *
+ *  With a stream transport, the length of the frame is filled in in place
+ *  in front of the message.
+ *
+ *  @param[in] len Length of the payload written.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int coap_backend_write_end(size_t len);
+
+/** @brief Abandon the request started by coap_backend_write_begin(). */
+void coap_backend_write_abort(void);
+
 /** @brief Get data from the UDP server.
  *
  *  @return 0 If successful.
@@ -130,6 +178,11 @@ int coap_backend_input(void);
  */
 int coap_backend_ping(void);
 
+/** @brief Get the time left until the server must be pinged.
+ *
+ *  @return Time in milliseconds, counted from the last message sent.
+ */
+int coap_backend_keepalive_time_left(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <coap_tcp.h>
+#include <net/coap.h>
+#include <errno.h>
+
+/* Version, type, token length, code and message ID. */
+#define COAP_UDP_HEADER_LEN 4
+#define COAP_TOKEN_MAX_LEN 8
+#define COAP_UDP_VERSION 1
+
+/* Offsets subtracted from the options and payload length when it does not
+ * fit in the 4-bit length nibble, RFC 8323 section 3.2.
+ */
+#define COAP_TCP_LEN_EXT8_BASE	13
+#define COAP_TCP_LEN_EXT16_BASE	269
+#define COAP_TCP_LEN_EXT32_BASE	65805
+
+static size_t ext_len_get(u8_t nibble)
+{
+	switch (nibble) {
+	case 13:
+		return 1;
+	case 14:
+		return 2;
+	case 15:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+int coap_tcp_frame(u8_t *buf, size_t len, size_t *frame_offset)
+{
+	u8_t *msg = buf + COAP_TCP_HEADROOM;
+	size_t body_len, ext_len, start;
+	u32_t ext_val;
+	u8_t tkl, code, nibble;
+
+	if (len < COAP_UDP_HEADER_LEN) {
+		return -EINVAL;
+	}
+
+	tkl = msg[0] & 0x0F;
+	if ((tkl > COAP_TOKEN_MAX_LEN) || (len < COAP_UDP_HEADER_LEN + tkl)) {
+		return -EINVAL;
+	}
+
+	code = msg[1];
+	body_len = len - COAP_UDP_HEADER_LEN - tkl;
+
+	if (body_len < COAP_TCP_LEN_EXT8_BASE) {
+		nibble = body_len;
+		ext_val = 0;
+	} else if (body_len < COAP_TCP_LEN_EXT16_BASE) {
+		nibble = 13;
+		ext_val = body_len - COAP_TCP_LEN_EXT8_BASE;
+	} else if (body_len < COAP_TCP_LEN_EXT32_BASE) {
+		nibble = 14;
+		ext_val = body_len - COAP_TCP_LEN_EXT16_BASE;
+	} else {
+		nibble = 15;
+		ext_val = body_len - COAP_TCP_LEN_EXT32_BASE;
+	}
+
+	ext_len = ext_len_get(nibble);
+
+	/* The frame header (length/TKL byte, extended length and code) is
+	 * written so that it ends right where the token already is. The token,
+	 * options and payload are left untouched.
+	 */
+	start = COAP_TCP_HEADROOM + 2 - ext_len;
+
+	buf[start] = (nibble << 4) | tkl;
+
+	for (size_t i = 0; i < ext_len; i++) {
+		buf[start + 1 + i] = ext_val >> (8 * (ext_len - 1 - i));
+	}
+
+	buf[start + 1 + ext_len] = code;
+
+	*frame_offset = start;
+
+	return 0;
+}
+
+size_t coap_tcp_frame_len(const u8_t *data, size_t len)
+{
+	size_t ext_len, body_len;
+	u32_t ext_val = 0;
+	u8_t nibble, tkl;
+
+	if (len < 1) {
+		return 0;
+	}
+
+	nibble = data[0] >> 4;
+	tkl = data[0] & 0x0F;
+	ext_len = ext_len_get(nibble);
+
+	if (len < 1 + ext_len) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < ext_len; i++) {
+		ext_val = (ext_val << 8) | data[1 + i];
+	}
+
+	switch (nibble) {
+	case 13:
+		body_len = ext_val + COAP_TCP_LEN_EXT8_BASE;
+		break;
+	case 14:
+		body_len = ext_val + COAP_TCP_LEN_EXT16_BASE;
+		break;
+	case 15:
+		/* Far beyond anything a constrained device can buffer, report
+		 * it as oversized instead of risking a wrap around.
+		 */
+		if (ext_val > 0x00FFFFFF) {
+			return SIZE_MAX;
+		}
+
+		body_len = ext_val + COAP_TCP_LEN_EXT32_BASE;
+		break;
+	default:
+		body_len = nibble;
+		break;
+	}
+
+	/* Length/TKL byte, extended length, code, token, options and
+	 * payload.
+	 */
+	return 1 + ext_len + 1 + tkl + body_len;
+}
+
+int coap_tcp_unframe(u8_t *buf, size_t frame_len, size_t *msg_offset,
+		     size_t *msg_len)
+{
+	u8_t *frame = buf + COAP_TCP_HEADROOM;
+	size_t ext_len, start;
+	u8_t tkl, code;
+
+	tkl = frame[0] & 0x0F;
+	ext_len = ext_len_get(frame[0] >> 4);
+
+	if ((tkl > COAP_TOKEN_MAX_LEN) || (frame_len < 2 + ext_len + tkl)) {
+		return -EBADMSG;
+	}
+
+	code = frame[1 + ext_len];
+
+	/* Place a 4 byte UDP header right in front of the token. Type and
+	 * message ID carry no meaning over a reliable transport.
+	 */
+	start = COAP_TCP_HEADROOM + ext_len - 2;
+
+	buf[start] = (COAP_UDP_VERSION << 6) | (COAP_TYPE_NON_CON << 4) | tkl;
+	buf[start + 1] = code;
+	buf[start + 2] = 0;
+	buf[start + 3] = 0;
+
+	*msg_offset = start;
+	*msg_len = frame_len - (2 + ext_len) + COAP_UDP_HEADER_LEN;
+
+	return 0;
+}
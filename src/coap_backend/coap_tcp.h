@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief CoAP over TCP/TLS (RFC 8323) framing helpers.
+ */
+
+#ifndef COAP_TCP_H__
+#define COAP_TCP_H__
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+/**
+ * @defgroup coap_tcp CoAP over TCP framing
+ * @{
+ * @brief Converts between the RFC 7252 message layout produced and consumed
+ *        by the Zephyr CoAP library and the RFC 8323 stream framing.
+ *
+ *        Both conversions are done in place. Messages are always encoded
+ *        and parsed with the regular CoAP API, only the fixed header in
+ *        front of the token is rewritten.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of bytes that must be reserved in front of a message buffer so
+ *  that it can be reframed in place in either direction.
+ */
+#define COAP_TCP_HEADROOM 2
+
+/** Default maximum message size assumed before the peer has sent its CSM. */
+#define COAP_TCP_DEFAULT_MAX_MSG_SIZE 1152
+
+/** Signaling codes, RFC 8323 section 5. */
+#define COAP_TCP_SIGNAL_CSM	0xE1
+#define COAP_TCP_SIGNAL_PING	0xE2
+#define COAP_TCP_SIGNAL_PONG	0xE3
+#define COAP_TCP_SIGNAL_RELEASE	0xE4
+#define COAP_TCP_SIGNAL_ABORT	0xE5
+
+/** CSM option numbers, RFC 8323 section 5.3. */
+#define COAP_TCP_OPTION_MAX_MESSAGE_SIZE	2
+#define COAP_TCP_OPTION_BLOCK_WISE_TRANSFER	4
+
+/** @brief Reframe a message encoded by the CoAP library for a stream
+ *         transport.
+ *
+ *  @param[in,out] buf Buffer holding the message at offset
+ *                     COAP_TCP_HEADROOM.
+ *  @param[in] len Length of the encoded message, excluding the headroom.
+ *  @param[out] frame_offset Offset into @p buf where the framed message
+ *                           starts. The frame ends at
+ *                           COAP_TCP_HEADROOM + @p len.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int coap_tcp_frame(u8_t *buf, size_t len, size_t *frame_offset);
+
+/** @brief Get the total length of the frame at the start of a stream
+ *         buffer.
+ *
+ *  @param[in] data Start of the received stream data.
+ *  @param[in] len Number of bytes available.
+ *
+ *  @return Length of the complete frame, 0 if more data is needed to
+ *          determine it.
+ */
+size_t coap_tcp_frame_len(const u8_t *data, size_t len);
+
+/** @brief Convert a received frame into a message that can be handed to
+ *         coap_packet_parse().
+ *
+ *  @param[in,out] buf Buffer holding the frame at offset COAP_TCP_HEADROOM.
+ *  @param[in] frame_len Length of the frame, as returned by
+ *                       coap_tcp_frame_len().
+ *  @param[out] msg_offset Offset into @p buf where the converted message
+ *                         starts.
+ *  @param[out] msg_len Length of the converted message.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int coap_tcp_unframe(u8_t *buf, size_t frame_len, size_t *msg_offset,
+		     size_t *msg_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* COAP_TCP_H__ */
@@ -0,0 +1,634 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <oscore.h>
+#include <zephyr.h>
+#include <string.h>
+#include <errno.h>
+#include <settings/settings.h>
+#include <tinycrypt/aes.h>
+#include <tinycrypt/ccm_mode.h>
+#include <tinycrypt/hmac.h>
+#include <tinycrypt/constants.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(coap_backend, CONFIG_COAP_BACKEND_LOG_LEVEL);
+
+#define OSCORE_COAP_VERSION 1
+
+/* AES-CCM-16-64-128, COSE algorithm 10. */
+#define OSCORE_ALG_AEAD		10
+#define OSCORE_KEY_LEN		16
+#define OSCORE_NONCE_LEN	13
+#define OSCORE_TAG_LEN		8
+
+#define OSCORE_ID_MAX_LEN	(OSCORE_NONCE_LEN - 6)
+#define OSCORE_PIV_MAX_LEN	5
+#define OSCORE_SECRET_MAX_LEN	32
+#define OSCORE_SSN_MAX		((1ULL << 40) - 1)
+
+#define OSCORE_FLAG_KID		BIT(3)
+#define OSCORE_FLAG_PIV_LEN	0x07
+
+#define OSCORE_PAYLOAD_MARKER	0xFF
+
+#define OSCORE_SETTINGS_NAME	"oscore"
+#define OSCORE_SETTINGS_SSN	"ssn"
+
+struct oscore_ctx {
+	u8_t sender_id[OSCORE_ID_MAX_LEN];
+	u8_t sender_id_len;
+	u8_t recipient_id[OSCORE_ID_MAX_LEN];
+	u8_t recipient_id_len;
+	u8_t sender_key[OSCORE_KEY_LEN];
+	u8_t recipient_key[OSCORE_KEY_LEN];
+	u8_t common_iv[OSCORE_NONCE_LEN];
+	/* Next sender sequence number. */
+	u64_t ssn;
+	/* Sequence numbers below this value are persisted as used. */
+	u64_t ssn_reserved;
+	/* Partial IV of the last request, responses are bound to it. */
+	u8_t req_piv[OSCORE_PIV_MAX_LEN];
+	u8_t req_piv_len;
+};
+
+static struct oscore_ctx ctx;
+static bool initialized;
+
+/* Holds the plaintext of outgoing requests and incoming responses. */
+static u8_t scratch[CONFIG_COAP_BACKEND_RX_TX_BUFFER_LEN];
+
+static int settings_set(const char *key, size_t len,
+			settings_read_cb read_cb, void *cb_arg)
+{
+	if (strcmp(key, OSCORE_SETTINGS_SSN) == 0) {
+		if (len != sizeof(ctx.ssn)) {
+			return -EINVAL;
+		}
+
+		if (read_cb(cb_arg, &ctx.ssn, sizeof(ctx.ssn)) < 0) {
+			return -EIO;
+		}
+
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+static struct settings_handler oscore_settings = {
+	.name = OSCORE_SETTINGS_NAME,
+	.h_set = settings_set,
+};
+
+static int hex_parse(const char *hex, u8_t *out, size_t out_size)
+{
+	size_t len = strlen(hex);
+
+	if ((len % 2) || (len / 2 > out_size)) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		char c = hex[i];
+		u8_t nibble;
+
+		if (c >= '0' && c <= '9') {
+			nibble = c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			nibble = c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			nibble = c - 'A' + 10;
+		} else {
+			return -EINVAL;
+		}
+
+		if (i % 2) {
+			out[i / 2] |= nibble;
+		} else {
+			out[i / 2] = nibble << 4;
+		}
+	}
+
+	return len / 2;
+}
+
+static int hkdf_sha256(const u8_t *salt, size_t salt_len,
+		       const u8_t *ikm, size_t ikm_len,
+		       const u8_t *info, size_t info_len,
+		       u8_t *out, size_t out_len)
+{
+	static const u8_t zero_salt[TC_SHA256_DIGEST_SIZE];
+	struct tc_hmac_state_struct hmac;
+	u8_t prk[TC_SHA256_DIGEST_SIZE];
+	u8_t okm[TC_SHA256_DIGEST_SIZE];
+	const u8_t counter = 1;
+
+	/* All OSCORE parameters fit in a single expand block. */
+	if (out_len > sizeof(okm)) {
+		return -EINVAL;
+	}
+
+	if (salt_len == 0) {
+		salt = zero_salt;
+		salt_len = sizeof(zero_salt);
+	}
+
+	if ((tc_hmac_set_key(&hmac, salt, salt_len) != TC_CRYPTO_SUCCESS) ||
+	    (tc_hmac_init(&hmac) != TC_CRYPTO_SUCCESS) ||
+	    (tc_hmac_update(&hmac, ikm, ikm_len) != TC_CRYPTO_SUCCESS) ||
+	    (tc_hmac_final(prk, sizeof(prk), &hmac) != TC_CRYPTO_SUCCESS)) {
+		return -EIO;
+	}
+
+	if ((tc_hmac_set_key(&hmac, prk, sizeof(prk)) != TC_CRYPTO_SUCCESS) ||
+	    (tc_hmac_init(&hmac) != TC_CRYPTO_SUCCESS) ||
+	    (tc_hmac_update(&hmac, info, info_len) != TC_CRYPTO_SUCCESS) ||
+	    (tc_hmac_update(&hmac, &counter, 1) != TC_CRYPTO_SUCCESS) ||
+	    (tc_hmac_final(okm, sizeof(okm), &hmac) != TC_CRYPTO_SUCCESS)) {
+		return -EIO;
+	}
+
+	memcpy(out, okm, out_len);
+
+	return 0;
+}
+
+/* CBOR encoded [id, id_context, alg_aead, type, L], RFC 8613 section 3.2.1.
+ * All lengths are below 24 so single byte CBOR headers suffice.
+ */
+static size_t info_encode(u8_t *buf, const u8_t *id, u8_t id_len,
+			  const char *type, u8_t out_len)
+{
+	size_t len = 0;
+	size_t type_len = strlen(type);
+
+	buf[len++] = 0x85;
+	buf[len++] = 0x40 | id_len;
+	memcpy(&buf[len], id, id_len);
+	len += id_len;
+	buf[len++] = 0xF6;
+	buf[len++] = OSCORE_ALG_AEAD;
+	buf[len++] = 0x60 | type_len;
+	memcpy(&buf[len], type, type_len);
+	len += type_len;
+	buf[len++] = out_len;
+
+	return len;
+}
+
+static int derive(const u8_t *secret, size_t secret_len,
+		  const u8_t *salt, size_t salt_len,
+		  const u8_t *id, u8_t id_len, const char *type,
+		  u8_t *out, u8_t out_len)
+{
+	u8_t info[1 + 1 + OSCORE_ID_MAX_LEN + 1 + 1 + 1 + 3 + 1];
+	size_t info_len = info_encode(info, id, id_len, type, out_len);
+
+	return hkdf_sha256(salt, salt_len, secret, secret_len,
+			   info, info_len, out, out_len);
+}
+
+/* CBOR encoded Enc_structure ["Encrypt0", h'', external_aad] where
+ * external_aad is [oscore_version, [alg_aead], request_kid, request_piv,
+ * options], RFC 8613 section 5.4.
+ */
+static size_t aad_encode(u8_t *buf, const u8_t *kid, u8_t kid_len,
+			 const u8_t *piv, u8_t piv_len)
+{
+	static const char context[] = "Encrypt0";
+	size_t ext_len = 7 + kid_len + piv_len;
+	size_t len = 0;
+
+	buf[len++] = 0x83;
+	buf[len++] = 0x60 | (sizeof(context) - 1);
+	memcpy(&buf[len], context, sizeof(context) - 1);
+	len += sizeof(context) - 1;
+	buf[len++] = 0x40;
+	buf[len++] = 0x40 | ext_len;
+
+	buf[len++] = 0x85;
+	buf[len++] = 0x01;
+	buf[len++] = 0x81;
+	buf[len++] = OSCORE_ALG_AEAD;
+	buf[len++] = 0x40 | kid_len;
+	memcpy(&buf[len], kid, kid_len);
+	len += kid_len;
+	buf[len++] = 0x40 | piv_len;
+	memcpy(&buf[len], piv, piv_len);
+	len += piv_len;
+	buf[len++] = 0x40;
+
+	return len;
+}
+
+static void nonce_build(u8_t *nonce, const u8_t *id, u8_t id_len,
+			const u8_t *piv, u8_t piv_len)
+{
+	memset(nonce, 0, OSCORE_NONCE_LEN);
+
+	nonce[0] = id_len;
+	memcpy(&nonce[1 + OSCORE_ID_MAX_LEN - id_len], id, id_len);
+	memcpy(&nonce[OSCORE_NONCE_LEN - piv_len], piv, piv_len);
+
+	for (size_t i = 0; i < OSCORE_NONCE_LEN; i++) {
+		nonce[i] ^= ctx.common_iv[i];
+	}
+}
+
+static u8_t piv_encode(u64_t ssn, u8_t *piv)
+{
+	u8_t len = 0;
+	u8_t tmp[OSCORE_PIV_MAX_LEN];
+
+	/* Network byte order without leading zeroes, 0 is encoded as 0x00. */
+	do {
+		tmp[len++] = ssn & 0xFF;
+		ssn >>= 8;
+	} while (ssn && (len < sizeof(tmp)));
+
+	for (u8_t i = 0; i < len; i++) {
+		piv[i] = tmp[len - 1 - i];
+	}
+
+	return len;
+}
+
+static int ssn_next(u64_t *ssn)
+{
+	int err;
+
+	if (ctx.ssn > OSCORE_SSN_MAX) {
+		LOG_ERR("OSCORE sequence numbers exhausted, re-key required");
+		return -ENOSPC;
+	}
+
+	if (ctx.ssn >= ctx.ssn_reserved) {
+		u64_t reserved = ctx.ssn +
+				 CONFIG_COAP_BACKEND_OSCORE_SEQ_PERSIST_INTERVAL;
+
+		err = settings_save_one(OSCORE_SETTINGS_NAME "/"
+					OSCORE_SETTINGS_SSN,
+					&reserved, sizeof(reserved));
+		if (err) {
+			LOG_ERR("Failed to persist OSCORE sequence number, %d",
+				err);
+			return err;
+		}
+
+		ctx.ssn_reserved = reserved;
+	}
+
+	*ssn = ctx.ssn++;
+
+	return 0;
+}
+
+static size_t option_field_encode(u16_t value, u8_t *nibble, u8_t *ext)
+{
+	if (value < 13) {
+		*nibble = value;
+		return 0;
+	} else if (value < 269) {
+		*nibble = 13;
+		ext[0] = value - 13;
+		return 1;
+	}
+
+	*nibble = 14;
+	ext[0] = (value - 269) >> 8;
+	ext[1] = (value - 269) & 0xFF;
+	return 2;
+}
+
+static size_t option_encode(u8_t *buf, u16_t delta, const u8_t *value,
+			    u16_t value_len)
+{
+	u8_t delta_nibble, len_nibble;
+	u8_t delta_ext[2], len_ext[2];
+	size_t delta_ext_len, len_ext_len;
+	size_t len = 0;
+
+	delta_ext_len = option_field_encode(delta, &delta_nibble, delta_ext);
+	len_ext_len = option_field_encode(value_len, &len_nibble, len_ext);
+
+	buf[len++] = (delta_nibble << 4) | len_nibble;
+	memcpy(&buf[len], delta_ext, delta_ext_len);
+	len += delta_ext_len;
+	memcpy(&buf[len], len_ext, len_ext_len);
+	len += len_ext_len;
+	memcpy(&buf[len], value, value_len);
+	len += value_len;
+
+	return len;
+}
+
+static int option_skip(const u8_t *buf, size_t len, size_t *offset)
+{
+	size_t i = *offset;
+	u8_t delta_nibble = buf[i] >> 4;
+	u8_t len_nibble = buf[i] & 0x0F;
+	size_t value_len;
+
+	i++;
+
+	if ((delta_nibble == 15) || (len_nibble == 15)) {
+		return -EBADMSG;
+	}
+
+	i += (delta_nibble == 13) ? 1 : (delta_nibble == 14) ? 2 : 0;
+
+	if (len_nibble == 13) {
+		if (i + 1 > len) {
+			return -EBADMSG;
+		}
+
+		value_len = buf[i] + 13;
+		i += 1;
+	} else if (len_nibble == 14) {
+		if (i + 2 > len) {
+			return -EBADMSG;
+		}
+
+		value_len = ((buf[i] << 8) | buf[i + 1]) + 269;
+		i += 2;
+	} else {
+		value_len = len_nibble;
+	}
+
+	if (i + value_len > len) {
+		return -EBADMSG;
+	}
+
+	*offset = i + value_len;
+
+	return 0;
+}
+
+int oscore_protect(struct coap_packet *request, u8_t *buf, size_t buf_len,
+		   const u8_t *token, u8_t token_len, u8_t code,
+		   const char *uri_path, const u8_t *payload,
+		   size_t payload_len)
+{
+	int err;
+	u64_t ssn;
+	u8_t nonce[OSCORE_NONCE_LEN];
+	u8_t aad[32];
+	u8_t option[1 + OSCORE_PIV_MAX_LEN + OSCORE_ID_MAX_LEN];
+	size_t aad_len, plain_len = 0, option_len = 0;
+	size_t uri_path_len = strlen(uri_path);
+	struct tc_aes_key_sched_struct sched;
+	struct tc_ccm_mode_struct ccm;
+
+	/* Inner code, Uri-Path with up to 3 bytes of option header, payload
+	 * marker and payload.
+	 */
+	if (1 + 3 + uri_path_len + 1 + payload_len > sizeof(scratch)) {
+		return -EMSGSIZE;
+	}
+
+	err = ssn_next(&ssn);
+	if (err) {
+		return err;
+	}
+
+	ctx.req_piv_len = piv_encode(ssn, ctx.req_piv);
+
+	scratch[plain_len++] = code;
+	plain_len += option_encode(&scratch[plain_len], COAP_OPTION_URI_PATH,
+				   (const u8_t *)uri_path, uri_path_len);
+
+	if (payload_len > 0) {
+		scratch[plain_len++] = OSCORE_PAYLOAD_MARKER;
+		memcpy(&scratch[plain_len], payload, payload_len);
+		plain_len += payload_len;
+	}
+
+	option[option_len++] = OSCORE_FLAG_KID | ctx.req_piv_len;
+	memcpy(&option[option_len], ctx.req_piv, ctx.req_piv_len);
+	option_len += ctx.req_piv_len;
+	memcpy(&option[option_len], ctx.sender_id, ctx.sender_id_len);
+	option_len += ctx.sender_id_len;
+
+	err = coap_packet_init(request, buf, buf_len, OSCORE_COAP_VERSION,
+			       COAP_TYPE_NON_CON, token_len, (u8_t *)token,
+			       COAP_METHOD_POST, coap_next_id());
+	if (err < 0) {
+		return err;
+	}
+
+	err = coap_packet_append_option(request, OSCORE_OPTION_NUMBER,
+					option, option_len);
+	if (err < 0) {
+		return err;
+	}
+
+	err = coap_packet_append_payload_marker(request);
+	if (err < 0) {
+		return err;
+	}
+
+	if (request->max_len - request->offset < plain_len + OSCORE_TAG_LEN) {
+		return -EMSGSIZE;
+	}
+
+	nonce_build(nonce, ctx.sender_id, ctx.sender_id_len,
+		    ctx.req_piv, ctx.req_piv_len);
+	aad_len = aad_encode(aad, ctx.sender_id, ctx.sender_id_len,
+			     ctx.req_piv, ctx.req_piv_len);
+
+	/* The ciphertext is written straight into the outer payload. */
+	if ((tc_aes128_set_encrypt_key(&sched, ctx.sender_key) !=
+	     TC_CRYPTO_SUCCESS) ||
+	    (tc_ccm_config(&ccm, &sched, nonce, sizeof(nonce),
+			   OSCORE_TAG_LEN) != TC_CRYPTO_SUCCESS) ||
+	    (tc_ccm_generation_encryption(request->data + request->offset,
+					  request->max_len - request->offset,
+					  aad, aad_len, scratch, plain_len,
+					  &ccm) != TC_CRYPTO_SUCCESS)) {
+		return -EIO;
+	}
+
+	request->offset += plain_len + OSCORE_TAG_LEN;
+
+	LOG_DBG("OSCORE request ssn %u: %d byte payload, %d bytes on the wire",
+		(u32_t)ssn, payload_len, request->offset);
+
+	return 0;
+}
+
+int oscore_unprotect(const struct coap_packet *response, u8_t *code,
+		     const u8_t **payload, u16_t *payload_len)
+{
+	struct coap_option option;
+	const u8_t *ciphertext;
+	u16_t ciphertext_len;
+	const u8_t *piv = ctx.req_piv;
+	u8_t piv_len = ctx.req_piv_len;
+	const u8_t *id = ctx.sender_id;
+	u8_t id_len = ctx.sender_id_len;
+	u8_t nonce[OSCORE_NONCE_LEN];
+	u8_t aad[32];
+	size_t aad_len, plain_len, offset = 1;
+	struct tc_aes_key_sched_struct sched;
+	struct tc_ccm_mode_struct ccm;
+
+	if (coap_find_options(response, OSCORE_OPTION_NUMBER,
+			      &option, 1) != 1) {
+		return -EPERM;
+	}
+
+	if (ctx.req_piv_len == 0) {
+		return -EINVAL;
+	}
+
+	/* A response either reuses the request nonce or carries its own
+	 * Partial IV generated with the server's Sender ID.
+	 */
+	if (option.len > 0) {
+		u8_t n = option.value[0] & OSCORE_FLAG_PIV_LEN;
+
+		if ((n > OSCORE_PIV_MAX_LEN) || (1 + n > option.len)) {
+			return -EBADMSG;
+		}
+
+		if (n > 0) {
+			piv = &option.value[1];
+			piv_len = n;
+			id = ctx.recipient_id;
+			id_len = ctx.recipient_id_len;
+		}
+	}
+
+	ciphertext = coap_packet_get_payload(response, &ciphertext_len);
+	if ((ciphertext == NULL) || (ciphertext_len <= OSCORE_TAG_LEN) ||
+	    (ciphertext_len - OSCORE_TAG_LEN > sizeof(scratch))) {
+		return -EBADMSG;
+	}
+
+	nonce_build(nonce, id, id_len, piv, piv_len);
+	aad_len = aad_encode(aad, ctx.sender_id, ctx.sender_id_len,
+			     ctx.req_piv, ctx.req_piv_len);
+
+	if ((tc_aes128_set_encrypt_key(&sched, ctx.recipient_key) !=
+	     TC_CRYPTO_SUCCESS) ||
+	    (tc_ccm_config(&ccm, &sched, nonce, sizeof(nonce),
+			   OSCORE_TAG_LEN) != TC_CRYPTO_SUCCESS)) {
+		return -EIO;
+	}
+
+	if (tc_ccm_decryption_verification(scratch, sizeof(scratch),
+					   aad, aad_len,
+					   ciphertext, ciphertext_len,
+					   &ccm) != TC_CRYPTO_SUCCESS) {
+		return -EACCES;
+	}
+
+	plain_len = ciphertext_len - OSCORE_TAG_LEN;
+	*code = scratch[0];
+	*payload = NULL;
+	*payload_len = 0;
+
+	while ((offset < plain_len) &&
+	       (scratch[offset] != OSCORE_PAYLOAD_MARKER)) {
+		if (option_skip(scratch, plain_len, &offset)) {
+			return -EBADMSG;
+		}
+	}
+
+	if (offset + 1 < plain_len) {
+		*payload = &scratch[offset + 1];
+		*payload_len = plain_len - offset - 1;
+	}
+
+	return 0;
+}
+
+int oscore_init(void)
+{
+	int err;
+	int secret_len, salt_len, id_len;
+	u8_t secret[OSCORE_SECRET_MAX_LEN];
+	u8_t salt[OSCORE_SECRET_MAX_LEN];
+
+	if (initialized) {
+		return 0;
+	}
+
+	secret_len = hex_parse(CONFIG_COAP_BACKEND_OSCORE_MASTER_SECRET,
+			       secret, sizeof(secret));
+	salt_len = hex_parse(CONFIG_COAP_BACKEND_OSCORE_MASTER_SALT,
+			     salt, sizeof(salt));
+	if ((secret_len <= 0) || (salt_len < 0)) {
+		LOG_ERR("Invalid OSCORE master secret or salt");
+		return -EINVAL;
+	}
+
+	id_len = hex_parse(CONFIG_COAP_BACKEND_OSCORE_SENDER_ID,
+			   ctx.sender_id, sizeof(ctx.sender_id));
+	if (id_len < 0) {
+		LOG_ERR("Invalid OSCORE sender ID");
+		return -EINVAL;
+	}
+
+	ctx.sender_id_len = id_len;
+
+	id_len = hex_parse(CONFIG_COAP_BACKEND_OSCORE_RECIPIENT_ID,
+			   ctx.recipient_id, sizeof(ctx.recipient_id));
+	if (id_len < 0) {
+		LOG_ERR("Invalid OSCORE recipient ID");
+		return -EINVAL;
+	}
+
+	ctx.recipient_id_len = id_len;
+
+	err = derive(secret, secret_len, salt, salt_len,
+		     ctx.sender_id, ctx.sender_id_len, "Key",
+		     ctx.sender_key, sizeof(ctx.sender_key));
+	err = err ? err : derive(secret, secret_len, salt, salt_len,
+				 ctx.recipient_id, ctx.recipient_id_len, "Key",
+				 ctx.recipient_key, sizeof(ctx.recipient_key));
+	err = err ? err : derive(secret, secret_len, salt, salt_len,
+				 NULL, 0, "IV",
+				 ctx.common_iv, sizeof(ctx.common_iv));
+
+	memset(secret, 0, sizeof(secret));
+
+	if (err) {
+		LOG_ERR("OSCORE key derivation failed, %d", err);
+		return err;
+	}
+
+	err = settings_subsys_init();
+	if (err) {
+		LOG_ERR("settings_subsys_init, error: %d", err);
+		return err;
+	}
+
+	err = settings_register(&oscore_settings);
+	if (err) {
+		LOG_ERR("settings_register, error: %d", err);
+		return err;
+	}
+
+	/* Restores the persisted upper bound. Every number below it may
+	 * already have been used.
+	 */
+	err = settings_load();
+	if (err) {
+		LOG_ERR("settings_load, error: %d", err);
+		return err;
+	}
+
+	ctx.ssn_reserved = ctx.ssn;
+	initialized = true;
+
+	LOG_DBG("OSCORE context ready, next sequence number %u",
+		(u32_t)ctx.ssn);
+
+	return 0;
+}
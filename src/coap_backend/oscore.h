@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief OSCORE (RFC 8613) message protection for the CoAP backend.
+ */
+
+#ifndef OSCORE_H__
+#define OSCORE_H__
+
+#include <zephyr/types.h>
+#include <net/coap.h>
+
+/**
+ * @defgroup oscore OSCORE message protection
+ * @{
+ * @brief Client side of OSCORE using a single pre-provisioned security
+ *        context and the AES-CCM-16-64-128 algorithm.
+ *
+ *        The sender sequence number is persisted through the settings
+ *        subsystem in steps of CONFIG_COAP_BACKEND_OSCORE_SEQ_PERSIST_INTERVAL
+ *        so that a reboot never reuses a nonce.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** CoAP option number of the OSCORE option. */
+#define OSCORE_OPTION_NUMBER 9
+
+/** @brief Derive the security context and restore the sequence number.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int oscore_init(void);
+
+/** @brief Encode an OSCORE protected request.
+ *
+ *  @details The request code, Uri-Path and payload are encrypted into the
+ *           payload of an outer POST request. The outer message is encoded
+ *           into @p buf.
+ *
+ *  @param[out] request Packet to encode the protected request into.
+ *  @param[in] buf Buffer backing @p request.
+ *  @param[in] buf_len Size of @p buf.
+ *  @param[in] token Token of the outer request.
+ *  @param[in] token_len Length of @p token.
+ *  @param[in] code Inner request code, for example COAP_METHOD_PUT.
+ *  @param[in] uri_path Inner Uri-Path, single segment.
+ *  @param[in] payload Inner payload.
+ *  @param[in] payload_len Length of @p payload.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int oscore_protect(struct coap_packet *request, u8_t *buf, size_t buf_len,
+		   const u8_t *token, u8_t token_len, u8_t code,
+		   const char *uri_path, const u8_t *payload,
+		   size_t payload_len);
+
+/** @brief Verify and decrypt an OSCORE protected response to the last
+ *         request created by oscore_protect().
+ *
+ *  @param[in] response Received outer response.
+ *  @param[out] code Inner response code.
+ *  @param[out] payload Set to point at the inner payload, within the module
+ *                      scratch buffer. Valid until the next call into the
+ *                      module.
+ *  @param[out] payload_len Length of the inner payload.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int oscore_unprotect(const struct coap_packet *response, u8_t *code,
+		     const u8_t **payload, u16_t *payload_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* OSCORE_H__ */
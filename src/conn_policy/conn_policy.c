@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <conn_policy.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(conn_policy, CONFIG_CONN_POLICY_LOG_LEVEL);
+
+/* Weight of a new sample in the smoothed values, 1 / 2^EWMA_SHIFT. */
+#define EWMA_SHIFT 2
+
+static struct conn_policy_decision decision = {
+#if defined(CONFIG_CONN_POLICY_MODE_PER_BURST)
+	.mode = CONN_POLICY_MODE_PER_BURST,
+#else
+	.mode = CONN_POLICY_MODE_PERSISTENT,
+#endif
+#if defined(CONFIG_CONN_POLICY_MODE_AUTO)
+	.reason = CONN_POLICY_REASON_NO_SCHEDULE,
+#else
+	.reason = CONN_POLICY_REASON_FORCED,
+#endif
+	.connect_time = CONFIG_CONN_POLICY_CONNECT_MS,
+};
+
+static bool schedule_fixed;
+static s64_t last_publish;
+
+K_MUTEX_DEFINE(policy_lock);
+
+static u32_t ewma(u32_t avg, u32_t sample)
+{
+	return (u32_t)(avg + (((s32_t)sample - (s32_t)avg) >> EWMA_SHIFT));
+}
+
+/* mA * ms and uA * ms / 1000 both give uC. */
+static u64_t persistent_cost(void)
+{
+	u64_t cost = (u64_t)decision.gap * CONFIG_CONN_POLICY_IDLE_CURRENT_UA /
+		     1000;
+
+	if (decision.keepalive > 0) {
+		u64_t pings = decision.gap / decision.keepalive;
+
+		/* Each keepalive wakes the radio and is followed by a tail. */
+		cost += pings * ((u64_t)CONFIG_CONN_POLICY_PING_MS *
+				 CONFIG_CONN_POLICY_ACTIVE_CURRENT_MA +
+				 (u64_t)CONFIG_CONN_POLICY_TAIL_MS *
+				 CONFIG_CONN_POLICY_TAIL_CURRENT_MA);
+	}
+
+	return cost;
+}
+
+static u64_t per_burst_cost(void)
+{
+	/* The tail after a connection overlaps with the tail of the
+	 * publication, which is paid in both modes.
+	 */
+	return (u64_t)decision.connect_time *
+	       CONFIG_CONN_POLICY_ACTIVE_CURRENT_MA +
+	       (u64_t)decision.gap * CONFIG_CONN_POLICY_SLEEP_CURRENT_UA / 1000;
+}
+
+static void evaluate(void)
+{
+	enum conn_policy_mode old_mode = decision.mode;
+	u64_t persistent = persistent_cost();
+	u64_t per_burst = per_burst_cost();
+	u64_t margin;
+
+	decision.persistent_cost = (u32_t)MIN(persistent, UINT32_MAX);
+	decision.per_burst_cost = (u32_t)MIN(per_burst, UINT32_MAX);
+
+	if (!IS_ENABLED(CONFIG_CONN_POLICY_MODE_AUTO)) {
+		return;
+	}
+
+	if (decision.gap == 0) {
+		decision.mode = CONN_POLICY_MODE_PERSISTENT;
+		decision.reason = CONN_POLICY_REASON_NO_SCHEDULE;
+		goto exit;
+	}
+
+	/* The current mode is kept unless the other one is cheaper by more
+	 * than the margin, so that the mode does not flap.
+	 */
+	if (decision.mode == CONN_POLICY_MODE_PERSISTENT) {
+		margin = persistent * CONFIG_CONN_POLICY_HYSTERESIS_PERCENT / 100;
+
+		if (per_burst + margin < persistent) {
+			decision.mode = CONN_POLICY_MODE_PER_BURST;
+			decision.reason = CONN_POLICY_REASON_RECONNECT_CHEAPER;
+		} else if (per_burst < persistent) {
+			decision.reason = CONN_POLICY_REASON_HYSTERESIS;
+		} else {
+			decision.reason = CONN_POLICY_REASON_IDLE_CHEAPER;
+		}
+	} else {
+		margin = per_burst * CONFIG_CONN_POLICY_HYSTERESIS_PERCENT / 100;
+
+		if (persistent + margin < per_burst) {
+			decision.mode = CONN_POLICY_MODE_PERSISTENT;
+			decision.reason = CONN_POLICY_REASON_IDLE_CHEAPER;
+		} else if (persistent < per_burst) {
+			decision.reason = CONN_POLICY_REASON_HYSTERESIS;
+		} else {
+			decision.reason = CONN_POLICY_REASON_RECONNECT_CHEAPER;
+		}
+	}
+
+exit:
+	if (decision.mode != old_mode) {
+		LOG_INF("Mode: %s, %s", conn_policy_mode_str(decision.mode),
+			conn_policy_reason_str(decision.reason));
+	}
+
+	LOG_DBG("Gap %d ms, persistent %d uC, per burst %d uC", decision.gap,
+		decision.persistent_cost, decision.per_burst_cost);
+}
+
+void conn_policy_connect_time_set(u32_t time)
+{
+	k_mutex_lock(&policy_lock, K_FOREVER);
+
+	decision.connect_time = ewma(decision.connect_time, time);
+	evaluate();
+
+	k_mutex_unlock(&policy_lock);
+}
+
+void conn_policy_keepalive_set(u32_t keepalive)
+{
+	k_mutex_lock(&policy_lock, K_FOREVER);
+
+	decision.keepalive = keepalive;
+	evaluate();
+
+	k_mutex_unlock(&policy_lock);
+}
+
+void conn_policy_schedule_set(u32_t gap)
+{
+	k_mutex_lock(&policy_lock, K_FOREVER);
+
+	schedule_fixed = (gap > 0);
+	decision.gap = gap;
+	evaluate();
+
+	k_mutex_unlock(&policy_lock);
+}
+
+void conn_policy_publish_notify(void)
+{
+	s64_t now = k_uptime_get();
+
+	k_mutex_lock(&policy_lock, K_FOREVER);
+
+	if (!schedule_fixed && (last_publish != 0)) {
+		u32_t gap = (u32_t)MIN(now - last_publish, UINT32_MAX);
+
+		decision.gap = decision.gap ? ewma(decision.gap, gap) : gap;
+		evaluate();
+	}
+
+	last_publish = now;
+
+	k_mutex_unlock(&policy_lock);
+}
+
+enum conn_policy_mode conn_policy_mode_get(void)
+{
+	return decision.mode;
+}
+
+void conn_policy_decision_get(struct conn_policy_decision *out)
+{
+	k_mutex_lock(&policy_lock, K_FOREVER);
+	*out = decision;
+	k_mutex_unlock(&policy_lock);
+}
+
+const char *conn_policy_mode_str(enum conn_policy_mode mode)
+{
+	switch (mode) {
+	case CONN_POLICY_MODE_PERSISTENT:
+		return "persistent";
+	case CONN_POLICY_MODE_PER_BURST:
+		return "connect per publication";
+	default:
+		return "unknown";
+	}
+}
+
+const char *conn_policy_reason_str(enum conn_policy_reason reason)
+{
+	switch (reason) {
+	case CONN_POLICY_REASON_FORCED:
+		return "set by configuration";
+	case CONN_POLICY_REASON_NO_SCHEDULE:
+		return "publication gap not known yet";
+	case CONN_POLICY_REASON_IDLE_CHEAPER:
+		return "staying connected is cheaper than reconnecting";
+	case CONN_POLICY_REASON_RECONNECT_CHEAPER:
+		return "reconnecting is cheaper than staying connected";
+	case CONN_POLICY_REASON_HYSTERESIS:
+		return "cost difference within hysteresis";
+	default:
+		return "unknown";
+	}
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Connection policy library header.
+ */
+
+#ifndef CONN_POLICY_H__
+#define CONN_POLICY_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup conn_policy Connection policy library
+ * @{
+ * @brief Chooses between a persistent cloud connection and one connection
+ *        per publication.
+ *
+ *        Costs are estimated as charge, in microcoulombs, spent over the
+ *        gap between two publications. Staying connected costs the idle
+ *        current needed to stay reachable plus the keepalives that fall in
+ *        the gap. Reconnecting costs the measured connection time at active
+ *        current, after which the device sleeps until the next
+ *        publication.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Connection modes. */
+enum conn_policy_mode {
+	/** Keep the connection open between publications. */
+	CONN_POLICY_MODE_PERSISTENT,
+	/** Connect for each publication and disconnect afterwards. */
+	CONN_POLICY_MODE_PER_BURST
+};
+
+/** @brief Reasons for the chosen mode. */
+enum conn_policy_reason {
+	/** The mode is fixed by configuration. */
+	CONN_POLICY_REASON_FORCED,
+	/** The gap between publications is not known yet. */
+	CONN_POLICY_REASON_NO_SCHEDULE,
+	/** Staying connected over the gap is cheaper than reconnecting. */
+	CONN_POLICY_REASON_IDLE_CHEAPER,
+	/** Reconnecting is cheaper than staying connected over the gap. */
+	CONN_POLICY_REASON_RECONNECT_CHEAPER,
+	/** The cost difference is within the hysteresis margin. */
+	CONN_POLICY_REASON_HYSTERESIS
+};
+
+/** @brief Current decision and the estimates it is based on. */
+struct conn_policy_decision {
+	/** Chosen mode. */
+	enum conn_policy_mode mode;
+	/** Why the mode was chosen. */
+	enum conn_policy_reason reason;
+	/** Expected gap between publications, in milliseconds. */
+	u32_t gap;
+	/** Smoothed connection time, in milliseconds. */
+	u32_t connect_time;
+	/** Keepalive interval of the connection, in milliseconds. */
+	u32_t keepalive;
+	/** Estimated charge of staying connected over the gap, in uC. */
+	u32_t persistent_cost;
+	/** Estimated charge of reconnecting for the next publication, in uC.
+	 */
+	u32_t per_burst_cost;
+};
+
+/** @brief Report the measured time of a connection, from the start of
+ *         name resolution until the connection is ready for data.
+ *
+ *  @param[in] time Connection time in milliseconds.
+ */
+void conn_policy_connect_time_set(u32_t time);
+
+/** @brief Set the keepalive interval of the connection.
+ *
+ *  @param[in] keepalive Keepalive interval in milliseconds, or 0 if no
+ *                       keepalives are sent.
+ */
+void conn_policy_keepalive_set(u32_t keepalive);
+
+/** @brief Set the gap between publications of a fixed schedule.
+ *
+ *  @param[in] gap Gap in milliseconds, or 0 to estimate it from
+ *                 conn_policy_publish_notify() calls instead.
+ */
+void conn_policy_schedule_set(u32_t gap);
+
+/** @brief Notify the library of a publication. Used to estimate the gap
+ *         between publications when no schedule is set.
+ */
+void conn_policy_publish_notify(void);
+
+/** @brief Get the chosen mode.
+ *
+ *  @return Connection mode.
+ */
+enum conn_policy_mode conn_policy_mode_get(void);
+
+/** @brief Get the current decision and its estimates.
+ *
+ *  @param[out] decision Pointer to struct the decision is copied to.
+ */
+void conn_policy_decision_get(struct conn_policy_decision *decision);
+
+/** @brief Get a printable name of a mode.
+ *
+ *  @param[in] mode Connection mode.
+ *
+ *  @return Mode name.
+ */
+const char *conn_policy_mode_str(enum conn_policy_mode mode);
+
+/** @brief Get a printable description of a reason.
+ *
+ *  @param[in] reason Reason of a decision.
+ *
+ *  @return Reason description.
+ */
+const char *conn_policy_reason_str(enum conn_policy_reason reason);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* CONN_POLICY_H__ */
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <downlink.h>
+#include <string.h>
+#include <data/json.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(downlink, CONFIG_DOWNLINK_LOG_LEVEL);
+
+struct downlink_msg {
+	char *cmd;
+	s32_t val;
+};
+
+static const struct json_obj_descr downlink_msg_descr[] = {
+	JSON_OBJ_DESCR_PRIM(struct downlink_msg, cmd, JSON_TOK_STRING),
+	JSON_OBJ_DESCR_PRIM(struct downlink_msg, val, JSON_TOK_NUMBER),
+};
+
+/* Bit set by json_obj_parse() when the "cmd" member was decoded. */
+#define DOWNLINK_MSG_CMD BIT(0)
+
+static const struct downlink_cmd *cmds[CONFIG_DOWNLINK_CMD_MAX];
+
+/* json_obj_parse() decodes in place, so messages are copied here first. */
+static char msg_buf[CONFIG_DOWNLINK_BUF_SIZE];
+
+K_MUTEX_DEFINE(downlink_lock);
+
+int downlink_cmd_register(const struct downlink_cmd *cmd)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(cmds); i++) {
+		if (cmds[i] == NULL) {
+			cmds[i] = cmd;
+			return 0;
+		}
+	}
+
+	LOG_ERR("No room for command %s", cmd->name);
+
+	return -ENOMEM;
+}
+
+static const struct downlink_cmd *cmd_find(const char *name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(cmds); i++) {
+		if ((cmds[i] != NULL) && (strcmp(cmds[i]->name, name) == 0)) {
+			return cmds[i];
+		}
+	}
+
+	return NULL;
+}
+
+int downlink_handle(const char *buf, size_t len)
+{
+	struct downlink_msg msg = { 0 };
+	const struct downlink_cmd *cmd;
+	int ret;
+
+	if (len >= sizeof(msg_buf)) {
+		LOG_WRN("Downlink message too long: %d bytes", len);
+		return -EMSGSIZE;
+	}
+
+	k_mutex_lock(&downlink_lock, K_FOREVER);
+
+	memcpy(msg_buf, buf, len);
+	msg_buf[len] = '\0';
+
+	ret = json_obj_parse(msg_buf, len, downlink_msg_descr,
+			     ARRAY_SIZE(downlink_msg_descr), &msg);
+	if ((ret < 0) || !(ret & DOWNLINK_MSG_CMD)) {
+		LOG_DBG("Not a downlink command");
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	cmd = cmd_find(msg.cmd);
+	if (cmd == NULL) {
+		LOG_WRN("Unknown downlink command: %s", log_strdup(msg.cmd));
+		ret = -ENOENT;
+		goto exit;
+	}
+
+	LOG_INF("Downlink command %s, value %d", cmd->name, msg.val);
+
+	cmd->handler(msg.val);
+	ret = 0;
+
+exit:
+	k_mutex_unlock(&downlink_lock);
+
+	return ret;
+}
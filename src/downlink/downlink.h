@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Downlink command library header.
+ */
+
+#ifndef DOWNLINK_H__
+#define DOWNLINK_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup downlink Downlink command library
+ * @{
+ * @brief Dispatches commands received from the server.
+ *
+ *        A command is a JSON object, {"cmd":"<name>","val":<int>}. The value
+ *        is optional and passed as 0 when omitted.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Downlink command handler.
+ *
+ *  @param[in] val Value of the command.
+ */
+typedef void (*downlink_cmd_handler_t)(s32_t val);
+
+/** @brief Downlink command. */
+struct downlink_cmd {
+	/** Command name, matched against the "cmd" member. */
+	const char *name;
+	/** Handler called when the command is received. */
+	downlink_cmd_handler_t handler;
+};
+
+/** @brief Register a command.
+ *
+ *  @param[in] cmd Command. Must remain valid while registered.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int downlink_cmd_register(const struct downlink_cmd *cmd);
+
+/** @brief Parse a downlink message and run the matching command.
+ *
+ *  @param[in] buf Message received from the server.
+ *  @param[in] len Length of the message.
+ *
+ *  @return 0 If a command was run.
+ *            -EINVAL if the message is not a command.
+ *            -ENOENT if no handler is registered for the command.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int downlink_handle(const char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* DOWNLINK_H__ */
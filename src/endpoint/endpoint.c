@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <endpoint.h>
+#include <resolver.h>
+#include <string.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(endpoint, CONFIG_ENDPOINT_LOG_LEVEL);
+
+#define ENDPOINT_SEPARATORS " ,"
+#define ENDPOINT_PORT_MAX 65535
+
+/* Weight of the previous estimate in the smoothed connection time, out of
+ * 8, as for the TCP SRTT.
+ */
+#define RTT_HISTORY_WEIGHT 7
+
+static struct endpoint_list *lists[CONFIG_ENDPOINT_LIST_MAX];
+
+#if defined(CONFIG_ENDPOINT_PREFETCH)
+/* Lookups block for seconds, they are kept off the system and publish work
+ * queues.
+ */
+K_THREAD_STACK_DEFINE(prefetch_wq_stack, CONFIG_ENDPOINT_PREFETCH_STACK_SIZE);
+
+static struct k_work_q prefetch_wq;
+static bool prefetch_wq_started;
+#endif
+
+static int endpoint_add(struct endpoint_list *list, const char *host,
+			size_t len, u16_t port)
+{
+	struct endpoint *ep;
+
+	if (list->count == ARRAY_SIZE(list->ep)) {
+		LOG_ERR("No room for endpoint %d of %s", list->count + 1,
+			log_strdup(list->name));
+		return -ENOMEM;
+	}
+
+	ep = &list->ep[list->count];
+
+	if ((len == 0) || (len >= sizeof(ep->host))) {
+		return -EINVAL;
+	}
+
+	memset(ep, 0, sizeof(*ep));
+	memcpy(ep->host, host, len);
+	ep->host[len] = '\0';
+	ep->port = port;
+
+	list->count++;
+
+	return 0;
+}
+
+static int port_parse(const char *str, size_t len, u16_t *port)
+{
+	u32_t val = 0;
+
+	if ((len == 0) || (len > 5)) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		if ((str[i] < '0') || (str[i] > '9')) {
+			return -EINVAL;
+		}
+
+		val = val * 10 + (str[i] - '0');
+	}
+
+	if ((val == 0) || (val > ENDPOINT_PORT_MAX)) {
+		return -EINVAL;
+	}
+
+	*port = val;
+
+	return 0;
+}
+
+/* Parses one host[:port] or [IPv6 address][:port] entry of len bytes. */
+static int fallback_parse(struct endpoint_list *list, const char *entry,
+			  size_t len, u16_t port)
+{
+	const char *end = entry + len;
+	const char *host = entry;
+	const char *sep;
+	size_t host_len;
+	int err;
+
+	if (entry[0] == '[') {
+		host = entry + 1;
+		sep = memchr(host, ']', end - host);
+		if (sep == NULL) {
+			return -EINVAL;
+		}
+
+		host_len = sep - host;
+		sep++;
+	} else {
+		sep = memchr(host, ':', len);
+		host_len = (sep != NULL) ? (size_t)(sep - host) : len;
+	}
+
+	if ((sep != NULL) && (sep < end)) {
+		if (*sep != ':') {
+			return -EINVAL;
+		}
+
+		err = port_parse(sep + 1, end - sep - 1, &port);
+		if (err) {
+			return err;
+		}
+	}
+
+	return endpoint_add(list, host, host_len, port);
+}
+
+static void prefetch_work_fn(struct k_work *work)
+{
+	struct endpoint_list *list =
+		CONTAINER_OF(work, struct endpoint_list, prefetch_work);
+	struct sockaddr_storage addr;
+	bool skip;
+	int err;
+
+	for (size_t i = 0; i < list->count; i++) {
+		struct endpoint *ep = &list->ep[i];
+
+		k_mutex_lock(&list->lock, K_FOREVER);
+		skip = (i == list->current) || ep->resolved;
+		k_mutex_unlock(&list->lock);
+
+		if (skip) {
+			continue;
+		}
+
+		/* Resolved without the lock, a lookup may take seconds. */
+		err = resolver_resolve(ep->host, ep->port, list->family,
+				       list->socktype, &addr);
+		if (err) {
+			continue;
+		}
+
+		k_mutex_lock(&list->lock, K_FOREVER);
+		ep->addr = addr;
+		ep->resolved = true;
+		ep->resolved_at = k_uptime_get();
+		k_mutex_unlock(&list->lock);
+
+		LOG_DBG("%s prefetched", log_strdup(ep->host));
+	}
+}
+
+int endpoint_list_init(struct endpoint_list *list, const char *name,
+		       const char *host, u16_t port, const char *fallbacks,
+		       int family, int socktype)
+{
+	size_t slot = ARRAY_SIZE(lists);
+	int err;
+
+	for (size_t i = 0; i < ARRAY_SIZE(lists); i++) {
+		if ((lists[i] == list) ||
+		    ((lists[i] == NULL) && (slot == ARRAY_SIZE(lists)))) {
+			slot = i;
+		}
+	}
+
+	if (slot == ARRAY_SIZE(lists)) {
+		LOG_ERR("No room for the endpoints of %s", log_strdup(name));
+		return -ENOMEM;
+	}
+
+	memset(list, 0, sizeof(*list));
+	list->name = name;
+	list->family = family;
+	list->socktype = socktype;
+	k_mutex_init(&list->lock);
+	k_work_init(&list->prefetch_work, prefetch_work_fn);
+
+#if defined(CONFIG_ENDPOINT_PREFETCH)
+	if (!prefetch_wq_started) {
+		k_work_q_start(&prefetch_wq, prefetch_wq_stack,
+			       K_THREAD_STACK_SIZEOF(prefetch_wq_stack),
+			       CONFIG_ENDPOINT_PREFETCH_PRIORITY);
+		k_thread_name_set(&prefetch_wq.thread, "endpoint_prefetch");
+		prefetch_wq_started = true;
+	}
+#endif
+
+	err = endpoint_add(list, host, strlen(host), port);
+	if (err) {
+		return err;
+	}
+
+	while (*fallbacks != '\0') {
+		size_t len;
+
+		fallbacks += strspn(fallbacks, ENDPOINT_SEPARATORS);
+		len = strcspn(fallbacks, ENDPOINT_SEPARATORS);
+
+		if (len == 0) {
+			break;
+		}
+
+		err = fallback_parse(list, fallbacks, len, port);
+		if (err) {
+			LOG_ERR("Invalid endpoint of %s: %s", log_strdup(name),
+				log_strdup(fallbacks));
+			return err;
+		}
+
+		fallbacks += len;
+	}
+
+	lists[slot] = list;
+
+	LOG_DBG("%s has %d endpoint(s)", log_strdup(name), list->count);
+
+	return 0;
+}
+
+struct endpoint_list *endpoint_list_get(const char *name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(lists); i++) {
+		if ((lists[i] != NULL) && (strcmp(lists[i]->name, name) == 0)) {
+			return lists[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Whether endpoint a, later in the list, is preferred over endpoint b. */
+static bool ranks_before(const struct endpoint *a, const struct endpoint *b)
+{
+#if defined(CONFIG_ENDPOINT_SELECT_RTT)
+	/* Endpoints are measured by connecting to them, those not measured
+	 * yet are tried first.
+	 */
+	if (b->rtt == 0) {
+		return false;
+	}
+
+	if (a->rtt == 0) {
+		return true;
+	}
+
+	return a->rtt + CONFIG_ENDPOINT_RTT_MARGIN_MS < b->rtt;
+#else
+	ARG_UNUSED(a);
+	ARG_UNUSED(b);
+
+	return false;
+#endif
+}
+
+/* Returns the preferred endpoint, skipping those failed until now unless
+ * now is 0. Returns count if every endpoint is skipped.
+ */
+static size_t preferred_get(const struct endpoint_list *list, s64_t now)
+{
+	size_t best = list->count;
+
+	for (size_t i = 0; i < list->count; i++) {
+		if (now && (now < list->ep[i].down_until)) {
+			continue;
+		}
+
+		if ((best == list->count) ||
+		    ranks_before(&list->ep[i], &list->ep[best])) {
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+/* Called with the lock held. */
+static void attempt_fail(struct endpoint_list *list)
+{
+	struct endpoint *ep = &list->ep[list->current];
+
+	list->pending = false;
+	ep->fails++;
+	ep->failures++;
+
+	/* The address may have moved, it is resolved again next time. */
+	ep->resolved = false;
+
+	/* Only the endpoint last connected to is given several tries. */
+	if ((list->current == list->good) &&
+	    (ep->failures < CONFIG_ENDPOINT_FAILURES_MAX)) {
+		return;
+	}
+
+	ep->failures = 0;
+	ep->down_until = k_uptime_get() + K_SECONDS(CONFIG_ENDPOINT_RETURN_S);
+
+	if (list->count > 1) {
+		LOG_WRN("%s:%u failed, failing over", log_strdup(ep->host),
+			ep->port);
+	}
+}
+
+int endpoint_select(struct endpoint_list *list, struct sockaddr_storage *addr,
+		    const char **host)
+{
+	s64_t now = k_uptime_get();
+	struct sockaddr_storage resolved;
+	struct endpoint *ep;
+	bool cached;
+	size_t i;
+	int err;
+
+	k_mutex_lock(&list->lock, K_FOREVER);
+
+	i = preferred_get(list, now);
+
+	if (i == list->count) {
+		/* All failed, the first to be available again is tried. */
+		i = 0;
+
+		for (size_t j = 1; j < list->count; j++) {
+			if (list->ep[j].down_until < list->ep[i].down_until) {
+				i = j;
+			}
+		}
+	}
+
+	ep = &list->ep[i];
+
+	if (i != list->current) {
+		LOG_INF("Endpoint %s:%u selected", log_strdup(ep->host),
+			ep->port);
+	}
+
+	list->current = i;
+	list->pending = true;
+	list->connected = false;
+
+	if (ep->resolved && (now - ep->resolved_at >=
+			     K_SECONDS(CONFIG_ENDPOINT_RESOLVE_CACHE_S))) {
+		ep->resolved = false;
+	}
+
+	cached = ep->resolved;
+	if (cached) {
+		*addr = ep->addr;
+	}
+
+	k_mutex_unlock(&list->lock);
+
+	/* Resolved without the lock, as by the prefetch. The host and port
+	 * do not change once the list is initialized.
+	 */
+	err = cached ? 0 : resolver_resolve(ep->host, ep->port, list->family,
+					    list->socktype, &resolved);
+
+	k_mutex_lock(&list->lock, K_FOREVER);
+
+	if (err) {
+		if (list->pending && (list->current == i)) {
+			attempt_fail(list);
+		}
+
+		goto exit;
+	}
+
+	if (!cached) {
+		ep->addr = resolved;
+		ep->resolved = true;
+		ep->resolved_at = k_uptime_get();
+		*addr = resolved;
+	}
+
+	*host = ep->host;
+
+	/* Resolution is left out of the connection time. */
+	list->connect_start = k_uptime_get();
+
+exit:
+	k_mutex_unlock(&list->lock);
+
+	return err;
+}
+
+void endpoint_connected(struct endpoint_list *list, bool measured)
+{
+	struct endpoint *ep;
+	u32_t sample;
+
+	k_mutex_lock(&list->lock, K_FOREVER);
+
+	if (!list->pending) {
+		k_mutex_unlock(&list->lock);
+		return;
+	}
+
+	ep = &list->ep[list->current];
+
+	list->pending = false;
+	list->connected = true;
+	list->connected_at = k_uptime_get();
+	list->good = list->current;
+
+	ep->failures = 0;
+	ep->down_until = 0;
+	ep->connects++;
+
+	LOG_INF("Connected to %s:%u", log_strdup(ep->host), ep->port);
+
+	if (measured) {
+		sample = MAX(list->connected_at - list->connect_start, 1);
+		ep->rtt = ep->rtt ? (RTT_HISTORY_WEIGHT * ep->rtt + sample) /
+				    (RTT_HISTORY_WEIGHT + 1) : sample;
+
+		LOG_DBG("Connection time %u ms, smoothed %u ms", sample,
+			ep->rtt);
+	}
+
+	k_mutex_unlock(&list->lock);
+
+#if defined(CONFIG_ENDPOINT_PREFETCH)
+	if (list->count > 1) {
+		k_work_submit_to_queue(&prefetch_wq, &list->prefetch_work);
+	}
+#endif
+}
+
+void endpoint_failed(struct endpoint_list *list)
+{
+	k_mutex_lock(&list->lock, K_FOREVER);
+
+	if (list->pending) {
+		attempt_fail(list);
+	}
+
+	k_mutex_unlock(&list->lock);
+}
+
+void endpoint_disconnected(struct endpoint_list *list)
+{
+	k_mutex_lock(&list->lock, K_FOREVER);
+
+	if (list->pending) {
+		attempt_fail(list);
+	}
+
+	list->connected = false;
+
+	k_mutex_unlock(&list->lock);
+}
+
+int endpoint_return_timeout_get(struct endpoint_list *list)
+{
+	s64_t left;
+	int timeout = K_FOREVER;
+
+	k_mutex_lock(&list->lock, K_FOREVER);
+
+	/* Endpoints that failed before the connection was made are available
+	 * again by the time it is due, they are not skipped.
+	 */
+	if (list->connected && (preferred_get(list, 0) != list->current)) {
+		left = list->connected_at - k_uptime_get() +
+		       K_SECONDS(CONFIG_ENDPOINT_RETURN_S);
+		timeout = MAX(left, 0);
+	}
+
+	k_mutex_unlock(&list->lock);
+
+	return timeout;
+}
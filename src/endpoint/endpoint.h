@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Endpoint selection library header.
+ */
+
+#ifndef ENDPOINT_H__
+#define ENDPOINT_H__
+
+#include <zephyr.h>
+#include <net/socket.h>
+
+/**
+ * @defgroup endpoint Endpoint selection library
+ * @{
+ * @brief Selects the server a backend connects to among several.
+ *
+ *        The first endpoint of a list is the one configured for the
+ *        backend, followed by its fallbacks. The endpoint last connected
+ *        to is failed over from after CONFIG_ENDPOINT_FAILURES_MAX
+ *        connection failures in a row, others at their first failure. A
+ *        failed endpoint is skipped for CONFIG_ENDPOINT_RETURN_S. Once
+ *        connected to another endpoint than the preferred one for as long,
+ *        the connection is to be made again to the preferred one.
+ *
+ *        Failures are those reported by the backend. Plain UDP CoAP
+ *        reports none but resolution failures, its connect() does not
+ *        reach the server, so it is not failed over from when the server
+ *        stops answering.
+ *
+ *        The preferred endpoint is the first one in order, or, with
+ *        CONFIG_ENDPOINT_SELECT_RTT, the one with the shortest measured
+ *        connection time. Resolved addresses are kept for
+ *        CONFIG_ENDPOINT_RESOLVE_CACHE_S, so that switching endpoints
+ *        does not wait for DNS.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Server endpoint. */
+struct endpoint {
+	/** Host name or IP address literal. */
+	char host[CONFIG_ENDPOINT_HOST_LEN_MAX + 1];
+	/** Port, in host byte order. */
+	u16_t port;
+	/** Resolved address, valid while resolved is set. */
+	struct sockaddr_storage addr;
+	bool resolved;
+	s64_t resolved_at;
+	/** Connection failures since the last connection. */
+	u8_t failures;
+	/** Uptime until which the endpoint is skipped. */
+	s64_t down_until;
+	/** Smoothed connection time in milliseconds, 0 until measured. */
+	u32_t rtt;
+	/** Connections made. */
+	u32_t connects;
+	/** Connection failures. */
+	u32_t fails;
+};
+
+/** @brief Endpoints of a backend. */
+struct endpoint_list {
+	/** Name of the backend, as bound with cloud_get_binding(). */
+	const char *name;
+	int family;
+	int socktype;
+	struct endpoint ep[CONFIG_ENDPOINT_MAX];
+	size_t count;
+	/** Endpoint of the current connection attempt or connection. */
+	size_t current;
+	/** Last endpoint connected to, the first one until connected. */
+	size_t good;
+	/** A connection attempt has neither succeeded nor failed yet. */
+	bool pending;
+	bool connected;
+	s64_t connect_start;
+	s64_t connected_at;
+	struct k_mutex lock;
+	struct k_work prefetch_work;
+};
+
+/** @brief Initialize an endpoint list and register it.
+ *
+ *  @param[out] list List.
+ *  @param[in] name Name of the backend.
+ *  @param[in] host Host of the preferred endpoint.
+ *  @param[in] port Port of the preferred endpoint, the default of the
+ *                  fallbacks.
+ *  @param[in] fallbacks Space separated host[:port] list, IPv6 addresses
+ *                       in brackets. May be empty.
+ *  @param[in] family AF_INET or AF_INET6.
+ *  @param[in] socktype Socket type the addresses are used with.
+ *
+ *  @return 0 If successful.
+ *            -EINVAL if an endpoint cannot be parsed.
+ *            -ENOMEM if there are more than CONFIG_ENDPOINT_MAX endpoints,
+ *            or more than CONFIG_ENDPOINT_LIST_MAX lists.
+ */
+int endpoint_list_init(struct endpoint_list *list, const char *name,
+		       const char *host, u16_t port, const char *fallbacks,
+		       int family, int socktype);
+
+/** @brief Get the registered list of a backend.
+ *
+ *  @param[in] name Name of the backend.
+ *
+ *  @return List, or NULL if the backend has none.
+ */
+struct endpoint_list *endpoint_list_get(const char *name);
+
+/** @brief Select the endpoint to connect to.
+ *
+ *  A connection attempt starts, it is to be ended with
+ *  endpoint_connected() or endpoint_failed().
+ *
+ *  @param[in] list List.
+ *  @param[out] addr Address of the endpoint.
+ *  @param[out] host Host of the endpoint, for certificate verification.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned, the
+ *            resolution failed and counts as a connection failure.
+ */
+int endpoint_select(struct endpoint_list *list, struct sockaddr_storage *addr,
+		    const char **host);
+
+/** @brief Report that the connection attempt succeeded.
+ *
+ *  @param[in] list List.
+ *  @param[in] measured The attempt completed a handshake with the server,
+ *                      its duration is taken as a connection time sample.
+ */
+void endpoint_connected(struct endpoint_list *list, bool measured);
+
+/** @brief Report that the connection attempt failed. */
+void endpoint_failed(struct endpoint_list *list);
+
+/** @brief Report that the connection was closed.
+ *
+ *  A pending connection attempt counts as failed.
+ */
+void endpoint_disconnected(struct endpoint_list *list);
+
+/** @brief Get the time until the connection is to be made again to the
+ *         preferred endpoint.
+ *
+ *  @return Time in milliseconds, K_FOREVER if connected to the preferred
+ *          endpoint or not connected.
+ */
+int endpoint_return_timeout_get(struct endpoint_list *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* ENDPOINT_H__ */
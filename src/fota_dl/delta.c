@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <delta.h>
+#include <sys/byteorder.h>
+#include <sys/crc.h>
+#include <string.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(delta, CONFIG_FOTA_DL_LOG_LEVEL);
+
+enum delta_step {
+	DELTA_STEP_HEADER,
+	DELTA_STEP_DIFF_LEN,
+	DELTA_STEP_EXTRA_LEN,
+	DELTA_STEP_SEEK,
+	DELTA_STEP_ZERO_RUN,
+	DELTA_STEP_ZEROS,
+	DELTA_STEP_LIT_LEN,
+	DELTA_STEP_LIT,
+	DELTA_STEP_EXTRA,
+	DELTA_STEP_DONE,
+};
+
+#define VARINT_SHIFT_MAX 28
+
+static int source_crc_check(struct delta_ctx *ctx, u32_t expected)
+{
+	u32_t crc = 0;
+	int err;
+
+	for (u32_t pos = 0; pos < ctx->st.source_size;
+	     pos += sizeof(ctx->buf)) {
+		size_t n = MIN(sizeof(ctx->buf), ctx->st.source_size - pos);
+
+		err = flash_area_read(ctx->src, pos, ctx->buf, n);
+		if (err) {
+			return err;
+		}
+
+		crc = crc32_ieee_update(crc, ctx->buf, n);
+	}
+
+	if (crc != expected) {
+		LOG_ERR("Patch does not apply to the running image");
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+static int header_parse(struct delta_ctx *ctx)
+{
+	struct delta_state *st = &ctx->st;
+
+	if (memcmp(ctx->hdr, DELTA_MAGIC, DELTA_MAGIC_LEN)) {
+		return -EBADMSG;
+	}
+
+	st->source_size = sys_get_le32(ctx->hdr + 4);
+	st->target_size = sys_get_le32(ctx->hdr + 8);
+
+	if ((st->source_size > ctx->src->fa_size) ||
+	    (st->target_size > ctx->w->fa->fa_size)) {
+		return -EFBIG;
+	}
+
+	LOG_INF("Patch from %u to %u bytes", st->source_size,
+		st->target_size);
+
+	return source_crc_check(ctx, sys_get_le32(ctx->hdr + 12));
+}
+
+/* Returns 1 when the varint is complete. */
+static int varint_feed(struct delta_state *st, u8_t byte)
+{
+	if (st->shift > VARINT_SHIFT_MAX) {
+		return -EBADMSG;
+	}
+
+	st->varint |= (u32_t)(byte & 0x7f) << st->shift;
+	st->shift += 7;
+
+	return (byte & 0x80) ? 0 : 1;
+}
+
+static int record_done(struct delta_state *st)
+{
+	s64_t src_pos = (s64_t)st->src_pos + st->seek;
+
+	if ((src_pos < 0) || (src_pos > st->source_size)) {
+		return -EBADMSG;
+	}
+
+	st->src_pos = src_pos;
+	st->step = (st->target_pos == st->target_size) ? DELTA_STEP_DONE :
+							  DELTA_STEP_DIFF_LEN;
+
+	return 0;
+}
+
+static int diff_piece_done(struct delta_state *st)
+{
+	if (st->diff_left > 0) {
+		st->step = DELTA_STEP_ZERO_RUN;
+		return 0;
+	}
+
+	if (st->extra_left > 0) {
+		st->step = DELTA_STEP_EXTRA;
+		return 0;
+	}
+
+	return record_done(st);
+}
+
+static int varint_done(struct delta_state *st)
+{
+	u32_t val = st->varint;
+
+	st->varint = 0;
+	st->shift = 0;
+
+	switch (st->step) {
+	case DELTA_STEP_DIFF_LEN:
+		st->diff_left = val;
+		st->step = DELTA_STEP_EXTRA_LEN;
+		return 0;
+	case DELTA_STEP_EXTRA_LEN:
+		st->extra_left = val;
+		st->step = DELTA_STEP_SEEK;
+		return 0;
+	case DELTA_STEP_SEEK:
+		st->seek = (s32_t)(val >> 1) ^ -(s32_t)(val & 1);
+
+		if ((u64_t)st->target_pos + st->diff_left + st->extra_left >
+		    st->target_size) {
+			return -EBADMSG;
+		}
+
+		return diff_piece_done(st);
+	case DELTA_STEP_ZERO_RUN:
+		if (val > st->diff_left) {
+			return -EBADMSG;
+		}
+
+		st->run = val;
+		st->step = val ? DELTA_STEP_ZEROS : DELTA_STEP_LIT_LEN;
+		return 0;
+	case DELTA_STEP_LIT_LEN:
+		if (val > st->diff_left) {
+			return -EBADMSG;
+		}
+
+		st->run = val;
+
+		if (val == 0) {
+			return diff_piece_done(st);
+		}
+
+		st->step = DELTA_STEP_LIT;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Writes up to len target bytes, without crossing a target page so that a
+ * snapshot can be taken at every page boundary. Source bytes are added to
+ * the data if from_source is set, data may then be NULL for a zero run.
+ * Returns the number of bytes written.
+ */
+static int emit(struct delta_ctx *ctx, const u8_t *data, size_t len,
+		bool from_source)
+{
+	struct delta_state *st = &ctx->st;
+	size_t page_left = ctx->w->page_size -
+			   (st->target_pos % ctx->w->page_size);
+	size_t n = MIN(len, page_left);
+	int err;
+
+	if (from_source) {
+		n = MIN(n, sizeof(ctx->buf));
+
+		if (st->src_pos + n > st->source_size) {
+			return -EBADMSG;
+		}
+
+		err = flash_area_read(ctx->src, st->src_pos, ctx->buf, n);
+		if (err) {
+			return err;
+		}
+
+		for (size_t i = 0; (data != NULL) && (i < n); i++) {
+			ctx->buf[i] += data[i];
+		}
+
+		data = ctx->buf;
+		st->src_pos += n;
+	}
+
+	err = flash_writer_write(ctx->w, data, n);
+	if (err) {
+		return err;
+	}
+
+	st->target_pos += n;
+
+	return n;
+}
+
+static void snapshot_check(struct delta_ctx *ctx, size_t offset)
+{
+	struct delta_state *st = &ctx->st;
+
+	/* A target page boundary is also a write buffer boundary, the page
+	 * has just been written.
+	 */
+	if ((st->target_pos == ctx->snapshot.target_pos) ||
+	    (st->target_pos % ctx->w->page_size) ||
+	    (flash_writer_committed(ctx->w) != st->target_pos)) {
+		return;
+	}
+
+	ctx->snapshot = *st;
+	ctx->snapshot_offset = offset;
+}
+
+static int source_open(struct delta_ctx *ctx, struct flash_writer *w)
+{
+	int err;
+
+	err = flash_area_open(FLASH_AREA_ID(image_0), &ctx->src);
+	if (err) {
+		LOG_ERR("flash_area_open, error: %d", err);
+		return err;
+	}
+
+	ctx->w = w;
+	ctx->hdr_len = 0;
+
+	return 0;
+}
+
+int delta_apply_init(struct delta_ctx *ctx, struct flash_writer *w)
+{
+	memset(&ctx->st, 0, sizeof(ctx->st));
+	ctx->st.step = DELTA_STEP_HEADER;
+	ctx->snapshot = ctx->st;
+	ctx->snapshot_offset = 0;
+
+	return source_open(ctx, w);
+}
+
+int delta_apply_resume(struct delta_ctx *ctx, struct flash_writer *w,
+		       const struct delta_state *snapshot)
+{
+	if ((snapshot->step == DELTA_STEP_HEADER) ||
+	    (snapshot->step > DELTA_STEP_DONE)) {
+		return -EINVAL;
+	}
+
+	ctx->st = *snapshot;
+	ctx->snapshot = *snapshot;
+
+	return source_open(ctx, w);
+}
+
+int delta_apply_write(struct delta_ctx *ctx, const u8_t *data, size_t len,
+		      size_t offset)
+{
+	struct delta_state *st = &ctx->st;
+	const u8_t *start = data;
+	const u8_t *end = data + len;
+	int err = 0;
+	int n;
+
+	/* Zero runs produce output without consuming patch data. */
+	while ((data < end) || (st->step == DELTA_STEP_ZEROS)) {
+		switch (st->step) {
+		case DELTA_STEP_HEADER:
+			ctx->hdr[ctx->hdr_len++] = *data++;
+
+			if (ctx->hdr_len == sizeof(ctx->hdr)) {
+				err = header_parse(ctx);
+				st->step = DELTA_STEP_DIFF_LEN;
+			}
+			break;
+		case DELTA_STEP_DIFF_LEN:
+		case DELTA_STEP_EXTRA_LEN:
+		case DELTA_STEP_SEEK:
+		case DELTA_STEP_ZERO_RUN:
+		case DELTA_STEP_LIT_LEN:
+			err = varint_feed(st, *data++);
+			if (err > 0) {
+				err = varint_done(st);
+			}
+			break;
+		case DELTA_STEP_ZEROS:
+			n = emit(ctx, NULL, st->run, true);
+			if (n < 0) {
+				return n;
+			}
+
+			st->run -= n;
+			st->diff_left -= n;
+
+			if (st->run == 0) {
+				st->step = DELTA_STEP_LIT_LEN;
+			}
+			break;
+		case DELTA_STEP_LIT:
+			n = emit(ctx, data, MIN(st->run, end - data), true);
+			if (n < 0) {
+				return n;
+			}
+
+			data += n;
+			st->run -= n;
+			st->diff_left -= n;
+
+			if (st->run == 0) {
+				err = diff_piece_done(st);
+			}
+			break;
+		case DELTA_STEP_EXTRA:
+			n = emit(ctx, data, MIN(st->extra_left, end - data),
+				 false);
+			if (n < 0) {
+				return n;
+			}
+
+			data += n;
+			st->extra_left -= n;
+
+			if (st->extra_left == 0) {
+				err = record_done(st);
+			}
+			break;
+		default:
+			LOG_ERR("Data after the end of the patch");
+			return -EBADMSG;
+		}
+
+		if (err) {
+			LOG_ERR("Malformed patch at offset %u, error: %d",
+				(u32_t)(offset + (data - start)), err);
+			return err;
+		}
+
+		snapshot_check(ctx, offset + (data - start));
+	}
+
+	return 0;
+}
+
+int delta_apply_finish(struct delta_ctx *ctx)
+{
+	if (ctx->st.step != DELTA_STEP_DONE) {
+		LOG_ERR("Patch incomplete, %u of %u bytes written",
+			ctx->st.target_pos, ctx->st.target_size);
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+void delta_apply_close(struct delta_ctx *ctx)
+{
+	flash_area_close(ctx->src);
+}
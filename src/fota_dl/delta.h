@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Delta image applier header.
+ */
+
+#ifndef DELTA_H__
+#define DELTA_H__
+
+#include <zephyr.h>
+#include <flash_writer.h>
+
+/**
+ * @defgroup delta Delta image applier
+ * @{
+ * @brief Rebuilds an image from the running one and a patch streamed in
+ *        arbitrary chunks.
+ *
+ *        The patch starts with a 16 byte header: the magic "IPD1", then the
+ *        source size, the target size and the CRC-32 of the source, each
+ *        32-bit little endian. Records follow, each made of a diff length,
+ *        an extra length and a source seek as LEB128 varints, the seek
+ *        zigzag encoded. The diff section adds its bytes to the source
+ *        bytes at the source position, coded as pieces of a zero run length
+ *        and a literal length followed by the literal bytes. The extra
+ *        section is copied verbatim, then the source position moves by the
+ *        seek. The format is produced by scripts/delta_gen.py.
+ *
+ *        RAM use is bounded by CONFIG_FOTA_DL_DELTA_BUF_SIZE, independent of
+ *        the image size.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DELTA_MAGIC "IPD1"
+#define DELTA_MAGIC_LEN (sizeof(DELTA_MAGIC) - 1)
+#define DELTA_HEADER_LEN 16
+
+/** @brief Decoder state. Plain data, so it can be stored and restored to
+ *         continue a patch.
+ */
+struct delta_state {
+	/** Size of the source image. */
+	u32_t source_size;
+	/** Size of the target image. */
+	u32_t target_size;
+	/** Position in the source image. */
+	u32_t src_pos;
+	/** Number of target bytes written. */
+	u32_t target_pos;
+	/** Bytes left in the diff section of the current record. */
+	u32_t diff_left;
+	/** Bytes left in the extra section of the current record. */
+	u32_t extra_left;
+	/** Source seek applied at the end of the current record. */
+	s32_t seek;
+	/** Bytes left in the current zero run or literal. */
+	u32_t run;
+	/** Varint being decoded. */
+	u32_t varint;
+	/** Bit position in the varint being decoded. */
+	u8_t shift;
+	/** Decoding step. */
+	u8_t step;
+};
+
+/** @brief Delta applier. */
+struct delta_ctx {
+	/** Current state. */
+	struct delta_state st;
+	/** State at the last completely written target page. */
+	struct delta_state snapshot;
+	/** Patch offset the snapshot continues at. */
+	size_t snapshot_offset;
+	/** Source flash area. */
+	const struct flash_area *src;
+	/** Target writer. */
+	struct flash_writer *w;
+	/** Number of header bytes received. */
+	u8_t hdr_len;
+	/** Header being received. */
+	u8_t hdr[DELTA_HEADER_LEN];
+	/** Source bytes being patched. */
+	u8_t buf[CONFIG_FOTA_DL_DELTA_BUF_SIZE];
+};
+
+/** @brief Start applying a patch.
+ *
+ *  @param[out] ctx Applier.
+ *  @param[in] w Writer of the target image, opened at offset 0.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int delta_apply_init(struct delta_ctx *ctx, struct flash_writer *w);
+
+/** @brief Continue applying a patch from a snapshot.
+ *
+ *  @param[out] ctx Applier.
+ *  @param[in] w Writer of the target image, opened at the target position
+ *               of the snapshot.
+ *  @param[in] snapshot Snapshot taken by a previous applier.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int delta_apply_resume(struct delta_ctx *ctx, struct flash_writer *w,
+		       const struct delta_state *snapshot);
+
+/** @brief Apply the next chunk of a patch.
+ *
+ *  @param[in] ctx Applier.
+ *  @param[in] data Patch data.
+ *  @param[in] len Length of the data.
+ *  @param[in] offset Offset of the data in the patch.
+ *
+ *  @return 0 If successful.
+ *            -EBADMSG if the patch is malformed or does not apply to the
+ *            running image.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int delta_apply_write(struct delta_ctx *ctx, const u8_t *data, size_t len,
+		      size_t offset);
+
+/** @brief Check that the complete target image has been written.
+ *
+ *  @param[in] ctx Applier.
+ *
+ *  @return 0 If the patch is complete.
+ *            -EBADMSG otherwise.
+ */
+int delta_apply_finish(struct delta_ctx *ctx);
+
+/** @brief Close the source flash area.
+ *
+ *  @param[in] ctx Applier.
+ */
+void delta_apply_close(struct delta_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* DELTA_H__ */
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <flash_writer.h>
+#include <drivers/flash.h>
+#include <string.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(flash_writer, CONFIG_FOTA_DL_LOG_LEVEL);
+
+static int erase_to(struct flash_writer *w, size_t end)
+{
+	int err;
+
+	while (w->erased < end) {
+		LOG_DBG("Erasing page at 0x%x", (u32_t)w->erased);
+
+		err = flash_area_erase(w->fa, w->erased, w->page_size);
+		if (err) {
+			LOG_ERR("Erasing page at 0x%x failed, error: %d",
+				(u32_t)w->erased, err);
+			return err;
+		}
+
+		w->erased += w->page_size;
+	}
+
+	return 0;
+}
+
+static int buf_write(struct flash_writer *w, size_t len)
+{
+	int err;
+
+	if (w->offset + len > w->fa->fa_size) {
+		return -EFBIG;
+	}
+
+	err = erase_to(w, w->offset + len);
+	if (err) {
+		return err;
+	}
+
+	err = flash_area_write(w->fa, w->offset, w->buf, len);
+	if (err) {
+		LOG_ERR("Writing 0x%x bytes at 0x%x failed, error: %d",
+			(u32_t)len, (u32_t)w->offset, err);
+		return err;
+	}
+
+	w->offset += len;
+	w->buf_len = 0;
+
+	return 0;
+}
+
+int flash_writer_open(struct flash_writer *w, u8_t area_id, size_t offset)
+{
+	struct flash_pages_info info;
+	struct device *dev;
+	int err;
+
+	err = flash_area_open(area_id, &w->fa);
+	if (err) {
+		LOG_ERR("flash_area_open, error: %d", err);
+		return err;
+	}
+
+	dev = device_get_binding(w->fa->fa_dev_name);
+	if (dev == NULL) {
+		err = -ENODEV;
+		goto error;
+	}
+
+	/* The pages of the area are assumed to be of equal size, which they
+	 * are on the nRF91 internal flash.
+	 */
+	err = flash_get_page_info_by_offs(dev, w->fa->fa_off, &info);
+	if (err) {
+		goto error;
+	}
+
+	w->page_size = info.size;
+	w->align = flash_get_write_block_size(dev);
+
+	if ((offset % w->page_size) || (offset > w->fa->fa_size) ||
+	    (sizeof(w->buf) % w->align) || (w->page_size % sizeof(w->buf))) {
+		err = -EINVAL;
+		goto error;
+	}
+
+	w->offset = offset;
+	w->erased = offset;
+	w->buf_len = 0;
+
+	return 0;
+
+error:
+	flash_area_close(w->fa);
+	return err;
+}
+
+int flash_writer_write(struct flash_writer *w, const u8_t *data, size_t len)
+{
+	int err;
+
+	while (len > 0) {
+		size_t chunk = MIN(len, sizeof(w->buf) - w->buf_len);
+
+		memcpy(w->buf + w->buf_len, data, chunk);
+		w->buf_len += chunk;
+		data += chunk;
+		len -= chunk;
+
+		if (w->buf_len == sizeof(w->buf)) {
+			err = buf_write(w, w->buf_len);
+			if (err) {
+				return err;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int flash_writer_flush(struct flash_writer *w)
+{
+	size_t len = ROUND_UP(w->buf_len, w->align);
+
+	if (w->buf_len == 0) {
+		return 0;
+	}
+
+	/* Pad with the erased value, the padding is never read back. */
+	memset(w->buf + w->buf_len, 0xff, len - w->buf_len);
+
+	return buf_write(w, len);
+}
+
+void flash_writer_close(struct flash_writer *w)
+{
+	flash_area_close(w->fa);
+	w->buf_len = 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Streaming flash writer header.
+ */
+
+#ifndef FLASH_WRITER_H__
+#define FLASH_WRITER_H__
+
+#include <zephyr.h>
+#include <storage/flash_map.h>
+
+/**
+ * @defgroup flash_writer Streaming flash writer
+ * @{
+ * @brief Writes a stream of data sequentially to a flash area.
+ *
+ *        Data is buffered up to CONFIG_FOTA_DL_WRITE_BUF_SIZE bytes before
+ *        it is written, and each flash page is erased right before the
+ *        first write to it, so the area does not need to be erased up
+ *        front.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Streaming flash writer. */
+struct flash_writer {
+	/** Flash area written to. */
+	const struct flash_area *fa;
+	/** Size of the flash pages in the area. */
+	size_t page_size;
+	/** Write block size of the flash device. */
+	size_t align;
+	/** Number of bytes written to flash. */
+	size_t offset;
+	/** Offset up to which the area is erased. */
+	size_t erased;
+	/** Number of bytes in buf. */
+	size_t buf_len;
+	/** Data waiting to be written. */
+	u8_t buf[CONFIG_FOTA_DL_WRITE_BUF_SIZE];
+};
+
+/** @brief Open a flash area for writing.
+ *
+ *  @param[out] w Writer.
+ *  @param[in] area_id ID of the flash area.
+ *  @param[in] offset Offset the stream starts at. Must be aligned to a
+ *                    flash page, the page is erased again before it is
+ *                    written.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int flash_writer_open(struct flash_writer *w, u8_t area_id, size_t offset);
+
+/** @brief Append data to the stream.
+ *
+ *  @param[in] w Writer.
+ *  @param[in] data Data.
+ *  @param[in] len Length of the data.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int flash_writer_write(struct flash_writer *w, const u8_t *data, size_t len);
+
+/** @brief Write buffered data to flash, padded to the write block size.
+ *
+ *  @param[in] w Writer.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int flash_writer_flush(struct flash_writer *w);
+
+/** @brief Close the flash area. Buffered data is discarded.
+ *
+ *  @param[in] w Writer.
+ */
+void flash_writer_close(struct flash_writer *w);
+
+/** @brief Get the offset up to which all pages are completely written.
+ *
+ *  @details A stream interrupted after this point can be restarted at
+ *           this offset.
+ *
+ *  @param[in] w Writer.
+ *
+ *  @return Page aligned offset.
+ */
+static inline size_t flash_writer_committed(const struct flash_writer *w)
+{
+	return w->offset - (w->offset % w->page_size);
+}
+
+/** @brief Get the number of bytes appended to the stream.
+ *
+ *  @param[in] w Writer.
+ *
+ *  @return Number of bytes, including buffered ones.
+ */
+static inline size_t flash_writer_size(const struct flash_writer *w)
+{
+	return w->offset + w->buf_len;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* FLASH_WRITER_H__ */
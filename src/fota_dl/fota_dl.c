@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <fota_dl.h>
+#include <flash_writer.h>
+#if defined(CONFIG_FOTA_DL_DELTA)
+#include <delta.h>
+#endif
+#include <settings/settings.h>
+#include <dfu/mcuboot.h>
+#include <string.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(fota_dl, CONFIG_FOTA_DL_LOG_LEVEL);
+
+#define FOTA_DL_SETTINGS_KEY "fota_dl"
+#define FOTA_DL_PROGRESS_KEY "progress"
+#define MCUBOOT_IMAGE_MAGIC 0x96f3b83d
+
+/* Stored each time a flash page is complete. An image ID of 0 means no
+ * download. For a full image the download and flash offsets are equal,
+ * for a patch the decoder state at the flash offset is stored as well.
+ */
+static struct {
+	u32_t image_id;
+	u32_t total;
+	u32_t offset;
+	u32_t target;
+	u32_t delta;
+#if defined(CONFIG_FOTA_DL_DELTA)
+	struct delta_state delta_state;
+#endif
+} progress;
+
+static const struct fota_dl_transport *transport;
+static struct flash_writer writer;
+#if defined(CONFIG_FOTA_DL_DELTA)
+static struct delta_ctx delta_ctx;
+#endif
+/* Number of bytes of the download received and written. */
+static size_t received;
+static bool active;
+static s64_t request_time;
+static int retries;
+
+static int settings_set(const char *key, size_t len,
+			settings_read_cb read_cb, void *cb_arg)
+{
+	ssize_t read;
+
+	if (strcmp(key, FOTA_DL_PROGRESS_KEY) || (len != sizeof(progress))) {
+		return -ENOENT;
+	}
+
+	read = read_cb(cb_arg, &progress, sizeof(progress));
+	if (read < 0) {
+		return read;
+	}
+
+	return 0;
+}
+
+static struct settings_handler settings_handler = {
+	.name = FOTA_DL_SETTINGS_KEY,
+	.h_set = settings_set,
+};
+
+static int progress_save(void)
+{
+	int err;
+
+	err = settings_save_one(FOTA_DL_SETTINGS_KEY "/" FOTA_DL_PROGRESS_KEY,
+				&progress, sizeof(progress));
+	if (err) {
+		LOG_ERR("Saving progress failed, error: %d", err);
+	}
+
+	return err;
+}
+
+static void block_request(void)
+{
+	int err;
+
+	request_time = k_uptime_get();
+
+	if (transport == NULL) {
+		return;
+	}
+
+	err = transport->request(progress.image_id, received);
+	if (err) {
+		/* Retried when the request times out. */
+		LOG_WRN("Block request failed, error: %d", err);
+	}
+}
+
+static void download_close(void)
+{
+	flash_writer_close(&writer);
+#if defined(CONFIG_FOTA_DL_DELTA)
+	if (progress.delta) {
+		delta_apply_close(&delta_ctx);
+	}
+#endif
+	active = false;
+}
+
+static void download_end(int result)
+{
+	download_close();
+
+	/* Timeouts and transport errors keep the progress, the download
+	 * continues on the next connection. Anything else starts over.
+	 */
+	if ((result != -ETIMEDOUT) && (result != -EIO)) {
+		memset(&progress, 0, sizeof(progress));
+		(void)progress_save();
+	}
+
+	if (result) {
+		LOG_ERR("Download ended, error: %d", result);
+	} else {
+		LOG_INF("Download complete, upgrade requested");
+	}
+
+	if (transport != NULL) {
+		transport->done(result);
+	}
+}
+
+static int download_complete(void)
+{
+	u32_t magic;
+	int err;
+
+	if ((progress.total != 0) && (received != progress.total)) {
+		LOG_ERR("Download is %u bytes, expected %u", (u32_t)received,
+			progress.total);
+		return -EBADMSG;
+	}
+
+#if defined(CONFIG_FOTA_DL_DELTA)
+	if (progress.delta) {
+		err = delta_apply_finish(&delta_ctx);
+		if (err) {
+			return err;
+		}
+	}
+#endif
+
+	err = flash_writer_flush(&writer);
+	if (err) {
+		return err;
+	}
+
+	err = flash_area_read(writer.fa, 0, &magic, sizeof(magic));
+	if (err) {
+		return err;
+	}
+
+	if (magic != MCUBOOT_IMAGE_MAGIC) {
+		LOG_ERR("Not an MCUboot image");
+		return -EBADMSG;
+	}
+
+	return boot_request_upgrade(BOOT_UPGRADE_TEST);
+}
+
+int fota_dl_init(void)
+{
+	int err;
+
+	err = settings_subsys_init();
+	if (err) {
+		LOG_ERR("settings_subsys_init, error: %d", err);
+		return err;
+	}
+
+	err = settings_register(&settings_handler);
+	if (err) {
+		LOG_ERR("settings_register, error: %d", err);
+		return err;
+	}
+
+	err = settings_load_subtree(FOTA_DL_SETTINGS_KEY);
+	if (err) {
+		LOG_ERR("settings_load_subtree, error: %d", err);
+		return err;
+	}
+
+	if (progress.image_id != 0) {
+		LOG_INF("Download of image %u interrupted at %u bytes",
+			progress.image_id, progress.offset);
+	}
+
+	return 0;
+}
+
+int fota_dl_confirm(void)
+{
+	int err;
+
+	if (boot_is_img_confirmed()) {
+		return 0;
+	}
+
+	err = boot_write_img_confirmed();
+	if (err) {
+		LOG_ERR("boot_write_img_confirmed, error: %d", err);
+		return err;
+	}
+
+	LOG_INF("Running image confirmed");
+
+	return 0;
+}
+
+void fota_dl_transport_set(const struct fota_dl_transport *t)
+{
+	transport = t;
+}
+
+int fota_dl_start(u32_t image_id)
+{
+	int err;
+
+	if (image_id == 0) {
+		return -EINVAL;
+	}
+
+	if (active) {
+		if (image_id == progress.image_id) {
+			return -EALREADY;
+		}
+
+		LOG_WRN("Download of image %u replaced by image %u",
+			progress.image_id, image_id);
+		download_end(-ECANCELED);
+	}
+
+	if (image_id != progress.image_id) {
+		memset(&progress, 0, sizeof(progress));
+		progress.image_id = image_id;
+
+		err = progress_save();
+		if (err) {
+			return err;
+		}
+	}
+
+	err = flash_writer_open(&writer, FLASH_AREA_ID(image_1),
+				progress.target);
+	if (err) {
+		LOG_ERR("flash_writer_open, error: %d", err);
+		return err;
+	}
+
+#if defined(CONFIG_FOTA_DL_DELTA)
+	/* There is no decoder state before the first page of a patch, the
+	 * patch is told again by its magic.
+	 */
+	if (progress.target == 0) {
+		progress.delta = false;
+	}
+
+	if (progress.delta) {
+		err = delta_apply_resume(&delta_ctx, &writer,
+					 &progress.delta_state);
+		if (err) {
+			LOG_ERR("delta_apply_resume, error: %d", err);
+			flash_writer_close(&writer);
+			return err;
+		}
+	}
+#endif
+
+	received = progress.offset;
+
+	LOG_INF("Downloading image %u from offset %u", image_id,
+		progress.offset);
+
+	active = true;
+	retries = 0;
+	block_request();
+
+	return 0;
+}
+
+int fota_dl_resume(void)
+{
+	if (active) {
+		retries = 0;
+		block_request();
+		return 0;
+	}
+
+	if (progress.image_id == 0) {
+		return 0;
+	}
+
+	return fota_dl_start(progress.image_id);
+}
+
+static int data_write(const u8_t *data, size_t len)
+{
+#if defined(CONFIG_FOTA_DL_DELTA)
+	int err;
+
+	/* The type of the download is told by its first bytes. */
+	if ((received == 0) && (len >= DELTA_MAGIC_LEN) &&
+	    (memcmp(data, DELTA_MAGIC, DELTA_MAGIC_LEN) == 0)) {
+		err = delta_apply_init(&delta_ctx, &writer);
+		if (err) {
+			return err;
+		}
+
+		progress.delta = true;
+
+		LOG_INF("Download is a patch to the running image");
+	}
+
+	if (progress.delta) {
+		return delta_apply_write(&delta_ctx, data, len, received);
+	}
+#endif
+
+	return flash_writer_write(&writer, data, len);
+}
+
+static void progress_update(void)
+{
+	u32_t target = flash_writer_committed(&writer);
+	u32_t offset = target;
+
+	if (target <= progress.target) {
+		return;
+	}
+
+#if defined(CONFIG_FOTA_DL_DELTA)
+	if (progress.delta) {
+		target = delta_ctx.snapshot.target_pos;
+		offset = delta_ctx.snapshot_offset;
+		progress.delta_state = delta_ctx.snapshot;
+	}
+#endif
+
+	progress.target = target;
+	progress.offset = offset;
+	(void)progress_save();
+}
+
+int fota_dl_block_received(u32_t image_id, size_t offset, const u8_t *data,
+			   size_t len, size_t total, bool last)
+{
+	size_t skip;
+	int err;
+
+	if (!active || (image_id != progress.image_id)) {
+		LOG_DBG("Block of image %u not requested", image_id);
+		return -EINVAL;
+	}
+
+	if (offset > received) {
+		LOG_WRN("Block at %u received, expected %u", (u32_t)offset,
+			(u32_t)received);
+		return -EINVAL;
+	}
+
+	skip = MIN(received - offset, len);
+
+	/* A late answer to a request that was retried. The data following
+	 * it has been requested already, requesting it again would start
+	 * another stream of blocks.
+	 */
+	if ((skip == len) && !last) {
+		LOG_DBG("Block at %u already received", (u32_t)offset);
+		return 0;
+	}
+
+	if (total != 0) {
+		if (total > writer.fa->fa_size) {
+			LOG_ERR("Download of %u bytes does not fit the slot",
+				(u32_t)total);
+			download_end(-EFBIG);
+			return -EFBIG;
+		}
+
+		progress.total = total;
+	}
+
+	err = data_write(data + skip, len - skip);
+	if (err) {
+		download_end(err);
+		return err;
+	}
+
+	received += len - skip;
+	retries = 0;
+
+	LOG_DBG("Received %u bytes at %u of %u", (u32_t)len, (u32_t)offset,
+		(u32_t)total);
+
+	progress_update();
+
+	if (last || ((total != 0) && (received >= total))) {
+		err = download_complete();
+		download_end(err);
+		return err;
+	}
+
+	block_request();
+
+	return 0;
+}
+
+s32_t fota_dl_timeout_get(void)
+{
+	s64_t left;
+
+	if (!active) {
+		return K_FOREVER;
+	}
+
+	left = request_time + CONFIG_FOTA_DL_BLOCK_TIMEOUT_MS - k_uptime_get();
+
+	return MAX(left, 0);
+}
+
+void fota_dl_process(void)
+{
+	if (fota_dl_timeout_get() != 0) {
+		return;
+	}
+
+	if (retries++ >= CONFIG_FOTA_DL_RETRIES) {
+		download_end(-ETIMEDOUT);
+		return;
+	}
+
+	LOG_WRN("Block request timed out, retry %d of %d", retries,
+		CONFIG_FOTA_DL_RETRIES);
+
+	block_request();
+}
+
+bool fota_dl_active(void)
+{
+	return active;
+}
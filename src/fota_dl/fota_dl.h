@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief FOTA download library header.
+ */
+
+#ifndef FOTA_DL_H__
+#define FOTA_DL_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup fota_dl FOTA download library
+ * @{
+ * @brief Downloads a firmware image into the MCUboot secondary slot.
+ *
+ *        The image is requested block by block through the transport of
+ *        the connected backend. Each block is streamed to flash and the
+ *        offset of the last completely written flash page is stored, so an
+ *        interrupted download, also across a reset, continues from there
+ *        instead of from the start.
+ *
+ *        The library is not thread safe. All functions must be called from
+ *        the thread driving the cloud connection, which is also the one
+ *        the backends deliver received blocks on.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Transport used to fetch the image. */
+struct fota_dl_transport {
+	/** Request the data of an image starting at an offset. The transport
+	 *  may deliver data from an earlier offset, for example from the start
+	 *  of the block containing it, the overlap is skipped.
+	 */
+	int (*request)(u32_t image_id, size_t offset);
+	/** Called when a download ends. 0 if the image is complete and
+	 *  marked for upgrade, otherwise a (negative) error code.
+	 */
+	void (*done)(int result);
+};
+
+/** @brief Load the download progress.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int fota_dl_init(void);
+
+/** @brief Confirm the running image.
+ *
+ *  @details Call once the connection to the cloud is ready. An image booted
+ *           for test after a download is kept from then on, MCUboot
+ *           reverts it at the next reset otherwise.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int fota_dl_confirm(void);
+
+/** @brief Set the transport of the connected backend.
+ *
+ *  @param[in] transport Transport. Must remain valid while set.
+ */
+void fota_dl_transport_set(const struct fota_dl_transport *transport);
+
+/** @brief Start downloading an image.
+ *
+ *  @details If the progress stored belongs to the same image, the download
+ *           continues from it. Otherwise it starts at the beginning.
+ *
+ *  @param[in] image_id Identifier of the image, not 0.
+ *
+ *  @return 0 If successful.
+ *            -EALREADY if the image is already being downloaded.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int fota_dl_start(u32_t image_id);
+
+/** @brief Continue an interrupted download.
+ *
+ *  @details Call when the connection is ready. Requests the next block of
+ *           a download in progress or starts the download stored before a
+ *           reset. Does nothing if there is none.
+ *
+ *  @return 0 If successful or nothing to resume.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int fota_dl_resume(void);
+
+/** @brief Pass data received from the transport.
+ *
+ *  @param[in] image_id Identifier of the image the data belongs to.
+ *  @param[in] offset Offset of the data in the image.
+ *  @param[in] data Data.
+ *  @param[in] len Length of the data.
+ *  @param[in] total Size of the image, 0 if not known.
+ *  @param[in] last True if the data ends the image.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int fota_dl_block_received(u32_t image_id, size_t offset, const u8_t *data,
+			   size_t len, size_t total, bool last);
+
+/** @brief Get the time until a block request is retried.
+ *
+ *  @return Time in milliseconds, K_FOREVER if no download is active.
+ */
+s32_t fota_dl_timeout_get(void);
+
+/** @brief Retry the block request if it has timed out. */
+void fota_dl_process(void);
+
+/** @brief Check if a download is active.
+ *
+ *  @return True if a download is active.
+ */
+bool fota_dl_active(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* FOTA_DL_H__ */
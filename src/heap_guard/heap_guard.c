@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <heap_guard.h>
+#include <reent.h>
+
+#if defined(CONFIG_NO_HEAP)
+BUILD_ASSERT_MSG(CONFIG_HEAP_MEM_POOL_SIZE == 0,
+		 "CONFIG_NO_HEAP requires CONFIG_HEAP_MEM_POOL_SIZE=0");
+#endif
+
+static atomic_t allocs;
+static atomic_t bytes;
+static atomic_t refused;
+static atomic_t last_caller;
+
+void *__real_k_malloc(size_t size);
+void *__real_k_calloc(size_t nmemb, size_t size);
+void *__real__malloc_r(struct _reent *r, size_t size);
+void *__real__calloc_r(struct _reent *r, size_t nmemb, size_t size);
+void *__real__realloc_r(struct _reent *r, void *ptr, size_t size);
+
+/* Returns true if the allocation may proceed. Runs in the caller's context,
+ * which can be an ISR, so only printk() is used to report.
+ */
+static bool alloc_record(size_t size, void *caller)
+{
+	atomic_inc(&allocs);
+	atomic_add(&bytes, size);
+	atomic_set(&last_caller, (atomic_val_t)caller);
+
+	if (!IS_ENABLED(CONFIG_NO_HEAP)) {
+		return true;
+	}
+
+	atomic_inc(&refused);
+	printk("Heap allocation of %u bytes from %p refused\n",
+	       (unsigned int)size, caller);
+
+	return false;
+}
+
+void *__wrap_k_malloc(size_t size)
+{
+	if (!alloc_record(size, __builtin_return_address(0))) {
+		return NULL;
+	}
+
+	return __real_k_malloc(size);
+}
+
+void *__wrap_k_calloc(size_t nmemb, size_t size)
+{
+	if (!alloc_record(nmemb * size, __builtin_return_address(0))) {
+		return NULL;
+	}
+
+	return __real_k_calloc(nmemb, size);
+}
+
+void *__wrap__malloc_r(struct _reent *r, size_t size)
+{
+	if (!alloc_record(size, __builtin_return_address(0))) {
+		return NULL;
+	}
+
+	return __real__malloc_r(r, size);
+}
+
+void *__wrap__calloc_r(struct _reent *r, size_t nmemb, size_t size)
+{
+	if (!alloc_record(nmemb * size, __builtin_return_address(0))) {
+		return NULL;
+	}
+
+	return __real__calloc_r(r, nmemb, size);
+}
+
+void *__wrap__realloc_r(struct _reent *r, void *ptr, size_t size)
+{
+	if (!alloc_record(size, __builtin_return_address(0))) {
+		return NULL;
+	}
+
+	return __real__realloc_r(r, ptr, size);
+}
+
+void heap_guard_stats_get(struct heap_guard_stats *stats)
+{
+	stats->allocs = atomic_get(&allocs);
+	stats->bytes = atomic_get(&bytes);
+	stats->refused = atomic_get(&refused);
+	stats->last_caller = (void *)atomic_get(&last_caller);
+}
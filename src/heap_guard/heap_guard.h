@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Heap guard library header.
+ */
+
+#ifndef HEAP_GUARD_H__
+#define HEAP_GUARD_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup heap_guard Heap guard library
+ * @{
+ * @brief Counts heap allocations made through k_malloc(), k_calloc() and
+ *        the newlib allocator.
+ *
+ *        With CONFIG_NO_HEAP every allocation is refused, so a build that
+ *        runs with zero allocations proves the code path never touches the
+ *        heap.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Heap allocation metrics. */
+struct heap_guard_stats {
+	/** Number of allocation requests. */
+	u32_t allocs;
+	/** Total number of bytes requested. */
+	u32_t bytes;
+	/** Number of requests refused because the heap is disabled. */
+	u32_t refused;
+	/** Return address of the last caller requesting memory. */
+	void *last_caller;
+};
+
+/** @brief Get heap allocation metrics.
+ *
+ *  @param[out] stats Pointer to struct the metrics are copied to.
+ */
+void heap_guard_stats_get(struct heap_guard_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* HEAP_GUARD_H__ */
@@ -5,62 +5,661 @@
  */
 
 #include <zephyr.h>
+#include <string.h>
 #include <modem/lte_lc.h>
 #include <net/cloud.h>
 #include <net/socket.h>
 #include <dk_buttons_and_leds.h>
+#include <publish_sched.h>
+#include <app_trace.h>
+#include <endpoint.h>
+#include <logging/log.h>
 
-static struct cloud_backend *cloud_backend;
-static struct k_delayed_work cloud_update_work;
-static struct k_delayed_work cloud_ping_work;
+#if defined(CONFIG_AT_CMD)
+#include <modem/at_cmd.h>
+#endif
+
+#if defined(CONFIG_DOWNLINK)
+#include <downlink.h>
+#endif
+
+#if defined(CONFIG_SHADOW)
+#include <shadow.h>
+#endif
+
+#if defined(CONFIG_CONN_POLICY)
+#include <conn_policy.h>
+#endif
+
+#if defined(CONFIG_TX_DEFER)
+#include <tx_defer.h>
+#endif
+
+/* With deferral, button 1 publishes alongside the periodic publications.
+ * The user awaits those, they are sent at once and release what is held.
+ */
+#if defined(CONFIG_CLOUD_PUBLICATION_BUTTON_PRESS) || \
+	defined(CONFIG_TX_DEFER)
+#define BUTTON_PUBLICATION
+#endif
+
+#if defined(CONFIG_POWER_PROFILE)
+#include <power_profile.h>
+
+/* Pressing button 1 while button 2 is held switches the power profile. */
+#define POWER_PROFILE_BUTTONS (DK_BTN1_MSK | DK_BTN2_MSK)
+#endif
+
+#if defined(CONFIG_MSG_POOL)
+#include <msg_pool.h>
+
+#if !defined(CONFIG_SERIALIZER)
+BUILD_ASSERT_MSG(sizeof(CONFIG_CLOUD_MESSAGE) - 1 <= CONFIG_MSG_POOL_BUF_SIZE,
+		 "CONFIG_CLOUD_MESSAGE does not fit in a message buffer");
+#endif
+#endif
+
+#if defined(CONFIG_SERIALIZER)
+#include <serializer.h>
+#endif
+
+#if defined(CONFIG_SERIALIZER_FORMAT_POSITIONAL)
+#include <schema.h>
+#endif
+
+/* The CoAP backend lets records be encoded directly into its message
+ * buffer. The MQTT library writes the payload from the buffer it is given,
+ * so only CoAP copied it.
+ */
+#if defined(CONFIG_SERIALIZER) && defined(CONFIG_COAP_BACKEND) && \
+	!defined(CONFIG_COAP_BACKEND_OSCORE)
+#include <coap_backend.h>
+#define RECORD_IN_PLACE
+#endif
+
+#if defined(CONFIG_HEAP_GUARD)
+#include <heap_guard.h>
+#endif
+
+#if defined(CONFIG_FOTA_DL)
+#include <fota_dl.h>
+#include <power/reboot.h>
+#endif
+
+#if defined(CONFIG_PERF_BUDGET)
+#include <perf_budget.h>
+#endif
+
+LOG_MODULE_REGISTER(app, CONFIG_APP_LOG_LEVEL);
+
+/* Connection to a cloud backend. */
+struct cloud_link {
+	struct cloud_backend *backend;
+	const char *name;
+	/* Servers of the backend, NULL if it selects them itself. */
+	struct endpoint_list *endpoints;
+	/* Set while the connection is ready for data. */
+	atomic_t ready;
+	bool connected;
+	s64_t connect_start;
+	/* Uptime to reconnect at, 0 when no reconnection is pending. */
+	s64_t retry_at;
+};
+
+/* CONFIG_CLOUD_BACKEND, followed by CONFIG_CLOUD_BACKEND_TELEMETRY when it
+ * names another backend.
+ */
+static struct cloud_link links[2];
+static size_t link_count;
+
+/* Classes of messages, each routed to the cheapest link meeting its needs. */
+enum msg_class {
+	/* Device shadow state, commands are received on the same link. */
+	MSG_CLASS_CONTROL,
+	/* Periodic records and the schemas they are encoded with. */
+	MSG_CLASS_TELEMETRY,
+	MSG_CLASS_COUNT
+};
+
+static struct cloud_link *class_link[MSG_CLASS_COUNT];
+
+#if defined(CONFIG_CLOUD_PUBLICATION_SEQUENTIAL)
+static struct publish_periodic cloud_update_work;
+#endif
+#if defined(BUTTON_PUBLICATION)
+static struct publish_work button_publish_work;
+#endif
+static struct publish_work cloud_ping_work;
+/* Starts publications that waited for the connection or the signal, on
+ * the publish work queue like every other publication.
+ */
+static struct publish_work deferred_publish_work;
+
+#if defined(CONFIG_PUBLISH_SCHED_PHASE_SPREAD)
+#define RECONNECT_SPREAD_WINDOW \
+	K_SECONDS(CONFIG_PUBLISH_SCHED_RECONNECT_SPREAD_WINDOW)
+#define PING_SPREAD_WINDOW K_SECONDS(CONFIG_PUBLISH_SCHED_PING_SPREAD_WINDOW)
+#else
+#define RECONNECT_SPREAD_WINDOW 0
+#define PING_SPREAD_WINDOW 0
+#endif
+
+#define PUBLICATION_INTERVAL \
+	K_SECONDS(CONFIG_CLOUD_MESSAGE_PUBLICATION_INTERVAL)
 
 static int packet_count = 0;
 
-static void cloud_update_work_fn(struct k_work *work)
+/* Set when a publication waits for the connection to become ready. */
+static atomic_t publish_pending;
+/* Wakes the main thread to connect in connect per publication mode. */
+K_SEM_DEFINE(connect_sem, 0, 1);
+
+static s64_t last_activity;
+
+#if defined(CONFIG_CLOUD_PUBLICATION_SEQUENTIAL)
+static bool publishing_started;
+#endif
+
+#if defined(CONFIG_POWER_PROFILE_LOW_POWER_ON_BOOT)
+static bool low_power_entered;
+#endif
+
+#if defined(CONFIG_SERIALIZER)
+/* The values of the default CONFIG_CLOUD_MESSAGE. */
+static const struct telemetry telemetry = {
+	.dev = {
+		.band = 3,
+		.nw = "NB-IoT GPS",
+		.iccid = "89450421180216254864",
+		.mod_v = "mfw_nrf9160_1.1.0-40.rc",
+		.brd_v = "nrf9160_pca10090",
+		.app_v = "1.0.2",
+		.ts = 1581412370663ULL
+	},
+	.roam = {
+		.rsrp = 64,
+		.area = 3305,
+		.mccmnc = 24202,
+		.cell = 34237203,
+		.ip = "10.81.160.193",
+		.ts = 1581438337056ULL
+	},
+	.bat = {
+		.v = 4125,
+		.ts = 1581438332150ULL
+	},
+	.acc = {
+		.v = { 6.442969, 7.256921, -1.019891 },
+		.ts = 1574251825404ULL
+	},
+	.gps = {
+		.lng = 10.437156350160675,
+		.lat = 63.421399614436105,
+		.acc = 5.192617416381836,
+		.alt = 152.19400024414062,
+		.spd = 0.0854216143488884,
+		.hdg = 0,
+		.ts = 1581438332000ULL
+	}
+};
+#endif
+
+static bool per_burst_mode(void)
+{
+#if defined(CONFIG_CONN_POLICY)
+	/* The main thread waits for input on the control link, it can only
+	 * stay disconnected between publications when that is the telemetry
+	 * link as well.
+	 */
+	return (link_count == 1) &&
+	       (conn_policy_mode_get() == CONN_POLICY_MODE_PER_BURST);
+#else
+	return false;
+#endif
+}
+
+static bool download_active(void)
+{
+#if defined(CONFIG_FOTA_DL)
+	return fota_dl_active();
+#else
+	return false;
+#endif
+}
+
+/* In per burst mode the connection is kept for a while after the last
+ * publication, and for as long as a firmware download runs.
+ */
+static bool lingering(void)
+{
+	return per_burst_mode() && atomic_get(&links[0].ready) &&
+	       !download_active();
+}
+
+#if defined(RECORD_IN_PLACE)
+static bool record_in_place(void)
+{
+	return class_link[MSG_CLASS_TELEMETRY]->backend ==
+	       cloud_get_binding("COAP_BACKEND");
+}
+
+static int record_publish_in_place(void)
+{
+	struct coap_backend_writer writer;
+	int len;
+	int err;
+
+	err = coap_backend_write_begin(&writer, NULL);
+	if (err) {
+		return err;
+	}
+
+	len = serializer_encode(&telemetry, writer.buf, writer.size);
+	if (len < 0) {
+		coap_backend_write_abort();
+		return len;
+	}
+
+	printk("Record encoded in place in %d bytes\n", len);
+
+	return coap_backend_write_end(len);
+}
+#endif
+
+static void cloud_publish(void)
 {
 	int err;
+	struct publish_sched_jitter jitter;
 
+#if defined(CONFIG_SERIALIZER)
+	printk("Publishing %s record\n", serializer_get()->name);
+#else
 	printk("Publishing message: %s\n", CONFIG_CLOUD_MESSAGE);
+#endif
 	printk("Packet count: %d\n", packet_count);
 
 	packet_count++;
 
+#if defined(RECORD_IN_PLACE)
+	if (record_in_place()) {
+		err = record_publish_in_place();
+		if (err) {
+			printk("Publishing in place failed, error: %d\n", err);
+		}
+
+		goto published;
+	}
+#endif
+
+#if defined(CONFIG_MSG_POOL)
+	struct msg_buf *buf = msg_buf_alloc(K_NO_WAIT);
+
+	if (buf == NULL) {
+		printk("No free message buffer, publication skipped\n");
+		goto reschedule;
+	}
+
+	/* The buffer is filled once, the backend references it directly
+	 * for as long as it needs it.
+	 */
+#if defined(CONFIG_SERIALIZER)
+	err = serializer_encode(&telemetry, buf->data,
+				CONFIG_MSG_POOL_BUF_SIZE);
+	if (err < 0) {
+		printk("serializer_encode, error: %d\n", err);
+		msg_buf_unref(buf);
+		goto reschedule;
+	}
+
+	buf->len = err;
+	printk("Record encoded in %d bytes\n", buf->len);
+#else
+	buf->len = sizeof(CONFIG_CLOUD_MESSAGE) - 1;
+	memcpy(buf->data, CONFIG_CLOUD_MESSAGE, buf->len);
+#endif
+
+	struct cloud_msg msg = {
+		.qos = CLOUD_QOS_AT_MOST_ONCE,
+		.endpoint.type = CLOUD_EP_TOPIC_MSG,
+		.buf = (char *)buf->data,
+		.len = buf->len
+	};
+#else
 	struct cloud_msg msg = {
 		.qos = CLOUD_QOS_AT_MOST_ONCE,
 		.endpoint.type = CLOUD_EP_TOPIC_MSG,
 		.buf = CONFIG_CLOUD_MESSAGE,
 		.len = sizeof(CONFIG_CLOUD_MESSAGE)-1
 	};
+#endif
 
-	err = cloud_send(cloud_backend, &msg);
+	err = cloud_send(class_link[MSG_CLASS_TELEMETRY]->backend, &msg);
 	if (err) {
 		printk("cloud_send failed, error: %d\n", err);
 	}
 
+#if defined(CONFIG_MSG_POOL)
+	msg_buf_unref(buf);
+#endif
+
+#if defined(RECORD_IN_PLACE)
+published:
+#endif
+#if defined(CONFIG_SHADOW)
+	/* Values changed locally go out with the publication. */
+	err = shadow_sync(false);
+	if (err) {
+		printk("shadow_sync, error: %d\n", err);
+	}
+#endif
+
+	last_activity = k_uptime_get();
+
+#if defined(CONFIG_MSG_POOL)
+reschedule:
+#endif
+	/* Statistics are logged at the debug level, the lines the sample
+	 * tests look for are printed in their configurations only.
+	 */
+	publish_sched_jitter_get(&jitter);
+	LOG_DBG("Publish jitter: last %d ms, min %d ms, max %d ms, avg %d ms",
+		jitter.last, jitter.min, jitter.max, jitter.avg);
+
 #if defined(CONFIG_CLOUD_PUBLICATION_SEQUENTIAL)
-	k_delayed_work_submit(
-			&cloud_update_work,
-			K_SECONDS(CONFIG_CLOUD_MESSAGE_PUBLICATION_INTERVAL));
+	/* The next publication is scheduled by the periodic work item from
+	 * an absolute deadline, so the time spent here does not add up.
+	 */
+	LOG_DBG("Missed publication periods: %d", cloud_update_work.missed);
+#endif
+
+#if defined(CONFIG_HEAP_GUARD)
+	struct heap_guard_stats heap;
+
+	heap_guard_stats_get(&heap);
+
+	if (IS_ENABLED(CONFIG_NO_HEAP)) {
+		printk("Heap allocations: %d, %d bytes, last caller %p\n",
+		       heap.allocs, heap.bytes, heap.last_caller);
+	} else {
+		LOG_DBG("Heap allocations: %d, %d bytes, last caller %p",
+			heap.allocs, heap.bytes, heap.last_caller);
+	}
+
+	if (IS_ENABLED(CONFIG_NO_HEAP) && heap.allocs) {
+		printk("ERROR: %d heap allocation(s) refused\n", heap.refused);
+	}
+#endif
+
+#if defined(CONFIG_TX_DEFER)
+	struct tx_defer_stats defer;
+
+	tx_defer_stats_get(&defer);
+	LOG_DBG("Deferred publications: %d, coalesced %d, longest hold %d ms, "
+		"RSRP %d dBm", defer.deferred, defer.coalesced,
+		defer.held_max, defer.rsrp);
+#endif
+
+#if defined(CONFIG_PERF_BUDGET)
+	struct perf_budget_stats perf;
+
+	err = perf_budget_check();
+	perf_budget_stats_get(&perf);
+	LOG_DBG("Encode: %d cycles, max %d, message %d bytes, max %d, "
+		"stack %d bytes", perf.cycles_last, perf.cycles_max,
+		perf.bytes_last, perf.bytes_max, perf.stack_max);
+
+	if (err) {
+		printk("ERROR: %d performance budget(s) exceeded\n",
+		       perf.exceeded);
+	} else if (perf.msgs == CONFIG_PERF_BUDGET_PUBLICATIONS) {
+		/* Reported once, over all publications measured until then. */
+		printk("Performance budgets met over %u publications\n",
+		       perf.msgs);
+	}
+#endif
+}
+
+static void publication_start(void)
+{
+	if (!atomic_get(&class_link[MSG_CLASS_TELEMETRY]->ready)) {
+		/* The main thread connects if needed and publishes once the
+		 * connection is ready.
+		 */
+		atomic_set(&publish_pending, 1);
+		k_sem_give(&connect_sem);
+		return;
+	}
+
+	cloud_publish();
+}
+
+static void publication_request(bool urgent)
+{
+	app_trace_publish_enqueue(packet_count);
+
+#if defined(CONFIG_CONN_POLICY)
+	conn_policy_publish_notify();
 #endif
+
+#if defined(CONFIG_TX_DEFER)
+	/* Held publications are started by deferred_publish_work, later
+	 * ones are coalesced with them.
+	 */
+	if (tx_defer_hold(urgent ? TX_DEFER_CLASS_URGENT :
+			  TX_DEFER_CLASS_BULK)) {
+		return;
+	}
+#endif
+
+	publication_start();
 }
 
+#if defined(CONFIG_CLOUD_PUBLICATION_SEQUENTIAL)
+static void cloud_update_work_fn(struct k_work *work)
+{
+	/* Periodic publications can wait for better coverage. */
+	publication_request(false);
+}
+#endif
+
+#if defined(BUTTON_PUBLICATION)
+static void button_publish_work_fn(struct k_work *work)
+{
+	publication_request(true);
+}
+#endif
+
+static void deferred_publish_work_fn(struct k_work *work)
+{
+	publication_start();
+}
+
+#if defined(CONFIG_TX_DEFER)
+static void tx_defer_release(enum tx_defer_reason reason)
+{
+	printk("Deferred publication released, %s\n",
+	       tx_defer_reason_str(reason));
+	publish_work_submit(&deferred_publish_work, K_NO_WAIT);
+}
+#endif
+
 static void cloud_ping_work_fn(struct k_work *work)
 {
 	int err;
 
 	printk("Pinging cloud!\n");
-	err = cloud_ping(cloud_backend);
+	err = cloud_ping(class_link[MSG_CLASS_CONTROL]->backend);
 	if (err) {
 		printk("cloud_ping, err: %d\n", err);
 	}
 }
 
+#if defined(CONFIG_POWER_PROFILE)
+static void power_profile_switch(enum power_profile profile)
+{
+	int err;
+
+	printk("Switching to %s power profile\n",
+	       profile == POWER_PROFILE_LOW_POWER ? "low power" : "debug");
+
+	err = power_profile_set(profile);
+	if (err) {
+		printk("power_profile_set, error: %d\n", err);
+	}
+
+#if defined(CONFIG_SHADOW)
+	(void)shadow_report("power",
+			    power_profile_get() == POWER_PROFILE_LOW_POWER);
+#endif
+}
+#endif
+
+#if defined(CONFIG_CONN_POLICY)
+static void conn_policy_print(void)
+{
+	struct conn_policy_decision decision;
+
+	conn_policy_decision_get(&decision);
+
+	printk("Connection mode: %s, %s\n",
+	       conn_policy_mode_str(decision.mode),
+	       conn_policy_reason_str(decision.reason));
+	printk("Connect time %d ms, gap %d ms, keepalive %d ms\n",
+	       decision.connect_time, decision.gap, decision.keepalive);
+	printk("Estimated cost per gap: persistent %d uC, per burst %d uC\n",
+	       decision.persistent_cost, decision.per_burst_cost);
+}
+#endif
+
+#if defined(CONFIG_SERIALIZER_FORMAT_POSITIONAL)
+/* Lets the server check at every connection that it decodes records with
+ * the same schemas.
+ */
+static void schemas_announce(void)
+{
+	struct msg_buf *buf = msg_buf_alloc(K_NO_WAIT);
+	u8_t *data;
+	int err;
+
+	if (buf == NULL) {
+		printk("No free message buffer, schemas not announced\n");
+		return;
+	}
+
+	data = buf->data;
+
+	err = schema_announce_encode(data, CONFIG_MSG_POOL_BUF_SIZE);
+	if (err < 0) {
+		printk("schema_announce_encode, error: %d\n", err);
+		goto exit;
+	}
+
+	struct cloud_msg msg = {
+		.qos = CLOUD_QOS_AT_LEAST_ONCE,
+		.endpoint.type = CLOUD_EP_TOPIC_MSG,
+		.buf = (char *)data,
+		.len = err
+	};
+
+	err = cloud_send(class_link[MSG_CLASS_TELEMETRY]->backend, &msg);
+	if (err) {
+		printk("cloud_send failed, error: %d\n", err);
+		goto exit;
+	}
+
+	printk("Schemas announced in %d bytes\n", msg.len);
+
+exit:
+	msg_buf_unref(buf);
+}
+#endif
+
+static struct cloud_link *link_find(const struct cloud_backend *backend)
+{
+	for (size_t i = 0; i < link_count; i++) {
+		if (links[i].backend == backend) {
+			return &links[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* With a single link, both parts apply to it. */
+static void link_ready(struct cloud_link *link)
+{
+#if defined(CONFIG_SHADOW)
+	int err;
+#endif
+
+	atomic_set(&link->ready, 1);
+
+	if (link == class_link[MSG_CLASS_TELEMETRY]) {
+		last_activity = k_uptime_get();
+#if defined(CONFIG_CONN_POLICY)
+		conn_policy_connect_time_set(last_activity -
+					     link->connect_start);
+		conn_policy_keepalive_set(
+			MAX(cloud_keepalive_time_left(link->backend), 0));
+		conn_policy_print();
+#endif
+#if defined(CONFIG_SERIALIZER_FORMAT_POSITIONAL)
+		schemas_announce();
+#endif
+	}
+
+#if defined(CONFIG_SHADOW)
+	if (link == class_link[MSG_CLASS_CONTROL]) {
+		/* Brings what changed on the server while disconnected. */
+		err = shadow_sync(true);
+		if (err) {
+			printk("shadow_sync, error: %d\n", err);
+		}
+	}
+#endif
+#if defined(CONFIG_POWER_PROFILE_LOW_POWER_ON_BOOT)
+	if (!low_power_entered) {
+		low_power_entered = true;
+		power_profile_switch(POWER_PROFILE_LOW_POWER);
+	}
+#endif
+#if defined(CONFIG_CLOUD_PUBLICATION_SEQUENTIAL)
+	/* Started at the first connection, and again after every loss of
+	 * the connection outside of per burst mode.
+	 */
+	if ((link == class_link[MSG_CLASS_TELEMETRY]) && !publishing_started) {
+		publishing_started = true;
+		publish_periodic_start(
+			&cloud_update_work,
+			publish_sched_phase_get(PUBLICATION_INTERVAL));
+	}
+#endif
+#if defined(CONFIG_FOTA_DL)
+	/* An image booted for test is kept once it reached the cloud. */
+	(void)fota_dl_confirm();
+
+	/* The download goes through the transport of the backend that set
+	 * it last, resuming on every link is harmless.
+	 */
+	fota_dl_resume();
+#endif
+}
+
 void cloud_event_handler(const struct cloud_backend *const backend,
 			 const struct cloud_event *const evt,
 			 void *user_data)
 {
+	struct cloud_link *link = link_find(backend);
+#if defined(CONFIG_SHADOW)
+	int err;
+#endif
+
 	ARG_UNUSED(user_data);
-	ARG_UNUSED(backend);
+
+	if (link == NULL) {
+		printk("Event %d from an unknown backend\n", evt->type);
+		return;
+	}
 
 	switch (evt->type) {
 	case CLOUD_EVT_CONNECTED:
@@ -68,12 +667,21 @@ void cloud_event_handler(const struct cloud_backend *const backend,
 		break;
 	case CLOUD_EVT_READY:
 		printk("CLOUD_EVT_READY\n");
-#if defined(CONFIG_CLOUD_PUBLICATION_SEQUENTIAL)
-		k_delayed_work_submit(&cloud_update_work, K_NO_WAIT);
-#endif
+		link_ready(link);
 		break;
 	case CLOUD_EVT_DISCONNECTED:
 		printk("CLOUD_EVT_DISCONNECTED\n");
+		atomic_clear(&link->ready);
+#if defined(CONFIG_CLOUD_PUBLICATION_SEQUENTIAL)
+		/* In per burst mode the publications due connect the link,
+		 * the schedule keeps running while disconnected.
+		 */
+		if ((link == class_link[MSG_CLASS_TELEMETRY]) &&
+		    !per_burst_mode()) {
+			publish_periodic_stop(&cloud_update_work);
+			publishing_started = false;
+		}
+#endif
 		break;
 	case CLOUD_EVT_ERROR:
 		printk("CLOUD_EVT_ERROR\n");
@@ -84,6 +692,17 @@ void cloud_event_handler(const struct cloud_backend *const backend,
 	case CLOUD_EVT_DATA_RECEIVED:
 		printk("CLOUD_EVT_DATA_RECEIVED\n");
 		printk("Data received from cloud: %s\n", evt->data.msg.buf);
+#if defined(CONFIG_SHADOW)
+		err = shadow_handle(evt->data.msg.buf, evt->data.msg.len);
+		if (err != -EINVAL) {
+			/* Reports the values the desired ones changed. */
+			(void)shadow_sync(false);
+			break;
+		}
+#endif
+#if defined(CONFIG_DOWNLINK)
+		downlink_handle(evt->data.msg.buf, evt->data.msg.len);
+#endif
 		break;
 	case CLOUD_EVT_PAIR_REQUEST:
 		printk("CLOUD_EVT_PAIR_REQUEST\n");
@@ -93,6 +712,14 @@ void cloud_event_handler(const struct cloud_backend *const backend,
 		break;
 	case CLOUD_EVT_FOTA_DONE:
 		printk("CLOUD_EVT_FOTA_DONE\n");
+#if defined(CONFIG_FOTA_DL)
+		printk("Rebooting to install the new image\n");
+		for (size_t i = 0; i < link_count; i++) {
+			cloud_disconnect(links[i].backend);
+		}
+
+		sys_reboot(SYS_REBOOT_COLD);
+#endif
 		break;
 	default:
 		printk("Unknown cloud event type: %d\n", evt->type);
@@ -102,8 +729,277 @@ void cloud_event_handler(const struct cloud_backend *const backend,
 
 static void work_init(void)
 {
-	k_delayed_work_init(&cloud_update_work, cloud_update_work_fn);
-	k_delayed_work_init(&cloud_ping_work, cloud_ping_work_fn);
+	publish_sched_init();
+#if defined(CONFIG_CLOUD_PUBLICATION_SEQUENTIAL)
+	publish_periodic_init(&cloud_update_work, cloud_update_work_fn,
+			      PUBLICATION_INTERVAL);
+#endif
+#if defined(BUTTON_PUBLICATION)
+	publish_work_init(&button_publish_work, button_publish_work_fn);
+#endif
+	publish_work_init(&cloud_ping_work, cloud_ping_work_fn);
+	publish_work_init(&deferred_publish_work, deferred_publish_work_fn);
+}
+
+static void phase_init(void)
+{
+	const u8_t *id = (const u8_t *)links[0].backend->config->id;
+	size_t id_len = links[0].backend->config->id_len;
+#if defined(CONFIG_AT_CMD)
+	static char imei[32];
+
+	/* Without a client ID set for the backend, the IMEI identifies the
+	 * device.
+	 */
+	if ((id == NULL) && (at_cmd_write("AT+CGSN", imei, sizeof(imei),
+					  NULL) == 0)) {
+		id = (const u8_t *)imei;
+		id_len = strspn(imei, "0123456789");
+	}
+#endif
+
+	if (id == NULL) {
+		printk("No client ID, random publish phase\n");
+		id_len = 0;
+	}
+
+	publish_sched_phase_init(id, id_len);
+
+	printk("Publish phase offset: %d ms\n",
+	       publish_sched_phase_get(PUBLICATION_INTERVAL));
+}
+
+#if defined(CONFIG_DOWNLINK) || defined(CONFIG_SHADOW)
+static void slot_set(s32_t val)
+{
+	publish_sched_slot_set(val);
+
+#if defined(CONFIG_CLOUD_PUBLICATION_SEQUENTIAL)
+	/* The slot is counted from when the command is received. */
+	publish_periodic_start(&cloud_update_work,
+			       publish_sched_phase_get(PUBLICATION_INTERVAL));
+#endif
+}
+#endif
+
+#if defined(CONFIG_DOWNLINK)
+static void slot_cmd_handler(s32_t val)
+{
+	slot_set(val);
+}
+
+static const struct downlink_cmd slot_cmd = {
+	.name = "slot",
+	.handler = slot_cmd_handler,
+};
+#endif
+
+#if defined(CONFIG_POWER_PROFILE) && defined(CONFIG_DOWNLINK)
+/* {"cmd":"power","val":1} enters the low power profile, 0 leaves it. */
+static void power_cmd_handler(s32_t val)
+{
+	power_profile_switch(val ? POWER_PROFILE_LOW_POWER :
+				   POWER_PROFILE_DEBUG);
+}
+
+static const struct downlink_cmd power_cmd = {
+	.name = "power",
+	.handler = power_cmd_handler,
+};
+#endif
+
+#if defined(CONFIG_FOTA_DL) && defined(CONFIG_DOWNLINK)
+/* {"cmd":"fota","val":<image ID>} downloads an image and installs it. */
+static void fota_cmd_handler(s32_t val)
+{
+	int err = fota_dl_start(val);
+
+	if (err && (err != -EALREADY)) {
+		printk("fota_dl_start, error: %d\n", err);
+	}
+}
+
+static const struct downlink_cmd fota_cmd = {
+	.name = "fota",
+	.handler = fota_cmd_handler,
+};
+#endif
+
+#if defined(CONFIG_SHADOW)
+static int shadow_send(const char *buf, size_t len)
+{
+	struct cloud_msg msg = {
+		.qos = CLOUD_QOS_AT_MOST_ONCE,
+		.endpoint.type = CLOUD_EP_TOPIC_STATE,
+		.buf = (char *)buf,
+		.len = len
+	};
+
+	if (!atomic_get(&class_link[MSG_CLASS_CONTROL]->ready)) {
+		return -ENOTCONN;
+	}
+
+	return cloud_send(class_link[MSG_CLASS_CONTROL]->backend, &msg);
+}
+
+/* Desired slot in milliseconds, negative to go back to the derived
+ * phase.
+ */
+static s32_t slot_desired_handler(s32_t val)
+{
+	slot_set(val);
+
+	return MAX(val, -1);
+}
+
+static const struct shadow_prop slot_prop = {
+	.key = "slot",
+	.handler = slot_desired_handler,
+};
+
+#if defined(CONFIG_POWER_PROFILE)
+/* 1 for the low power profile, 0 for the debug profile. */
+static s32_t power_desired_handler(s32_t val)
+{
+	power_profile_switch(val ? POWER_PROFILE_LOW_POWER :
+				   POWER_PROFILE_DEBUG);
+
+	return power_profile_get() == POWER_PROFILE_LOW_POWER;
+}
+
+static const struct shadow_prop power_prop = {
+	.key = "power",
+	.handler = power_desired_handler,
+};
+#endif
+
+static void shadow_props_init(void)
+{
+	int err;
+
+	shadow_init(shadow_send);
+
+	err = shadow_prop_register(&slot_prop);
+	if (err) {
+		printk("shadow_prop_register, error: %d\n", err);
+	}
+
+	(void)shadow_report(slot_prop.key, -1);
+
+#if defined(CONFIG_POWER_PROFILE)
+	err = shadow_prop_register(&power_prop);
+	if (err) {
+		printk("shadow_prop_register, error: %d\n", err);
+	}
+
+	(void)shadow_report(power_prop.key,
+			    power_profile_get() == POWER_PROFILE_LOW_POWER);
+#endif
+}
+#endif
+
+static int ping_timeout_get(const struct cloud_link *link)
+{
+	int time_left = cloud_keepalive_time_left(link->backend);
+
+	if (time_left < 0) {
+		return time_left;
+	}
+
+	/* Pings are advanced by the phase offset of the device so that they
+	 * do not line up across devices that connected at the same time.
+	 */
+	return MAX(time_left - publish_sched_phase_get(PING_SPREAD_WINDOW), 0);
+}
+
+static int linger_timeout_get(void)
+{
+#if defined(CONFIG_CONN_POLICY)
+	s64_t left = last_activity + CONFIG_CONN_POLICY_LINGER_MS -
+		     k_uptime_get();
+
+	return MAX(left, 0);
+#else
+	return 0;
+#endif
+}
+
+/* Shortest of two timeouts, negative ones never expire. */
+static int timeout_min(int a, int b)
+{
+	if (a < 0) {
+		return b;
+	}
+
+	if (b < 0) {
+		return a;
+	}
+
+	return MIN(a, b);
+}
+
+static int return_timeout_get(const struct cloud_link *link)
+{
+	return link->endpoints ?
+	       endpoint_return_timeout_get(link->endpoints) : K_FOREVER;
+}
+
+/* Time until the link is to be pinged, closed once it lingered long
+ * enough, moved back to its preferred server, or reconnected. Negative if
+ * it waits for nothing.
+ */
+static int link_timeout_get(const struct cloud_link *link)
+{
+	int timeout;
+
+	if (!link->connected) {
+		return link->retry_at ?
+		       MAX(link->retry_at - k_uptime_get(), 0) : K_FOREVER;
+	}
+
+	timeout = lingering() ? linger_timeout_get() : ping_timeout_get(link);
+
+	return timeout_min(timeout, return_timeout_get(link));
+}
+
+static void link_retry(struct cloud_link *link)
+{
+	s32_t delay = K_SECONDS(CONFIG_CLOUD_RECONNECT_DELAY) +
+		      publish_sched_phase_get(RECONNECT_SPREAD_WINDOW);
+
+	printk("Reconnecting to %s in %d ms\n", link->name, delay);
+	link->retry_at = k_uptime_get() + delay;
+}
+
+static int link_connect(struct cloud_link *link)
+{
+	int err;
+
+	link->retry_at = 0;
+	link->connect_start = k_uptime_get();
+
+	err = cloud_connect(link->backend);
+
+	/* Backends register their servers when they first connect. */
+	if (link->endpoints == NULL) {
+		link->endpoints = endpoint_list_get(link->name);
+	}
+
+	if (err) {
+		printk("cloud_connect, error: %d\n", err);
+		return err;
+	}
+
+	link->connected = true;
+
+	return 0;
+}
+
+static void link_close(struct cloud_link *link)
+{
+	cloud_disconnect(link->backend);
+	atomic_clear(&link->ready);
+	link->connected = false;
 }
 
 static void modem_configure(void)
@@ -142,91 +1038,308 @@ static void modem_configure(void)
 #endif
 }
 
-#if defined(CONFIG_CLOUD_PUBLICATION_BUTTON_PRESS)
+#if defined(BUTTON_PUBLICATION) || defined(CONFIG_POWER_PROFILE)
 static void button_handler(u32_t button_states, u32_t has_changed)
 {
-	if (has_changed & button_states & DK_BTN1_MSK) {
-		k_delayed_work_submit(&cloud_update_work, K_NO_WAIT);
+	if (!(has_changed & button_states & DK_BTN1_MSK)) {
+		return;
+	}
+
+#if defined(CONFIG_POWER_PROFILE)
+	if ((button_states & POWER_PROFILE_BUTTONS) == POWER_PROFILE_BUTTONS) {
+		power_profile_switch(
+			power_profile_get() == POWER_PROFILE_LOW_POWER ?
+			POWER_PROFILE_DEBUG : POWER_PROFILE_LOW_POWER);
+		return;
 	}
+#endif
+
+#if defined(BUTTON_PUBLICATION)
+	publish_work_submit(&button_publish_work, K_NO_WAIT);
+#endif
 }
 #endif
 
+static void links_init(void)
+{
+	links[0].name = CONFIG_CLOUD_BACKEND;
+	link_count = 1;
+
+	/* An empty telemetry backend means CONFIG_CLOUD_BACKEND. */
+	if ((sizeof(CONFIG_CLOUD_BACKEND_TELEMETRY) > 1) &&
+	    strcmp(CONFIG_CLOUD_BACKEND_TELEMETRY, CONFIG_CLOUD_BACKEND)) {
+		links[1].name = CONFIG_CLOUD_BACKEND_TELEMETRY;
+		link_count = 2;
+	}
+
+	for (size_t i = 0; i < link_count; i++) {
+		links[i].backend = cloud_get_binding(links[i].name);
+		__ASSERT(links[i].backend != NULL, "%s backend not found",
+			 links[i].name);
+
+		printk("Binded to %s\n", links[i].name);
+	}
+
+	class_link[MSG_CLASS_CONTROL] = &links[0];
+	class_link[MSG_CLASS_TELEMETRY] = &links[link_count - 1];
+
+	if (link_count > 1) {
+		printk("Telemetry through %s\n",
+		       class_link[MSG_CLASS_TELEMETRY]->name);
+	}
+}
+
 void main(void)
 {
 	int err;
 
 	printk("Cloud client has started\n");
 
-	cloud_backend = cloud_get_binding(CONFIG_CLOUD_BACKEND);
-	__ASSERT(cloud_backend != NULL, "%s backend not found",
-		 CONFIG_CLOUD_BACKEND);
+	links_init();
 
-	printk("Binded to %s\n", CONFIG_CLOUD_BACKEND);
+#if defined(CONFIG_SERIALIZER_BENCHMARK)
+	serializer_benchmark(&telemetry);
+#endif
 
 	work_init();
 	modem_configure();
+	phase_init();
 
-#if defined(CONFIG_CLOUD_PUBLICATION_BUTTON_PRESS)
-	err = dk_buttons_init(button_handler);
+#if defined(CONFIG_DOWNLINK)
+	err = downlink_cmd_register(&slot_cmd);
 	if (err) {
-		printk("dk_buttons_init, error: %d\n", err);
+		printk("downlink_cmd_register, error: %d\n", err);
+	}
+
+#if defined(CONFIG_POWER_PROFILE)
+	err = downlink_cmd_register(&power_cmd);
+	if (err) {
+		printk("downlink_cmd_register, error: %d\n", err);
 	}
 #endif
 
-	err = cloud_init(cloud_backend, cloud_event_handler);
+#if defined(CONFIG_FOTA_DL)
+	err = downlink_cmd_register(&fota_cmd);
 	if (err) {
-		printk("Cloud backend could not be initialized, error: %d\n",
-			err);
+		printk("downlink_cmd_register, error: %d\n", err);
 	}
+#endif
+#endif
+
+#if defined(CONFIG_SHADOW)
+	shadow_props_init();
+#endif
 
-	err = cloud_connect(cloud_backend);
+#if defined(CONFIG_TX_DEFER)
+	err = tx_defer_init(tx_defer_release);
 	if (err) {
-		printk("cloud_connect, error: %d\n", err);
+		printk("tx_defer_init, error: %d\n", err);
+	}
+#endif
+
+#if defined(CONFIG_FOTA_DL)
+	err = fota_dl_init();
+	if (err) {
+		printk("fota_dl_init, error: %d\n", err);
 	}
+#endif
 
-	struct pollfd fds[] = {
-		{
-			.fd = cloud_backend->config->socket,
-			.events = POLLIN
+#if defined(BUTTON_PUBLICATION) || defined(CONFIG_POWER_PROFILE)
+	err = dk_buttons_init(button_handler);
+	if (err) {
+		printk("dk_buttons_init, error: %d\n", err);
+	}
+#endif
+
+	for (size_t i = 0; i < link_count; i++) {
+		err = cloud_init(links[i].backend, cloud_event_handler);
+		if (err) {
+			printk("Cloud backend could not be initialized, "
+			       "error: %d\n", err);
 		}
-	};
+	}
+
+#if defined(CONFIG_DOWNLINK) || defined(CONFIG_SHADOW)
+	/* Commands arrive on the configuration endpoint of backends with
+	 * subscriptions and desired shadow values on the state endpoint,
+	 * they are subscribed to at every connection.
+	 */
+	if (class_link[MSG_CLASS_CONTROL]->backend->api->ep_subscriptions_add !=
+	    NULL) {
+		const struct cloud_endpoint endpoints[] = {
+#if defined(CONFIG_DOWNLINK)
+			{ .type = CLOUD_EP_TOPIC_CONFIG },
+#endif
+#if defined(CONFIG_SHADOW)
+			{ .type = CLOUD_EP_TOPIC_STATE },
+#endif
+		};
+
+		err = cloud_ep_subscriptions_add(
+			class_link[MSG_CLASS_CONTROL]->backend, endpoints,
+			ARRAY_SIZE(endpoints));
+		if (err) {
+			printk("cloud_ep_subscriptions_add, error: %d\n", err);
+		}
+	}
+#endif
+
+#if defined(CONFIG_CONN_POLICY) && defined(CONFIG_CLOUD_PUBLICATION_SEQUENTIAL)
+	conn_policy_schedule_set(PUBLICATION_INTERVAL);
+#endif
+
+	struct pollfd fds[ARRAY_SIZE(links)];
+	struct cloud_link *polled[ARRAY_SIZE(links)];
+	int timeouts[ARRAY_SIZE(links)];
+	size_t nfds;
+	int timeout;
+
+	/* The first connection is made in every mode, it measures the
+	 * connection time and starts the publication schedule.
+	 */
+	k_sem_give(&connect_sem);
 
 	while (true) {
-		err = poll(fds, ARRAY_SIZE(fds),
-			   cloud_keepalive_time_left(cloud_backend));
+		for (size_t i = 0; i < link_count; i++) {
+			struct cloud_link *link = &links[i];
+
+			if (link->connected || (link->retry_at &&
+			    (k_uptime_get() < link->retry_at))) {
+				continue;
+			}
+
+			if (per_burst_mode()) {
+				/* Stay disconnected until there is something
+				 * to publish.
+				 */
+				k_sem_take(&connect_sem, K_FOREVER);
+			}
+
+			err = link_connect(link);
+			if (err) {
+				link_retry(link);
+				k_sem_give(&connect_sem);
+			}
+		}
+
+		if (atomic_get(&class_link[MSG_CLASS_TELEMETRY]->ready) &&
+		    atomic_cas(&publish_pending, 1, 0)) {
+			publish_work_submit(&deferred_publish_work, K_NO_WAIT);
+		}
+
+		nfds = 0;
+		timeout = K_FOREVER;
+
+		for (size_t i = 0; i < link_count; i++) {
+			timeouts[i] = link_timeout_get(&links[i]);
+			timeout = timeout_min(timeout, timeouts[i]);
+
+			if (links[i].connected) {
+				fds[nfds].fd = links[i].backend->config->socket;
+				fds[nfds].events = POLLIN;
+				polled[nfds++] = &links[i];
+			}
+		}
+
+#if defined(CONFIG_FOTA_DL)
+		timeout = timeout_min(timeout, fota_dl_timeout_get());
+#endif
+
+		if (nfds == 0) {
+			/* Every link waits to reconnect. */
+			k_sleep(timeout);
+			continue;
+		}
+
+		err = poll(fds, nfds, timeout);
 		if (err < 0) {
+			app_trace_poll_wake(APP_TRACE_POLL_ERROR);
 			printk("poll() returned an error: %d\n", err);
 			continue;
 		}
 
 		if (err == 0) {
-			cloud_ping(cloud_backend);
+			app_trace_poll_wake(APP_TRACE_POLL_TIMEOUT);
+
+#if defined(CONFIG_FOTA_DL)
+			if (fota_dl_timeout_get() == 0) {
+				fota_dl_process();
+				continue;
+			}
+#endif
+
+			/* Links due are handled, others are reconnected at
+			 * the top of the loop.
+			 */
+			for (size_t i = 0; i < link_count; i++) {
+				if (!links[i].connected ||
+				    (timeouts[i] != timeout)) {
+					continue;
+				}
+
+				/* Closed links are reconnected at the top of
+				 * the loop.
+				 */
+				if (return_timeout_get(&links[i]) == 0) {
+					printk("Returning %s to its preferred "
+					       "server\n", links[i].name);
+					link_close(&links[i]);
+					continue;
+				}
+
+				if (lingering()) {
+					printk("Disconnecting until next "
+					       "publication\n");
+					link_close(&links[i]);
+					continue;
+				}
+
+				cloud_ping(links[i].backend);
+			}
+
 			continue;
 		}
 
-		if ((fds[0].revents & POLLIN) == POLLIN) {
-			cloud_input(cloud_backend);
-		}
+		for (size_t i = 0; i < nfds; i++) {
+			struct cloud_link *link = polled[i];
 
-		if ((fds[0].revents & POLLNVAL) == POLLNVAL) {
-			printk("Socket error: POLLNVAL\n");
-			printk("The cloud socket was unexpectedly closed.\n");
-			return;
-		}
+			if (fds[i].revents == 0) {
+				continue;
+			}
 
-		if ((fds[0].revents & POLLHUP) == POLLHUP) {
-			printk("Socket error: POLLHUP\n");
-			printk("Connection was closed by the cloud.\n");
-			return;
-		}
+			app_trace_poll_wake((fds[i].revents & POLLIN) ?
+					    APP_TRACE_POLL_INPUT :
+					    APP_TRACE_POLL_SOCKET_ERROR);
+
+			if ((fds[i].revents & POLLIN) == POLLIN) {
+				cloud_input(link->backend);
+			}
 
-		if ((fds[0].revents & POLLERR) == POLLERR) {
-			printk("Socket error: POLLERR\n");
-			printk("Cloud connection was unexpectedly closed.\n");
-			return;
+			if ((fds[i].revents & POLLNVAL) == POLLNVAL) {
+				printk("Socket error: POLLNVAL\n");
+				printk("The cloud socket was unexpectedly "
+				       "closed.\n");
+			} else if ((fds[i].revents & POLLHUP) == POLLHUP) {
+				printk("Socket error: POLLHUP\n");
+				printk("Connection was closed by the cloud.\n");
+			} else if ((fds[i].revents & POLLERR) == POLLERR) {
+				printk("Socket error: POLLERR\n");
+				printk("Cloud connection was unexpectedly "
+				       "closed.\n");
+			} else {
+				continue;
+			}
+
+			link_close(link);
+
+			if (!per_burst_mode()) {
+				link_retry(link);
+			}
 		}
 	}
 
 	printk("Closing Cloud connection\n");
-	cloud_disconnect(cloud_backend);
+	for (size_t i = 0; i < link_count; i++) {
+		cloud_disconnect(links[i].backend);
+	}
 }
@@ -3,6 +3,20 @@
 #include <net/socket.h>
 #include <net/cloud.h>
 #include <stdio.h>
+#include <tls_ciphersuites.h>
+#include <app_trace.h>
+#include <perf_budget.h>
+#include <resolver.h>
+#include <endpoint.h>
+
+#if defined(CONFIG_MSG_POOL)
+#include <msg_pool.h>
+#endif
+
+#if defined(CONFIG_MQTT_BACKEND_FOTA)
+#include <fota_dl.h>
+#include <sys/byteorder.h>
+#endif
 
 #include <logging/log.h>
 
@@ -26,12 +40,89 @@ BUILD_ASSERT_MSG(sizeof(CONFIG_MQTT_BACKEND_BROKER_HOST_NAME) > 1,
 static char client_id_buf[MQTT_BACKEND_CLIENT_ID_LEN_MAX + 1];
 static char update_topic[UPDATE_TOPIC_LEN + 1];
 
+#if defined(CONFIG_CLOUD_API)
+#define CMD_TOPIC "%s/cmd"
+#define CMD_TOPIC_LEN (MQTT_BACKEND_CLIENT_ID_LEN_MAX + sizeof(CMD_TOPIC) - 1)
+
+static char cmd_topic[CMD_TOPIC_LEN + 1];
+
+/* Reports of the device shadow are published to the update topic, desired
+ * values arrive on the delta topic.
+ */
+#define SHADOW_UPDATE_TOPIC "%s/shadow/update"
+#define SHADOW_DELTA_TOPIC "%s/shadow/delta"
+#define SHADOW_TOPIC_LEN (MQTT_BACKEND_CLIENT_ID_LEN_MAX + \
+			  sizeof(SHADOW_UPDATE_TOPIC) - 1)
+
+static char shadow_update_topic[SHADOW_TOPIC_LEN + 1];
+static char shadow_delta_topic[SHADOW_TOPIC_LEN + 1];
+#endif
+
+/* Return code of a refused subscription, see MQTT 3.1.1 section 3.9.3. */
+#define SUBACK_FAILURE 0x80
+
+#if defined(CONFIG_MQTT_BACKEND_FOTA)
+#define FOTA_REQ_TOPIC "%s/fota/req"
+#define FOTA_CHUNK_TOPIC "%s/fota/chunk"
+#define FOTA_TOPIC_LEN (MQTT_BACKEND_CLIENT_ID_LEN_MAX + \
+			sizeof(FOTA_CHUNK_TOPIC) - 1)
+#define FOTA_REQ_FORMAT "{\"id\":%u,\"off\":%u,\"len\":%d}"
+#define FOTA_REQ_LEN_MAX 64
+
+/* Chunks start with the image ID, the offset of the chunk and the size of
+ * the image, each 32-bit big endian.
+ */
+#define FOTA_CHUNK_HEADER_LEN 12
+
+BUILD_ASSERT_MSG(CONFIG_MQTT_BACKEND_FOTA_CHUNK_SIZE + FOTA_CHUNK_HEADER_LEN <=
+		 CONFIG_MQTT_BACKEND_MQTT_PAYLOAD_BUFFER_LEN,
+		 "FOTA chunk does not fit in the MQTT payload buffer");
+
+static char fota_req_topic[FOTA_TOPIC_LEN + 1];
+static char fota_chunk_topic[FOTA_TOPIC_LEN + 1];
+#endif
+
 static char rx_buffer[CONFIG_MQTT_BACKEND_MQTT_RX_TX_BUFFER_LEN];
 static char tx_buffer[CONFIG_MQTT_BACKEND_MQTT_RX_TX_BUFFER_LEN];
 static char payload_buf[CONFIG_MQTT_BACKEND_MQTT_PAYLOAD_BUFFER_LEN];
 
 static struct mqtt_client client;
 static struct sockaddr_storage broker;
+static struct endpoint_list endpoints;
+/* Host name of the selected broker. */
+static const char *broker_host;
+
+#if defined(CONFIG_MQTT_BACKEND_TLS_CIPHERSUITES_PSK_AES128_CCM8)
+static int cipher_list[] = { TLS_PSK_WITH_AES_128_CCM_8 };
+#elif defined(CONFIG_MQTT_BACKEND_TLS_CIPHERSUITES_PSK_AES128_CBC_SHA256)
+static int cipher_list[] = { TLS_PSK_WITH_AES_128_CBC_SHA256 };
+#elif defined(CONFIG_MQTT_BACKEND_TLS_CIPHERSUITES_ECDHE_ECDSA_AES128_CBC_SHA256)
+static int cipher_list[] = { TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256 };
+#elif defined(CONFIG_MQTT_BACKEND_TLS_CIPHERSUITES_ECDHE_RSA_AES128_CBC_SHA256)
+static int cipher_list[] = { TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256 };
+#endif
+
+#if defined(CONFIG_MSG_POOL)
+/* Pooled payloads of publications waiting for PUBACK. */
+static struct {
+	u16_t message_id;
+	struct msg_buf *buf;
+} inflight[CONFIG_MQTT_BACKEND_INFLIGHT_MAX];
+#endif
+
+/* Topic filters subscribed to. They are kept in one array so that any
+ * range of them can be sent as the list of a SUBSCRIBE. For each, the
+ * message ID of its last SUBSCRIBE, its position in it and the result of
+ * the SUBACK are tracked.
+ */
+static struct mqtt_topic subscriptions[CONFIG_MQTT_BACKEND_SUBSCRIPTIONS_MAX];
+static struct {
+	u16_t message_id;
+	u8_t index;
+	int result;
+} suback[CONFIG_MQTT_BACKEND_SUBSCRIPTIONS_MAX];
+static size_t subscription_count;
+static bool connected;
 
 #if !defined(CONFIG_CLOUD_API)
 static mqtt_backend_evt_handler_t module_evt_handler;
@@ -59,9 +150,86 @@ static int mqtt_backend_topics_populate(void)
 		return -ENOMEM;
 	}
 
+#if defined(CONFIG_CLOUD_API)
+	err = snprintf(cmd_topic, sizeof(cmd_topic), CMD_TOPIC, client_id_buf);
+	if (err >= sizeof(cmd_topic)) {
+		return -ENOMEM;
+	}
+
+	err = snprintf(shadow_update_topic, sizeof(shadow_update_topic),
+		       SHADOW_UPDATE_TOPIC, client_id_buf);
+	if (err >= sizeof(shadow_update_topic)) {
+		return -ENOMEM;
+	}
+
+	err = snprintf(shadow_delta_topic, sizeof(shadow_delta_topic),
+		       SHADOW_DELTA_TOPIC, client_id_buf);
+	if (err >= sizeof(shadow_delta_topic)) {
+		return -ENOMEM;
+	}
+#endif
+
+#if defined(CONFIG_MQTT_BACKEND_FOTA)
+	err = snprintf(fota_req_topic, sizeof(fota_req_topic),
+		       FOTA_REQ_TOPIC, client_id_buf);
+	if (err >= sizeof(fota_req_topic)) {
+		return -ENOMEM;
+	}
+
+	err = snprintf(fota_chunk_topic, sizeof(fota_chunk_topic),
+		       FOTA_CHUNK_TOPIC, client_id_buf);
+	if (err >= sizeof(fota_chunk_topic)) {
+		return -ENOMEM;
+	}
+#endif
+
 	return 0;
 }
 
+#if defined(CONFIG_MSG_POOL)
+static void inflight_add(u16_t message_id, const void *payload)
+{
+	struct msg_buf *buf = msg_buf_from_data(payload);
+
+	if (buf == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(inflight); i++) {
+		if (inflight[i].buf == NULL) {
+			inflight[i].message_id = message_id;
+			inflight[i].buf = msg_buf_ref(buf);
+			return;
+		}
+	}
+
+	LOG_WRN("No free in-flight slot, message %d not retained",
+		message_id);
+}
+
+static void inflight_release(u16_t message_id)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(inflight); i++) {
+		if ((inflight[i].buf != NULL) &&
+		    (inflight[i].message_id == message_id)) {
+			msg_buf_unref(inflight[i].buf);
+			inflight[i].buf = NULL;
+			return;
+		}
+	}
+}
+
+static void inflight_release_all(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(inflight); i++) {
+		if (inflight[i].buf != NULL) {
+			msg_buf_unref(inflight[i].buf);
+			inflight[i].buf = NULL;
+		}
+	}
+}
+#endif
+
 #if !defined(CONFIG_CLOUD_API)
 static void mqtt_backend_notify_event(const struct mqtt_backend_evt *evt)
 {
@@ -71,6 +239,219 @@ static void mqtt_backend_notify_event(const struct mqtt_backend_evt *evt)
 }
 #endif
 
+static int subscription_find(const void *filter, size_t len)
+{
+	for (size_t i = 0; i < subscription_count; i++) {
+		if ((subscriptions[i].topic.size == len) &&
+		    (memcmp(subscriptions[i].topic.utf8, filter, len) == 0)) {
+			return i;
+		}
+	}
+
+	return -ENOENT;
+}
+
+/* Subscribes to the filters from first on, in one SUBSCRIBE. */
+static int subscribe(size_t first)
+{
+	const struct mqtt_subscription_list sub_list = {
+		.list = &subscriptions[first],
+		.list_count = subscription_count - first,
+		.message_id = sys_rand32_get()
+	};
+	int err;
+
+	if (sub_list.list_count == 0) {
+		return 0;
+	}
+
+	for (size_t i = first; i < subscription_count; i++) {
+		suback[i].message_id = sub_list.message_id;
+		suback[i].index = i - first;
+		suback[i].result = -EINPROGRESS;
+	}
+
+	LOG_DBG("Subscribing to %d topic filters, id = %d",
+		sub_list.list_count, sub_list.message_id);
+
+	err = mqtt_subscribe(&client, &sub_list);
+	if (err) {
+		LOG_ERR("mqtt_subscribe, error: %d", err);
+	}
+
+	return err;
+}
+
+static void suback_handle(const struct mqtt_suback_param *p, int result)
+{
+	for (size_t i = 0; i < subscription_count; i++) {
+		const char *filter = (const char *)subscriptions[i].topic.utf8;
+		u8_t code = SUBACK_FAILURE;
+
+		if ((suback[i].message_id != p->message_id) ||
+		    (suback[i].result != -EINPROGRESS)) {
+			continue;
+		}
+
+		if (!result && (suback[i].index < p->return_codes.len)) {
+			code = p->return_codes.data[suback[i].index];
+		}
+
+		if (code == SUBACK_FAILURE) {
+			suback[i].result = -EACCES;
+			LOG_WRN("Subscription to %s refused",
+				log_strdup(filter));
+			continue;
+		}
+
+		suback[i].result = code;
+		LOG_DBG("Subscribed to %s, QoS %d",
+			log_strdup(filter), code);
+	}
+}
+
+int mqtt_backend_subscriptions_add(const struct mqtt_topic *list,
+				   size_t count)
+{
+	size_t first = subscription_count;
+
+	if (count > ARRAY_SIZE(subscriptions) - subscription_count) {
+		LOG_ERR("No room for %d more topic filters", count);
+		return -ENOMEM;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (subscription_find(list[i].topic.utf8,
+				      list[i].topic.size) >= 0) {
+			return -EALREADY;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		subscriptions[subscription_count] = list[i];
+		suback[subscription_count].message_id = 0;
+		suback[subscription_count].result = -EINPROGRESS;
+		subscription_count++;
+	}
+
+	/* Otherwise they are subscribed to with the others after CONNACK. */
+	if (!connected) {
+		return 0;
+	}
+
+	return subscribe(first);
+}
+
+int mqtt_backend_subscriptions_remove(const struct mqtt_topic *list,
+				      size_t count)
+{
+	const struct mqtt_subscription_list unsub_list = {
+		.list = (struct mqtt_topic *)list,
+		.list_count = count,
+		.message_id = sys_rand32_get()
+	};
+
+	for (size_t i = 0; i < count; i++) {
+		if (subscription_find(list[i].topic.utf8,
+				      list[i].topic.size) < 0) {
+			return -ENOENT;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		int pos = subscription_find(list[i].topic.utf8,
+					    list[i].topic.size);
+
+		/* The order is kept, it matches the SUBACKs outstanding. */
+		subscription_count--;
+		memmove(&subscriptions[pos], &subscriptions[pos + 1],
+			(subscription_count - pos) * sizeof(subscriptions[0]));
+		memmove(&suback[pos], &suback[pos + 1],
+			(subscription_count - pos) * sizeof(suback[0]));
+	}
+
+	if (!connected) {
+		return 0;
+	}
+
+	return mqtt_unsubscribe(&client, &unsub_list);
+}
+
+int mqtt_backend_subscription_result(const char *filter)
+{
+	int pos = subscription_find(filter, strlen(filter));
+
+	return (pos < 0) ? pos : suback[pos].result;
+}
+
+#if defined(CONFIG_MQTT_BACKEND_FOTA)
+static int fota_request(u32_t image_id, size_t offset)
+{
+	char req[FOTA_REQ_LEN_MAX];
+	struct mqtt_publish_param param = {
+		.message.topic.qos = MQTT_QOS_0_AT_MOST_ONCE,
+		.message.topic.topic.utf8 = fota_req_topic,
+		.message.topic.topic.size = strlen(fota_req_topic),
+		.message.payload.data = req,
+		.message_id = sys_rand32_get()
+	};
+
+	param.message.payload.len = snprintf(req, sizeof(req), FOTA_REQ_FORMAT,
+					     image_id, (unsigned int)offset,
+					     CONFIG_MQTT_BACKEND_FOTA_CHUNK_SIZE);
+
+	LOG_DBG("FOTA chunk requested at %d", offset);
+
+	return mqtt_publish(&client, &param);
+}
+
+static void fota_chunk_handle(const u8_t *buf, size_t len)
+{
+	u32_t image_id, offset, total;
+
+	if (len < FOTA_CHUNK_HEADER_LEN) {
+		LOG_ERR("FOTA chunk too short");
+		return;
+	}
+
+	image_id = sys_get_be32(buf);
+	offset = sys_get_be32(buf + 4);
+	total = sys_get_be32(buf + 8);
+	buf += FOTA_CHUNK_HEADER_LEN;
+	len -= FOTA_CHUNK_HEADER_LEN;
+
+	(void)fota_dl_block_received(image_id, offset, buf, len, total,
+				     offset + len >= total);
+}
+
+static void fota_done(int result)
+{
+	if (result) {
+		return;
+	}
+
+#if defined(CONFIG_CLOUD_API)
+	struct cloud_event cloud_evt = {
+		.type = CLOUD_EVT_FOTA_DONE,
+	};
+
+	cloud_notify_event(mqtt_backend, &cloud_evt,
+			   mqtt_backend->config->user_data);
+#else
+	struct mqtt_backend_evt mqtt_backend_evt = {
+		.type = MQTT_BACKEND_EVT_FOTA_DONE,
+	};
+
+	mqtt_backend_notify_event(&mqtt_backend_evt);
+#endif
+}
+
+static const struct fota_dl_transport fota_transport = {
+	.request = fota_request,
+	.done = fota_done,
+};
+#endif
+
 static int publish_get_payload(struct mqtt_client *const c, size_t length)
 {
 	if (length > sizeof(payload_buf)) {
@@ -94,11 +475,31 @@ static void mqtt_evt_handler(struct mqtt_client *const c,
 
 	switch (mqtt_evt->type) {
 	case MQTT_EVT_CONNACK:
+		LOG_DBG("CONNACK, error: %d",
+			mqtt_evt->param.connack.return_code);
+
+		app_trace_connect_phase(APP_TRACE_BACKEND_MQTT,
+					APP_TRACE_CONNECT_READY,
+					-mqtt_evt->param.connack.return_code);
+
+		/* The broker closes a refused connection, the disconnection
+		 * that follows drives the retry or failover.
+		 */
+		if (mqtt_evt->param.connack.return_code) {
+			LOG_ERR("Connection refused: %d",
+				mqtt_evt->param.connack.return_code);
+			endpoint_failed(&endpoints);
+			break;
+		}
+
 		LOG_DBG("MQTT client connected!");
 
+		/* Timed from the TCP handshake up to CONNACK. */
+		endpoint_connected(&endpoints, true);
 
-		LOG_DBG("CONNACK, error: %d",
-			mqtt_evt->param.connack.return_code);
+		/* All topic filters in one SUBSCRIBE, one round trip. */
+		connected = true;
+		(void)subscribe(0);
 
 #if defined(CONFIG_CLOUD_API)
 		cloud_evt.type = CLOUD_EVT_CONNECTED;
@@ -117,6 +518,12 @@ static void mqtt_evt_handler(struct mqtt_client *const c,
 	case MQTT_EVT_DISCONNECT:
 		LOG_DBG("MQTT_EVT_DISCONNECT: result = %d", mqtt_evt->result);
 
+		connected = false;
+
+#if defined(CONFIG_MSG_POOL)
+		inflight_release_all();
+#endif
+
 #if defined(CONFIG_CLOUD_API)
 		cloud_evt.type = CLOUD_EVT_DISCONNECTED;
 		cloud_notify_event(mqtt_backend, &cloud_evt,
@@ -147,6 +554,16 @@ static void mqtt_evt_handler(struct mqtt_client *const c,
 			mqtt_publish_qos1_ack(c, &ack);
 		}
 
+#if defined(CONFIG_MQTT_BACKEND_FOTA)
+		if ((p->message.topic.topic.size == strlen(fota_chunk_topic)) &&
+		    (memcmp(p->message.topic.topic.utf8, fota_chunk_topic,
+			    p->message.topic.topic.size) == 0)) {
+			fota_chunk_handle(payload_buf,
+					  p->message.payload.len);
+			break;
+		}
+#endif
+
 #if defined(CONFIG_CLOUD_API)
 		cloud_evt.type = CLOUD_EVT_DATA_RECEIVED;
 		cloud_evt.data.msg.buf = payload_buf;
@@ -155,7 +572,7 @@ static void mqtt_evt_handler(struct mqtt_client *const c,
 		cloud_notify_event(mqtt_backend, &cloud_evt,
 				   config->user_data);
 #else
-		mqtt_backend_evt.type = MQTT_BACKEND_DATA_RECEIVED;
+		mqtt_backend_evt.type = MQTT_BACKEND_EVT_DATA_RECEIVED;
 		mqtt_backend_evt.ptr = payload_buf;
 		mqtt_backend_evt.len = p->message.payload.len;
 		mqtt_backend_notify_event(&mqtt_backend_evt);
@@ -166,84 +583,60 @@ static void mqtt_evt_handler(struct mqtt_client *const c,
 		LOG_DBG("MQTT_EVT_PUBACK: id = %d result = %d",
 			mqtt_evt->param.puback.message_id,
 			mqtt_evt->result);
+
+		app_trace_publish_ack(APP_TRACE_BACKEND_MQTT,
+				      mqtt_evt->param.puback.message_id);
+
+#if defined(CONFIG_MSG_POOL)
+		inflight_release(mqtt_evt->param.puback.message_id);
+#endif
 		break;
 	case MQTT_EVT_SUBACK:
 		LOG_DBG("MQTT_EVT_SUBACK: id = %d result = %d",
 			mqtt_evt->param.suback.message_id,
 			mqtt_evt->result);
+
+		suback_handle(&mqtt_evt->param.suback, mqtt_evt->result);
 		break;
 	default:
 		break;
 	}
 }
 
+#if defined(CONFIG_MQTT_BACKEND_STATIC_IPV4)
+#define MQTT_BACKEND_BROKER_ADDR CONFIG_MQTT_BACKEND_STATIC_IPV4_ADDR
+#else
+#define MQTT_BACKEND_BROKER_ADDR CONFIG_MQTT_BACKEND_BROKER_HOST_NAME
+#endif
+
 static int broker_init(void)
 {
 	int err;
-	struct addrinfo *result;
-	struct addrinfo *addr;
-	struct addrinfo hints = {
-		.ai_family = MQTT_BACKEND_FAMILY,
-		.ai_socktype = SOCK_STREAM
-	};
 
-	err = getaddrinfo(CONFIG_MQTT_BACKEND_BROKER_HOST_NAME,
-			  NULL, &hints, &result);
+	if (endpoint_list_get("MQTT_BACKEND") == NULL) {
+		err = endpoint_list_init(
+			&endpoints, "MQTT_BACKEND", MQTT_BACKEND_BROKER_ADDR,
+			CONFIG_MQTT_BACKEND_BROKER_PORT,
+			CONFIG_MQTT_BACKEND_BROKER_FALLBACK_HOSTS,
+			MQTT_BACKEND_FAMILY, SOCK_STREAM);
+		if (err) {
+			return err;
+		}
+	}
+
+	err = endpoint_select(&endpoints, &broker, &broker_host);
 	if (err) {
-		LOG_ERR("getaddrinfo, error %d", err);
 		return err;
 	}
 
-	addr = result;
-
-	while (addr != NULL) {
-		if ((addr->ai_addrlen == sizeof(struct sockaddr_in)) &&
-		    (MQTT_BACKEND_FAMILY == AF_INET)) {
-			struct sockaddr_in *broker4 =
-				((struct sockaddr_in *)&broker);
-			char ipv4_addr[NET_IPV4_ADDR_LEN];
-
-			broker4->sin_addr.s_addr =
-				((struct sockaddr_in *)addr->ai_addr)
-				->sin_addr.s_addr;
-			broker4->sin_family = AF_INET;
-			broker4->sin_port = htons(CONFIG_MQTT_BACKEND_BROKER_PORT);
-
-			inet_ntop(AF_INET, &broker4->sin_addr.s_addr, ipv4_addr,
-				  sizeof(ipv4_addr));
-			LOG_DBG("IPv4 Address found %s", log_strdup(ipv4_addr));
-			break;
-		} else if ((addr->ai_addrlen == sizeof(struct sockaddr_in6)) &&
-			   (MQTT_BACKEND_FAMILY == AF_INET6)) {
-			struct sockaddr_in6 *broker6 =
-				((struct sockaddr_in6 *)&broker);
-			char ipv6_addr[NET_IPV6_ADDR_LEN];
-
-			memcpy(broker6->sin6_addr.s6_addr,
-			       ((struct sockaddr_in6 *)addr->ai_addr)
-			       ->sin6_addr.s6_addr,
-			       sizeof(struct in6_addr));
-			broker6->sin6_family = AF_INET6;
-			broker6->sin6_port = htons(CONFIG_MQTT_BACKEND_BROKER_PORT);
-
-			inet_ntop(AF_INET6, &broker6->sin6_addr.s6_addr,
-				  ipv6_addr, sizeof(ipv6_addr));
-			LOG_DBG("IPv4 Address found %s", log_strdup(ipv6_addr));
-			break;
-		}
-
-		LOG_DBG("ai_addrlen = %u should be %u or %u",
-			(unsigned int)addr->ai_addrlen,
-			(unsigned int)sizeof(struct sockaddr_in),
-			(unsigned int)sizeof(struct sockaddr_in6));
-
-		addr = addr->ai_next;
-		break;
+#if defined(CONFIG_MQTT_BACKEND_STATIC_IPV4)
+	/* The static address stands for the configured broker. */
+	if (strcmp(broker_host, MQTT_BACKEND_BROKER_ADDR) == 0) {
+		broker_host = CONFIG_MQTT_BACKEND_BROKER_HOST_NAME;
 	}
+#endif
 
-	freeaddrinfo(result);
-
-	return err;
+	return 0;
 }
 
 static int client_broker_init(struct mqtt_client *const client)
@@ -275,12 +668,27 @@ static int client_broker_init(struct mqtt_client *const client)
 	static sec_tag_t sec_tag_list[] = { CONFIG_MQTT_BACKEND_SEC_TAG };
 	struct mqtt_sec_config *tls_cfg = &(client->transport).tls.config;
 
+#if defined(CONFIG_MQTT_BACKEND_TLS_CREDENTIALS_PSK)
+	/* Both ends are authenticated by the pre-shared key. */
+	tls_cfg->peer_verify		= 0;
+#else
 	tls_cfg->peer_verify		= 2;
+#endif
+#if defined(CONFIG_MQTT_BACKEND_TLS_CIPHERSUITES_DEFAULT)
 	tls_cfg->cipher_count		= 0;
 	tls_cfg->cipher_list		= NULL;
+#else
+	tls_cfg->cipher_count		= ARRAY_SIZE(cipher_list);
+	tls_cfg->cipher_list		= cipher_list;
+#endif
 	tls_cfg->sec_tag_count		= ARRAY_SIZE(sec_tag_list);
 	tls_cfg->sec_tag_list		= sec_tag_list;
-	tls_cfg->hostname		= CONFIG_MQTT_BACKEND_BROKER_HOST_NAME;
+#if defined(CONFIG_MQTT_BACKEND_TLS_CREDENTIALS_RAW_PUBLIC_KEY)
+	/* The broker is identified by its pinned key, not by name. */
+	tls_cfg->hostname		= NULL;
+#else
+	tls_cfg->hostname		= broker_host;
+#endif
 #else
 	client->transport.type		= MQTT_TRANSPORT_NON_SECURE;
 #endif
@@ -289,6 +697,8 @@ static int client_broker_init(struct mqtt_client *const client)
 
 int mqtt_backend_ping(void)
 {
+	app_trace_ping(APP_TRACE_BACKEND_MQTT);
+
 	return mqtt_ping(&client);
 }
 
@@ -302,8 +712,33 @@ int mqtt_backend_input(void)
 	return mqtt_input(&client);
 }
 
+/* Size of the PUBLISH packet written by mqtt_publish(), see MQTT 3.1.1
+ * section 3.3.
+ */
+static size_t publish_len(const struct mqtt_publish_param *param)
+{
+	u32_t remaining = 2 + param->message.topic.topic.size +
+			  param->message.payload.len;
+	size_t len;
+
+	if (param->message.topic.qos != MQTT_QOS_0_AT_MOST_ONCE) {
+		remaining += sizeof(param->message_id);
+	}
+
+	/* Fixed header byte, then the remaining length as a varint. */
+	len = 1 + remaining;
+
+	do {
+		len++;
+		remaining >>= 7;
+	} while (remaining);
+
+	return len;
+}
+
 int mqtt_backend_send(const struct mqtt_backend_tx_data *const tx_data)
 {
+	int err;
 	struct mqtt_backend_tx_data tx_data_pub = {
 		.str	    = tx_data->str,
 		.len	    = tx_data->len,
@@ -339,30 +774,74 @@ int mqtt_backend_send(const struct mqtt_backend_tx_data *const tx_data)
 	LOG_DBG("Publishing to topic: %s",
 		log_strdup(param.message.topic.topic.utf8));
 
-	return mqtt_publish(&client, &param);
+	app_trace_publish_encode(APP_TRACE_BACKEND_MQTT, param.message_id,
+				 param.message.payload.len);
+
+	/* mqtt_publish() encodes and writes, the encoding is not timed. */
+	err = mqtt_publish(&client, &param);
+
+	perf_budget_msg_sent(publish_len(&param));
+
+	app_trace_publish_write(APP_TRACE_BACKEND_MQTT, param.message_id, err);
+
+	if (err) {
+		return err;
+	}
+
+#if defined(CONFIG_MSG_POOL)
+	/* Keep pooled payloads until the broker has acknowledged them. */
+	if (param.message.topic.qos != MQTT_QOS_0_AT_MOST_ONCE) {
+		inflight_add(param.message_id, param.message.payload.data);
+	}
+#endif
+
+	return 0;
 }
 
 int mqtt_backend_disconnect(void)
 {
+	endpoint_disconnected(&endpoints);
+
 	return mqtt_disconnect(&client);
 }
 
 int mqtt_backend_connect(struct mqtt_backend_config *const config)
 {
 	int err;
+	s64_t connect_start;
+
+	app_trace_connect_phase(APP_TRACE_BACKEND_MQTT,
+				APP_TRACE_CONNECT_START, 0);
 
 	err = client_broker_init(&client);
 	if (err) {
 		LOG_ERR("client_broker_init, error: %d", err);
+		app_trace_connect_phase(APP_TRACE_BACKEND_MQTT,
+					APP_TRACE_CONNECT_FAILED, err);
 		return err;
 	}
 
+	app_trace_connect_phase(APP_TRACE_BACKEND_MQTT,
+				APP_TRACE_CONNECT_RESOLVED, 0);
+
+	connect_start = k_uptime_get();
+
 	err = mqtt_connect(&client);
 	if (err) {
 		LOG_ERR("mqtt_connect, error: %d", err);
+		endpoint_failed(&endpoints);
+		app_trace_connect_phase(APP_TRACE_BACKEND_MQTT,
+					APP_TRACE_CONNECT_FAILED, err);
 		return err;
 	}
 
+	app_trace_connect_phase(APP_TRACE_BACKEND_MQTT,
+				APP_TRACE_CONNECT_TRANSPORT, 0);
+
+	/* Covers the TCP and TLS handshakes and sending CONNECT. */
+	LOG_DBG("Connected to broker in %d ms",
+		(int)(k_uptime_get() - connect_start));
+
 #if !defined(CONFIG_CLOUD_API)
 #if defined(CONFIG_MQTT_BACKEND_TLS_ENABLE)
 	config->socket = client.transport.tls.sock;
@@ -389,6 +868,24 @@ int mqtt_backend_init(const struct mqtt_backend_config *const config,
 	module_evt_handler = event_handler;
 #endif
 
+#if defined(CONFIG_MQTT_BACKEND_FOTA)
+	const struct mqtt_topic fota_topic = {
+		.topic = {
+			.utf8 = fota_chunk_topic,
+			.size = strlen(fota_chunk_topic)
+		},
+		.qos = MQTT_QOS_0_AT_MOST_ONCE
+	};
+
+	fota_dl_transport_set(&fota_transport);
+
+	err = mqtt_backend_subscriptions_add(&fota_topic, 1);
+	if (err) {
+		LOG_ERR("FOTA chunk topic not subscribed, error: %d", err);
+		return err;
+	}
+#endif
+
 	return err;
 }
 
@@ -442,14 +939,88 @@ static int c_send(const struct cloud_backend *const backend,
 	case CLOUD_EP_TOPIC_MSG:
 		tx_data.topic.str = update_topic;
 		tx_data.topic.len = strlen(update_topic);
+		break;
+	case CLOUD_EP_TOPIC_STATE:
+		tx_data.topic.str = shadow_update_topic;
+		tx_data.topic.len = strlen(shadow_update_topic);
+		break;
 	default:
 		LOG_ERR("No endpoint topic available");
-		break;
+		return -EINVAL;
 	}
 
 	return mqtt_backend_send(&tx_data);
 }
 
+static int endpoint_topic(const struct cloud_endpoint *ep,
+			  struct mqtt_topic *topic)
+{
+	/* Commands are not repeated by the server. */
+	topic->qos = MQTT_QOS_1_AT_LEAST_ONCE;
+
+	if (ep->str != NULL) {
+		topic->topic.utf8 = (u8_t *)ep->str;
+		topic->topic.size = ep->len;
+		return 0;
+	}
+
+	if (ep->type == CLOUD_EP_TOPIC_CONFIG) {
+		topic->topic.utf8 = (u8_t *)cmd_topic;
+		topic->topic.size = strlen(cmd_topic);
+		return 0;
+	}
+
+	if (ep->type == CLOUD_EP_TOPIC_STATE) {
+		topic->topic.utf8 = (u8_t *)shadow_delta_topic;
+		topic->topic.size = strlen(shadow_delta_topic);
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+static int c_ep_subscriptions_add(const struct cloud_backend *const backend,
+				  const struct cloud_endpoint *const list,
+				  size_t list_count)
+{
+	struct mqtt_topic topics[CONFIG_MQTT_BACKEND_SUBSCRIPTIONS_MAX];
+	int err;
+
+	if (list_count > ARRAY_SIZE(topics)) {
+		return -ENOMEM;
+	}
+
+	for (size_t i = 0; i < list_count; i++) {
+		err = endpoint_topic(&list[i], &topics[i]);
+		if (err) {
+			return err;
+		}
+	}
+
+	return mqtt_backend_subscriptions_add(topics, list_count);
+}
+
+static int c_ep_subscriptions_remove(const struct cloud_backend *const backend,
+				     const struct cloud_endpoint *const list,
+				     size_t list_count)
+{
+	struct mqtt_topic topics[CONFIG_MQTT_BACKEND_SUBSCRIPTIONS_MAX];
+	int err;
+
+	if (list_count > ARRAY_SIZE(topics)) {
+		return -ENOENT;
+	}
+
+	for (size_t i = 0; i < list_count; i++) {
+		err = endpoint_topic(&list[i], &topics[i]);
+		if (err) {
+			return err;
+		}
+	}
+
+	return mqtt_backend_subscriptions_remove(topics, list_count);
+}
+
 static int c_input(const struct cloud_backend *const backend)
 {
 	return mqtt_backend_input();
@@ -472,7 +1043,9 @@ static const struct cloud_api mqtt_backend_api = {
 	.send			= c_send,
 	.ping			= c_ping,
 	.keepalive_time_left	= c_keepalive_time_left,
-	.input			= c_input
+	.input			= c_input,
+	.ep_subscriptions_add	= c_ep_subscriptions_add,
+	.ep_subscriptions_remove = c_ep_subscriptions_remove
 };
 
 CLOUD_BACKEND_DEFINE(MQTT_BACKEND, mqtt_backend_api);
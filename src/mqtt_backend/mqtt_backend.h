@@ -139,6 +139,48 @@ int mqtt_backend_disconnect(void);
  */
 int mqtt_backend_send(const struct mqtt_backend_tx_data *const tx_data);
 
+/** @brief Subscribe to topic filters.
+ *
+ *  @details The filters are kept and all of them are subscribed to in a
+ *           single SUBSCRIBE after every CONNACK. Filters added while
+ *           connected are subscribed to right away, in one SUBSCRIBE.
+ *
+ *  @param[in] list Topic filters and the QoS requested for each. The
+ *                  filters are strings that must remain valid while
+ *                  subscribed.
+ *  @param[in] count Number of filters.
+ *
+ *  @return 0 If successful.
+ *            -EALREADY if a filter is subscribed to already.
+ *            -ENOMEM if CONFIG_MQTT_BACKEND_SUBSCRIPTIONS_MAX is exceeded.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int mqtt_backend_subscriptions_add(const struct mqtt_topic *list,
+				   size_t count);
+
+/** @brief Unsubscribe from topic filters.
+ *
+ *  @param[in] list Topic filters.
+ *  @param[in] count Number of filters.
+ *
+ *  @return 0 If successful.
+ *            -ENOENT if a filter is not subscribed to.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int mqtt_backend_subscriptions_remove(const struct mqtt_topic *list,
+				      size_t count);
+
+/** @brief Get the result of the subscription to a topic filter.
+ *
+ *  @param[in] filter Topic filter.
+ *
+ *  @return QoS granted by the broker, 0 to 2.
+ *          -EINPROGRESS if the SUBACK is outstanding.
+ *          -EACCES if the broker refused the subscription.
+ *          -ENOENT if the filter is not subscribed to.
+ */
+int mqtt_backend_subscription_result(const char *filter);
+
 /** @brief Get data from MQTT broker.
  *
  *  @return 0 If successful.
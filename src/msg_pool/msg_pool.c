@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <msg_pool.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(msg_pool, CONFIG_MSG_POOL_LOG_LEVEL);
+
+/* Every block starts with a struct msg_buf, its size_t needs 8 byte
+ * alignment on 64-bit targets such as native_posix_64.
+ */
+#define MSG_BUF_ALIGN sizeof(void *)
+#define MSG_BUF_BLOCK_SIZE \
+	ROUND_UP(sizeof(struct msg_buf) + CONFIG_MSG_POOL_BUF_SIZE, \
+		 MSG_BUF_ALIGN)
+
+K_MEM_SLAB_DEFINE(msg_slab, MSG_BUF_BLOCK_SIZE, CONFIG_MSG_POOL_BUF_COUNT,
+		  MSG_BUF_ALIGN);
+
+static atomic_t peak;
+static atomic_t alloc_failures;
+
+struct msg_buf *msg_buf_alloc(s32_t timeout)
+{
+	struct msg_buf *buf;
+	atomic_val_t used, old_peak;
+
+	if (k_mem_slab_alloc(&msg_slab, (void **)&buf, timeout)) {
+		atomic_inc(&alloc_failures);
+		LOG_WRN("Message pool exhausted");
+		return NULL;
+	}
+
+	atomic_set(&buf->ref, 1);
+	buf->len = 0;
+
+	used = k_mem_slab_num_used_get(&msg_slab);
+
+	do {
+		old_peak = atomic_get(&peak);
+		if (used <= old_peak) {
+			break;
+		}
+	} while (!atomic_cas(&peak, old_peak, used));
+
+	LOG_DBG("Allocated %p, %d/%d in use, peak %d", buf, (int)used,
+		CONFIG_MSG_POOL_BUF_COUNT, (int)atomic_get(&peak));
+
+	return buf;
+}
+
+struct msg_buf *msg_buf_ref(struct msg_buf *buf)
+{
+	__ASSERT_NO_MSG(atomic_get(&buf->ref) > 0);
+
+	atomic_inc(&buf->ref);
+
+	return buf;
+}
+
+void msg_buf_unref(struct msg_buf *buf)
+{
+	__ASSERT_NO_MSG(atomic_get(&buf->ref) > 0);
+
+	/* atomic_dec() returns the value before decrementing. */
+	if (atomic_dec(&buf->ref) != 1) {
+		return;
+	}
+
+	LOG_DBG("Released %p", buf);
+
+	k_mem_slab_free(&msg_slab, (void **)&buf);
+}
+
+struct msg_buf *msg_buf_from_data(const void *data)
+{
+	const char *start = msg_slab.buffer;
+	const char *end = start + MSG_BUF_BLOCK_SIZE * CONFIG_MSG_POOL_BUF_COUNT;
+	const char *ptr = data;
+	struct msg_buf *buf;
+
+	if ((ptr < start) || (ptr >= end)) {
+		return NULL;
+	}
+
+	buf = (struct msg_buf *)(start + MSG_BUF_BLOCK_SIZE *
+				 ((ptr - start) / MSG_BUF_BLOCK_SIZE));
+
+	if ((const void *)buf->data != data) {
+		return NULL;
+	}
+
+	return buf;
+}
+
+void msg_pool_stats_get(struct msg_pool_stats *stats)
+{
+	stats->used = k_mem_slab_num_used_get(&msg_slab);
+	stats->peak = atomic_get(&peak);
+	stats->total = CONFIG_MSG_POOL_BUF_COUNT;
+	stats->alloc_failures = atomic_get(&alloc_failures);
+}
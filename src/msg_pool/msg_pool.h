@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Message pool library header.
+ */
+
+#ifndef MSG_POOL_H__
+#define MSG_POOL_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup msg_pool Message pool library
+ * @{
+ * @brief Reference counted message buffers backed by a memory slab.
+ *
+ *        A buffer is returned to the pool when its last reference is
+ *        released. Every stage that keeps a buffer beyond a function call,
+ *        for example a backend waiting for an acknowledgment, takes its own
+ *        reference with msg_buf_ref().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Pooled message buffer. */
+struct msg_buf {
+	/** Number of references held. */
+	atomic_t ref;
+	/** Number of valid bytes in data. */
+	size_t len;
+	/** Message payload, CONFIG_MSG_POOL_BUF_SIZE bytes. */
+	u8_t data[];
+};
+
+/** @brief Pool occupancy metrics. */
+struct msg_pool_stats {
+	/** Buffers currently allocated. */
+	u32_t used;
+	/** Highest number of buffers allocated at the same time. */
+	u32_t peak;
+	/** Total number of buffers in the pool. */
+	u32_t total;
+	/** Number of allocations that failed because the pool was empty. */
+	u32_t alloc_failures;
+};
+
+/** @brief Allocate a buffer holding one reference.
+ *
+ *  @param[in] timeout Time to wait for a free buffer, in milliseconds, or
+ *                     K_NO_WAIT or K_FOREVER.
+ *
+ *  @return Pointer to the buffer, NULL if none became available.
+ */
+struct msg_buf *msg_buf_alloc(s32_t timeout);
+
+/** @brief Take an additional reference to a buffer.
+ *
+ *  @param[in] buf Buffer to reference.
+ *
+ *  @return @p buf.
+ */
+struct msg_buf *msg_buf_ref(struct msg_buf *buf);
+
+/** @brief Release a reference. The buffer returns to the pool when the last
+ *         reference is released.
+ *
+ *  @param[in] buf Buffer to release.
+ */
+void msg_buf_unref(struct msg_buf *buf);
+
+/** @brief Look up the pooled buffer that owns a payload pointer.
+ *
+ *  @details Lets stages that only see a payload pointer, such as the cloud
+ *           API backends, take a reference to the underlying buffer.
+ *
+ *  @param[in] data Payload pointer.
+ *
+ *  @return Pointer to the buffer, NULL if @p data is not the payload of a
+ *          pooled buffer.
+ */
+struct msg_buf *msg_buf_from_data(const void *data);
+
+/** @brief Get the payload capacity of a buffer.
+ *
+ *  @return Capacity in bytes.
+ */
+static inline size_t msg_buf_size(void)
+{
+	return CONFIG_MSG_POOL_BUF_SIZE;
+}
+
+/** @brief Get pool occupancy metrics.
+ *
+ *  @param[out] stats Pointer to struct the metrics are copied to.
+ */
+void msg_pool_stats_get(struct msg_pool_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* MSG_POOL_H__ */
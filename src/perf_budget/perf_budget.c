@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <perf_budget.h>
+#include <debug/stack.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(perf_budget, CONFIG_PERF_BUDGET_LOG_LEVEL);
+
+#define BUDGET_LIMIT(budget) \
+	((budget) + ((budget) * CONFIG_PERF_BUDGET_TOLERANCE_PERCENT) / 100)
+
+static struct k_spinlock lock;
+static struct perf_budget_stats stats;
+
+static void budget_check(const char *name, u32_t value, u32_t budget)
+{
+	if (value <= BUDGET_LIMIT(budget)) {
+		return;
+	}
+
+	stats.exceeded++;
+
+	LOG_ERR("%s: %u over the budget of %u + %d%%", name, value, budget,
+		CONFIG_PERF_BUDGET_TOLERANCE_PERCENT);
+}
+
+/* Called with the lock held. */
+static void msg_record(size_t len)
+{
+	stats.msgs++;
+	stats.bytes_last = len;
+	stats.bytes_max = MAX(stats.bytes_max, len);
+
+	budget_check("Message bytes", len, CONFIG_PERF_BUDGET_MSG_BYTES);
+}
+
+u32_t perf_budget_encode_start(void)
+{
+	return k_cycle_get_32();
+}
+
+void perf_budget_encode_end(u32_t start, size_t len)
+{
+	u32_t cycles = k_cycle_get_32() - start;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	stats.encodes++;
+	stats.cycles_last = cycles;
+	stats.cycles_max = MAX(stats.cycles_max, cycles);
+
+	budget_check("Encode cycles", cycles,
+		     CONFIG_PERF_BUDGET_ENCODE_CYCLES);
+	msg_record(len);
+
+	k_spin_unlock(&lock, key);
+}
+
+void perf_budget_msg_sent(size_t len)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	msg_record(len);
+
+	k_spin_unlock(&lock, key);
+}
+
+int perf_budget_check(void)
+{
+	struct k_thread *thread = k_current_get();
+	size_t unused = stack_unused_space_get(
+		(const char *)thread->stack_info.start,
+		thread->stack_info.size);
+	u32_t used = thread->stack_info.size - unused;
+
+	if (used > stats.stack_max) {
+		stats.stack_max = used;
+		budget_check("Stack bytes", used,
+			     CONFIG_PERF_BUDGET_STACK_BYTES);
+	}
+
+	return stats.exceeded ? -E2BIG : 0;
+}
+
+void perf_budget_stats_get(struct perf_budget_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = stats;
+
+	k_spin_unlock(&lock, key);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Performance budget library header.
+ */
+
+#ifndef PERF_BUDGET_H__
+#define PERF_BUDGET_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup perf_budget Performance budget library
+ * @{
+ * @brief Measures encoding cycles, message sizes and the stack high-water
+ *        mark against the budgets set in Kconfig.
+ *
+ *        The encoding hooks are called by the backends and compile to
+ *        nothing when CONFIG_PERF_BUDGET is disabled.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Performance metrics. */
+struct perf_budget_stats {
+	/** Number of publications measured. */
+	u32_t msgs;
+	/** Number of publications the encoding was timed of. */
+	u32_t encodes;
+	/** Cycles spent encoding the last publication timed. */
+	u32_t cycles_last;
+	/** Most cycles spent encoding a publication. */
+	u32_t cycles_max;
+	/** Size of the last publication, in bytes. */
+	u32_t bytes_last;
+	/** Size of the largest publication, in bytes. */
+	u32_t bytes_max;
+	/** Stack high-water mark of the publishing thread, in bytes. */
+	u32_t stack_max;
+	/** Number of measurements over budget. */
+	u32_t exceeded;
+};
+
+#if defined(CONFIG_PERF_BUDGET)
+
+/** @brief A backend starts encoding a publication.
+ *
+ *  @return Start of the encoding, passed to perf_budget_encode_end().
+ */
+u32_t perf_budget_encode_start(void);
+
+/** @brief A backend encoded a publication, before it is written to the
+ *         socket.
+ *
+ *  @param[in] start Value returned by perf_budget_encode_start().
+ *  @param[in] len Size of the encoded publication, in bytes.
+ */
+void perf_budget_encode_end(u32_t start, size_t len);
+
+/** @brief A backend sent a publication it cannot time the encoding of
+ *         apart from the socket write. Only its size is measured.
+ *
+ *  @param[in] len Size of the encoded publication, in bytes.
+ */
+void perf_budget_msg_sent(size_t len);
+
+#else
+
+static inline u32_t perf_budget_encode_start(void) { return 0; }
+static inline void perf_budget_encode_end(u32_t start, size_t len) {}
+static inline void perf_budget_msg_sent(size_t len) {}
+
+#endif /* CONFIG_PERF_BUDGET */
+
+/** @brief Update the stack high-water mark of the calling thread and check
+ *         all budgets.
+ *
+ *  @return 0 If every measurement so far is within budget.
+ *            -E2BIG if a budget was exceeded.
+ */
+int perf_budget_check(void);
+
+/** @brief Get performance metrics.
+ *
+ *  @param[out] stats Pointer to struct the metrics are copied to.
+ */
+void perf_budget_stats_get(struct perf_budget_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* PERF_BUDGET_H__ */
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <power_profile.h>
+#include <device.h>
+#include <string.h>
+
+#if defined(CONFIG_BSD_LIBRARY_TRACE_ENABLED)
+#include <modem/at_cmd.h>
+#endif
+
+#include <logging/log.h>
+#include <logging/log_ctrl.h>
+#include <logging/log_backend.h>
+
+LOG_MODULE_REGISTER(power_profile, CONFIG_POWER_PROFILE_LOG_LEVEL);
+
+static enum power_profile current = POWER_PROFILE_DEBUG;
+
+K_MUTEX_DEFINE(profile_lock);
+
+static int uart_power_set(const char *name, u32_t state)
+{
+	struct device *dev;
+	int err;
+
+	if (strlen(name) == 0) {
+		return 0;
+	}
+
+	dev = device_get_binding(name);
+	if (dev == NULL) {
+		LOG_WRN("%s not found", log_strdup(name));
+		return 0;
+	}
+
+	err = device_set_power_state(dev, state, NULL, NULL);
+	if (err) {
+		LOG_ERR("device_set_power_state %s, error: %d",
+			log_strdup(name), err);
+	}
+
+	return err;
+}
+
+static int modem_trace_set(bool enable)
+{
+#if defined(CONFIG_BSD_LIBRARY_TRACE_ENABLED)
+	int err;
+
+	err = at_cmd_write(enable ? CONFIG_POWER_PROFILE_MODEM_TRACE_CMD :
+				    "AT%XMODEMTRACE=0", NULL, 0, NULL);
+	if (err) {
+		LOG_ERR("Modem trace could not be %s, error: %d",
+			enable ? "started" : "stopped", err);
+	}
+
+	return err;
+#else
+	return 0;
+#endif
+}
+
+static void log_backends_set(bool enable)
+{
+#if defined(CONFIG_LOG)
+	if (!enable) {
+		/* Flush pending messages before their backends stop. */
+		while (log_process(false)) {
+		}
+	}
+
+	for (int i = 0; i < log_backend_count_get(); i++) {
+		const struct log_backend *backend = log_backend_get(i);
+
+		if (enable) {
+			log_backend_activate(backend, backend->cb->ctx);
+		} else {
+			log_backend_deactivate(backend);
+		}
+	}
+#endif
+}
+
+int power_profile_set(enum power_profile profile)
+{
+	int err = 0;
+	int ret;
+
+	k_mutex_lock(&profile_lock, K_FOREVER);
+
+	if (profile == current) {
+		goto exit;
+	}
+
+	/* Every subsystem is switched even if an earlier one failed, the
+	 * first error is returned.
+	 */
+	if (profile == POWER_PROFILE_LOW_POWER) {
+		LOG_INF("Entering low power profile");
+
+		log_backends_set(false);
+
+		err = modem_trace_set(false);
+		ret = uart_power_set(CONFIG_POWER_PROFILE_TRACE_UART,
+				     DEVICE_PM_OFF_STATE);
+		err = err ? err : ret;
+		ret = uart_power_set(CONFIG_POWER_PROFILE_CONSOLE_UART,
+				     DEVICE_PM_OFF_STATE);
+		err = err ? err : ret;
+	} else {
+		err = uart_power_set(CONFIG_POWER_PROFILE_CONSOLE_UART,
+				     DEVICE_PM_ACTIVE_STATE);
+		ret = uart_power_set(CONFIG_POWER_PROFILE_TRACE_UART,
+				     DEVICE_PM_ACTIVE_STATE);
+		err = err ? err : ret;
+		ret = modem_trace_set(true);
+		err = err ? err : ret;
+
+		log_backends_set(true);
+
+		LOG_INF("Debug profile restored");
+	}
+
+	current = profile;
+
+exit:
+	k_mutex_unlock(&profile_lock);
+
+	return err;
+}
+
+enum power_profile power_profile_get(void)
+{
+	return current;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Power profile library header.
+ */
+
+#ifndef POWER_PROFILE_H__
+#define POWER_PROFILE_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup power_profile Power profile library
+ * @{
+ * @brief Gates the subsystems that keep the UARTs and their clocks
+ *        running.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Power profiles. */
+enum power_profile {
+	/** Console, AT host, modem trace and logging enabled. */
+	POWER_PROFILE_DEBUG,
+	/** UARTs powered down, modem trace stopped, logging deactivated. */
+	POWER_PROFILE_LOW_POWER
+};
+
+/** @brief Switch to a power profile.
+ *
+ *  @param[in] profile Profile to switch to.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned. The profile
+ *            may then be partially applied.
+ */
+int power_profile_set(enum power_profile profile);
+
+/** @brief Get the current power profile.
+ *
+ *  @return Current profile.
+ */
+enum power_profile power_profile_get(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* POWER_PROFILE_H__ */
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <publish_sched.h>
+#include <random/rand32.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(publish_sched, CONFIG_PUBLISH_SCHED_LOG_LEVEL);
+
+K_THREAD_STACK_DEFINE(publish_wq_stack,
+		      CONFIG_PUBLISH_SCHED_WORKQUEUE_STACK_SIZE);
+
+static struct k_work_q publish_wq;
+
+static struct {
+	u32_t samples;
+	s32_t last;
+	s32_t min;
+	s32_t max;
+	s64_t sum;
+} jitter;
+
+K_MUTEX_DEFINE(jitter_lock);
+
+#define FNV1A_OFFSET_BASIS 2166136261U
+#define FNV1A_PRIME 16777619U
+
+static u32_t phase_hash = FNV1A_OFFSET_BASIS;
+static s32_t phase_slot = -1;
+
+static void jitter_record(s32_t latency)
+{
+	k_mutex_lock(&jitter_lock, K_FOREVER);
+
+	if ((jitter.samples == 0) || (latency < jitter.min)) {
+		jitter.min = latency;
+	}
+
+	if ((jitter.samples == 0) || (latency > jitter.max)) {
+		jitter.max = latency;
+	}
+
+	jitter.last = latency;
+	jitter.sum += latency;
+	jitter.samples++;
+
+	k_mutex_unlock(&jitter_lock);
+}
+
+static void publish_work_fn(struct k_work *work)
+{
+	struct publish_work *pw = publish_work_from_k_work(work);
+	s32_t latency = (s32_t)(k_uptime_get() - pw->due);
+
+	jitter_record(latency);
+
+	LOG_DBG("Work %p started %d ms after its due time", pw, latency);
+
+	pw->handler(work);
+}
+
+void publish_sched_init(void)
+{
+	k_work_q_start(&publish_wq, publish_wq_stack,
+		       K_THREAD_STACK_SIZEOF(publish_wq_stack),
+		       CONFIG_PUBLISH_SCHED_WORKQUEUE_PRIORITY);
+	k_thread_name_set(&publish_wq.thread, "publish_wq");
+}
+
+void publish_work_init(struct publish_work *pw, k_work_handler_t handler)
+{
+	pw->handler = handler;
+	k_delayed_work_init(&pw->work, publish_work_fn);
+}
+
+int publish_work_submit(struct publish_work *pw, s32_t delay)
+{
+	pw->due = k_uptime_get() + delay;
+
+	return k_delayed_work_submit_to_queue(&publish_wq, &pw->work, delay);
+}
+
+int publish_work_submit_at(struct publish_work *pw, s64_t deadline)
+{
+	s64_t delay = deadline - k_uptime_get();
+
+	pw->due = deadline;
+
+	return k_delayed_work_submit_to_queue(&publish_wq, &pw->work,
+					      MAX(delay, 0));
+}
+
+static int periodic_schedule(struct publish_periodic *pp)
+{
+	s64_t now = k_uptime_get();
+	s64_t next;
+	u32_t pending;
+	u32_t skip;
+
+	pp->count++;
+	next = pp->base + (s64_t)pp->count * pp->period;
+
+	if (next > now) {
+		return publish_work_submit_at(&pp->work, next);
+	}
+
+	/* Deadlines up to and including now have been missed. */
+	pending = (u32_t)((now - next) / pp->period) + 1;
+
+#if defined(CONFIG_PUBLISH_SCHED_MISSED_CATCH_UP)
+	/* Keep the most recent ones, they run back to back. */
+	skip = pending > CONFIG_PUBLISH_SCHED_CATCH_UP_MAX ?
+	       pending - CONFIG_PUBLISH_SCHED_CATCH_UP_MAX : 0;
+#else
+	skip = pending;
+#endif
+
+	pp->count += skip;
+	pp->missed += skip;
+
+	LOG_WRN("Periodic work %p missed %d period(s), %d skipped", pp,
+		pending, skip);
+
+	return publish_work_submit_at(&pp->work,
+				      pp->base + (s64_t)pp->count * pp->period);
+}
+
+static void periodic_work_fn(struct k_work *work)
+{
+	struct publish_work *pw = publish_work_from_k_work(work);
+	struct publish_periodic *pp =
+		CONTAINER_OF(pw, struct publish_periodic, work);
+	s64_t base = pp->base;
+	int err;
+
+	pp->handler(work);
+
+	/* Stopped or restarted by the handler. */
+	if (pp->stopped || (pp->base != base)) {
+		return;
+	}
+
+	err = periodic_schedule(pp);
+	if (err) {
+		LOG_ERR("Periodic work %p could not be rescheduled, error: %d",
+			pp, err);
+	}
+}
+
+void publish_periodic_init(struct publish_periodic *pp,
+			   k_work_handler_t handler, u32_t period)
+{
+	__ASSERT_NO_MSG(period > 0);
+
+	pp->handler = handler;
+	pp->period = period;
+	pp->count = 0;
+	pp->missed = 0;
+	pp->stopped = true;
+	publish_work_init(&pp->work, periodic_work_fn);
+}
+
+int publish_periodic_start(struct publish_periodic *pp, s32_t delay)
+{
+	pp->base = k_uptime_get() + delay;
+	pp->count = 0;
+	pp->stopped = false;
+
+	return publish_work_submit_at(&pp->work, pp->base);
+}
+
+void publish_periodic_stop(struct publish_periodic *pp)
+{
+	pp->stopped = true;
+	k_delayed_work_cancel(&pp->work.work);
+}
+
+void publish_sched_phase_init(const u8_t *id, size_t id_len)
+{
+	u32_t hash = FNV1A_OFFSET_BASIS;
+
+	/* Every device without an identity would hash to the offset basis
+	 * and share the same phase.
+	 */
+	if ((id == NULL) || (id_len == 0)) {
+		phase_hash = sys_rand32_get();
+
+		LOG_DBG("Random phase hash: 0x%08x", phase_hash);
+		return;
+	}
+
+	for (size_t i = 0; i < id_len; i++) {
+		hash ^= id[i];
+		hash *= FNV1A_PRIME;
+	}
+
+	phase_hash = hash;
+
+	LOG_DBG("Phase hash: 0x%08x", hash);
+}
+
+void publish_sched_slot_set(s32_t slot)
+{
+	phase_slot = slot;
+
+	LOG_INF("Server assigned slot: %d ms", slot);
+}
+
+s32_t publish_sched_phase_get(u32_t window)
+{
+	if (!IS_ENABLED(CONFIG_PUBLISH_SCHED_PHASE_SPREAD) || (window == 0)) {
+		return 0;
+	}
+
+	if (phase_slot >= 0) {
+		return phase_slot % window;
+	}
+
+	return phase_hash % window;
+}
+
+void publish_sched_jitter_get(struct publish_sched_jitter *stats)
+{
+	k_mutex_lock(&jitter_lock, K_FOREVER);
+
+	stats->samples = jitter.samples;
+	stats->last = jitter.last;
+	stats->min = jitter.min;
+	stats->max = jitter.max;
+	stats->avg = jitter.samples ? (s32_t)(jitter.sum / jitter.samples) : 0;
+
+	k_mutex_unlock(&jitter_lock);
+}
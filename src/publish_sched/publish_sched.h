@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Publish scheduler library header.
+ */
+
+#ifndef PUBLISH_SCHED_H__
+#define PUBLISH_SCHED_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup publish_sched Publish scheduler library
+ * @{
+ * @brief Runs publication and ping work on a dedicated work queue and
+ *        measures how late each item starts compared to when it was due.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Work item executed on the publish work queue. */
+struct publish_work {
+	/** Underlying delayed work item. */
+	struct k_delayed_work work;
+	/** Handler called when the work item runs. */
+	k_work_handler_t handler;
+	/** Uptime in milliseconds the work item is due at. */
+	s64_t due;
+};
+
+/** @brief Work item executed periodically on absolute deadlines. */
+struct publish_periodic {
+	/** Underlying publish work item. */
+	struct publish_work work;
+	/** Handler called every period. */
+	k_work_handler_t handler;
+	/** Uptime in milliseconds of the first deadline. */
+	s64_t base;
+	/** Period in milliseconds. */
+	u32_t period;
+	/** Number of the current deadline, counted from base. */
+	u32_t count;
+	/** Number of deadlines skipped because they were missed. */
+	u32_t missed;
+	/** Set once stopped, the handler running then does not re-arm. */
+	bool stopped;
+};
+
+/** @brief Start latency statistics, in milliseconds. */
+struct publish_sched_jitter {
+	/** Number of executions measured. */
+	u32_t samples;
+	/** Latency of the last execution. */
+	s32_t last;
+	/** Lowest latency observed. */
+	s32_t min;
+	/** Highest latency observed. */
+	s32_t max;
+	/** Mean latency. */
+	s32_t avg;
+};
+
+/** @brief Start the publish work queue.
+ *
+ *  @warning This API must be called exactly once, before any work item is
+ *           submitted.
+ */
+void publish_sched_init(void);
+
+/** @brief Initialize a publish work item.
+ *
+ *  @param[out] pw Work item.
+ *  @param[in] handler Handler called when the item runs. The k_work
+ *                     pointer passed to it belongs to @p pw.
+ */
+void publish_work_init(struct publish_work *pw, k_work_handler_t handler);
+
+/** @brief Submit a work item to the publish work queue.
+ *
+ *  @param[in] pw Work item.
+ *  @param[in] delay Delay before the item runs, in milliseconds.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int publish_work_submit(struct publish_work *pw, s32_t delay);
+
+/** @brief Submit a work item to run at an absolute time.
+ *
+ *  @param[in] pw Work item.
+ *  @param[in] deadline Uptime in milliseconds the item is due at. The item
+ *                      runs immediately if the deadline has passed.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int publish_work_submit_at(struct publish_work *pw, s64_t deadline);
+
+/** @brief Initialize a periodic work item.
+ *
+ *  @param[out] pp Periodic work item.
+ *  @param[in] handler Handler called every period.
+ *  @param[in] period Period in milliseconds.
+ */
+void publish_periodic_init(struct publish_periodic *pp,
+			   k_work_handler_t handler, u32_t period);
+
+/** @brief Start or restart a periodic work item.
+ *
+ *  @details The first deadline is @p delay from now. Following deadlines
+ *           are computed from it, independent of how long the handler
+ *           takes. Deadlines missed while the work queue was busy are
+ *           skipped or caught up on according to the configured policy.
+ *
+ *  @param[in] pp Periodic work item.
+ *  @param[in] delay Delay before the first execution, in milliseconds.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int publish_periodic_start(struct publish_periodic *pp, s32_t delay);
+
+/** @brief Stop a periodic work item.
+ *
+ *  @details May be called from the handler, the work item is then not
+ *           scheduled again when the handler returns.
+ *
+ *  @param[in] pp Periodic work item.
+ */
+void publish_periodic_stop(struct publish_periodic *pp);
+
+/** @brief Set the identity the phase offset is derived from.
+ *
+ *  @details Without an identity, the phase is drawn at random so that
+ *           devices without one are spread as well.
+ *
+ *  @param[in] id Client ID, or NULL if the device has none.
+ *  @param[in] id_len Length of the client ID.
+ */
+void publish_sched_phase_init(const u8_t *id, size_t id_len);
+
+/** @brief Set a server assigned slot, overriding the derived phase.
+ *
+ *  @param[in] slot Slot offset in milliseconds, or a negative value to go
+ *                  back to the phase derived from the client ID.
+ */
+void publish_sched_slot_set(s32_t slot);
+
+/** @brief Get the phase offset of this device within a window.
+ *
+ *  @details The offset is the server assigned slot if one is set,
+ *           otherwise a hash of the client ID. It is the same for every
+ *           call with the same window, and 0 if phase spreading is
+ *           disabled.
+ *
+ *  @param[in] window Window length in milliseconds.
+ *
+ *  @return Offset in milliseconds, lower than @p window.
+ */
+s32_t publish_sched_phase_get(u32_t window);
+
+/** @brief Get the publish work item containing a k_work.
+ *
+ *  @param[in] work Work pointer passed to a publish work handler.
+ *
+ *  @return Pointer to the publish work item.
+ */
+static inline struct publish_work *publish_work_from_k_work(
+						struct k_work *work)
+{
+	return CONTAINER_OF(work, struct publish_work, work.work);
+}
+
+/** @brief Get start latency statistics for all publish work items.
+ *
+ *  @param[out] jitter Pointer to struct the statistics are copied to.
+ */
+void publish_sched_jitter_get(struct publish_sched_jitter *jitter);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* PUBLISH_SCHED_H__ */
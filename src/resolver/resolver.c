@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <resolver.h>
+#include <string.h>
+
+#if defined(CONFIG_RESOLVER_NO_HEAP)
+#include <modem/at_cmd.h>
+#include <random/rand32.h>
+#include <sys/byteorder.h>
+#endif
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(resolver, CONFIG_RESOLVER_LOG_LEVEL);
+
+#if defined(CONFIG_RESOLVER_NO_HEAP)
+#define DNS_PORT 53
+#define DNS_MSG_MAX_LEN 512
+#define DNS_HEADER_LEN 12
+#define DNS_FLAGS_QR BIT(15)
+#define DNS_FLAGS_RD BIT(8)
+#define DNS_FLAGS_RCODE_MASK 0x000f
+#define DNS_TYPE_A 1
+#define DNS_TYPE_AAAA 28
+#define DNS_CLASS_IN 1
+#define DNS_LABEL_MAX_LEN 63
+#define DNS_LABEL_POINTER 0xc0
+
+/* Primary DNS server is the sixth field of the +CGCONTRDP response. */
+#define CGCONTRDP_DNS_PRIM_FIELD 5
+
+static u8_t dns_buf[DNS_MSG_MAX_LEN];
+static char at_buf[128];
+static u16_t dns_id;
+
+K_MUTEX_DEFINE(dns_lock);
+#endif
+
+static void port_set(struct sockaddr_storage *addr, u16_t port)
+{
+	if (addr->ss_family == AF_INET6) {
+		((struct sockaddr_in6 *)addr)->sin6_port = htons(port);
+	} else {
+		((struct sockaddr_in *)addr)->sin_port = htons(port);
+	}
+}
+
+static int literal_parse(const char *host, int family,
+			 struct sockaddr_storage *addr)
+{
+	void *dst;
+
+	if (family == AF_INET6) {
+		dst = &((struct sockaddr_in6 *)addr)->sin6_addr;
+	} else {
+		dst = &((struct sockaddr_in *)addr)->sin_addr;
+	}
+
+	if (inet_pton(family, host, dst) != 1) {
+		return -EINVAL;
+	}
+
+	addr->ss_family = family;
+
+	return 0;
+}
+
+#if defined(CONFIG_RESOLVER_NO_HEAP)
+/* Called with dns_lock held. */
+static int dns_server_get(struct sockaddr_in *server)
+{
+	const char *field = at_buf;
+	size_t len;
+	int err;
+
+	memset(server, 0, sizeof(*server));
+	server->sin_family = AF_INET;
+	server->sin_port = htons(DNS_PORT);
+
+	if (sizeof(CONFIG_RESOLVER_DNS_SERVER) > 1) {
+		field = CONFIG_RESOLVER_DNS_SERVER;
+		len = strlen(field);
+	} else {
+		err = at_cmd_write("AT+CGCONTRDP=0", at_buf, sizeof(at_buf),
+				   NULL);
+		if (err) {
+			LOG_ERR("Could not read PDN DNS servers, error: %d",
+				err);
+			return err;
+		}
+
+		field = strchr(at_buf, ':');
+
+		for (int i = 0; (field != NULL) &&
+				(i < CGCONTRDP_DNS_PRIM_FIELD); i++) {
+			field = strchr(field + 1, ',');
+		}
+
+		if (field == NULL) {
+			LOG_ERR("No DNS server in PDN context");
+			return -ENOENT;
+		}
+
+		field += strspn(field, ", \"");
+		len = strcspn(field, "\",\r\n");
+	}
+
+	if (len >= NET_IPV4_ADDR_LEN) {
+		return -EINVAL;
+	}
+
+	/* The field is copied out because inet_pton() needs a terminated
+	 * string.
+	 */
+	char ipv4_addr[NET_IPV4_ADDR_LEN];
+
+	memcpy(ipv4_addr, field, len);
+	ipv4_addr[len] = '\0';
+
+	if (inet_pton(AF_INET, ipv4_addr, &server->sin_addr) != 1) {
+		LOG_ERR("Invalid DNS server address: %s",
+			log_strdup(ipv4_addr));
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int dns_query_encode(const char *host, u16_t type)
+{
+	u8_t *p = dns_buf;
+	const char *label = host;
+
+	sys_put_be16(dns_id, p);
+	sys_put_be16(DNS_FLAGS_RD, p + 2);
+	sys_put_be16(1, p + 4);
+	sys_put_be16(0, p + 6);
+	sys_put_be16(0, p + 8);
+	sys_put_be16(0, p + 10);
+	p += DNS_HEADER_LEN;
+
+	while (*label != '\0') {
+		size_t len = strcspn(label, ".");
+
+		if ((len == 0) || (len > DNS_LABEL_MAX_LEN) ||
+		    ((p + 1 + len + 5) > (dns_buf + sizeof(dns_buf)))) {
+			return -EINVAL;
+		}
+
+		*p++ = len;
+		memcpy(p, label, len);
+		p += len;
+		label += len;
+
+		if (*label == '.') {
+			label++;
+		}
+	}
+
+	*p++ = 0;
+	sys_put_be16(type, p);
+	sys_put_be16(DNS_CLASS_IN, p + 2);
+	p += 4;
+
+	return p - dns_buf;
+}
+
+/* Returns the offset following the name at off, or a negative value if the
+ * name runs past the end of the message.
+ */
+static int dns_name_skip(size_t len, size_t off)
+{
+	while (off < len) {
+		u8_t label = dns_buf[off];
+
+		if ((label & DNS_LABEL_POINTER) == DNS_LABEL_POINTER) {
+			return (off + 2 <= len) ? (int)(off + 2) : -EBADMSG;
+		}
+
+		off += 1 + label;
+
+		if (label == 0) {
+			return off;
+		}
+	}
+
+	return -EBADMSG;
+}
+
+static int dns_response_decode(size_t len, u16_t type,
+			       struct sockaddr_storage *addr)
+{
+	u16_t flags, qdcount, ancount;
+	int off = DNS_HEADER_LEN;
+
+	if ((len < DNS_HEADER_LEN) || (sys_get_be16(dns_buf) != dns_id)) {
+		return -EAGAIN;
+	}
+
+	flags = sys_get_be16(dns_buf + 2);
+	qdcount = sys_get_be16(dns_buf + 4);
+	ancount = sys_get_be16(dns_buf + 6);
+
+	if (!(flags & DNS_FLAGS_QR)) {
+		return -EAGAIN;
+	}
+
+	if (flags & DNS_FLAGS_RCODE_MASK) {
+		LOG_ERR("DNS error response, rcode: %d",
+			flags & DNS_FLAGS_RCODE_MASK);
+		return -ENOENT;
+	}
+
+	while (qdcount--) {
+		off = dns_name_skip(len, off);
+		if (off < 0) {
+			return off;
+		}
+		off += 4;
+	}
+
+	while (ancount--) {
+		u16_t rr_type, rdlen;
+
+		off = dns_name_skip(len, off);
+		if ((off < 0) || ((off + 10) > len)) {
+			return -EBADMSG;
+		}
+
+		rr_type = sys_get_be16(dns_buf + off);
+		rdlen = sys_get_be16(dns_buf + off + 8);
+		off += 10;
+
+		if ((off + rdlen) > len) {
+			return -EBADMSG;
+		}
+
+		/* CNAME records precede the addresses, skip them. */
+		if ((rr_type == DNS_TYPE_A) && (type == DNS_TYPE_A) &&
+		    (rdlen == sizeof(struct in_addr))) {
+			memcpy(&((struct sockaddr_in *)addr)->sin_addr,
+			       dns_buf + off, rdlen);
+			addr->ss_family = AF_INET;
+			return 0;
+		}
+
+		if ((rr_type == DNS_TYPE_AAAA) && (type == DNS_TYPE_AAAA) &&
+		    (rdlen == sizeof(struct in6_addr))) {
+			memcpy(&((struct sockaddr_in6 *)addr)->sin6_addr,
+			       dns_buf + off, rdlen);
+			addr->ss_family = AF_INET6;
+			return 0;
+		}
+
+		off += rdlen;
+	}
+
+	return -ENOENT;
+}
+
+static int dns_resolve(const char *host, int family, int socktype,
+		       struct sockaddr_storage *addr)
+{
+	u16_t type = (family == AF_INET6) ? DNS_TYPE_AAAA : DNS_TYPE_A;
+	struct timeval timeout = {
+		.tv_sec = CONFIG_RESOLVER_TIMEOUT_MS / MSEC_PER_SEC,
+		.tv_usec = (CONFIG_RESOLVER_TIMEOUT_MS % MSEC_PER_SEC) *
+			   USEC_PER_MSEC,
+	};
+	struct sockaddr_in server;
+	int query_len;
+	int fd;
+	int err;
+
+	/* The lookup itself always runs over UDP. */
+	ARG_UNUSED(socktype);
+
+	/* Held from the AT response on, it is read into a static buffer as
+	 * well.
+	 */
+	k_mutex_lock(&dns_lock, K_FOREVER);
+
+	err = dns_server_get(&server);
+	if (err) {
+		goto unlock;
+	}
+
+	dns_id = sys_rand32_get();
+
+	query_len = dns_query_encode(host, type);
+	if (query_len < 0) {
+		LOG_ERR("Host name cannot be encoded");
+		err = query_len;
+		goto unlock;
+	}
+
+	fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd < 0) {
+		LOG_ERR("Failed to create DNS socket: %d", errno);
+		err = -errno;
+		goto unlock;
+	}
+
+	err = setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+			 sizeof(timeout));
+	if (err) {
+		LOG_ERR("Failed to set DNS timeout: %d", errno);
+		err = -errno;
+		goto close;
+	}
+
+	err = -ETIMEDOUT;
+
+	for (int i = 0; i <= CONFIG_RESOLVER_RETRIES; i++) {
+		ssize_t len;
+
+		/* The query is re-encoded every try, the response
+		 * overwrites it.
+		 */
+		dns_query_encode(host, type);
+
+		len = sendto(fd, dns_buf, query_len, 0,
+			     (struct sockaddr *)&server, sizeof(server));
+		if (len < 0) {
+			LOG_ERR("DNS query send failed: %d", errno);
+			err = -errno;
+			break;
+		}
+
+		do {
+			len = recv(fd, dns_buf, sizeof(dns_buf), 0);
+			if (len < 0) {
+				err = -ETIMEDOUT;
+				break;
+			}
+
+			err = dns_response_decode(len, type, addr);
+		} while (err == -EAGAIN);
+
+		if (len >= 0) {
+			break;
+		}
+
+		LOG_WRN("DNS query timed out, try %d of %d", i + 1,
+			CONFIG_RESOLVER_RETRIES + 1);
+	}
+
+close:
+	(void)close(fd);
+unlock:
+	k_mutex_unlock(&dns_lock);
+
+	return err;
+}
+#else
+static int dns_resolve(const char *host, int family, int socktype,
+		       struct sockaddr_storage *addr)
+{
+	int err;
+	struct addrinfo *result;
+	struct addrinfo *ai;
+	struct addrinfo hints = {
+		.ai_family = family,
+		.ai_socktype = socktype
+	};
+
+	err = getaddrinfo(host, NULL, &hints, &result);
+	if (err) {
+		LOG_ERR("getaddrinfo, error %d", err);
+		return -EIO;
+	}
+
+	err = -ENOENT;
+
+	for (ai = result; ai != NULL; ai = ai->ai_next) {
+		if (ai->ai_family == family) {
+			memcpy(addr, ai->ai_addr, ai->ai_addrlen);
+			err = 0;
+			break;
+		}
+	}
+
+	freeaddrinfo(result);
+
+	return err;
+}
+#endif
+
+int resolver_resolve(const char *host, u16_t port, int family, int socktype,
+		     struct sockaddr_storage *addr)
+{
+	char addr_str[NET_IPV6_ADDR_LEN];
+	int err;
+
+	memset(addr, 0, sizeof(*addr));
+
+	err = literal_parse(host, family, addr);
+	if (err) {
+		err = dns_resolve(host, family, socktype, addr);
+	}
+
+	if (err) {
+		LOG_ERR("Could not resolve %s, error: %d", log_strdup(host),
+			err);
+		return err;
+	}
+
+	port_set(addr, port);
+
+	inet_ntop(family, (family == AF_INET6) ?
+		  (void *)&((struct sockaddr_in6 *)addr)->sin6_addr :
+		  (void *)&((struct sockaddr_in *)addr)->sin_addr,
+		  addr_str, sizeof(addr_str));
+	LOG_DBG("%s resolved to %s", log_strdup(host), log_strdup(addr_str));
+
+	return 0;
+}
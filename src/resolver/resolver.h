@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Resolver library header.
+ */
+
+#ifndef RESOLVER_H__
+#define RESOLVER_H__
+
+#include <zephyr.h>
+#include <net/socket.h>
+
+/**
+ * @defgroup resolver Resolver library
+ * @{
+ * @brief Resolves server host names into a socket address.
+ *
+ *        IP address literals are parsed without a lookup. Other names are
+ *        resolved with getaddrinfo(), or, with CONFIG_RESOLVER_NO_HEAP, by
+ *        a DNS client working in static buffers.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Resolve a host name.
+ *
+ *  @param[in] host Host name or IP address literal.
+ *  @param[in] port Port number, in host byte order.
+ *  @param[in] family AF_INET or AF_INET6.
+ *  @param[in] socktype Socket type the address is used with.
+ *  @param[out] addr Resolved address.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int resolver_resolve(const char *host, u16_t port, int family, int socktype,
+		     struct sockaddr_storage *addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* RESOLVER_H__ */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <quant.h>
+
+#define STANDARD_GRAVITY 9.80665
+#define MV_PER_VOLT 1000.0
+
+static const u32_t resolution[QUANT_UNIT_COUNT] = {
+	[QUANT_DEG] = CONFIG_SERIALIZER_QUANT_DEG_STEPS,
+	[QUANT_HEADING] = CONFIG_SERIALIZER_QUANT_HEADING_STEPS,
+	[QUANT_METER] = CONFIG_SERIALIZER_QUANT_METER_STEPS,
+	[QUANT_SPEED] = CONFIG_SERIALIZER_QUANT_SPEED_STEPS,
+	[QUANT_ACCEL] = CONFIG_SERIALIZER_QUANT_ACCEL_STEPS,
+	[QUANT_BAT] = CONFIG_SERIALIZER_QUANT_BAT_STEPS,
+};
+
+/* Steps per unit of the telemetry record, see quant.json. */
+static const double factor[QUANT_UNIT_COUNT] = {
+	[QUANT_DEG] = CONFIG_SERIALIZER_QUANT_DEG_STEPS,
+	[QUANT_HEADING] = CONFIG_SERIALIZER_QUANT_HEADING_STEPS,
+	[QUANT_METER] = CONFIG_SERIALIZER_QUANT_METER_STEPS,
+	[QUANT_SPEED] = CONFIG_SERIALIZER_QUANT_SPEED_STEPS,
+	[QUANT_ACCEL] = CONFIG_SERIALIZER_QUANT_ACCEL_STEPS /
+			STANDARD_GRAVITY,
+	[QUANT_BAT] = CONFIG_SERIALIZER_QUANT_BAT_STEPS / MV_PER_VOLT,
+};
+
+s32_t quant_steps(enum quant_unit unit, double val)
+{
+	double steps = val * factor[unit];
+
+	if (steps >= INT32_MAX) {
+		return INT32_MAX;
+	}
+
+	if (steps <= INT32_MIN) {
+		return INT32_MIN;
+	}
+
+	/* Rounded half away from zero. */
+	return (s32_t)(steps < 0 ? steps - 0.5 : steps + 0.5);
+}
+
+u32_t quant_resolution(enum quant_unit unit)
+{
+	return resolution[unit];
+}
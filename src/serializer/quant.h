@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Sensor value quantization header.
+ */
+
+#ifndef QUANT_H__
+#define QUANT_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup quant Sensor value quantization
+ * @{
+ * @brief Converts sensor values to integer steps of a configured
+ *        resolution.
+ *
+ *        The resolutions are set in Kconfig and listed for the decoder in
+ *        quant.json, which must be updated when they are changed. A value
+ *        is decoded as steps / steps per unit * unit size, the unit size
+ *        being the value of one unit in the telemetry record.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Quantized quantities. */
+enum quant_unit {
+	/** Longitude and latitude, in degrees. */
+	QUANT_DEG,
+	/** Heading, in degrees. */
+	QUANT_HEADING,
+	/** Altitude and accuracy, in meters. */
+	QUANT_METER,
+	/** Speed, in m/s. */
+	QUANT_SPEED,
+	/** Acceleration in m/s^2, quantized in steps of g. */
+	QUANT_ACCEL,
+	/** Battery voltage in mV, quantized in steps of volts. */
+	QUANT_BAT,
+	QUANT_UNIT_COUNT
+};
+
+/** @brief Quantize a value.
+ *
+ *  @param[in] unit Quantity of the value.
+ *  @param[in] val Value, in the unit of the telemetry record.
+ *
+ *  @return Number of steps nearest to the value, saturated to the range of
+ *          a signed 32-bit integer.
+ */
+s32_t quant_steps(enum quant_unit unit, double val);
+
+/** @brief Get the resolution of a quantity.
+ *
+ *  @param[in] unit Quantity.
+ *
+ *  @return Steps per unit as configured, the unit being the one listed for
+ *          the quantity in quant.json.
+ */
+u32_t quant_resolution(enum quant_unit unit);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* QUANT_H__ */
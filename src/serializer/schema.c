@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <schema.h>
+#include <quant.h>
+#include <telemetry.h>
+#include <schema_table.h>
+#include <sys/byteorder.h>
+#include <string.h>
+
+#define SCHEMA_DEFINE(_name, _id, _version, _crc)			\
+	static const struct schema_field _name##_fields[] = {		\
+		SCHEMA_FIELDS_##_name					\
+	};								\
+	const struct schema schema_##_name = {				\
+		.id = _id,						\
+		.version = _version,					\
+		.crc = _crc,						\
+		.fields = _name##_fields,				\
+		.field_count = ARRAY_SIZE(_name##_fields)		\
+	};
+
+#define SCHEMA_REF(_name, _id, _version, _crc) &schema_##_name,
+
+SCHEMA_REGISTRY(SCHEMA_DEFINE)
+
+static const struct schema *const registry[] = {
+	SCHEMA_REGISTRY(SCHEMA_REF)
+};
+
+/* Output stream. Once a write fails, the following ones do nothing and the
+ * error is reported at the end.
+ */
+struct schema_out {
+	u8_t *buf;
+	size_t size;
+	size_t len;
+	int err;
+};
+
+static void bytes_write(struct schema_out *out, const void *data, size_t len)
+{
+	if (out->err) {
+		return;
+	}
+
+	if (len > out->size - out->len) {
+		out->err = -ENOMEM;
+		return;
+	}
+
+	memcpy(out->buf + out->len, data, len);
+	out->len += len;
+}
+
+static void varint_write(struct schema_out *out, u64_t val)
+{
+	u8_t buf[10];
+	size_t len = 0;
+
+	do {
+		buf[len] = val & 0x7f;
+		val >>= 7;
+
+		if (val) {
+			buf[len] |= 0x80;
+		}
+
+		len++;
+	} while (val);
+
+	bytes_write(out, buf, len);
+}
+
+static u64_t uint_read(const u8_t *member, size_t size)
+{
+	u8_t u8;
+	u16_t u16;
+	u32_t u32;
+	u64_t u64;
+
+	switch (size) {
+	case sizeof(u8):
+		memcpy(&u8, member, sizeof(u8));
+		return u8;
+	case sizeof(u16):
+		memcpy(&u16, member, sizeof(u16));
+		return u16;
+	case sizeof(u32):
+		memcpy(&u32, member, sizeof(u32));
+		return u32;
+	default:
+		memcpy(&u64, member, sizeof(u64));
+		return u64;
+	}
+}
+
+static void field_write(struct schema_out *out,
+			const struct schema_field *field, const u8_t *member)
+{
+	size_t len;
+	double val;
+	s32_t steps;
+
+	switch (field->type) {
+	case SCHEMA_UINT:
+		varint_write(out, uint_read(member, field->size));
+		break;
+	case SCHEMA_STR:
+		len = strnlen((const char *)member, field->size);
+		varint_write(out, len);
+		bytes_write(out, member, len);
+		break;
+	case SCHEMA_QUANT:
+		if (field->size != sizeof(val)) {
+			out->err = -EINVAL;
+			break;
+		}
+
+		memcpy(&val, member, sizeof(val));
+		steps = quant_steps(field->unit, val);
+		varint_write(out, ((u32_t)steps << 1) ^ (u32_t)(steps >> 31));
+		break;
+	default:
+		out->err = -EINVAL;
+		break;
+	}
+}
+
+int schema_encode(const struct schema *s, const void *record, u8_t *buf,
+		  size_t size)
+{
+	struct schema_out out = {
+		.buf = buf,
+		.size = size
+	};
+
+	bytes_write(&out, &s->id, sizeof(s->id));
+
+	for (size_t i = 0; i < s->field_count; i++) {
+		field_write(&out, &s->fields[i],
+			    (const u8_t *)record + s->fields[i].offset);
+	}
+
+	return out.err ? out.err : out.len;
+}
+
+int schema_announce_encode(u8_t *buf, size_t size)
+{
+	struct schema_out out = {
+		.buf = buf,
+		.size = size
+	};
+	u8_t id = SCHEMA_ID_ANNOUNCE;
+	u8_t crc[sizeof(u32_t)];
+
+	bytes_write(&out, &id, sizeof(id));
+	varint_write(&out, ARRAY_SIZE(registry));
+
+	for (size_t i = 0; i < ARRAY_SIZE(registry); i++) {
+		bytes_write(&out, &registry[i]->id, sizeof(registry[i]->id));
+		varint_write(&out, registry[i]->version);
+		sys_put_le32(registry[i]->crc, crc);
+		bytes_write(&out, crc, sizeof(crc));
+	}
+
+	varint_write(&out, QUANT_UNIT_COUNT);
+
+	for (int unit = 0; unit < QUANT_UNIT_COUNT; unit++) {
+		varint_write(&out, quant_resolution(unit));
+	}
+
+	return out.err ? out.err : out.len;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Schema registry header.
+ */
+
+#ifndef SCHEMA_H__
+#define SCHEMA_H__
+
+#include <zephyr.h>
+#include <stddef.h>
+
+/**
+ * @defgroup schema Schema registry
+ * @{
+ * @brief Positional encoding of records by the schemas of
+ *        src/serializer/schema.json.
+ *
+ *        An encoded record is the 1-byte ID of its schema followed by the
+ *        values of the fields in schema order, without names or tags. The
+ *        server decodes it with the same registry, the field tables built
+ *        in are generated from it. The schemas built in are announced to
+ *        the server at connect with their CRC, so that it can detect a
+ *        registry that differs from its own.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Schema ID of the announcement. */
+#define SCHEMA_ID_ANNOUNCE 0
+
+/** @brief Field types. */
+enum schema_type {
+	/** Unsigned integer, as a varint. */
+	SCHEMA_UINT,
+	/** String, as a varint length and the bytes. */
+	SCHEMA_STR,
+	/** Double, as a zigzag varint of quantization steps. */
+	SCHEMA_QUANT,
+};
+
+/** @brief Field of a schema. */
+struct schema_field {
+	/** Offset of the member in the record. */
+	u16_t offset;
+	/** Size of the member. */
+	u8_t size;
+	/** Field type, see @ref schema_type. */
+	u8_t type;
+	/** Quantity of a SCHEMA_QUANT field, see @ref quant_unit. */
+	u8_t unit;
+};
+
+/** @brief Define the field of a schema for a member of a record. */
+#define SCHEMA_FIELD(_record, _member, _type, _unit)			\
+	{								\
+		.offset = offsetof(_record, _member),			\
+		.size = sizeof(((_record *)0)->_member),		\
+		.type = _type,						\
+		.unit = _unit						\
+	}
+
+/** @brief Schema. */
+struct schema {
+	u8_t id;
+	u16_t version;
+	/** CRC of the schema in the registry, see scripts/schema_gen.py. */
+	u32_t crc;
+	const struct schema_field *fields;
+	size_t field_count;
+};
+
+/** @brief Schema of the telemetry record. */
+extern const struct schema schema_telemetry;
+
+/** @brief Encode a record.
+ *
+ *  @param[in] s Schema of the record.
+ *  @param[in] record Record.
+ *  @param[out] buf Buffer the record is encoded into.
+ *  @param[in] size Size of the buffer.
+ *
+ *  @return Length of the encoded record if successful.
+ *          -ENOMEM if it does not fit the buffer.
+ *          Otherwise, a (negative) error code is returned.
+ */
+int schema_encode(const struct schema *s, const void *record, u8_t *buf,
+		  size_t size);
+
+/** @brief Encode the announcement of the schemas built in.
+ *
+ *  The announcement is the ID SCHEMA_ID_ANNOUNCE, the number of schemas,
+ *  the ID, version and CRC of each, the number of quantities and the
+ *  resolution of each in the order of @ref quant_unit.
+ *
+ *  @param[out] buf Buffer the announcement is encoded into.
+ *  @param[in] size Size of the buffer.
+ *
+ *  @return Length of the announcement if successful.
+ *          -ENOMEM if it does not fit the buffer.
+ */
+int schema_announce_encode(u8_t *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* SCHEMA_H__ */
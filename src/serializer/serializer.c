@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <serializer.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(serializer, CONFIG_SERIALIZER_LOG_LEVEL);
+
+const struct serializer *serializer_get(void)
+{
+#if defined(CONFIG_SERIALIZER_FORMAT_PROTOBUF) && \
+	defined(CONFIG_SERIALIZER_QUANT)
+	return &serializer_protobuf_quant;
+#elif defined(CONFIG_SERIALIZER_FORMAT_PROTOBUF)
+	return &serializer_protobuf;
+#elif defined(CONFIG_SERIALIZER_FORMAT_POSITIONAL)
+	return &serializer_positional;
+#else
+	return &serializer_json;
+#endif
+}
+
+int serializer_encode(const struct telemetry *t, u8_t *buf, size_t size)
+{
+	const struct serializer *s = serializer_get();
+	int len;
+
+	len = s->encode(t, buf, size);
+	if (len < 0) {
+		LOG_ERR("%s encoding failed, error: %d", s->name, len);
+	}
+
+	return len;
+}
+
+#if defined(CONFIG_SERIALIZER_BENCHMARK)
+static const struct serializer *const benchmarked[] = {
+#if defined(CONFIG_SERIALIZER_JSON)
+	&serializer_json,
+#endif
+#if defined(CONFIG_SERIALIZER_PROTOBUF)
+	&serializer_protobuf,
+#endif
+#if defined(CONFIG_SERIALIZER_QUANT)
+	&serializer_protobuf_quant,
+#endif
+#if defined(CONFIG_SERIALIZER_POSITIONAL)
+	&serializer_positional,
+#endif
+};
+
+static u8_t bench_buf[CONFIG_MSG_POOL_BUF_SIZE];
+
+void serializer_benchmark(const struct telemetry *t)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(benchmarked); i++) {
+		const struct serializer *s = benchmarked[i];
+		u32_t start = k_cycle_get_32();
+		u32_t cycles;
+		int len = 0;
+
+		for (int round = 0; round < CONFIG_SERIALIZER_BENCHMARK_ROUNDS;
+		     round++) {
+			len = s->encode(t, bench_buf, sizeof(bench_buf));
+			if (len < 0) {
+				break;
+			}
+		}
+
+		cycles = (k_cycle_get_32() - start) /
+			 CONFIG_SERIALIZER_BENCHMARK_ROUNDS;
+
+		if (len < 0) {
+			printk("Serializer %s: error %d\n", s->name, len);
+			continue;
+		}
+
+		printk("Serializer %s: %d bytes, %u cycles, %u us per "
+		       "encoding\n", s->name, len, cycles,
+		       (u32_t)(SYS_CLOCK_HW_CYCLES_TO_NS64(cycles) /
+			       NSEC_PER_USEC));
+	}
+}
+#endif
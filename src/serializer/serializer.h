@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Telemetry serializer header.
+ */
+
+#ifndef SERIALIZER_H__
+#define SERIALIZER_H__
+
+#include <zephyr.h>
+#include <telemetry.h>
+
+/**
+ * @defgroup serializer Telemetry serializer
+ * @{
+ * @brief Encodes telemetry records into the payload handed to the cloud
+ *        backend.
+ *
+ *        Every format implements the same interface. The format used for
+ *        publications is chosen with CONFIG_SERIALIZER_FORMAT, the others
+ *        are only built for the benchmark.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Serializer interface. */
+struct serializer {
+	/** Name of the format. */
+	const char *name;
+	/** @brief Encode a record.
+	 *
+	 *  @param[in] t Record.
+	 *  @param[out] buf Buffer the record is encoded into.
+	 *  @param[in] size Size of the buffer.
+	 *
+	 *  @return Length of the encoded record if successful.
+	 *          -ENOMEM if it does not fit the buffer.
+	 *          Otherwise, a (negative) error code is returned.
+	 */
+	int (*encode)(const struct telemetry *t, u8_t *buf, size_t size);
+};
+
+#if defined(CONFIG_SERIALIZER_JSON)
+/** @brief JSON, in the layout of CONFIG_CLOUD_MESSAGE. */
+extern const struct serializer serializer_json;
+#endif
+
+#if defined(CONFIG_SERIALIZER_PROTOBUF)
+/** @brief Protocol Buffers, see telemetry.proto. */
+extern const struct serializer serializer_protobuf;
+#endif
+
+#if defined(CONFIG_SERIALIZER_QUANT)
+/** @brief Protocol Buffers with quantized sensor values, see quant.h. */
+extern const struct serializer serializer_protobuf_quant;
+#endif
+
+#if defined(CONFIG_SERIALIZER_POSITIONAL)
+/** @brief Schema-indexed positional encoding, see schema.h. */
+extern const struct serializer serializer_positional;
+#endif
+
+/** @brief Get the serializer selected for publications. */
+const struct serializer *serializer_get(void);
+
+/** @brief Encode a record with the serializer selected for publications.
+ *
+ *  @param[in] t Record.
+ *  @param[out] buf Buffer the record is encoded into.
+ *  @param[in] size Size of the buffer.
+ *
+ *  @return Length of the encoded record if successful.
+ *          Otherwise, a (negative) error code is returned.
+ */
+int serializer_encode(const struct telemetry *t, u8_t *buf, size_t size);
+
+#if defined(CONFIG_SERIALIZER_BENCHMARK)
+/** @brief Encode a record with every built serializer and print the encoded
+ *         size and the cycles spent per encoding.
+ *
+ *  @param[in] t Record.
+ */
+void serializer_benchmark(const struct telemetry *t);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* SERIALIZER_H__ */
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <serializer.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Output buffer. Once an append fails, the following ones do nothing and
+ * the error is reported at the end.
+ */
+struct json_out {
+	char *buf;
+	size_t size;
+	size_t len;
+	int err;
+};
+
+static void append(struct json_out *out, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	if (out->err) {
+		return;
+	}
+
+	va_start(args, fmt);
+	len = vsnprintf(out->buf + out->len, out->size - out->len, fmt, args);
+	va_end(args);
+
+	if ((len < 0) || (len >= out->size - out->len)) {
+		out->err = -ENOMEM;
+		return;
+	}
+
+	out->len += len;
+}
+
+/* Shortest representation that reads back as the same double. */
+static void append_double(struct json_out *out, double val)
+{
+	char num[32];
+
+	for (int precision = 15; precision <= 17; precision++) {
+		snprintf(num, sizeof(num), "%.*g", precision, val);
+
+		if (strtod(num, NULL) == val) {
+			break;
+		}
+	}
+
+	append(out, "%s", num);
+}
+
+static void append_str(struct json_out *out, const char *str)
+{
+	append(out, "\"");
+
+	for (; *str != '\0'; str++) {
+		if ((*str == '"') || (*str == '\\')) {
+			append(out, "\\%c", *str);
+		} else if ((u8_t)*str < ' ') {
+			append(out, "\\u%04x", *str);
+		} else {
+			append(out, "%c", *str);
+		}
+	}
+
+	append(out, "\"");
+}
+
+static void dev_append(struct json_out *out, const struct telemetry_dev *dev)
+{
+	append(out, "\"dev\":{\"v\":{\"band\":%u,\"nw\":", dev->band);
+	append_str(out, dev->nw);
+	append(out, ",\"iccid\":");
+	append_str(out, dev->iccid);
+	append(out, ",\"modV\":");
+	append_str(out, dev->mod_v);
+	append(out, ",\"brdV\":");
+	append_str(out, dev->brd_v);
+	append(out, ",\"appV\":");
+	append_str(out, dev->app_v);
+	append(out, "},\"ts\":%llu}", dev->ts);
+}
+
+static void roam_append(struct json_out *out,
+			const struct telemetry_roam *roam)
+{
+	append(out, "\"roam\":{\"v\":{\"rsrp\":%u,\"area\":%u,\"mccmnc\":%u,"
+	       "\"cell\":%u,\"ip\":", roam->rsrp, roam->area, roam->mccmnc,
+	       roam->cell);
+	append_str(out, roam->ip);
+	append(out, "},\"ts\":%llu}", roam->ts);
+}
+
+static void acc_append(struct json_out *out, const struct telemetry_acc *acc)
+{
+	append(out, "\"acc\":{\"v\":[");
+
+	for (size_t i = 0; i < ARRAY_SIZE(acc->v); i++) {
+		append(out, i ? "," : "");
+		append_double(out, acc->v[i]);
+	}
+
+	append(out, "],\"ts\":%llu}", acc->ts);
+}
+
+static void gps_append(struct json_out *out, const struct telemetry_gps *gps)
+{
+	append(out, "\"gps\":{\"v\":{\"lng\":");
+	append_double(out, gps->lng);
+	append(out, ",\"lat\":");
+	append_double(out, gps->lat);
+	append(out, ",\"acc\":");
+	append_double(out, gps->acc);
+	append(out, ",\"alt\":");
+	append_double(out, gps->alt);
+	append(out, ",\"spd\":");
+	append_double(out, gps->spd);
+	append(out, ",\"hdg\":");
+	append_double(out, gps->hdg);
+	append(out, "},\"ts\":%llu}", gps->ts);
+}
+
+static int json_encode(const struct telemetry *t, u8_t *buf, size_t size)
+{
+	struct json_out out = {
+		.buf = (char *)buf,
+		.size = size
+	};
+
+	append(&out, "{");
+	dev_append(&out, &t->dev);
+	append(&out, ",");
+	roam_append(&out, &t->roam);
+	append(&out, ",\"bat\":{\"v\":%u,\"ts\":%llu},", t->bat.v, t->bat.ts);
+	acc_append(&out, &t->acc);
+	append(&out, ",");
+	gps_append(&out, &t->gps);
+	append(&out, "}");
+
+	/* The terminating null is not part of the payload. */
+	return out.err ? out.err : out.len;
+}
+
+const struct serializer serializer_json = {
+	.name = "json",
+	.encode = json_encode
+};
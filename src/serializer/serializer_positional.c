@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <serializer.h>
+#include <schema.h>
+
+static int positional_encode(const struct telemetry *t, u8_t *buf,
+			     size_t size)
+{
+	return schema_encode(&schema_telemetry, t, buf, size);
+}
+
+const struct serializer serializer_positional = {
+	.name = "positional",
+	.encode = positional_encode
+};
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <serializer.h>
+#include <sys/byteorder.h>
+#include <string.h>
+
+#if defined(CONFIG_SERIALIZER_QUANT)
+#include <quant.h>
+#endif
+
+/* Protocol Buffers wire types. */
+#define PB_WT_VARINT 0
+#define PB_WT_64BIT 1
+#define PB_WT_LEN 2
+
+/* Output stream. Without a buffer the bytes are only counted, which sizes a
+ * submessage before it is written. Once a write fails, the following ones
+ * do nothing and the error is reported at the end.
+ */
+struct pb_out {
+	u8_t *buf;
+	size_t size;
+	size_t len;
+	int err;
+};
+
+typedef void (*pb_msg_encode_t)(struct pb_out *out, const void *msg);
+
+static void bytes_write(struct pb_out *out, const void *data, size_t len)
+{
+	if (out->err) {
+		return;
+	}
+
+	if (out->buf != NULL) {
+		if (len > out->size - out->len) {
+			out->err = -ENOMEM;
+			return;
+		}
+
+		memcpy(out->buf + out->len, data, len);
+	}
+
+	out->len += len;
+}
+
+static void varint_write(struct pb_out *out, u64_t val)
+{
+	u8_t buf[10];
+	size_t len = 0;
+
+	do {
+		buf[len] = val & 0x7f;
+		val >>= 7;
+
+		if (val) {
+			buf[len] |= 0x80;
+		}
+
+		len++;
+	} while (val);
+
+	bytes_write(out, buf, len);
+}
+
+static void tag_write(struct pb_out *out, u32_t field, u8_t wire_type)
+{
+	varint_write(out, (field << 3) | wire_type);
+}
+
+static void double_write(struct pb_out *out, double val)
+{
+	u64_t bits;
+	u8_t buf[sizeof(bits)];
+
+	memcpy(&bits, &val, sizeof(bits));
+	sys_put_le64(bits, buf);
+	bytes_write(out, buf, sizeof(buf));
+}
+
+/* Scalar fields holding their default value are omitted, as in proto3. */
+static void uint_field(struct pb_out *out, u32_t field, u64_t val)
+{
+	if (val) {
+		tag_write(out, field, PB_WT_VARINT);
+		varint_write(out, val);
+	}
+}
+
+#if defined(CONFIG_SERIALIZER_QUANT)
+static u32_t zigzag(s32_t val)
+{
+	return ((u32_t)val << 1) ^ (u32_t)(val >> 31);
+}
+
+static void sint_field(struct pb_out *out, u32_t field, s32_t val)
+{
+	uint_field(out, field, zigzag(val));
+}
+
+/* Values that cannot be negative are sent unsigned. */
+static u32_t unsigned_steps(enum quant_unit unit, double val)
+{
+	s32_t steps = quant_steps(unit, val);
+
+	return (steps > 0) ? steps : 0;
+}
+#endif
+
+static void double_field(struct pb_out *out, u32_t field, double val)
+{
+	if (val != 0.0) {
+		tag_write(out, field, PB_WT_64BIT);
+		double_write(out, val);
+	}
+}
+
+static void str_field(struct pb_out *out, u32_t field, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (len) {
+		tag_write(out, field, PB_WT_LEN);
+		varint_write(out, len);
+		bytes_write(out, str, len);
+	}
+}
+
+static void msg_field(struct pb_out *out, u32_t field,
+		      pb_msg_encode_t encode, const void *msg)
+{
+	struct pb_out sizing = { 0 };
+
+	encode(&sizing, msg);
+
+	tag_write(out, field, PB_WT_LEN);
+	varint_write(out, sizing.len);
+	encode(out, msg);
+}
+
+/* The field numbers below are the ones of telemetry.proto. */
+static void dev_encode(struct pb_out *out, const void *msg)
+{
+	const struct telemetry_dev *dev = msg;
+
+	uint_field(out, 1, dev->band);
+	str_field(out, 2, dev->nw);
+	str_field(out, 3, dev->iccid);
+	str_field(out, 4, dev->mod_v);
+	str_field(out, 5, dev->brd_v);
+	str_field(out, 6, dev->app_v);
+	uint_field(out, 7, dev->ts);
+}
+
+static void roam_encode(struct pb_out *out, const void *msg)
+{
+	const struct telemetry_roam *roam = msg;
+
+	uint_field(out, 1, roam->rsrp);
+	uint_field(out, 2, roam->area);
+	uint_field(out, 3, roam->mccmnc);
+	uint_field(out, 4, roam->cell);
+	str_field(out, 5, roam->ip);
+	uint_field(out, 6, roam->ts);
+}
+
+static void bat_encode(struct pb_out *out, const void *msg)
+{
+	const struct telemetry_bat *bat = msg;
+
+	uint_field(out, 1, bat->v);
+	uint_field(out, 2, bat->ts);
+}
+
+static void acc_encode(struct pb_out *out, const void *msg)
+{
+	const struct telemetry_acc *acc = msg;
+
+	/* Repeated scalars are packed in proto3. */
+	tag_write(out, 1, PB_WT_LEN);
+	varint_write(out, sizeof(acc->v));
+
+	for (size_t i = 0; i < ARRAY_SIZE(acc->v); i++) {
+		double_write(out, acc->v[i]);
+	}
+
+	uint_field(out, 2, acc->ts);
+}
+
+static void gps_encode(struct pb_out *out, const void *msg)
+{
+	const struct telemetry_gps *gps = msg;
+
+	double_field(out, 1, gps->lng);
+	double_field(out, 2, gps->lat);
+	double_field(out, 3, gps->acc);
+	double_field(out, 4, gps->alt);
+	double_field(out, 5, gps->spd);
+	double_field(out, 6, gps->hdg);
+	uint_field(out, 7, gps->ts);
+}
+
+#if defined(CONFIG_SERIALIZER_QUANT)
+static void bat_q_encode(struct pb_out *out, const void *msg)
+{
+	const struct telemetry_bat *bat = msg;
+
+	uint_field(out, 1, unsigned_steps(QUANT_BAT, bat->v));
+	uint_field(out, 2, bat->ts);
+}
+
+static void acc_q_encode(struct pb_out *out, const void *msg)
+{
+	const struct telemetry_acc *acc = msg;
+	struct pb_out sizing = { 0 };
+	u32_t v[ARRAY_SIZE(acc->v)];
+
+	for (size_t i = 0; i < ARRAY_SIZE(acc->v); i++) {
+		v[i] = zigzag(quant_steps(QUANT_ACCEL, acc->v[i]));
+		varint_write(&sizing, v[i]);
+	}
+
+	tag_write(out, 1, PB_WT_LEN);
+	varint_write(out, sizing.len);
+
+	for (size_t i = 0; i < ARRAY_SIZE(v); i++) {
+		varint_write(out, v[i]);
+	}
+
+	uint_field(out, 2, acc->ts);
+}
+
+static void gps_q_encode(struct pb_out *out, const void *msg)
+{
+	const struct telemetry_gps *gps = msg;
+
+	sint_field(out, 1, quant_steps(QUANT_DEG, gps->lng));
+	sint_field(out, 2, quant_steps(QUANT_DEG, gps->lat));
+	uint_field(out, 3, unsigned_steps(QUANT_METER, gps->acc));
+	sint_field(out, 4, quant_steps(QUANT_METER, gps->alt));
+	uint_field(out, 5, unsigned_steps(QUANT_SPEED, gps->spd));
+	uint_field(out, 6, unsigned_steps(QUANT_HEADING, gps->hdg));
+	uint_field(out, 7, gps->ts);
+}
+#endif
+
+static int telemetry_encode(const struct telemetry *t, u8_t *buf,
+			    size_t size, bool quant)
+{
+	struct pb_out out = {
+		.buf = buf,
+		.size = size
+	};
+
+	msg_field(&out, 1, dev_encode, &t->dev);
+	msg_field(&out, 2, roam_encode, &t->roam);
+
+#if defined(CONFIG_SERIALIZER_QUANT)
+	if (quant) {
+		msg_field(&out, 6, bat_q_encode, &t->bat);
+		msg_field(&out, 7, acc_q_encode, &t->acc);
+		msg_field(&out, 8, gps_q_encode, &t->gps);
+
+		return out.err ? out.err : out.len;
+	}
+#endif
+
+	msg_field(&out, 3, bat_encode, &t->bat);
+	msg_field(&out, 4, acc_encode, &t->acc);
+	msg_field(&out, 5, gps_encode, &t->gps);
+
+	return out.err ? out.err : out.len;
+}
+
+static int protobuf_encode(const struct telemetry *t, u8_t *buf,
+			   size_t size)
+{
+	return telemetry_encode(t, buf, size, false);
+}
+
+const struct serializer serializer_protobuf = {
+	.name = "protobuf",
+	.encode = protobuf_encode
+};
+
+#if defined(CONFIG_SERIALIZER_QUANT)
+static int protobuf_quant_encode(const struct telemetry *t, u8_t *buf,
+				 size_t size)
+{
+	return telemetry_encode(t, buf, size, true);
+}
+
+const struct serializer serializer_protobuf_quant = {
+	.name = "protobuf quantized",
+	.encode = protobuf_quant_encode
+};
+#endif
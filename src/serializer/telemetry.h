@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Telemetry record header.
+ */
+
+#ifndef TELEMETRY_H__
+#define TELEMETRY_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup telemetry Telemetry record
+ * @{
+ * @brief Device, network, battery, accelerometer and GPS readings published
+ *        by the sample, each with the time it was taken in milliseconds
+ *        since the Unix epoch. The layout on the wire is defined by the
+ *        serializer, see telemetry.proto for the Protocol Buffers schema.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_STR_LEN_MAX 32
+
+/** @brief Device information. */
+struct telemetry_dev {
+	u8_t band;
+	char nw[TELEMETRY_STR_LEN_MAX];
+	char iccid[TELEMETRY_STR_LEN_MAX];
+	char mod_v[TELEMETRY_STR_LEN_MAX];
+	char brd_v[TELEMETRY_STR_LEN_MAX];
+	char app_v[TELEMETRY_STR_LEN_MAX];
+	u64_t ts;
+};
+
+/** @brief Network registration. */
+struct telemetry_roam {
+	u8_t rsrp;
+	u16_t area;
+	u32_t mccmnc;
+	u32_t cell;
+	char ip[TELEMETRY_STR_LEN_MAX];
+	u64_t ts;
+};
+
+/** @brief Battery voltage in millivolts. */
+struct telemetry_bat {
+	u16_t v;
+	u64_t ts;
+};
+
+/** @brief Acceleration along X, Y and Z in m/s^2. */
+struct telemetry_acc {
+	double v[3];
+	u64_t ts;
+};
+
+/** @brief GPS fix. */
+struct telemetry_gps {
+	/** Longitude and latitude in degrees. */
+	double lng;
+	double lat;
+	/** Horizontal accuracy in meters. */
+	double acc;
+	/** Altitude in meters. */
+	double alt;
+	/** Speed in m/s. */
+	double spd;
+	/** Heading in degrees. */
+	double hdg;
+	u64_t ts;
+};
+
+/** @brief Telemetry record. */
+struct telemetry {
+	struct telemetry_dev dev;
+	struct telemetry_roam roam;
+	struct telemetry_bat bat;
+	struct telemetry_acc acc;
+	struct telemetry_gps gps;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* TELEMETRY_H__ */
@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <shadow.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <data/json.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(shadow, CONFIG_SHADOW_LOG_LEVEL);
+
+struct shadow_msg {
+	s32_t ver;
+	bool full;
+	s32_t val[CONFIG_SHADOW_PROP_MAX];
+};
+
+/* Bits set by json_obj_parse() for the members decoded, in the order of
+ * msg_descr.
+ */
+#define SHADOW_MSG_VER BIT(0)
+#define SHADOW_MSG_FULL BIT(1)
+#define SHADOW_MSG_PROP_SHIFT 2
+
+/* The properties are appended as they are registered. */
+static struct json_obj_descr msg_descr[SHADOW_MSG_PROP_SHIFT +
+				       CONFIG_SHADOW_PROP_MAX] = {
+	JSON_OBJ_DESCR_PRIM(struct shadow_msg, ver, JSON_TOK_NUMBER),
+	JSON_OBJ_DESCR_PRIM(struct shadow_msg, full, JSON_TOK_TRUE),
+};
+
+/* Longest key json_obj_parse() matches. */
+#define SHADOW_KEY_LEN_MAX 127
+
+static const char *const reserved_keys[] = { "ver", "full", "get",
+					     "reported" };
+
+static struct {
+	const struct shadow_prop *prop;
+	s32_t reported;
+	/* A value was reported. */
+	bool known;
+	/* The value changed since the server last accepted it. */
+	bool dirty;
+	/* The value was sent and is not accepted yet. */
+	bool inflight;
+} props[CONFIG_SHADOW_PROP_MAX];
+
+static size_t prop_count;
+static u32_t version;
+static bool awaiting_ack;
+static s64_t report_time;
+static shadow_send_t send_fn;
+
+/* Messages are written here, and received ones are copied here first as
+ * json_obj_parse() decodes in place.
+ */
+static char msg_buf[CONFIG_SHADOW_BUF_SIZE];
+static size_t msg_len;
+
+K_MUTEX_DEFINE(shadow_lock);
+
+void shadow_init(shadow_send_t send)
+{
+	send_fn = send;
+}
+
+static int prop_find(const char *key)
+{
+	for (size_t i = 0; i < prop_count; i++) {
+		if (strcmp(props[i].prop->key, key) == 0) {
+			return i;
+		}
+	}
+
+	return -ENOENT;
+}
+
+int shadow_prop_register(const struct shadow_prop *prop)
+{
+	struct json_obj_descr *descr;
+	int ret = 0;
+
+	if (strlen(prop->key) > SHADOW_KEY_LEN_MAX) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(reserved_keys); i++) {
+		if (strcmp(prop->key, reserved_keys[i]) == 0) {
+			return -EINVAL;
+		}
+	}
+
+	k_mutex_lock(&shadow_lock, K_FOREVER);
+
+	if (prop_find(prop->key) >= 0) {
+		ret = -EALREADY;
+		goto exit;
+	}
+
+	if (prop_count == ARRAY_SIZE(props)) {
+		LOG_ERR("No room for property %s", prop->key);
+		ret = -ENOMEM;
+		goto exit;
+	}
+
+	/* Decoded like "ver", an s32_t number, into the value slot of the
+	 * property.
+	 */
+	descr = &msg_descr[SHADOW_MSG_PROP_SHIFT + prop_count];
+	*descr = msg_descr[0];
+	descr->field_name = prop->key;
+	descr->field_name_len = strlen(prop->key);
+	descr->offset = offsetof(struct shadow_msg, val) +
+			prop_count * sizeof(s32_t);
+
+	props[prop_count].prop = prop;
+	props[prop_count].known = false;
+	props[prop_count].dirty = false;
+	props[prop_count].inflight = false;
+	prop_count++;
+
+exit:
+	k_mutex_unlock(&shadow_lock);
+
+	return ret;
+}
+
+int shadow_report(const char *key, s32_t val)
+{
+	int i;
+
+	k_mutex_lock(&shadow_lock, K_FOREVER);
+
+	i = prop_find(key);
+	if ((i >= 0) && (!props[i].known || (props[i].reported != val))) {
+		props[i].reported = val;
+		props[i].known = true;
+		props[i].dirty = true;
+	}
+
+	k_mutex_unlock(&shadow_lock);
+
+	return (i < 0) ? i : 0;
+}
+
+u32_t shadow_version_get(void)
+{
+	return version;
+}
+
+/* Appends to msg_buf. Once the message does not fit, msg_len stays past
+ * the end of the buffer.
+ */
+static void msg_printf(const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	if (msg_len >= sizeof(msg_buf)) {
+		return;
+	}
+
+	va_start(args, fmt);
+	len = vsnprintf(msg_buf + msg_len, sizeof(msg_buf) - msg_len, fmt,
+			args);
+	va_end(args);
+
+	msg_len = (len < 0) ? sizeof(msg_buf) : msg_len + len;
+}
+
+static int msg_send(void)
+{
+	if (msg_len >= sizeof(msg_buf)) {
+		LOG_ERR("Shadow message does not fit in %d bytes",
+			sizeof(msg_buf));
+		return -ENOMEM;
+	}
+
+	if (send_fn == NULL) {
+		return -ENOTCONN;
+	}
+
+	LOG_DBG("Sending %s", log_strdup(msg_buf));
+
+	return send_fn(msg_buf, msg_len);
+}
+
+static int resync_request(void)
+{
+	int err;
+
+	msg_len = 0;
+	msg_printf("{\"ver\":%u,\"get\":true}", version);
+
+	err = msg_send();
+	if (err) {
+		return err;
+	}
+
+	/* No report is sent until the full document arrives, it would be
+	 * refused.
+	 */
+	awaiting_ack = true;
+	report_time = k_uptime_get();
+
+	return 0;
+}
+
+int shadow_sync(bool check)
+{
+	bool dirty = false;
+	int err = 0;
+
+	k_mutex_lock(&shadow_lock, K_FOREVER);
+
+	if (awaiting_ack) {
+		/* After connecting, the answer may have been lost with the
+		 * previous connection, so it is not waited for.
+		 */
+		if (!check && (k_uptime_get() - report_time <
+			       CONFIG_SHADOW_ACK_TIMEOUT_MS)) {
+			goto exit;
+		}
+
+		LOG_WRN("Version %u not acknowledged, reporting again",
+			version);
+
+		awaiting_ack = false;
+
+		for (size_t i = 0; i < prop_count; i++) {
+			props[i].dirty |= props[i].inflight;
+			props[i].inflight = false;
+		}
+	}
+
+	msg_len = 0;
+	msg_printf("{\"ver\":%u,\"reported\":{", version);
+
+	for (size_t i = 0; i < prop_count; i++) {
+		if (props[i].dirty) {
+			msg_printf("%s\"%s\":%d", dirty ? "," : "",
+				   props[i].prop->key, props[i].reported);
+			dirty = true;
+		}
+	}
+
+	msg_printf("}}");
+
+	if (!dirty && !check) {
+		goto exit;
+	}
+
+	err = msg_send();
+	if (err) {
+		goto exit;
+	}
+
+	for (size_t i = 0; i < prop_count; i++) {
+		props[i].inflight = props[i].dirty;
+		props[i].dirty = false;
+	}
+
+	awaiting_ack = true;
+	report_time = k_uptime_get();
+
+exit:
+	k_mutex_unlock(&shadow_lock);
+
+	return err;
+}
+
+static void desired_apply(const struct shadow_msg *msg, u32_t keys)
+{
+	for (size_t i = 0; i < prop_count; i++) {
+		const struct shadow_prop *prop = props[i].prop;
+		s32_t val;
+
+		/* Properties without a handler are only reported. */
+		if (!(keys & BIT(i)) || (prop->handler == NULL)) {
+			continue;
+		}
+
+		LOG_INF("Desired %s: %d", prop->key, msg->val[i]);
+
+		val = prop->handler(msg->val[i]);
+		(void)shadow_report(prop->key, val);
+	}
+}
+
+static void acked(void)
+{
+	awaiting_ack = false;
+
+	for (size_t i = 0; i < prop_count; i++) {
+		props[i].inflight = false;
+	}
+}
+
+int shadow_handle(const char *buf, size_t len)
+{
+	struct shadow_msg msg = { 0 };
+	u32_t keys;
+	u32_t ver;
+	int ret;
+
+	/* Longer than any shadow message the buffer is sized for, so it is
+	 * left to the other handlers of received data.
+	 */
+	if (len >= sizeof(msg_buf)) {
+		LOG_DBG("Not a shadow message, %u bytes", len);
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&shadow_lock, K_FOREVER);
+
+	memcpy(msg_buf, buf, len);
+	msg_buf[len] = '\0';
+
+	ret = json_obj_parse(msg_buf, len, msg_descr,
+			     SHADOW_MSG_PROP_SHIFT + prop_count, &msg);
+	if ((ret < 0) || !(ret & SHADOW_MSG_VER) || (msg.ver < 0)) {
+		LOG_DBG("Not a shadow message");
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	keys = (u32_t)ret >> SHADOW_MSG_PROP_SHIFT;
+	ver = msg.ver;
+	ret = 0;
+
+	if (msg.full) {
+		LOG_INF("Full document, version %u", ver);
+
+		desired_apply(&msg, keys);
+		version = ver;
+		acked();
+
+		/* Everything is reported again on top of the new version. */
+		for (size_t i = 0; i < prop_count; i++) {
+			props[i].dirty = props[i].known;
+		}
+	} else if (ver == version + 1) {
+		desired_apply(&msg, keys);
+		version = ver;
+
+		/* A delta without values is the answer to a report. */
+		if (!keys && awaiting_ack) {
+			acked();
+		}
+	} else if ((ver == version) && !keys && awaiting_ack) {
+		/* A report without values leaves the version as is. */
+		acked();
+	} else if (ver <= version) {
+		LOG_DBG("Version %u dropped, at %u", ver, version);
+	} else {
+		LOG_WRN("Versions %u to %u missed, resynchronizing",
+			version + 1, ver - 1);
+		ret = resync_request();
+	}
+
+exit:
+	k_mutex_unlock(&shadow_lock);
+
+	return ret;
+}
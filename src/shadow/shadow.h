@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Device shadow header.
+ */
+
+#ifndef SHADOW_H__
+#define SHADOW_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup shadow Device shadow
+ * @{
+ * @brief Keeps a versioned document of integer properties in sync with the
+ *        server.
+ *
+ *        The server numbers the versions of the document and increments
+ *        the version with every change, whichever side made it. The device
+ *        keeps the last version it is in sync with and sends it with its
+ *        reported values:
+ *
+ *        {"ver":<version>,"reported":{"<key>":<value>,...}}
+ *
+ *        Only the values that changed since they were last accepted are
+ *        listed. The server accepts them if the version is its own, and
+ *        answers with the version that includes them, {"ver":<version>}.
+ *        It answers a report based on an older version with the full
+ *        document instead, the device then reports all of its values
+ *        again.
+ *
+ *        Desired values changed on the server are sent as a delta, each
+ *        property at the top level of the object:
+ *
+ *        {"ver":<version>,"<key>":<value>,...}
+ *
+ *        A delta is applied if its version follows the one of the device,
+ *        older ones are dropped. After a gap the device asks for the full
+ *        document, {"ver":<version>,"get":true}, which the server sends
+ *        as a delta with "full":true. A device starts at version 0, so
+ *        the first report after boot brings the full document.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Handler of a desired value.
+ *
+ *  @param[in] val Desired value.
+ *
+ *  @return Value of the property once applied, which is reported.
+ */
+typedef s32_t (*shadow_desired_handler_t)(s32_t val);
+
+/** @brief Shadow property. */
+struct shadow_prop {
+	/** Key of the property in the document. */
+	const char *key;
+	/** Handler called when a desired value is received, NULL for a
+	 *  property that is only reported.
+	 */
+	shadow_desired_handler_t handler;
+};
+
+/** @brief Function sending a shadow message to the state endpoint.
+ *
+ *  @param[in] buf Message.
+ *  @param[in] len Length of the message.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+typedef int (*shadow_send_t)(const char *buf, size_t len);
+
+/** @brief Initialize the shadow.
+ *
+ *  @param[in] send Function sending the messages.
+ */
+void shadow_init(shadow_send_t send);
+
+/** @brief Register a property.
+ *
+ *  @param[in] prop Property. Must remain valid while registered.
+ *
+ *  @return 0 If successful.
+ *            -ENOMEM if CONFIG_SHADOW_PROP_MAX properties are registered.
+ *            -EINVAL if the key is reserved or too long.
+ */
+int shadow_prop_register(const struct shadow_prop *prop);
+
+/** @brief Set the reported value of a property.
+ *
+ *  The value is sent with the next synchronization if it changed.
+ *
+ *  @param[in] key Key of the property.
+ *  @param[in] val Value.
+ *
+ *  @return 0 If successful.
+ *            -ENOENT if no property is registered with the key.
+ */
+int shadow_report(const char *key, s32_t val);
+
+/** @brief Send the reported values that changed.
+ *
+ *  Nothing is sent while reported values wait for the server to accept
+ *  them, until CONFIG_SHADOW_ACK_TIMEOUT_MS has passed or @p check is set.
+ *
+ *  @param[in] check Send a report even if no value changed, so that the
+ *                   server sends what the device missed. Values not
+ *                   accepted yet are reported again. Used after
+ *                   connecting.
+ *
+ *  @return 0 If successful or if there was nothing to send.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int shadow_sync(bool check);
+
+/** @brief Handle a message received from the server.
+ *
+ *  @param[in] buf Message.
+ *  @param[in] len Length of the message.
+ *
+ *  @return 0 If the message was a shadow message.
+ *            -EINVAL if it is not a shadow message, including messages
+ *            longer than CONFIG_SHADOW_BUF_SIZE.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int shadow_handle(const char *buf, size_t len);
+
+/** @brief Get the version of the document the device is in sync with. */
+u32_t shadow_version_get(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* SHADOW_H__ */
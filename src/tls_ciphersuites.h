@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief IANA TLS cipher suite identifiers selectable by the backends.
+ */
+
+#ifndef TLS_CIPHERSUITES_H__
+#define TLS_CIPHERSUITES_H__
+
+/* Pre-shared key suites. AES-128-CCM-8 has the smallest per-record overhead
+ * and the cheapest handshake of the suites supported by the modem.
+ */
+#define TLS_PSK_WITH_AES_128_CCM_8			0xC0A8
+#define TLS_PSK_WITH_AES_128_CBC_SHA256			0x00AE
+
+/* Certificate based suites. */
+#define TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256		0xC023
+#define TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256		0xC027
+
+#endif /* TLS_CIPHERSUITES_H__ */
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <tx_defer.h>
+
+#if defined(CONFIG_TX_DEFER_SOURCE_MODEM)
+#include <modem/modem_info.h>
+#endif
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(tx_defer, CONFIG_TX_DEFER_LOG_LEVEL);
+
+#define RSRP_GOOD_DBM (CONFIG_TX_DEFER_RSRP_THRESHOLD_DBM + \
+		       CONFIG_TX_DEFER_RSRP_HYSTERESIS_DB)
+
+static tx_defer_release_t release_handler;
+static s16_t rsrp = TX_DEFER_RSRP_UNKNOWN;
+static bool poor;
+static bool holding;
+static s64_t held_since;
+static struct tx_defer_stats stats;
+static struct k_delayed_work deadline_work;
+
+K_MUTEX_DEFINE(defer_lock);
+
+/* Ends the hold, called with defer_lock held. Returns whether a
+ * publication was held.
+ */
+static bool hold_end(enum tx_defer_reason reason)
+{
+	u32_t held;
+
+	if (!holding) {
+		return false;
+	}
+
+	holding = false;
+	(void)k_delayed_work_cancel(&deadline_work);
+
+	held = k_uptime_get() - held_since;
+	stats.held_max = MAX(stats.held_max, held);
+	stats.released[reason]++;
+
+	LOG_INF("Publication released after %u ms, %s", held,
+		tx_defer_reason_str(reason));
+
+	return true;
+}
+
+static void release(enum tx_defer_reason reason)
+{
+	bool released;
+
+	k_mutex_lock(&defer_lock, K_FOREVER);
+	released = hold_end(reason);
+	k_mutex_unlock(&defer_lock);
+
+	/* Called without the lock, the handler may publish right away. */
+	if (released && (release_handler != NULL)) {
+		release_handler(reason);
+	}
+}
+
+static void deadline_work_fn(struct k_work *work)
+{
+	release(TX_DEFER_REASON_DEADLINE);
+}
+
+bool tx_defer_hold(enum tx_defer_class cls)
+{
+	bool hold = false;
+
+	if (cls == TX_DEFER_CLASS_URGENT) {
+		/* The radio is woken for this one, what is held goes along. */
+		release(TX_DEFER_REASON_URGENT);
+		return false;
+	}
+
+	k_mutex_lock(&defer_lock, K_FOREVER);
+
+	if (holding) {
+		stats.coalesced++;
+		hold = true;
+	} else if (poor) {
+		LOG_INF("Publication deferred, RSRP %d dBm", rsrp);
+
+		holding = true;
+		held_since = k_uptime_get();
+		stats.deferred++;
+		k_delayed_work_submit(&deadline_work,
+				      K_SECONDS(CONFIG_TX_DEFER_DEADLINE_S));
+		hold = true;
+	}
+
+	k_mutex_unlock(&defer_lock);
+
+	return hold;
+}
+
+void tx_defer_rsrp_set(s16_t val)
+{
+	bool good;
+
+	k_mutex_lock(&defer_lock, K_FOREVER);
+
+	rsrp = val;
+
+	if (val == TX_DEFER_RSRP_UNKNOWN) {
+		poor = false;
+	} else if (val < CONFIG_TX_DEFER_RSRP_THRESHOLD_DBM) {
+		poor = true;
+	} else if (val >= RSRP_GOOD_DBM) {
+		poor = false;
+	}
+
+	good = !poor;
+
+	k_mutex_unlock(&defer_lock);
+
+	LOG_DBG("RSRP %d dBm, %s", val, good ? "good" : "poor");
+
+	if (good) {
+		release(TX_DEFER_REASON_SIGNAL);
+	}
+}
+
+s16_t tx_defer_rsrp_get(void)
+{
+	return rsrp;
+}
+
+void tx_defer_stats_get(struct tx_defer_stats *out)
+{
+	k_mutex_lock(&defer_lock, K_FOREVER);
+	*out = stats;
+	out->rsrp = rsrp;
+	k_mutex_unlock(&defer_lock);
+}
+
+const char *tx_defer_reason_str(enum tx_defer_reason reason)
+{
+	switch (reason) {
+	case TX_DEFER_REASON_SIGNAL:
+		return "signal improved";
+	case TX_DEFER_REASON_URGENT:
+		return "urgent publication";
+	case TX_DEFER_REASON_DEADLINE:
+		return "deadline";
+	default:
+		return "unknown";
+	}
+}
+
+#if defined(CONFIG_TX_DEFER_SOURCE_MODEM)
+/* RSRP is notified as an index from 0 to 97, dBm = index - 140. Other
+ * values mean it is not known.
+ */
+#define RSRP_INDEX_MAX 97
+#define RSRP_INDEX_OFFSET 140
+
+static void modem_rsrp_handler(char index)
+{
+	u8_t val = index;
+
+	tx_defer_rsrp_set(val > RSRP_INDEX_MAX ? TX_DEFER_RSRP_UNKNOWN :
+			  (s16_t)val - RSRP_INDEX_OFFSET);
+}
+
+static int source_start(void)
+{
+	int err;
+
+	err = modem_info_init();
+	if (err) {
+		LOG_ERR("modem_info_init, error: %d", err);
+		return err;
+	}
+
+	return modem_info_rsrp_register(modem_rsrp_handler);
+}
+#elif defined(CONFIG_TX_DEFER_SOURCE_SIM)
+BUILD_ASSERT_MSG(CONFIG_TX_DEFER_SIM_RSRP_MIN_DBM <
+		 CONFIG_TX_DEFER_SIM_RSRP_MAX_DBM,
+		 "Simulated RSRP range is empty");
+
+/* Steps from the maximum down to the minimum. */
+#define SIM_HALF_STEPS MAX(CONFIG_TX_DEFER_SIM_PERIOD_S / 2 / \
+			   CONFIG_TX_DEFER_SIM_STEP_S, 1)
+#define SIM_RANGE_DB (CONFIG_TX_DEFER_SIM_RSRP_MAX_DBM - \
+		      CONFIG_TX_DEFER_SIM_RSRP_MIN_DBM)
+
+static struct k_delayed_work sim_work;
+static u32_t sim_step;
+
+static void sim_work_fn(struct k_work *work)
+{
+	u32_t pos = sim_step % (2 * SIM_HALF_STEPS);
+	u32_t down = (pos <= SIM_HALF_STEPS) ? pos : 2 * SIM_HALF_STEPS - pos;
+
+	sim_step++;
+
+	tx_defer_rsrp_set(CONFIG_TX_DEFER_SIM_RSRP_MAX_DBM -
+			  (s16_t)(SIM_RANGE_DB * down / SIM_HALF_STEPS));
+
+	k_delayed_work_submit(&sim_work, K_SECONDS(CONFIG_TX_DEFER_SIM_STEP_S));
+}
+
+static int source_start(void)
+{
+	k_delayed_work_init(&sim_work, sim_work_fn);
+
+	return k_delayed_work_submit(&sim_work, K_NO_WAIT);
+}
+#else
+static int source_start(void)
+{
+	return 0;
+}
+#endif
+
+int tx_defer_init(tx_defer_release_t release)
+{
+	release_handler = release;
+	k_delayed_work_init(&deadline_work, deadline_work_fn);
+
+	return source_start();
+}
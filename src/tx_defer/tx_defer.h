@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**@file
+ *@brief Transmission deferral library header.
+ */
+
+#ifndef TX_DEFER_H__
+#define TX_DEFER_H__
+
+#include <zephyr.h>
+
+/**
+ * @defgroup tx_defer Transmission deferral library
+ * @{
+ * @brief Defers publications while the signal is poor.
+ *
+ *        The signal counts as poor once the RSRP drops below
+ *        CONFIG_TX_DEFER_RSRP_THRESHOLD_DBM, and as good again once it
+ *        rises CONFIG_TX_DEFER_RSRP_HYSTERESIS_DB above it. Bulk
+ *        publications requested while it is poor are held, those
+ *        requested while one is held are coalesced with it. The held
+ *        publication is released when the signal becomes good, when an
+ *        urgent publication is sent, since the radio is woken anyway, or
+ *        CONFIG_TX_DEFER_DEADLINE_S after it was first held.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** RSRP before the first measurement, counted as good. */
+#define TX_DEFER_RSRP_UNKNOWN INT16_MIN
+
+/** @brief Publication classes. */
+enum tx_defer_class {
+	/** Sent whatever the signal quality. */
+	TX_DEFER_CLASS_URGENT,
+	/** Deferred while the signal is poor. */
+	TX_DEFER_CLASS_BULK
+};
+
+/** @brief Reasons a held publication was released. */
+enum tx_defer_reason {
+	/** The signal became good. */
+	TX_DEFER_REASON_SIGNAL,
+	/** An urgent publication was sent. */
+	TX_DEFER_REASON_URGENT,
+	/** The publication was held for CONFIG_TX_DEFER_DEADLINE_S. */
+	TX_DEFER_REASON_DEADLINE
+};
+
+/** @brief Deferral statistics. */
+struct tx_defer_stats {
+	/** Last RSRP, in dBm, or TX_DEFER_RSRP_UNKNOWN. */
+	s16_t rsrp;
+	/** Publications held. */
+	u32_t deferred;
+	/** Publications coalesced with a held one. */
+	u32_t coalesced;
+	/** Releases, indexed by @ref tx_defer_reason. */
+	u32_t released[3];
+	/** Longest time a publication was held, in milliseconds. */
+	u32_t held_max;
+};
+
+/** @brief Handler releasing a held publication.
+ *
+ *  @details Called from the context that released it, which may be the
+ *           system work queue or the modem notification thread. It should
+ *           only submit the publication to a work queue.
+ *
+ *  @param[in] reason Why it was released, see @ref tx_defer_reason.
+ */
+typedef void (*tx_defer_release_t)(enum tx_defer_reason reason);
+
+/** @brief Initialize the library and start the signal quality source.
+ *
+ *  @param[in] release Handler releasing a held publication.
+ *
+ *  @return 0 If successful.
+ *            Otherwise, a (negative) error code is returned.
+ */
+int tx_defer_init(tx_defer_release_t release);
+
+/** @brief Check whether a publication must wait.
+ *
+ *  @param[in] cls Class of the publication, see @ref tx_defer_class.
+ *
+ *  @return true if the publication is held, the release handler is called
+ *          when it may be sent. false if it is sent now.
+ */
+bool tx_defer_hold(enum tx_defer_class cls);
+
+/** @brief Set the current RSRP.
+ *
+ *  @details Called by the signal quality source, or by the application
+ *           with CONFIG_TX_DEFER_SOURCE_NONE.
+ *
+ *  @param[in] rsrp RSRP in dBm, or TX_DEFER_RSRP_UNKNOWN.
+ */
+void tx_defer_rsrp_set(s16_t rsrp);
+
+/** @brief Get the current RSRP.
+ *
+ *  @return RSRP in dBm, or TX_DEFER_RSRP_UNKNOWN.
+ */
+s16_t tx_defer_rsrp_get(void);
+
+/** @brief Get deferral statistics.
+ *
+ *  @param[out] stats Statistics.
+ */
+void tx_defer_stats_get(struct tx_defer_stats *stats);
+
+/** @brief Get a printable name for a release reason. */
+const char *tx_defer_reason_str(enum tx_defer_reason reason);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ *@}
+ */
+
+#endif /* TX_DEFER_H__ */
@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <net/socket.h>
+#include <sys/byteorder.h>
+
+/* Included for the token and the socket, they are not part of the module
+ * API.
+ */
+#include "coap_backend.c"
+
+#define RECV_TIMEOUT_MS 1000
+#define KEEPALIVE_MS K_SECONDS(CONFIG_COAP_BACKEND_KEEPALIVE)
+#define IDLE_MS K_SECONDS(2)
+
+#define HEADER_LEN 4
+#define TOKEN_LEN_MASK 0x0f
+#define PAYLOAD_MARKER 0xff
+
+/* Version 1, see RFC 7252 section 3, with the type and the token length. */
+#define HEADER_NON 0x50
+#define HEADER_CON 0x40
+#define HEADER_ACK 0x60
+#define CODE_EMPTY 0x00
+#define CODE_PUT 0x03
+#define CODE_CONTENT 0x45
+
+/* Uri-Path, option 11, as the first option of the request. */
+#define URI_PATH_DELTA 0xb0
+#define RESOURCE_LEN (sizeof(CONFIG_COAP_BACKEND_RESOURCE) - 1)
+
+static const char payload[] = "{\"tmp\":{\"val\":23,\"ts\":735181200}}";
+static const char cmd[] = "{\"cmd\":\"slot\",\"val\":1200}";
+
+static int server_fd;
+static struct sockaddr_in peer;
+static u8_t server_buf[128];
+/* Token of the last request received, echoed in the responses. */
+static u8_t server_token[8];
+static size_t server_token_len;
+
+static u32_t evts;
+static u8_t rx_data[64];
+static size_t rx_len;
+static bool reply_in_handler;
+static int reply_err;
+
+static void evt_handler(const struct coap_backend_event *evt)
+{
+	evts |= BIT(evt->type);
+
+	if (evt->type == COAP_BACKEND_EVT_DATA_RECEIVED) {
+		/* Like the shadow, which reports from the handler. The
+		 * received data must still be there afterwards.
+		 */
+		if (reply_in_handler) {
+			struct coap_backend_tx_data tx_data = {
+				.str = (char *)payload,
+				.len = sizeof(payload) - 1
+			};
+
+			reply_err = coap_backend_send(&tx_data);
+		}
+
+		rx_len = MIN(evt->len, sizeof(rx_data));
+		memcpy(rx_data, evt->ptr, rx_len);
+	}
+}
+
+static void fd_wait(int fd)
+{
+	struct pollfd fds = {
+		.fd = fd,
+		.events = POLLIN
+	};
+
+	zassert_equal(poll(&fds, 1, RECV_TIMEOUT_MS), 1, "Nothing received");
+}
+
+/* The client socket does not block, input is polled for like the sample
+ * does.
+ */
+static void device_input(void)
+{
+	fd_wait(client_fd);
+	zassert_equal(coap_backend_input(), 0, "Input failed");
+}
+
+static size_t server_recv(void)
+{
+	socklen_t peer_len = sizeof(peer);
+	ssize_t len;
+
+	fd_wait(server_fd);
+
+	len = recvfrom(server_fd, server_buf, sizeof(server_buf), 0,
+		       (struct sockaddr *)&peer, &peer_len);
+	zassert_true(len >= HEADER_LEN, "Server receive failed");
+
+	server_token_len = server_buf[0] & TOKEN_LEN_MASK;
+	zassert_true((server_token_len <= sizeof(server_token)) &&
+		     (HEADER_LEN + server_token_len <= len), "Invalid token");
+	memcpy(server_token, &server_buf[HEADER_LEN], server_token_len);
+
+	return len;
+}
+
+static void server_send(const void *data, size_t len)
+{
+	zassert_equal(sendto(server_fd, data, len, 0,
+			     (struct sockaddr *)&peer, sizeof(peer)), len,
+		      "Server send failed");
+}
+
+/* Every test ends with the budgets checked, the stack of each test thread
+ * is measured before the next one reuses it.
+ */
+static void budgets_check(void)
+{
+	zassert_equal(perf_budget_check(), 0, "Performance budget exceeded");
+}
+
+/* NON PUT to the default resource, with the token of the request. */
+static size_t request_expect(u8_t *buf, const u8_t *id, const void *data,
+			     size_t len)
+{
+	size_t pos = 0;
+
+	buf[pos++] = HEADER_NON | sizeof(next_token);
+	buf[pos++] = CODE_PUT;
+	buf[pos++] = id[0];
+	buf[pos++] = id[1];
+	memcpy(&buf[pos], &next_token, sizeof(next_token));
+	pos += sizeof(next_token);
+	buf[pos++] = URI_PATH_DELTA | RESOURCE_LEN;
+	memcpy(&buf[pos], CONFIG_COAP_BACKEND_RESOURCE, RESOURCE_LEN);
+	pos += RESOURCE_LEN;
+
+	if (len) {
+		buf[pos++] = PAYLOAD_MARKER;
+		memcpy(&buf[pos], data, len);
+	}
+
+	return pos + len;
+}
+
+static void test_connect(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(CONFIG_COAP_BACKEND_SERVER_PORT)
+	};
+	struct coap_backend_config config = { 0 };
+
+	inet_pton(AF_INET, CONFIG_COAP_BACKEND_SERVER_HOST_NAME,
+		  &addr.sin_addr);
+
+	server_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	zassert_true(server_fd >= 0, "No server socket");
+	zassert_equal(bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)),
+		      0, "Server socket not bound");
+
+	zassert_equal(coap_backend_init(&config, evt_handler), 0,
+		      "Initialization failed");
+	zassert_equal(coap_backend_connect(&config), 0, "Connection failed");
+	zassert_equal(config.socket, client_fd, "Socket not returned");
+
+	budgets_check();
+}
+
+static void test_publish(void)
+{
+	struct coap_backend_tx_data tx_data = {
+		.str = (char *)payload,
+		.len = sizeof(payload) - 1
+	};
+	struct perf_budget_stats stats;
+	u8_t expected[64];
+	size_t len;
+
+	zassert_equal(coap_backend_send(&tx_data), 0, "Not published");
+
+	/* The message ID is the only field not known beforehand. */
+	len = server_recv();
+	zassert_equal(len, request_expect(expected, &server_buf[2], payload,
+					  tx_data.len),
+		      "Wrong request length");
+	zassert_mem_equal(server_buf, expected, len, "Wrong request");
+
+	perf_budget_stats_get(&stats);
+	zassert_equal(stats.bytes_last, len, "Size miscounted");
+	zassert_equal(stats.encodes, stats.msgs, "Encoding not timed");
+
+	budgets_check();
+}
+
+static void test_write_in_place(void)
+{
+	struct coap_backend_writer writer;
+	u8_t expected[64];
+	size_t len;
+
+	zassert_equal(coap_backend_write_begin(&writer, NULL), 0,
+		      "Write not started");
+	zassert_true(writer.size >= sizeof(payload) - 1, "No room for payload");
+	memcpy(writer.buf, payload, sizeof(payload) - 1);
+	zassert_equal(coap_backend_write_end(sizeof(payload) - 1), 0,
+		      "Write not sent");
+
+	len = server_recv();
+	zassert_equal(len, request_expect(expected, &server_buf[2], payload,
+					  sizeof(payload) - 1),
+		      "Wrong request length");
+	zassert_mem_equal(server_buf, expected, len, "Wrong request");
+
+	/* Without a payload the marker is left out. */
+	zassert_equal(coap_backend_write_begin(&writer, NULL), 0,
+		      "Write not started");
+	zassert_equal(coap_backend_write_end(0), 0, "Write not sent");
+
+	len = server_recv();
+	zassert_equal(len, request_expect(expected, &server_buf[2], NULL, 0),
+		      "Wrong empty request length");
+	zassert_mem_equal(server_buf, expected, len, "Wrong empty request");
+
+	budgets_check();
+}
+
+static void test_receive(void)
+{
+	u8_t response[HEADER_LEN + sizeof(server_token) + 1 + sizeof(cmd) - 1];
+	size_t pos = 0;
+
+	/* NON 2.05 Content with the token the last request carried. */
+	response[pos++] = HEADER_NON | server_token_len;
+	response[pos++] = CODE_CONTENT;
+	sys_put_be16(0x1234, &response[pos]);
+	pos += 2;
+	memcpy(&response[pos], server_token, server_token_len);
+	pos += server_token_len;
+	response[pos++] = PAYLOAD_MARKER;
+	memcpy(&response[pos], cmd, sizeof(cmd) - 1);
+	pos += sizeof(cmd) - 1;
+
+	zassert_equal(server_token_len, sizeof(next_token), "No token sent");
+
+	server_send(response, pos);
+	device_input();
+
+	zassert_true(evts & BIT(COAP_BACKEND_EVT_DATA_RECEIVED),
+		     "No data received");
+	zassert_equal(rx_len, sizeof(cmd) - 1, "Wrong payload length");
+	zassert_mem_equal(rx_data, cmd, rx_len, "Wrong payload");
+
+	budgets_check();
+}
+
+static void test_receive_other_token(void)
+{
+	u8_t response[HEADER_LEN + sizeof(next_token) + 1 + sizeof(cmd) - 1];
+	size_t pos = 0;
+
+	/* Without a token the response belongs to no request. */
+	response[pos++] = HEADER_NON;
+	response[pos++] = CODE_CONTENT;
+	sys_put_be16(0x1235, &response[pos]);
+	pos += 2;
+	response[pos++] = PAYLOAD_MARKER;
+	memcpy(&response[pos], cmd, sizeof(cmd) - 1);
+	pos += sizeof(cmd) - 1;
+
+	evts = 0;
+	server_send(response, pos);
+	device_input();
+	zassert_equal(evts, 0, "Response without a token notified");
+
+	/* Nor with a token of another request. */
+	response[0] = HEADER_NON | sizeof(next_token);
+	memmove(&response[HEADER_LEN + sizeof(next_token)],
+		&response[HEADER_LEN], pos - HEADER_LEN);
+	sys_put_le16(next_token + 1, &response[HEADER_LEN]);
+	pos += sizeof(next_token);
+
+	server_send(response, pos);
+	device_input();
+	zassert_equal(evts, 0, "Response to another request notified");
+
+	budgets_check();
+}
+
+static void test_send_from_handler(void)
+{
+	u8_t expected[64];
+	size_t len;
+
+	reply_in_handler = true;
+	rx_len = 0;
+	test_receive();
+	reply_in_handler = false;
+
+	zassert_equal(reply_err, 0, "Not sent from the handler");
+
+	len = server_recv();
+	zassert_equal(len, request_expect(expected, &server_buf[2], payload,
+					  sizeof(payload) - 1),
+		      "Wrong request length");
+	zassert_mem_equal(server_buf, expected, len, "Wrong request");
+}
+
+static void test_keepalive(void)
+{
+	int left = coap_backend_keepalive_time_left();
+	u8_t ack[HEADER_LEN] = { HEADER_ACK, CODE_EMPTY };
+	size_t len;
+
+	zassert_true((left > 0) && (left <= KEEPALIVE_MS),
+		     "Keepalive time out of range");
+
+	k_sleep(IDLE_MS);
+	zassert_true(coap_backend_keepalive_time_left() <= left - IDLE_MS,
+		     "Keepalive time not counting down");
+
+	zassert_equal(coap_backend_ping(), 0, "Ping failed");
+
+	/* CoAP ping, an empty CON, see RFC 7252 section 4.3. */
+	len = server_recv();
+	zassert_equal(len, HEADER_LEN, "Wrong ping length");
+	zassert_equal(server_buf[0], HEADER_CON, "Ping not confirmable");
+	zassert_equal(server_buf[1], CODE_EMPTY, "Ping not empty");
+	zassert_true(coap_backend_keepalive_time_left() > left - IDLE_MS,
+		     "Keepalive time not restarted");
+
+	/* The ping is answered with an empty ACK, which carries no data. */
+	evts = 0;
+	ack[2] = server_buf[2];
+	ack[3] = server_buf[3];
+	server_send(ack, sizeof(ack));
+	device_input();
+	zassert_equal(evts, 0, "Empty ACK notified");
+
+	budgets_check();
+}
+
+static void test_disconnect(void)
+{
+	zassert_equal(coap_backend_disconnect(), 0, "Disconnection failed");
+
+	close(server_fd);
+
+	budgets_check();
+}
+
+static void test_budgets(void)
+{
+	struct perf_budget_stats stats;
+
+	perf_budget_stats_get(&stats);
+
+	TC_PRINT("Encode: %u cycles, message %u bytes max, stack %u bytes\n",
+		 stats.cycles_max, stats.bytes_max, stats.stack_max);
+
+	zassert_equal(stats.msgs, 4, "Publications not all measured");
+	zassert_equal(stats.encodes, 4, "Encoding not timed");
+	zassert_equal(stats.exceeded, 0, "Performance budget exceeded");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(coap_backend,
+			 ztest_unit_test(test_connect),
+			 ztest_unit_test(test_publish),
+			 ztest_unit_test(test_write_in_place),
+			 ztest_unit_test(test_receive),
+			 ztest_unit_test(test_receive_other_token),
+			 ztest_unit_test(test_send_from_handler),
+			 ztest_unit_test(test_keepalive),
+			 ztest_unit_test(test_disconnect),
+			 ztest_unit_test(test_budgets));
+
+	ztest_run_test_suite(coap_backend);
+}
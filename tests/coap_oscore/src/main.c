@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <net/socket.h>
+#include <net/coap.h>
+#include <sys/byteorder.h>
+#include <tinycrypt/aes.h>
+#include <tinycrypt/ccm_mode.h>
+#include <tinycrypt/constants.h>
+#include <coap_backend.h>
+
+#define RECV_TIMEOUT_MS 1000
+
+#define HEADER_LEN 4
+#define PAYLOAD_MARKER 0xff
+
+/* Version 1, see RFC 7252 section 3, with the type. */
+#define HEADER_NON 0x50
+#define CODE_CHANGED 0x44
+#define CODE_CONTENT 0x45
+
+/* OSCORE, option 9, as the only option of the response, empty. */
+#define OSCORE_OPTION 9
+#define OSCORE_OPTION_EMPTY 0x90
+#define OSCORE_FLAG_PIV_LEN 0x07
+#define OSCORE_PIV_MAX_LEN 5
+
+#define NONCE_LEN 13
+#define TAG_LEN 8
+
+/* Server side of the context of RFC 8613 appendix C.1.1, its Sender Key is
+ * the Recipient Key of the device. The device has an empty Sender ID.
+ */
+static const u8_t server_key[] = {
+	0xff, 0xb1, 0x4e, 0x09, 0x3c, 0x94, 0xc9, 0xca,
+	0xc9, 0x47, 0x16, 0x48, 0xb4, 0xf9, 0x87, 0x10
+};
+
+static const u8_t common_iv[NONCE_LEN] = {
+	0x46, 0x22, 0xd4, 0xdd, 0x6d, 0x94, 0x41, 0x68,
+	0xee, 0xfb, 0x54, 0x98, 0x7c
+};
+
+static const char payload[] = "{\"tmp\":{\"val\":23,\"ts\":735181200}}";
+static const char cmd[] = "{\"cmd\":\"slot\",\"val\":1200}";
+
+static int client_fd;
+static int server_fd;
+static struct sockaddr_in peer;
+static u8_t server_buf[128];
+
+/* Token and Partial IV of the last request received. */
+static u8_t req_token[8];
+static u8_t req_token_len;
+static u8_t req_piv[OSCORE_PIV_MAX_LEN];
+static u8_t req_piv_len;
+
+static u8_t rx_data[64];
+static size_t rx_len;
+static bool reply_in_handler;
+static int reply_err;
+
+static void evt_handler(const struct coap_backend_event *evt)
+{
+	if (evt->type != COAP_BACKEND_EVT_DATA_RECEIVED) {
+		return;
+	}
+
+	/* Like the shadow, which reports from the handler. Protecting the
+	 * report reuses the OSCORE scratch buffer the response was decrypted
+	 * into, the received data must still be there afterwards.
+	 */
+	if (reply_in_handler) {
+		struct coap_backend_tx_data tx_data = {
+			.str = (char *)payload,
+			.len = sizeof(payload) - 1
+		};
+
+		reply_err = coap_backend_send(&tx_data);
+	}
+
+	rx_len = MIN(evt->len, sizeof(rx_data));
+	memcpy(rx_data, evt->ptr, rx_len);
+}
+
+static void fd_wait(int fd)
+{
+	struct pollfd fds = {
+		.fd = fd,
+		.events = POLLIN
+	};
+
+	zassert_equal(poll(&fds, 1, RECV_TIMEOUT_MS), 1, "Nothing received");
+}
+
+static void device_input(void)
+{
+	fd_wait(client_fd);
+	zassert_equal(coap_backend_input(), 0, "Input failed");
+}
+
+/* Receives a protected request and keeps what its response is bound to. */
+static void request_recv(void)
+{
+	socklen_t peer_len = sizeof(peer);
+	struct coap_packet request;
+	struct coap_option option;
+	ssize_t len;
+
+	fd_wait(server_fd);
+
+	len = recvfrom(server_fd, server_buf, sizeof(server_buf), 0,
+		       (struct sockaddr *)&peer, &peer_len);
+	zassert_true(len >= HEADER_LEN, "Server receive failed");
+
+	zassert_equal(coap_packet_parse(&request, server_buf, len, NULL, 0),
+		      0, "Request cannot be parsed");
+	zassert_equal(coap_header_get_code(&request), COAP_METHOD_POST,
+		      "Outer code is not POST");
+
+	req_token_len = coap_header_get_token(&request, req_token);
+	zassert_true(req_token_len > 0, "No token");
+
+	zassert_equal(coap_find_options(&request, OSCORE_OPTION, &option, 1),
+		      1, "No OSCORE option");
+	req_piv_len = option.value[0] & OSCORE_FLAG_PIV_LEN;
+	zassert_true((req_piv_len > 0) && (1 + req_piv_len <= option.len),
+		     "No Partial IV");
+	memcpy(req_piv, &option.value[1], req_piv_len);
+}
+
+/* CBOR encoded Enc_structure of RFC 8613 section 5.4, for the empty kid of
+ * the device and no class I options.
+ */
+static size_t aad_encode(u8_t *buf)
+{
+	static const char context[] = "Encrypt0";
+	size_t len = 0;
+
+	buf[len++] = 0x83;
+	buf[len++] = 0x60 | (sizeof(context) - 1);
+	memcpy(&buf[len], context, sizeof(context) - 1);
+	len += sizeof(context) - 1;
+	buf[len++] = 0x40;
+	buf[len++] = 0x40 | (7 + req_piv_len);
+
+	buf[len++] = 0x85;
+	buf[len++] = 0x01;
+	buf[len++] = 0x81;
+	buf[len++] = 10;
+	buf[len++] = 0x40;
+	buf[len++] = 0x40 | req_piv_len;
+	memcpy(&buf[len], req_piv, req_piv_len);
+	len += req_piv_len;
+	buf[len++] = 0x40;
+
+	return len;
+}
+
+/* Sends 2.05 Content with cmd, protected without a Partial IV of its own
+ * so that the request nonce is reused.
+ */
+static void response_send(void)
+{
+	u8_t plain[2 + sizeof(cmd) - 1];
+	u8_t response[HEADER_LEN + sizeof(req_token) + 2 + sizeof(plain) +
+		      TAG_LEN];
+	u8_t nonce[NONCE_LEN] = { 0 };
+	u8_t aad[32];
+	struct tc_aes_key_sched_struct sched;
+	struct tc_ccm_mode_struct ccm;
+	size_t pos = 0;
+
+	plain[0] = CODE_CONTENT;
+	plain[1] = PAYLOAD_MARKER;
+	memcpy(&plain[2], cmd, sizeof(cmd) - 1);
+
+	memcpy(&nonce[NONCE_LEN - req_piv_len], req_piv, req_piv_len);
+	for (size_t i = 0; i < NONCE_LEN; i++) {
+		nonce[i] ^= common_iv[i];
+	}
+
+	response[pos++] = HEADER_NON | req_token_len;
+	response[pos++] = CODE_CHANGED;
+	sys_put_be16(0x1234, &response[pos]);
+	pos += 2;
+	memcpy(&response[pos], req_token, req_token_len);
+	pos += req_token_len;
+	response[pos++] = OSCORE_OPTION_EMPTY;
+	response[pos++] = PAYLOAD_MARKER;
+
+	zassert_equal(tc_aes128_set_encrypt_key(&sched, server_key),
+		      TC_CRYPTO_SUCCESS, "Key not set");
+	zassert_equal(tc_ccm_config(&ccm, &sched, nonce, sizeof(nonce),
+				    TAG_LEN), TC_CRYPTO_SUCCESS,
+		      "CCM not configured");
+	zassert_equal(tc_ccm_generation_encryption(&response[pos],
+						   sizeof(plain) + TAG_LEN,
+						   aad, aad_encode(aad),
+						   plain, sizeof(plain), &ccm),
+		      TC_CRYPTO_SUCCESS, "Response not encrypted");
+	pos += sizeof(plain) + TAG_LEN;
+
+	zassert_equal(sendto(server_fd, response, pos, 0,
+			     (struct sockaddr *)&peer, sizeof(peer)), pos,
+		      "Server send failed");
+}
+
+static void test_connect(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(CONFIG_COAP_BACKEND_SERVER_PORT)
+	};
+	struct coap_backend_config config = { 0 };
+
+	inet_pton(AF_INET, CONFIG_COAP_BACKEND_SERVER_HOST_NAME,
+		  &addr.sin_addr);
+
+	server_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	zassert_true(server_fd >= 0, "No server socket");
+	zassert_equal(bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)),
+		      0, "Server socket not bound");
+
+	zassert_equal(coap_backend_init(&config, evt_handler), 0,
+		      "Initialization failed");
+	zassert_equal(coap_backend_connect(&config), 0, "Connection failed");
+
+	client_fd = config.socket;
+}
+
+static void test_publish(void)
+{
+	struct coap_backend_tx_data tx_data = {
+		.str = (char *)payload,
+		.len = sizeof(payload) - 1
+	};
+
+	zassert_equal(coap_backend_send(&tx_data), 0, "Not published");
+
+	request_recv();
+}
+
+static void test_receive(void)
+{
+	rx_len = 0;
+	response_send();
+	device_input();
+
+	zassert_equal(rx_len, sizeof(cmd) - 1, "Wrong payload length");
+	zassert_mem_equal(rx_data, cmd, rx_len, "Wrong payload");
+}
+
+static void test_send_from_handler(void)
+{
+	reply_in_handler = true;
+	test_receive();
+	reply_in_handler = false;
+
+	zassert_equal(reply_err, 0, "Not sent from the handler");
+
+	/* The report sent from the handler is protected like any other. */
+	request_recv();
+}
+
+static void test_disconnect(void)
+{
+	zassert_equal(coap_backend_disconnect(), 0, "Disconnection failed");
+
+	close(server_fd);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(coap_oscore,
+			 ztest_unit_test(test_connect),
+			 ztest_unit_test(test_publish),
+			 ztest_unit_test(test_receive),
+			 ztest_unit_test(test_send_from_handler),
+			 ztest_unit_test(test_disconnect));
+
+	ztest_run_test_suite(coap_oscore);
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <storage/flash_map.h>
+#include <delta.h>
+#include <flash_writer.h>
+
+#include "delta_vectors.h"
+
+/* Patch blocks line up with neither the records nor the flash pages. */
+#define CHUNK_LEN 37
+
+#define SOURCE_AREA FLASH_AREA_ID(image_0)
+#define TARGET_AREA FLASH_AREA_ID(image_1)
+
+static struct flash_writer writer;
+static struct delta_ctx ctx;
+static u8_t read_buf[256];
+
+static void area_erase(u8_t area_id)
+{
+	const struct flash_area *fa;
+
+	zassert_equal(flash_area_open(area_id, &fa), 0, "Area not opened");
+	zassert_equal(flash_area_erase(fa, 0, fa->fa_size), 0,
+		      "Area not erased");
+	flash_area_close(fa);
+}
+
+/* The running image the patch applies to. */
+static void source_write(void)
+{
+	const struct flash_area *fa;
+
+	area_erase(SOURCE_AREA);
+
+	zassert_equal(flash_area_open(SOURCE_AREA, &fa), 0,
+		      "Area not opened");
+	zassert_equal(flash_area_write(fa, 0, source_image,
+				       sizeof(source_image)), 0,
+		      "Source image not written");
+	flash_area_close(fa);
+}
+
+static void target_check(void)
+{
+	const struct flash_area *fa;
+
+	zassert_equal(flash_area_open(TARGET_AREA, &fa), 0,
+		      "Area not opened");
+
+	for (size_t pos = 0; pos < sizeof(target_image);
+	     pos += sizeof(read_buf)) {
+		size_t n = MIN(sizeof(read_buf), sizeof(target_image) - pos);
+
+		zassert_equal(flash_area_read(fa, pos, read_buf, n), 0,
+			      "Target image not read");
+		zassert_mem_equal(read_buf, target_image + pos, n,
+				  "Target image differs at 0x%x", (u32_t)pos);
+	}
+
+	flash_area_close(fa);
+}
+
+static void apply_start(void)
+{
+	area_erase(TARGET_AREA);
+
+	zassert_equal(flash_writer_open(&writer, TARGET_AREA, 0), 0,
+		      "Writer not opened");
+	zassert_equal(delta_apply_init(&ctx, &writer), 0,
+		      "Applier not started");
+}
+
+/* Feeds the patch from offset on, stops early once the applier took a
+ * snapshot at or beyond stop_pos in the target.
+ */
+static void patch_feed(size_t offset, size_t chunk_len, u32_t stop_pos)
+{
+	while (offset < sizeof(patch)) {
+		size_t n = MIN(chunk_len, sizeof(patch) - offset);
+		int err;
+
+		err = delta_apply_write(&ctx, patch + offset, n, offset);
+		zassert_equal(err, 0, "Patch not applied at 0x%x",
+			      (u32_t)offset);
+		offset += n;
+
+		if (ctx.snapshot.target_pos >= stop_pos) {
+			break;
+		}
+	}
+}
+
+static void apply_end(void)
+{
+	zassert_equal(delta_apply_finish(&ctx), 0, "Patch incomplete");
+	zassert_equal(flash_writer_flush(&writer), 0, "Writer not flushed");
+
+	delta_apply_close(&ctx);
+	flash_writer_close(&writer);
+
+	target_check();
+}
+
+static void test_apply(void)
+{
+	apply_start();
+	patch_feed(0, CHUNK_LEN, UINT32_MAX);
+	apply_end();
+}
+
+static void test_apply_bytewise(void)
+{
+	apply_start();
+	patch_feed(0, 1, UINT32_MAX);
+	apply_end();
+}
+
+static void test_resume(void)
+{
+	struct delta_state snapshot;
+	size_t snapshot_offset;
+	size_t page_size;
+	u32_t pos;
+
+	apply_start();
+	page_size = writer.page_size;
+	delta_apply_close(&ctx);
+	flash_writer_close(&writer);
+
+	/* Interrupted after each page of the target, continued from the
+	 * stored state only, as after a reset. A long zero run may complete
+	 * several pages with one patch block, the snapshot is then taken at
+	 * the last of them.
+	 */
+	for (pos = page_size; pos < sizeof(target_image); pos += page_size) {
+		apply_start();
+		patch_feed(0, CHUNK_LEN, pos);
+
+		snapshot = ctx.snapshot;
+		snapshot_offset = ctx.snapshot_offset;
+		zassert_true(snapshot.target_pos >= pos,
+			     "No snapshot at page boundary 0x%x", pos);
+		zassert_equal(snapshot.target_pos % page_size, 0,
+			      "Snapshot not at a page boundary");
+		zassert_true(snapshot_offset < sizeof(patch),
+			     "Snapshot beyond the patch");
+
+		delta_apply_close(&ctx);
+		flash_writer_close(&writer);
+		memset(&ctx, 0xa5, sizeof(ctx));
+
+		zassert_equal(flash_writer_open(&writer, TARGET_AREA,
+						snapshot.target_pos), 0,
+			      "Writer not reopened");
+		zassert_equal(delta_apply_resume(&ctx, &writer, &snapshot), 0,
+			      "Applier not resumed at 0x%x", pos);
+
+		patch_feed(snapshot_offset, CHUNK_LEN, UINT32_MAX);
+		apply_end();
+	}
+}
+
+static void test_other_source(void)
+{
+	u8_t header[DELTA_HEADER_LEN];
+
+	/* The CRC of the source is the last header field. */
+	memcpy(header, patch, sizeof(header));
+	header[sizeof(header) - 1] ^= 0x01;
+
+	apply_start();
+	zassert_equal(delta_apply_write(&ctx, header, sizeof(header), 0),
+		      -EBADMSG, "Patch applied to another image");
+
+	delta_apply_close(&ctx);
+	flash_writer_close(&writer);
+}
+
+static void test_truncated(void)
+{
+	int err;
+
+	apply_start();
+
+	err = delta_apply_write(&ctx, patch, sizeof(patch) - 1, 0);
+	zassert_equal(err, 0, "Patch not applied");
+	zassert_equal(delta_apply_finish(&ctx), -EBADMSG,
+		      "Truncated patch completed");
+
+	delta_apply_close(&ctx);
+	flash_writer_close(&writer);
+}
+
+void test_main(void)
+{
+	source_write();
+
+	ztest_test_suite(delta,
+			 ztest_unit_test(test_apply),
+			 ztest_unit_test(test_apply_bytewise),
+			 ztest_unit_test(test_resume),
+			 ztest_unit_test(test_other_source),
+			 ztest_unit_test(test_truncated));
+
+	ztest_run_test_suite(delta);
+}
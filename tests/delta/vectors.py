@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Generate the images and the patch of the delta decoder test.
+
+The source image is pseudo random. The target is made from it the way a
+new firmware differs from the running one: a relinked block with changed
+addresses, new code, a block moved ahead and one moved back. The patch
+between them is created by scripts/delta_gen.py, so it has diffs with zero
+runs and literals, extra bytes and seeks in both directions. Run by the
+build of the test.
+"""
+
+import argparse
+import os
+import random
+import sys
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parents[2] / "scripts"))
+import delta_gen  # noqa: E402
+
+SEED = 2020
+SOURCE_SIZE = 16384
+# Every so many bytes of the relinked block an address changed.
+RELINK_STRIDE = 64
+
+
+def images():
+    rnd = random.Random(SEED)
+
+    def random_bytes(length):
+        return bytes(rnd.getrandbits(8) for _ in range(length))
+
+    source = random_bytes(SOURCE_SIZE)
+
+    relinked = bytearray(source[:6144])
+    for pos in range(0, len(relinked), RELINK_STRIDE):
+        relinked[pos] = (relinked[pos] + 0x10) & 0xff
+
+    target = bytes(relinked) + random_bytes(1000) + source[12288:] + \
+        source[6144:12288] + random_bytes(1500)
+    return source, target
+
+
+def array(name, data):
+    out = ["static const u8_t {}[] = {{".format(name)]
+    for pos in range(0, len(data), 12):
+        out.append("\t" + ", ".join("0x{:02x}".format(b)
+                                    for b in data[pos:pos + 12]) + ",")
+    out += ["};", ""]
+    return out
+
+
+def header(source, target, patch):
+    out = ["/* Generated by tests/delta/vectors.py, do not edit. */",
+           "",
+           "#ifndef DELTA_VECTORS_H__",
+           "#define DELTA_VECTORS_H__",
+           ""]
+    out += array("source_image", source)
+    out += array("target_image", target)
+    out += array("patch", patch)
+    out += ["#endif /* DELTA_VECTORS_H__ */", ""]
+    return "\n".join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", help="header file to write")
+    args = parser.parse_args()
+
+    source, target = images()
+    patch, _ = delta_gen.create(source, target)
+    if delta_gen.apply(source, patch) != target:
+        sys.exit("error: patch verification failed")
+
+    text = header(source, target, patch)
+    if os.path.exists(args.output):
+        with open(args.output) as f:
+            if f.read() == text:
+                return
+    with open(args.output, "w") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <net/socket.h>
+#include <sys/byteorder.h>
+
+/* Included for the client and the publication size, they are not part of
+ * the module API.
+ */
+#include "mqtt_backend.c"
+#include "mqtt_internal.h"
+
+#define CLIENT_ID CONFIG_MQTT_BACKEND_CLIENT_ID_STATIC
+#define CLIENT_ID_LEN (sizeof(CLIENT_ID) - 1)
+#define CMD_FILTER CLIENT_ID "/cmd"
+#define CMD_FILTER_LEN (sizeof(CMD_FILTER) - 1)
+
+#define RECV_TIMEOUT_MS 1000
+#define KEEPALIVE_MS K_SECONDS(CONFIG_MQTT_KEEPALIVE)
+#define IDLE_MS K_SECONDS(2)
+
+/* Fixed headers, see MQTT 3.1.1 section 2.2. */
+#define CONNECT 0x10
+#define PUBLISH 0x30
+#define PUBLISH_QOS_SHIFT 1
+#define SUBSCRIBE 0x82
+
+static const u8_t connect_protocol[] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04 };
+static const u8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+/* Not authorized, see MQTT 3.1.1 section 3.2.2.3. */
+static const u8_t connack_refused[] = { 0x20, 0x02, 0x00, 0x05 };
+static const u8_t pingreq[] = { 0xc0, 0x00 };
+static const u8_t pingresp[] = { 0xd0, 0x00 };
+static const u8_t disconnect[] = { 0xe0, 0x00 };
+
+static const char payload[] = "{\"tmp\":{\"val\":23,\"ts\":735181200}}";
+static const char cmd[] = "{\"cmd\":\"slot\",\"val\":1200}";
+
+/* PUBLISH of the command with QoS 1 and message ID 0x1234. */
+static const u8_t cmd_publish[] = {
+	PUBLISH | (MQTT_QOS_1_AT_LEAST_ONCE << PUBLISH_QOS_SHIFT),
+	2 + CMD_FILTER_LEN + 2 + sizeof(cmd) - 1,
+	0x00, CMD_FILTER_LEN, 'm', 'y', '-', 't', 'h', 'i', 'n', 'g',
+	'/', 'c', 'm', 'd', 0x12, 0x34
+};
+static const u8_t cmd_puback[] = { 0x40, 0x02, 0x12, 0x34 };
+
+static int listen_fd;
+static int broker_fd;
+static u8_t broker_buf[256];
+
+static u32_t evts;
+static u8_t rx_data[64];
+static size_t rx_len;
+
+static void evt_handler(const struct mqtt_backend_evt *evt)
+{
+	evts |= BIT(evt->type);
+
+	if (evt->type == MQTT_BACKEND_EVT_DATA_RECEIVED) {
+		rx_len = MIN(evt->len, sizeof(rx_data));
+		memcpy(rx_data, evt->ptr, rx_len);
+	}
+}
+
+static void fd_wait(int fd)
+{
+	struct pollfd fds = {
+		.fd = fd,
+		.events = POLLIN
+	};
+
+	zassert_equal(poll(&fds, 1, RECV_TIMEOUT_MS), 1, "Nothing received");
+}
+
+/* The client socket does not block, input is polled for like the sample
+ * does.
+ */
+static void device_input(void)
+{
+	fd_wait(client.transport.tcp.sock);
+	zassert_equal(mqtt_backend_input(), 0, "Input failed");
+}
+
+static size_t broker_recv(void)
+{
+	ssize_t len;
+
+	fd_wait(broker_fd);
+
+	len = recv(broker_fd, broker_buf, sizeof(broker_buf), 0);
+	zassert_true(len > 0, "Broker receive failed");
+
+	return len;
+}
+
+static void broker_send(const void *data, size_t len)
+{
+	zassert_equal(send(broker_fd, data, len, 0), len,
+		      "Broker send failed");
+}
+
+/* Every test ends with the budgets checked, the stack of each test thread
+ * is measured before the next one reuses it.
+ */
+static void budgets_check(void)
+{
+	zassert_equal(perf_budget_check(), 0, "Performance budget exceeded");
+}
+
+/* PUBLISH of the test payload to the update topic, the client ID. */
+static size_t publish_expect(u8_t *buf, enum mqtt_qos qos, const u8_t *id)
+{
+	size_t len = 0;
+
+	buf[len++] = PUBLISH | (qos << PUBLISH_QOS_SHIFT);
+	buf[len++] = 2 + CLIENT_ID_LEN + (qos ? 2 : 0) + sizeof(payload) - 1;
+	buf[len++] = 0x00;
+	buf[len++] = CLIENT_ID_LEN;
+	memcpy(&buf[len], CLIENT_ID, CLIENT_ID_LEN);
+	len += CLIENT_ID_LEN;
+
+	if (qos) {
+		buf[len++] = id[0];
+		buf[len++] = id[1];
+	}
+
+	memcpy(&buf[len], payload, sizeof(payload) - 1);
+
+	return len + sizeof(payload) - 1;
+}
+
+/* Connections are accepted by the stack before accept() is called, so the
+ * broker needs no thread of its own.
+ */
+static void broker_listen(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(CONFIG_MQTT_BACKEND_BROKER_PORT)
+	};
+
+	inet_pton(AF_INET, CONFIG_MQTT_BACKEND_BROKER_HOST_NAME,
+		  &addr.sin_addr);
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if ((listen_fd < 0) ||
+	    bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(listen_fd, 1)) {
+		printk("Broker not started, error: %d\n", errno);
+	}
+}
+
+static void test_connect_refused(void)
+{
+	struct mqtt_backend_config config = { 0 };
+
+	zassert_equal(mqtt_backend_init(&config, evt_handler), 0,
+		      "Initialization failed");
+	zassert_equal(mqtt_backend_connect(&config), 0, "Connection failed");
+
+	broker_fd = accept(listen_fd, NULL, NULL);
+	zassert_true(broker_fd >= 0, "Connection not accepted");
+
+	broker_recv();
+	zassert_equal(broker_buf[0], CONNECT, "Not a CONNECT");
+
+	/* The broker closes the connection after refusing it. */
+	broker_send(connack_refused, sizeof(connack_refused));
+	close(broker_fd);
+
+	fd_wait(client.transport.tcp.sock);
+	(void)mqtt_backend_input();
+
+	zassert_false(evts & BIT(MQTT_BACKEND_EVT_READY),
+		      "Refused connection ready");
+	zassert_false(connected, "Refused connection in use");
+	zassert_equal(endpoints.ep[0].fails, 1, "Refusal not counted");
+
+	evts = 0;
+
+	budgets_check();
+}
+
+static void test_connect(void)
+{
+	const struct mqtt_topic cmd_topic = {
+		.topic = {
+			.utf8 = (u8_t *)CMD_FILTER,
+			.size = CMD_FILTER_LEN
+		},
+		.qos = MQTT_QOS_1_AT_LEAST_ONCE
+	};
+	struct mqtt_backend_config config = { 0 };
+	u8_t suback[] = { 0x90, 0x03, 0x00, 0x00, MQTT_QOS_1_AT_LEAST_ONCE };
+	size_t len;
+
+	zassert_equal(mqtt_backend_init(&config, evt_handler), 0,
+		      "Initialization failed");
+	zassert_equal(mqtt_backend_subscriptions_add(&cmd_topic, 1), 0,
+		      "Filter not added");
+	zassert_equal(mqtt_backend_connect(&config), 0, "Connection failed");
+
+	broker_fd = accept(listen_fd, NULL, NULL);
+	zassert_true(broker_fd >= 0, "Connection not accepted");
+
+	/* CONNECT, section 3.1, with the client ID as the only field of the
+	 * payload.
+	 */
+	len = broker_recv();
+	zassert_equal(broker_buf[0], CONNECT, "Not a CONNECT");
+	zassert_equal(broker_buf[1], len - 2, "Wrong remaining length");
+	zassert_mem_equal(&broker_buf[2], connect_protocol,
+			  sizeof(connect_protocol), "Wrong protocol");
+	zassert_equal(sys_get_be16(&broker_buf[10]), CONFIG_MQTT_KEEPALIVE,
+		      "Wrong keepalive");
+	zassert_equal(sys_get_be16(&broker_buf[12]), CLIENT_ID_LEN,
+		      "Wrong client ID length");
+	zassert_mem_equal(&broker_buf[14], CLIENT_ID, CLIENT_ID_LEN,
+			  "Wrong client ID");
+
+	broker_send(connack, sizeof(connack));
+	device_input();
+	zassert_true(evts & BIT(MQTT_BACKEND_EVT_CONNECTED), "Not connected");
+	zassert_true(evts & BIT(MQTT_BACKEND_EVT_READY), "Not ready");
+
+	/* SUBSCRIBE, section 3.8, of the filter added before connecting. */
+	len = broker_recv();
+	zassert_equal(len, 2 + 2 + 2 + CMD_FILTER_LEN + 1,
+		      "Wrong SUBSCRIBE length");
+	zassert_equal(broker_buf[0], SUBSCRIBE, "Not a SUBSCRIBE");
+	zassert_equal(sys_get_be16(&broker_buf[4]), CMD_FILTER_LEN,
+		      "Wrong filter length");
+	zassert_mem_equal(&broker_buf[6], CMD_FILTER, CMD_FILTER_LEN,
+			  "Wrong filter");
+	zassert_equal(broker_buf[len - 1], MQTT_QOS_1_AT_LEAST_ONCE,
+		      "Wrong QoS requested");
+	zassert_equal(mqtt_backend_subscription_result(CMD_FILTER),
+		      -EINPROGRESS, "SUBACK not awaited");
+
+	/* SUBACK with the message ID of the SUBSCRIBE. */
+	suback[2] = broker_buf[2];
+	suback[3] = broker_buf[3];
+	broker_send(suback, sizeof(suback));
+	device_input();
+	zassert_equal(mqtt_backend_subscription_result(CMD_FILTER),
+		      MQTT_QOS_1_AT_LEAST_ONCE, "Subscription not granted");
+
+	budgets_check();
+}
+
+static void test_publish(void)
+{
+	struct mqtt_backend_tx_data tx_data = {
+		.topic.type = MQTT_BACKEND_TOPIC_MSG,
+		.str = (char *)payload,
+		.len = sizeof(payload) - 1,
+		.qos = MQTT_QOS_0_AT_MOST_ONCE
+	};
+	struct perf_budget_stats stats;
+	u8_t expected[64];
+	u8_t puback[] = { 0x40, 0x02, 0x00, 0x00 };
+	size_t len;
+
+	zassert_equal(mqtt_backend_send(&tx_data), 0, "QoS 0 not published");
+
+	/* PUBLISH, section 3.3, to the client ID as topic. */
+	len = broker_recv();
+	zassert_equal(len, publish_expect(expected, tx_data.qos, NULL),
+		      "Wrong QoS 0 PUBLISH length");
+	zassert_mem_equal(broker_buf, expected, len, "Wrong QoS 0 PUBLISH");
+
+	perf_budget_stats_get(&stats);
+	zassert_equal(stats.bytes_last, len, "QoS 0 size miscounted");
+
+	tx_data.qos = MQTT_QOS_1_AT_LEAST_ONCE;
+	zassert_equal(mqtt_backend_send(&tx_data), 0, "QoS 1 not published");
+
+	/* The message ID follows the topic. */
+	len = broker_recv();
+	zassert_equal(len, publish_expect(expected, tx_data.qos,
+					  &broker_buf[4 + CLIENT_ID_LEN]),
+		      "Wrong QoS 1 PUBLISH length");
+	zassert_mem_equal(broker_buf, expected, len, "Wrong QoS 1 PUBLISH");
+
+	perf_budget_stats_get(&stats);
+	zassert_equal(stats.bytes_last, len, "QoS 1 size miscounted");
+
+	puback[2] = broker_buf[4 + CLIENT_ID_LEN];
+	puback[3] = broker_buf[5 + CLIENT_ID_LEN];
+	broker_send(puback, sizeof(puback));
+	device_input();
+
+	budgets_check();
+}
+
+static void test_receive(void)
+{
+	u8_t publish[sizeof(cmd_publish) + sizeof(cmd) - 1];
+	size_t len;
+
+	/* In one segment, the payload is read right after the header. */
+	memcpy(publish, cmd_publish, sizeof(cmd_publish));
+	memcpy(&publish[sizeof(cmd_publish)], cmd, sizeof(cmd) - 1);
+	broker_send(publish, sizeof(publish));
+	device_input();
+
+	zassert_true(evts & BIT(MQTT_BACKEND_EVT_DATA_RECEIVED),
+		     "No data received");
+	zassert_equal(rx_len, sizeof(cmd) - 1, "Wrong payload length");
+	zassert_mem_equal(rx_data, cmd, rx_len, "Wrong payload");
+
+	/* PUBACK, section 3.4, of the command received with QoS 1. */
+	len = broker_recv();
+	zassert_equal(len, sizeof(cmd_puback), "Wrong PUBACK length");
+	zassert_mem_equal(broker_buf, cmd_puback, len, "Wrong PUBACK");
+
+	budgets_check();
+}
+
+static void test_keepalive(void)
+{
+	int left = mqtt_backend_keepalive_time_left();
+	size_t len;
+
+	zassert_true((left > 0) && (left <= KEEPALIVE_MS),
+		     "Keepalive time out of range");
+
+	k_sleep(IDLE_MS);
+	zassert_true(mqtt_backend_keepalive_time_left() <= left - IDLE_MS,
+		     "Keepalive time not counting down");
+
+	zassert_equal(mqtt_backend_ping(), 0, "Ping failed");
+
+	/* PINGREQ, section 3.12. */
+	len = broker_recv();
+	zassert_equal(len, sizeof(pingreq), "Wrong PINGREQ length");
+	zassert_mem_equal(broker_buf, pingreq, len, "Wrong PINGREQ");
+	zassert_true(mqtt_backend_keepalive_time_left() > left - IDLE_MS,
+		     "Keepalive time not restarted");
+	zassert_equal(client.unacked_ping, 1, "Ping not outstanding");
+
+	broker_send(pingresp, sizeof(pingresp));
+	device_input();
+	zassert_equal(client.unacked_ping, 0, "PINGRESP not processed");
+
+	budgets_check();
+}
+
+static void test_encode_budget(void)
+{
+	struct mqtt_publish_param param = {
+		.message.topic.qos = MQTT_QOS_1_AT_LEAST_ONCE,
+		.message.topic.topic.utf8 = (u8_t *)update_topic,
+		.message.topic.topic.size = strlen(update_topic),
+		.message.payload.data = (u8_t *)payload,
+		.message.payload.len = sizeof(payload) - 1,
+		.message_id = 1
+	};
+	u8_t buf[64];
+	struct buf_ctx packet = {
+		.cur = buf,
+		.end = buf + sizeof(buf)
+	};
+	u32_t start;
+	int err;
+
+	/* mqtt_publish() encodes like this before it writes, the backend
+	 * cannot time the encoding alone.
+	 */
+	start = perf_budget_encode_start();
+	err = publish_encode(&param, &packet);
+	perf_budget_encode_end(start, packet.end - packet.cur);
+
+	zassert_equal(err, 0, "Encoding failed");
+	zassert_equal(packet.end - packet.cur, publish_len(&param),
+		      "Publication size miscounted");
+
+	budgets_check();
+}
+
+static void test_disconnect(void)
+{
+	size_t len;
+
+	zassert_equal(mqtt_backend_disconnect(), 0, "Disconnection failed");
+	zassert_true(evts & BIT(MQTT_BACKEND_EVT_DISCONNECTED),
+		     "Not disconnected");
+
+	/* DISCONNECT, section 3.14. */
+	len = broker_recv();
+	zassert_equal(len, sizeof(disconnect), "Wrong DISCONNECT length");
+	zassert_mem_equal(broker_buf, disconnect, len, "Wrong DISCONNECT");
+
+	close(broker_fd);
+	close(listen_fd);
+
+	budgets_check();
+}
+
+static void test_budgets(void)
+{
+	struct perf_budget_stats stats;
+
+	perf_budget_stats_get(&stats);
+
+	TC_PRINT("Encode: %u cycles, message %u bytes max, stack %u bytes\n",
+		 stats.cycles_max, stats.bytes_max, stats.stack_max);
+
+	zassert_equal(stats.msgs, 3, "Publications not all measured");
+	zassert_equal(stats.encodes, 1, "Encoding not timed");
+	zassert_equal(stats.exceeded, 0, "Performance budget exceeded");
+}
+
+void test_main(void)
+{
+	broker_listen();
+
+	ztest_test_suite(mqtt_backend,
+			 ztest_unit_test(test_connect_refused),
+			 ztest_unit_test(test_connect),
+			 ztest_unit_test(test_publish),
+			 ztest_unit_test(test_receive),
+			 ztest_unit_test(test_keepalive),
+			 ztest_unit_test(test_encode_budget),
+			 ztest_unit_test(test_disconnect),
+			 ztest_unit_test(test_budgets));
+
+	ztest_run_test_suite(mqtt_backend);
+}
@@ -0,0 +1,10 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <logging/log.h>
+
+/* Registered by the CoAP backend in the application. */
+LOG_MODULE_REGISTER(coap_backend, CONFIG_COAP_BACKEND_LOG_LEVEL);
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+
+/* Included for the derived context, it is not part of the module API. */
+#include "oscore.c"
+
+/* RFC 8613 appendix C.1.1, client with an empty Sender ID. */
+static const u8_t sender_key[] = {
+	0xf0, 0x91, 0x0e, 0xd7, 0x29, 0x5e, 0x6a, 0xd4,
+	0xb5, 0x4f, 0xc7, 0x93, 0x15, 0x43, 0x02, 0xff
+};
+
+static const u8_t recipient_key[] = {
+	0xff, 0xb1, 0x4e, 0x09, 0x3c, 0x94, 0xc9, 0xca,
+	0xc9, 0x47, 0x16, 0x48, 0xb4, 0xf9, 0x87, 0x10
+};
+
+static const u8_t common_iv[] = {
+	0x46, 0x22, 0xd4, 0xdd, 0x6d, 0x94, 0x41, 0x68,
+	0xee, 0xfb, 0x54, 0x98, 0x7c
+};
+
+/* RFC 8613 appendix C.4, GET /tv1 protected with sequence number 20. */
+#define REQUEST_SSN 20
+
+static const u8_t request_token[] = { 0x00, 0x00, 0x39, 0x74 };
+
+static const u8_t request_option[] = { 0x09, 0x14 };
+
+static const u8_t request_ciphertext[] = {
+	0x61, 0x2f, 0x10, 0x92, 0xf1, 0x77, 0x6f, 0x1c,
+	0x16, 0x68, 0xb3, 0x82, 0x5e
+};
+
+/* RFC 8613 appendix C.7, 2.05 Content "Hello World!" to the request of
+ * appendix C.4, without a Partial IV.
+ */
+static const u8_t response[] = {
+	0x64, 0x44, 0x5d, 0x1f, 0x00, 0x00, 0x39, 0x74,
+	0x90, 0xff, 0xdb, 0xaa, 0xd1, 0xe9, 0xa7, 0xe7,
+	0xb2, 0xa8, 0x13, 0xd3, 0xc3, 0x15, 0x24, 0x37,
+	0x83, 0x03, 0xcd, 0xaf, 0xae, 0x11, 0x91, 0x06
+};
+
+static const char response_payload[] = "Hello World!";
+
+static void request_piv_set(void)
+{
+	ctx.req_piv[0] = REQUEST_SSN;
+	ctx.req_piv_len = 1;
+}
+
+static void test_key_derivation(void)
+{
+	zassert_equal(oscore_init(), 0, "Initialization failed");
+
+	zassert_mem_equal(ctx.sender_key, sender_key, sizeof(sender_key),
+			  "Wrong Sender Key");
+	zassert_mem_equal(ctx.recipient_key, recipient_key,
+			  sizeof(recipient_key), "Wrong Recipient Key");
+	zassert_mem_equal(ctx.common_iv, common_iv, sizeof(common_iv),
+			  "Wrong Common IV");
+}
+
+static void test_request_protect(void)
+{
+	struct coap_packet request;
+	struct coap_packet parsed;
+	struct coap_option option;
+	const u8_t *payload;
+	u16_t payload_len;
+	u8_t buf[64];
+	int err;
+
+	/* Reserved beforehand, so that nothing is persisted. */
+	ctx.ssn = REQUEST_SSN;
+	ctx.ssn_reserved = REQUEST_SSN + 1;
+
+	err = oscore_protect(&request, buf, sizeof(buf), request_token,
+			     sizeof(request_token), COAP_METHOD_GET, "tv1",
+			     NULL, 0);
+	zassert_equal(err, 0, "Protection failed");
+	zassert_equal(ctx.ssn, REQUEST_SSN + 1, "Sequence number not used");
+
+	err = coap_packet_parse(&parsed, buf, request.offset, NULL, 0);
+	zassert_equal(err, 0, "Protected request cannot be parsed");
+	zassert_equal(coap_header_get_code(&parsed), COAP_METHOD_POST,
+		      "Outer code is not POST");
+
+	err = coap_find_options(&parsed, OSCORE_OPTION_NUMBER, &option, 1);
+	zassert_equal(err, 1, "No OSCORE option");
+	zassert_equal(option.len, sizeof(request_option),
+		      "Wrong OSCORE option length");
+	zassert_mem_equal(option.value, request_option,
+			  sizeof(request_option), "Wrong OSCORE option");
+
+	payload = coap_packet_get_payload(&parsed, &payload_len);
+	zassert_not_null(payload, "No ciphertext");
+	zassert_equal(payload_len, sizeof(request_ciphertext),
+		      "Wrong ciphertext length");
+	zassert_mem_equal(payload, request_ciphertext,
+			  sizeof(request_ciphertext), "Wrong ciphertext");
+}
+
+static void test_response_unprotect(void)
+{
+	struct coap_packet packet;
+	u8_t buf[sizeof(response)];
+	const u8_t *payload;
+	u16_t payload_len;
+	u8_t code;
+	int err;
+
+	request_piv_set();
+	memcpy(buf, response, sizeof(response));
+
+	err = coap_packet_parse(&packet, buf, sizeof(buf), NULL, 0);
+	zassert_equal(err, 0, "Response cannot be parsed");
+
+	err = oscore_unprotect(&packet, &code, &payload, &payload_len);
+	zassert_equal(err, 0, "Verification failed");
+	zassert_equal(code, COAP_RESPONSE_CODE_CONTENT, "Wrong inner code");
+	zassert_equal(payload_len, sizeof(response_payload) - 1,
+		      "Wrong payload length");
+	zassert_mem_equal(payload, response_payload, payload_len,
+			  "Wrong payload");
+}
+
+static void test_response_tampered(void)
+{
+	struct coap_packet packet;
+	u8_t buf[sizeof(response)];
+	const u8_t *payload;
+	u16_t payload_len;
+	u8_t code;
+	int err;
+
+	request_piv_set();
+	memcpy(buf, response, sizeof(response));
+	buf[sizeof(buf) - 1] ^= 0x01;
+
+	err = coap_packet_parse(&packet, buf, sizeof(buf), NULL, 0);
+	zassert_equal(err, 0, "Response cannot be parsed");
+
+	err = oscore_unprotect(&packet, &code, &payload, &payload_len);
+	zassert_equal(err, -EACCES, "Tampered response accepted");
+}
+
+static void test_response_other_request(void)
+{
+	struct coap_packet packet;
+	u8_t buf[sizeof(response)];
+	const u8_t *payload;
+	u16_t payload_len;
+	u8_t code;
+	int err;
+
+	/* The response is bound to the Partial IV of its request. */
+	request_piv_set();
+	ctx.req_piv[0]++;
+	memcpy(buf, response, sizeof(response));
+
+	err = coap_packet_parse(&packet, buf, sizeof(buf), NULL, 0);
+	zassert_equal(err, 0, "Response cannot be parsed");
+
+	err = oscore_unprotect(&packet, &code, &payload, &payload_len);
+	zassert_equal(err, -EACCES, "Response to another request accepted");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(oscore,
+			 ztest_unit_test(test_key_derivation),
+			 ztest_unit_test(test_request_protect),
+			 ztest_unit_test(test_response_unprotect),
+			 ztest_unit_test(test_response_tampered),
+			 ztest_unit_test(test_response_other_request));
+
+	ztest_run_test_suite(oscore);
+}
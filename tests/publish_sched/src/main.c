@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <publish_sched.h>
+
+#define TICK_MS (MSEC_PER_SEC / CONFIG_SYS_CLOCK_TICKS_PER_SEC)
+
+/* Delayed work is due on a tick boundary and starts on the next tick. */
+#define LATENCY_MAX_MS (2 * TICK_MS)
+
+#define DELAY_MS 50
+#define PERIOD_MS 100
+#define RUNS 5
+#define WAIT_MS K_SECONDS(2)
+
+/* The handler takes part of the period, which must not shift the
+ * following deadlines.
+ */
+#define HANDLER_MS 40
+
+/* Long enough to miss the next two deadlines. */
+#define STALL_MS (2 * PERIOD_MS + PERIOD_MS / 2)
+#define STALL_MISSED 2
+
+#define PHASE_WINDOW_MS K_SECONDS(60)
+#define SLOT_MS 1200
+
+static const char client_id[] = "my-thing";
+
+static struct publish_work single;
+static struct publish_periodic periodic;
+
+static s64_t runs[RUNS];
+static size_t run_count;
+static u32_t stall_run = RUNS;
+K_SEM_DEFINE(done, 0, 1);
+
+static void latency_check(s64_t start, s64_t due)
+{
+	zassert_true(start >= due, "Started %d ms early", (int)(due - start));
+	zassert_true(start - due <= LATENCY_MAX_MS, "Started %d ms late",
+		     (int)(start - due));
+}
+
+static void single_fn(struct k_work *work)
+{
+	runs[run_count++] = k_uptime_get();
+	k_sem_give(&done);
+}
+
+static void periodic_fn(struct k_work *work)
+{
+	runs[run_count] = k_uptime_get();
+
+	if (run_count == stall_run) {
+		k_busy_wait(STALL_MS * USEC_PER_MSEC);
+	} else {
+		k_busy_wait(HANDLER_MS * USEC_PER_MSEC);
+	}
+
+	if (++run_count == RUNS) {
+		publish_periodic_stop(&periodic);
+		k_sem_give(&done);
+	}
+}
+
+static void runs_reset(void)
+{
+	memset(runs, 0, sizeof(runs));
+	run_count = 0;
+}
+
+static void test_submit(void)
+{
+	s64_t due;
+
+	runs_reset();
+	publish_work_init(&single, single_fn);
+
+	due = k_uptime_get() + DELAY_MS;
+	zassert_equal(publish_work_submit(&single, DELAY_MS), 0,
+		      "Not submitted");
+	zassert_equal(k_sem_take(&done, WAIT_MS), 0, "Work did not run");
+	latency_check(runs[0], due);
+
+	due = k_uptime_get() + PERIOD_MS;
+	zassert_equal(publish_work_submit_at(&single, due), 0,
+		      "Not submitted");
+	zassert_equal(k_sem_take(&done, WAIT_MS), 0, "Work did not run");
+	latency_check(runs[1], due);
+}
+
+static void test_periodic(void)
+{
+	s64_t base;
+
+	runs_reset();
+	stall_run = RUNS;
+	publish_periodic_init(&periodic, periodic_fn, PERIOD_MS);
+
+	base = k_uptime_get() + DELAY_MS;
+	zassert_equal(publish_periodic_start(&periodic, DELAY_MS), 0,
+		      "Not started");
+	zassert_equal(k_sem_take(&done, WAIT_MS), 0, "Periods did not run");
+
+	/* Absolute deadlines, the handler time does not accumulate. */
+	for (size_t i = 0; i < RUNS; i++) {
+		latency_check(runs[i], base + i * PERIOD_MS);
+	}
+
+	zassert_equal(periodic.missed, 0, "Deadline missed");
+}
+
+static void test_stop_from_handler(void)
+{
+	/* Stopped by the handler of the last run in test_periodic(). */
+	k_sleep(3 * PERIOD_MS);
+
+	zassert_true(periodic.stopped, "Not stopped");
+	zassert_equal(run_count, RUNS, "Ran after being stopped");
+}
+
+static void test_missed_skip(void)
+{
+	s64_t base;
+
+	runs_reset();
+	stall_run = 1;
+	publish_periodic_init(&periodic, periodic_fn, PERIOD_MS);
+
+	base = k_uptime_get() + DELAY_MS;
+	zassert_equal(publish_periodic_start(&periodic, DELAY_MS), 0,
+		      "Not started");
+	zassert_equal(k_sem_take(&done, WAIT_MS), 0, "Periods did not run");
+
+	/* The deadlines passed during the stall are dropped, the following
+	 * ones stay on the grid.
+	 */
+	latency_check(runs[0], base);
+	latency_check(runs[1], base + PERIOD_MS);
+
+	for (size_t i = 2; i < RUNS; i++) {
+		latency_check(runs[i], base + (i + STALL_MISSED) * PERIOD_MS);
+	}
+
+	zassert_equal(periodic.missed, STALL_MISSED, "Wrong missed count");
+}
+
+static void test_phase(void)
+{
+	s32_t phase;
+
+	publish_sched_phase_init((const u8_t *)client_id, sizeof(client_id) - 1);
+	phase = publish_sched_phase_get(PHASE_WINDOW_MS);
+
+	zassert_true((phase >= 0) && (phase < PHASE_WINDOW_MS),
+		     "Phase out of the window");
+	zassert_equal(publish_sched_phase_get(PHASE_WINDOW_MS), phase,
+		      "Phase not stable");
+
+	/* The server slot overrides the derived phase until cleared. */
+	publish_sched_slot_set(SLOT_MS);
+	zassert_equal(publish_sched_phase_get(PHASE_WINDOW_MS), SLOT_MS,
+		      "Slot not used");
+
+	publish_sched_slot_set(-1);
+	zassert_equal(publish_sched_phase_get(PHASE_WINDOW_MS), phase,
+		      "Derived phase not restored");
+}
+
+static void test_jitter(void)
+{
+	struct publish_sched_jitter jitter;
+
+	publish_sched_jitter_get(&jitter);
+
+	TC_PRINT("Start latency: %d to %d ms, mean %d ms over %u runs\n",
+		 jitter.min, jitter.max, jitter.avg, jitter.samples);
+
+	zassert_equal(jitter.samples, 2 + 2 * RUNS, "Runs not all measured");
+	zassert_true(jitter.min >= 0, "Work started early");
+	zassert_true(jitter.max <= LATENCY_MAX_MS, "Work started late");
+}
+
+void test_main(void)
+{
+	publish_sched_init();
+
+	ztest_test_suite(publish_sched,
+			 ztest_unit_test(test_submit),
+			 ztest_unit_test(test_periodic),
+			 ztest_unit_test(test_stop_from_handler),
+			 ztest_unit_test(test_missed_skip),
+			 ztest_unit_test(test_phase),
+			 ztest_unit_test(test_jitter));
+
+	ztest_run_test_suite(publish_sched);
+}
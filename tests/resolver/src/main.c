@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <resolver.h>
+#include <heap_guard.h>
+#include <modem/at_cmd.h>
+#include <sys/byteorder.h>
+
+#define DNS_PORT 53
+#define DNS_HEADER_LEN 12
+#define DNS_FLAGS_RESPONSE 0x8180
+#define DNS_FLAGS_NAME_ERROR 0x8183
+#define DNS_ANSWER_LEN 16
+
+#define SERVER_ADDR "127.0.0.1"
+#define RESOLVED_ADDR "192.0.2.1"
+#define HOST "broker.example.com"
+#define MISSING_LABEL "missing"
+#define MISSING_HOST MISSING_LABEL ".example.com"
+#define PORT 8883
+
+#define THREAD_STACK_SIZE 2048
+#define THREAD_PRIORITY K_PRIO_PREEMPT(5)
+
+/* The primary DNS server is the sixth field of the response. */
+static const char cgcontrdp[] =
+	"+CGCONTRDP: 0,,\"internet\",\"\",\"\",\"" SERVER_ADDR "\",\"\","
+	",,,,1500\r\nOK\r\n";
+
+/* Answer record pointing back at the name of the question. */
+static const u8_t answer[DNS_ANSWER_LEN - 4] = {
+	0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+	0x0e, 0x10, 0x00, 0x04
+};
+
+static u8_t server_buf[512];
+static atomic_t queries;
+
+K_THREAD_STACK_DEFINE(server_stack, THREAD_STACK_SIZE);
+static struct k_thread server_thread;
+K_SEM_DEFINE(server_ready, 0, 1);
+
+K_THREAD_STACK_DEFINE(resolve_stack, THREAD_STACK_SIZE);
+static struct k_thread resolve_thread;
+K_SEM_DEFINE(resolve_done, 0, 1);
+static struct sockaddr_storage resolve_addr;
+static int resolve_err;
+
+/* The modem is not there, the PDN context is answered from here. */
+int at_cmd_write(const char *const cmd, char *buf, size_t buf_len,
+		 enum at_cmd_state *state)
+{
+	ARG_UNUSED(state);
+
+	if ((strcmp(cmd, "AT+CGCONTRDP=0") != 0) ||
+	    (buf_len < sizeof(cgcontrdp))) {
+		return -EINVAL;
+	}
+
+	memcpy(buf, cgcontrdp, sizeof(cgcontrdp));
+
+	return 0;
+}
+
+static size_t server_answer(size_t len)
+{
+	const u8_t *name = server_buf + DNS_HEADER_LEN;
+	struct in_addr addr;
+
+	if ((name[0] == sizeof(MISSING_LABEL) - 1) &&
+	    (memcmp(&name[1], MISSING_LABEL, name[0]) == 0)) {
+		sys_put_be16(DNS_FLAGS_NAME_ERROR, server_buf + 2);
+		return len;
+	}
+
+	if (len + DNS_ANSWER_LEN > sizeof(server_buf)) {
+		return 0;
+	}
+
+	sys_put_be16(DNS_FLAGS_RESPONSE, server_buf + 2);
+	sys_put_be16(1, server_buf + 6);
+
+	memcpy(server_buf + len, answer, sizeof(answer));
+	len += sizeof(answer);
+
+	inet_pton(AF_INET, RESOLVED_ADDR, &addr);
+	memcpy(server_buf + len, &addr, sizeof(addr));
+	len += sizeof(addr);
+
+	return len;
+}
+
+static void server_run(void *p1, void *p2, void *p3)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(DNS_PORT)
+	};
+	int fd;
+
+	inet_pton(AF_INET, SERVER_ADDR, &addr.sin_addr);
+
+	/* Lookups time out and fail the tests if the server is missing. */
+	fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if ((fd < 0) ||
+	    bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		printk("DNS server not started, error: %d\n", errno);
+		return;
+	}
+
+	k_sem_give(&server_ready);
+
+	while (true) {
+		struct sockaddr_in peer;
+		socklen_t peer_len = sizeof(peer);
+		ssize_t len;
+
+		len = recvfrom(fd, server_buf, sizeof(server_buf), 0,
+			       (struct sockaddr *)&peer, &peer_len);
+		if (len < DNS_HEADER_LEN) {
+			continue;
+		}
+
+		atomic_inc(&queries);
+
+		len = server_answer(len);
+		if (len > 0) {
+			sendto(fd, server_buf, len, 0,
+			       (struct sockaddr *)&peer, peer_len);
+		}
+	}
+}
+
+static u32_t heap_allocs(void)
+{
+	struct heap_guard_stats stats;
+
+	heap_guard_stats_get(&stats);
+
+	return stats.allocs;
+}
+
+static void addr_check(const struct sockaddr_storage *addr,
+		       const char *expected)
+{
+	const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+	struct in_addr expected_addr;
+
+	inet_pton(AF_INET, expected, &expected_addr);
+
+	zassert_equal(addr->ss_family, AF_INET, "Wrong family");
+	zassert_equal(ntohs(in->sin_port), PORT, "Wrong port");
+	zassert_mem_equal(&in->sin_addr, &expected_addr,
+			  sizeof(expected_addr), "Wrong address");
+}
+
+static void test_literal(void)
+{
+	struct sockaddr_storage addr;
+	u32_t allocs = heap_allocs();
+	atomic_val_t sent = atomic_get(&queries);
+	int err;
+
+	err = resolver_resolve("192.0.2.7", PORT, AF_INET, SOCK_STREAM,
+			       &addr);
+	zassert_equal(err, 0, "Literal not parsed");
+	addr_check(&addr, "192.0.2.7");
+
+	zassert_equal(atomic_get(&queries), sent, "Literal looked up");
+	zassert_equal(heap_allocs(), allocs, "Heap used");
+}
+
+static void test_lookup(void)
+{
+	struct sockaddr_storage addr;
+	u32_t allocs = heap_allocs();
+	int err;
+
+	err = resolver_resolve(HOST, PORT, AF_INET, SOCK_STREAM, &addr);
+	zassert_equal(err, 0, "Lookup failed");
+	addr_check(&addr, RESOLVED_ADDR);
+
+	zassert_equal(heap_allocs(), allocs, "Heap used");
+}
+
+static void test_name_error(void)
+{
+	struct sockaddr_storage addr;
+	u32_t allocs = heap_allocs();
+	int err;
+
+	err = resolver_resolve(MISSING_HOST, PORT, AF_INET, SOCK_STREAM,
+			       &addr);
+	zassert_equal(err, -ENOENT, "Missing name resolved");
+
+	zassert_equal(heap_allocs(), allocs, "Heap used");
+}
+
+static void resolve_run(void *p1, void *p2, void *p3)
+{
+	resolve_err = resolver_resolve(HOST, PORT, AF_INET, SOCK_STREAM,
+				       &resolve_addr);
+	k_sem_give(&resolve_done);
+}
+
+static void test_concurrent(void)
+{
+	struct sockaddr_storage addr;
+	int err;
+
+	/* Both lookups read the PDN context and use the static buffers. */
+	k_thread_create(&resolve_thread, resolve_stack,
+			K_THREAD_STACK_SIZEOF(resolve_stack), resolve_run,
+			NULL, NULL, NULL, THREAD_PRIORITY, 0, K_NO_WAIT);
+
+	err = resolver_resolve(HOST, PORT, AF_INET, SOCK_STREAM, &addr);
+	zassert_equal(err, 0, "Lookup failed");
+	addr_check(&addr, RESOLVED_ADDR);
+
+	zassert_equal(k_sem_take(&resolve_done, K_SECONDS(5)), 0,
+		      "Concurrent lookup did not end");
+	zassert_equal(resolve_err, 0, "Concurrent lookup failed");
+	addr_check(&resolve_addr, RESOLVED_ADDR);
+}
+
+void test_main(void)
+{
+	k_thread_create(&server_thread, server_stack,
+			K_THREAD_STACK_SIZEOF(server_stack), server_run,
+			NULL, NULL, NULL, THREAD_PRIORITY, 0, K_NO_WAIT);
+	k_sem_take(&server_ready, K_SECONDS(1));
+
+	ztest_test_suite(resolver,
+			 ztest_unit_test(test_literal),
+			 ztest_unit_test(test_lookup),
+			 ztest_unit_test(test_name_error),
+			 ztest_unit_test(test_concurrent));
+
+	ztest_run_test_suite(resolver);
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <tx_defer.h>
+
+#define RSRP_GOOD_DBM (CONFIG_TX_DEFER_RSRP_THRESHOLD_DBM + \
+		       CONFIG_TX_DEFER_RSRP_HYSTERESIS_DB)
+
+#define POLL_MS 100
+#define SWEEP_MS K_SECONDS(CONFIG_TX_DEFER_SIM_PERIOD_S)
+#define DEADLINE_MS K_SECONDS(CONFIG_TX_DEFER_DEADLINE_S)
+#define RELEASE_WAIT_MS (DEADLINE_MS + K_SECONDS(1))
+
+static enum tx_defer_reason last_reason;
+static u32_t releases;
+K_SEM_DEFINE(released, 0, 1);
+
+static void release_handler(enum tx_defer_reason reason)
+{
+	last_reason = reason;
+	releases++;
+	k_sem_give(&released);
+}
+
+static bool rsrp_poor(s16_t rsrp)
+{
+	return rsrp < CONFIG_TX_DEFER_RSRP_THRESHOLD_DBM;
+}
+
+static void rsrp_wait(bool (*cond)(s16_t rsrp))
+{
+	s64_t end = k_uptime_get() + SWEEP_MS;
+
+	while (!cond(tx_defer_rsrp_get())) {
+		zassert_true(k_uptime_get() < end, "RSRP not reached");
+		k_sleep(POLL_MS);
+	}
+}
+
+static void release_wait(enum tx_defer_reason reason)
+{
+	zassert_equal(k_sem_take(&released, RELEASE_WAIT_MS), 0,
+		      "Not released");
+	zassert_equal(last_reason, reason, "Released for another reason");
+}
+
+static void test_good_signal(void)
+{
+	zassert_equal(tx_defer_init(release_handler), 0, "Not initialized");
+
+	/* The sweep starts at the maximum. */
+	k_sleep(POLL_MS);
+	zassert_true(tx_defer_rsrp_get() >= RSRP_GOOD_DBM, "Poor at start");
+
+	zassert_false(tx_defer_hold(TX_DEFER_CLASS_BULK), "Held");
+	zassert_false(tx_defer_hold(TX_DEFER_CLASS_URGENT), "Urgent held");
+	zassert_equal(releases, 0, "Released without a hold");
+}
+
+static void test_defer_coalesce_urgent(void)
+{
+	struct tx_defer_stats stats;
+
+	rsrp_wait(rsrp_poor);
+
+	zassert_true(tx_defer_hold(TX_DEFER_CLASS_BULK), "Not deferred");
+	zassert_true(tx_defer_hold(TX_DEFER_CLASS_BULK), "Not coalesced");
+
+	/* Sent at once, and what is held goes along. */
+	zassert_false(tx_defer_hold(TX_DEFER_CLASS_URGENT), "Urgent held");
+	release_wait(TX_DEFER_REASON_URGENT);
+
+	tx_defer_stats_get(&stats);
+	zassert_equal(stats.deferred, 1, "Wrong deferred count");
+	zassert_equal(stats.coalesced, 1, "Wrong coalesced count");
+}
+
+static void test_deadline(void)
+{
+	struct tx_defer_stats stats;
+	s64_t start = k_uptime_get();
+
+	/* The signal stays poor for longer than the deadline. */
+	zassert_true(rsrp_poor(tx_defer_rsrp_get()), "Signal not poor");
+	zassert_true(tx_defer_hold(TX_DEFER_CLASS_BULK), "Not deferred");
+	release_wait(TX_DEFER_REASON_DEADLINE);
+
+	zassert_true(k_uptime_get() - start >= DEADLINE_MS,
+		     "Released before the deadline");
+
+	tx_defer_stats_get(&stats);
+	zassert_true(stats.held_max >= DEADLINE_MS, "Hold not measured");
+}
+
+static void test_signal(void)
+{
+	/* Poor until the RSRP rises over the hysteresis, before the
+	 * deadline.
+	 */
+	zassert_true(tx_defer_hold(TX_DEFER_CLASS_BULK), "Not deferred");
+	release_wait(TX_DEFER_REASON_SIGNAL);
+
+	zassert_true(tx_defer_rsrp_get() >= RSRP_GOOD_DBM,
+		     "Released while poor");
+	zassert_false(tx_defer_hold(TX_DEFER_CLASS_BULK), "Held");
+}
+
+static void test_stats(void)
+{
+	struct tx_defer_stats stats;
+
+	tx_defer_stats_get(&stats);
+
+	zassert_equal(stats.deferred, 3, "Wrong deferred count");
+	zassert_equal(stats.coalesced, 1, "Wrong coalesced count");
+	zassert_equal(stats.released[TX_DEFER_REASON_URGENT], 1,
+		      "Wrong urgent release count");
+	zassert_equal(stats.released[TX_DEFER_REASON_DEADLINE], 1,
+		      "Wrong deadline release count");
+	zassert_equal(stats.released[TX_DEFER_REASON_SIGNAL], 1,
+		      "Wrong signal release count");
+	zassert_equal(releases, 3, "Release handler not called for each");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(tx_defer,
+			 ztest_unit_test(test_good_signal),
+			 ztest_unit_test(test_defer_coalesce_urgent),
+			 ztest_unit_test(test_deadline),
+			 ztest_unit_test(test_signal),
+			 ztest_unit_test(test_stats));
+
+	ztest_run_test_suite(tx_defer);
+}